@@ -0,0 +1,108 @@
+#include "alloc.h"
+#include "types.h"
+#include <sys/mman.h>
+
+static AllocStats alloc_stats = { 0, 0, 0, 0, 0, 0 };
+
+BlockPool ins_buf_pool = { MAX_INS_LEN * sizeof(char), NULL, 0 };
+BlockPool ins_bcs_pool = { MAX_INS_LEN * sizeof(BaseCounts), NULL, 0 };
+BlockPool fs_payload_pool = { FS_PAYLOAD_LEN * sizeof(char), NULL, 0 };
+
+/* aligned_malloc
+   Args: (1) size_t size - number of bytes wanted
+   Returns: pointer to ALLOC_ALIGN-aligned memory, or NULL if there
+   are not enough memories. Requests of HUGE_PAGE_SIZE or more are
+   huge page aligned and backed where the system allows it.
+   This is what save_malloc is.
+*/
+void* aligned_malloc( size_t size ) {
+  void* mem;
+  size_t align = ALLOC_ALIGN;
+  int huge = 0;
+
+  if ( size == 0 ) {
+    size = 1;
+  }
+  if ( size >= HUGE_PAGE_SIZE ) {
+    huge = 1;
+    align = HUGE_PAGE_SIZE;
+    size  = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+  }
+
+  if ( posix_memalign( &mem, align, size ) != 0 ) {
+    return NULL;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if ( huge ) {
+    /* Only advice; if the kernel says no we just have small pages */
+    if ( madvise( mem, size, MADV_HUGEPAGE ) == 0 ) {
+      alloc_stats.num_huge++;
+      alloc_stats.bytes_huge += size;
+    }
+  }
+#endif
+
+  alloc_stats.num_allocs++;
+  alloc_stats.bytes_alloced += size;
+  return mem;
+}
+
+/* pool_get
+   Args: (1) BlockPoolP bp - pool to get a block from
+   Returns: pointer to a block of bp->block_size bytes (contents
+   undefined), or NULL if there are not enough memories
+*/
+void* pool_get( BlockPoolP bp ) {
+  void* block;
+  alloc_stats.num_block_gets++;
+  if ( bp->free_list != NULL ) {
+    block = bp->free_list;
+    bp->free_list = *(void**)block;
+    bp->num_free--;
+    alloc_stats.num_block_reuses++;
+    return block;
+  }
+  return aligned_malloc( bp->block_size );
+}
+
+/* pool_put
+   Args: (1) BlockPoolP bp - pool the block came from
+         (2) void* block - block to give back, may be NULL
+   Returns: void
+   Puts the block on the pool's free list for reuse
+*/
+void pool_put( BlockPoolP bp, void* block ) {
+  if ( block == NULL ) {
+    return;
+  }
+  *(void**)block = bp->free_list;
+  bp->free_list = block;
+  bp->num_free++;
+}
+
+/* get_alloc_stats
+   Args: (1) AllocStats* as - place to put a copy of the current
+             allocation statistics
+   Returns: void
+*/
+void get_alloc_stats( AllocStats* as ) {
+  *as = alloc_stats;
+}
+
+/* print_alloc_stats
+   Args: (1) FILE* out - where to write
+   Returns: void
+   Writes a short summary of the allocation statistics to out
+*/
+void print_alloc_stats( FILE* out ) {
+  fprintf( out, "Allocations: %lu (%lu bytes)\n",
+	   (unsigned long)alloc_stats.num_allocs,
+	   (unsigned long)alloc_stats.bytes_alloced );
+  fprintf( out, "Huge page backed: %lu (%lu bytes)\n",
+	   (unsigned long)alloc_stats.num_huge,
+	   (unsigned long)alloc_stats.bytes_huge );
+  fprintf( out, "Pooled blocks: %lu taken, %lu recycled\n",
+	   (unsigned long)alloc_stats.num_block_gets,
+	   (unsigned long)alloc_stats.num_block_reuses );
+}
@@ -0,0 +1,111 @@
+/* 
+ * File:   alloc.h
+ * Author:
+ *
+ * Memory allocation layer behind save_malloc. Everything handed
+ * out here can be released with plain free().
+ */
+
+#ifndef _ALLOC_H
+#define	_ALLOC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "params.h"
+
+/* ALLOC_ALIGN is the alignment, in bytes, of every block handed
+   out by save_malloc; one cache line, which is also enough for
+   any SIMD load */
+#define ALLOC_ALIGN (64)
+
+/* HUGE_PAGE_SIZE is the size of a transparent huge page. Requests
+   at least this big are aligned to it, rounded up to a multiple of
+   it, and advised to the kernel as huge page candidates. This is
+   what the DP matrices and the AlnSeq and FragSeq pools get */
+#define HUGE_PAGE_SIZE (2097152)
+
+/* Define AllocStats as a struct alloc_stats to keep count of what
+   the allocation layer has done so far in this process */
+typedef struct alloc_stats {
+  size_t num_allocs; // number of save_malloc calls
+  size_t bytes_alloced; // total bytes handed out by save_malloc
+  size_t num_huge; // number of those that are huge page backed
+  size_t bytes_huge; // total bytes in huge page backed blocks
+  size_t num_block_gets; // number of blocks taken from a BlockPool
+  size_t num_block_reuses; // number of those that were recycled
+                           // rather than newly allocated
+} AllocStats;
+
+/* Define BlockPool as a struct block_pool to recycle fixed-size
+   blocks that are made and thrown away over and over, like the
+   buffers for inserted sequence. Blocks given back with pool_put
+   go on the free list and are handed out again by pool_get.
+   Each block is its own save_malloc allocation, so one that never
+   comes back to the pool can still be freed with free() */
+typedef struct block_pool {
+  size_t block_size; // size in bytes of every block in this pool
+  void*  free_list; // first block ready for reuse; each free block
+                    // keeps a pointer to the next one in its first bytes
+  size_t num_free; // number of blocks on the free list
+} BlockPool;
+typedef struct block_pool* BlockPoolP;
+
+/* Pool of MAX_INS_LEN char buffers for sequence inserted relative
+   to the reference (AlnSeq->ins) */
+extern BlockPool ins_buf_pool;
+
+/* Pool of MAX_INS_LEN BaseCounts arrays for calling the consensus
+   of inserted sequence */
+extern BlockPool ins_bcs_pool;
+
+/* Pool of FS_PAYLOAD_LEN blocks for the id, desc, seq, and qual
+   strings of FragSeqs */
+extern BlockPool fs_payload_pool;
+
+/* aligned_malloc
+   Args: (1) size_t size - number of bytes wanted
+   Returns: pointer to ALLOC_ALIGN-aligned memory, or NULL if there
+   are not enough memories. Requests of HUGE_PAGE_SIZE or more are
+   huge page aligned and backed where the system allows it.
+   This is what save_malloc is.
+*/
+void* aligned_malloc( size_t size );
+
+/* pool_get
+   Args: (1) BlockPoolP bp - pool to get a block from
+   Returns: pointer to a block of bp->block_size bytes (contents
+   undefined), or NULL if there are not enough memories
+*/
+void* pool_get( BlockPoolP bp );
+
+/* pool_put
+   Args: (1) BlockPoolP bp - pool the block came from
+         (2) void* block - block to give back, may be NULL
+   Returns: void
+   Puts the block on the pool's free list for reuse
+*/
+void pool_put( BlockPoolP bp, void* block );
+
+/* get_alloc_stats
+   Args: (1) AllocStats* as - place to put a copy of the current
+             allocation statistics
+   Returns: void
+*/
+void get_alloc_stats( AllocStats* as );
+
+/* print_alloc_stats
+   Args: (1) FILE* out - where to write
+   Returns: void
+   Writes a short summary of the allocation statistics to out
+*/
+void print_alloc_stats( FILE* out );
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ALLOC_H */
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "bgzf.h"
+#include "params.h"
+#include "types.h"
+#include "alloc.h"
+
+/* Every BGZF block starts with this gzip header, whose extra field
+   (BC) holds the size of the whole block less one in its last two
+   bytes; it ends with the CRC32 and length of what went in */
+#define BGZF_HEADER_LEN (18)
+#define BGZF_FOOTER_LEN (8)
+static const unsigned char bgzf_header[BGZF_HEADER_LEN] =
+  { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 'B', 'C', 0x02, 0,
+    0, 0 };
+
+/* An empty block, which ends every BGZF file */
+#define BGZF_EOF_LEN (28)
+static const unsigned char bgzf_eof[BGZF_EOF_LEN] =
+  { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 'B', 'C', 0x02, 0,
+    0x1b, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+typedef struct bgzf_block {
+  unsigned char* in;  // up to BGZF_BLOCK_LEN bytes to compress
+  unsigned char* out; // the BGZF block they make
+  size_t in_len;
+  size_t out_len;
+  int done; // Boolean, TRUE means out is ready to write
+} BgzfBlock;
+
+/* Blocks are used round robin. Counting every block ever filled,
+   blocks next_write up to next_zip are being compressed (or are
+   done), blocks next_zip up to next_fill are waiting for a thread,
+   and block next_fill is being filled. All of these but next_fill,
+   and the done flags, are only looked at or changed with lock held.
+*/
+struct bgzf_writer {
+  FILE* f;
+  BgzfBlock* blocks;
+  size_t num_blocks;
+  size_t next_write;
+  size_t next_zip;
+  size_t next_fill;
+  int num_threads;
+  pthread_t* threads;
+  pthread_mutex_t lock;
+  pthread_cond_t queued;     // a block is waiting, or we're closing
+  pthread_cond_t compressed; // a block is done
+  int closing; // Boolean, TRUE means threads stop when nothing is waiting
+  int zip_error;   // Boolean, TRUE means a thread could not compress a
+                   // block; only changed with lock held
+  int write_error; // Boolean, TRUE means something could not be
+                   // compressed or written by the writing thread
+  z_stream zs; // for compressing without threads
+};
+
+static int init_deflate( z_stream* zs ) {
+  memset( zs, 0, sizeof(z_stream) );
+  return ( deflateInit2( zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+			 Z_DEFAULT_STRATEGY ) == Z_OK );
+}
+
+static void put_le( unsigned char* p, unsigned long n, int bytes ) {
+  int i;
+  for( i = 0; i < bytes; i++ ) {
+    p[i] = (n >> (8 * i)) & 0xff;
+  }
+}
+
+/* compress_block
+   Args: (1) z_stream* zs - from init_deflate
+         (2) BgzfBlock* b - with in and in_len set
+   Returns: 1 if success; 0 if the block did not compress
+   Makes the whole BGZF block of b->in in b->out
+*/
+static int compress_block( z_stream* zs, BgzfBlock* b ) {
+  size_t len;
+  if ( deflateReset( zs ) != Z_OK ) {
+    return 0;
+  }
+  zs->next_in   = b->in;
+  zs->avail_in  = b->in_len;
+  zs->next_out  = b->out + BGZF_HEADER_LEN;
+  zs->avail_out = BGZF_MAX_BLOCK_LEN - BGZF_HEADER_LEN - BGZF_FOOTER_LEN;
+  if ( deflate( zs, Z_FINISH ) != Z_STREAM_END ) {
+    return 0;
+  }
+  len = BGZF_HEADER_LEN + zs->total_out + BGZF_FOOTER_LEN;
+  memcpy( b->out, bgzf_header, BGZF_HEADER_LEN );
+  put_le( &b->out[BGZF_HEADER_LEN - 2], len - 1, 2 );
+  put_le( &b->out[len - BGZF_FOOTER_LEN],
+	  crc32( crc32( 0L, Z_NULL, 0 ), b->in, b->in_len ), 4 );
+  put_le( &b->out[len - 4], b->in_len, 4 );
+  b->out_len = len;
+  return 1;
+}
+
+/* zip_thread
+   Compresses waiting blocks until bgzf_close says stop
+*/
+static void* zip_thread( void* arg ) {
+  BgzfWriterP bw = (BgzfWriterP)arg;
+  z_stream zs;
+  BgzfBlock* b;
+  int ok, zipped;
+
+  ok = init_deflate( &zs );
+  pthread_mutex_lock( &bw->lock );
+  while( 1 ) {
+    while( (bw->next_zip == bw->next_fill) && !bw->closing ) {
+      pthread_cond_wait( &bw->queued, &bw->lock );
+    }
+    if ( bw->next_zip == bw->next_fill ) {
+      break;
+    }
+    b = &bw->blocks[bw->next_zip++ % bw->num_blocks];
+    pthread_mutex_unlock( &bw->lock );
+
+    zipped = ok && compress_block( &zs, b );
+
+    pthread_mutex_lock( &bw->lock );
+    if ( !zipped ) {
+      bw->zip_error = 1;
+    }
+    b->done = 1;
+    pthread_cond_signal( &bw->compressed );
+  }
+  pthread_mutex_unlock( &bw->lock );
+  if ( ok ) {
+    deflateEnd( &zs );
+  }
+  return NULL;
+}
+
+/* write_blocks
+   Args: (1) BgzfWriterP bw - with bw->lock held
+         (2) size_t until - write all blocks before this one
+   Returns: void
+   Writes blocks to the file in order, waiting for them to be
+   compressed, until block until; then writes any more that are
+   already done
+*/
+static void write_blocks( BgzfWriterP bw, size_t until ) {
+  BgzfBlock* b;
+  while( bw->next_write < bw->next_fill ) {
+    b = &bw->blocks[bw->next_write % bw->num_blocks];
+    if ( !b->done ) {
+      if ( bw->next_write >= until ) {
+	return;
+      }
+      pthread_cond_wait( &bw->compressed, &bw->lock );
+      continue;
+    }
+    pthread_mutex_unlock( &bw->lock );
+    if ( fwrite( b->out, 1, b->out_len, bw->f ) != b->out_len ) {
+      bw->write_error = 1;
+    }
+    pthread_mutex_lock( &bw->lock );
+    bw->next_write++;
+  }
+}
+
+/* queue_block
+   Args: (1) BgzfWriterP bw - with something in block next_fill
+   Returns: void
+   Hands block next_fill over to be compressed and written, and gets
+   the next one ready to fill
+*/
+static void queue_block( BgzfWriterP bw ) {
+  BgzfBlock* b;
+  b = &bw->blocks[bw->next_fill % bw->num_blocks];
+  if ( bw->num_threads == 0 ) {
+    if ( !compress_block( &bw->zs, b ) ||
+	 (fwrite( b->out, 1, b->out_len, bw->f ) != b->out_len) ) {
+      bw->write_error = 1;
+    }
+    b->in_len = 0;
+    return;
+  }
+
+  pthread_mutex_lock( &bw->lock );
+  bw->next_fill++;
+  pthread_cond_signal( &bw->queued );
+  /* The block to fill next must have been written */
+  write_blocks( bw, (bw->next_fill >= bw->num_blocks) ?
+		bw->next_fill - bw->num_blocks + 1 : 0 );
+  pthread_mutex_unlock( &bw->lock );
+
+  b = &bw->blocks[bw->next_fill % bw->num_blocks];
+  b->in_len = 0;
+  b->done = 0;
+}
+
+/* abandon_open
+   Args: (1) BgzfWriterP bw - being set up by bgzf_open, with its
+             file open and deflate stream started
+         (2) const char* fn - its file
+         (3) size_t num_blocks - how many of bw->blocks have their
+	     buffers allocated; the buffers of the last one may be NULL
+   Returns: NULL
+   Undoes what bgzf_open did before running out of memories: ends the
+   deflate stream, frees what was allocated, and closes and removes fn
+*/
+static BgzfWriterP abandon_open( BgzfWriterP bw, const char* fn,
+				 size_t num_blocks ) {
+  size_t i;
+  deflateEnd( &bw->zs );
+  for( i = 0; i < num_blocks; i++ ) {
+    free( bw->blocks[i].in );
+    free( bw->blocks[i].out );
+  }
+  free( bw->blocks );
+  free( bw->threads );
+  fclose( bw->f );
+  unlink( fn );
+  free( bw );
+  return NULL;
+}
+
+/* bgzf_open
+   Args: (1) const char* fn - file to write
+         (2) int threads - number of threads to compress blocks; 0
+	     means compress them in the thread that writes
+   Returns: BgzfWriterP ready for bgzf_write; NULL if fn cannot be
+   opened or not enough memories, in which case nothing is left open
+   or allocated, and no fn is left behind
+*/
+BgzfWriterP bgzf_open( const char* fn, int threads ) {
+  BgzfWriterP bw;
+  size_t i;
+
+  bw = (BgzfWriterP)save_malloc( sizeof(struct bgzf_writer) );
+  if ( bw == NULL ) {
+    return NULL;
+  }
+  memset( bw, 0, sizeof(struct bgzf_writer) );
+  bw->f = fopen( fn, "wb" );
+  if ( bw->f == NULL ) {
+    free( bw );
+    return NULL;
+  }
+  if ( !init_deflate( &bw->zs ) ) {
+    fclose( bw->f );
+    unlink( fn );
+    free( bw );
+    return NULL;
+  }
+
+  bw->num_blocks = (threads > 0) ? threads * BGZF_QUEUE_BLOCKS : 1;
+  bw->blocks = (BgzfBlock*)save_malloc( bw->num_blocks * sizeof(BgzfBlock) );
+  bw->threads = (pthread_t*)save_malloc( (threads + 1) * sizeof(pthread_t) );
+  if ( (bw->blocks == NULL) || (bw->threads == NULL) ) {
+    return abandon_open( bw, fn, 0 );
+  }
+  for( i = 0; i < bw->num_blocks; i++ ) {
+    bw->blocks[i].in  = (unsigned char*)save_malloc( BGZF_BLOCK_LEN );
+    bw->blocks[i].out = (unsigned char*)save_malloc( BGZF_MAX_BLOCK_LEN );
+    if ( (bw->blocks[i].in == NULL) || (bw->blocks[i].out == NULL) ) {
+      return abandon_open( bw, fn, i + 1 );
+    }
+    bw->blocks[i].in_len = 0;
+    bw->blocks[i].done = 0;
+  }
+
+  pthread_mutex_init( &bw->lock, NULL );
+  pthread_cond_init( &bw->queued, NULL );
+  pthread_cond_init( &bw->compressed, NULL );
+  for( bw->num_threads = 0; bw->num_threads < threads; bw->num_threads++ ) {
+    if ( pthread_create( &bw->threads[bw->num_threads], NULL,
+			 zip_thread, bw ) != 0 ) {
+      break;
+    }
+  }
+  return bw;
+}
+
+/* bgzf_write
+   Args: (1) BgzfWriterP bw
+         (2) const char* data - what to write
+	 (3) size_t len - how many bytes of it
+   Returns: 1 if success; 0 if compressing or writing failed
+   Only one thread may write to bw
+*/
+int bgzf_write( BgzfWriterP bw, const char* data, size_t len ) {
+  BgzfBlock* b;
+  size_t n;
+  while( len > 0 ) {
+    b = &bw->blocks[bw->next_fill % bw->num_blocks];
+    n = BGZF_BLOCK_LEN - b->in_len;
+    if ( n > len ) {
+      n = len;
+    }
+    memcpy( &b->in[b->in_len], data, n );
+    b->in_len += n;
+    data += n;
+    len  -= n;
+    if ( b->in_len == BGZF_BLOCK_LEN ) {
+      queue_block( bw );
+    }
+  }
+  return !bw->write_error;
+}
+
+/* bgzf_close
+   Args: (1) BgzfWriterP bw
+   Returns: 1 if success; 0 if compressing or writing any of it failed
+   Writes whatever is left and the BGZF end of file block, stops the
+   compression threads, closes the file, and frees bw
+*/
+int bgzf_close( BgzfWriterP bw ) {
+  int i, ok;
+  size_t j;
+
+  if ( bw->blocks[bw->next_fill % bw->num_blocks].in_len > 0 ) {
+    queue_block( bw );
+  }
+  pthread_mutex_lock( &bw->lock );
+  write_blocks( bw, bw->next_fill );
+  bw->closing = 1;
+  pthread_cond_broadcast( &bw->queued );
+  pthread_mutex_unlock( &bw->lock );
+  for( i = 0; i < bw->num_threads; i++ ) {
+    pthread_join( bw->threads[i], NULL );
+  }
+
+  if ( fwrite( bgzf_eof, 1, BGZF_EOF_LEN, bw->f ) != BGZF_EOF_LEN ) {
+    bw->write_error = 1;
+  }
+  if ( fclose( bw->f ) != 0 ) {
+    bw->write_error = 1;
+  }
+  ok = !bw->write_error && !bw->zip_error;
+
+  deflateEnd( &bw->zs );
+  pthread_mutex_destroy( &bw->lock );
+  pthread_cond_destroy( &bw->queued );
+  pthread_cond_destroy( &bw->compressed );
+  for( j = 0; j < bw->num_blocks; j++ ) {
+    free( bw->blocks[j].in );
+    free( bw->blocks[j].out );
+  }
+  free( bw->blocks );
+  free( bw->threads );
+  free( bw );
+  return ok;
+}
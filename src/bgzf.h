@@ -0,0 +1,41 @@
+#ifndef INCLUDED_bgzf_H
+#define INCLUDED_bgzf_H
+
+#include <stddef.h>
+
+/* Writing BGZF files: gzip files made of independently compressed
+   blocks of at most BGZF_BLOCK_LEN bytes, so gzip reads them as
+   usual and samtools and friends can also seek in them. Blocks are
+   compressed by a pool of threads while more output is being
+   written, and go to the file in order.
+*/
+typedef struct bgzf_writer* BgzfWriterP;
+
+/* bgzf_open
+   Args: (1) const char* fn - file to write
+         (2) int threads - number of threads to compress blocks; 0
+	     means compress them in the thread that writes
+   Returns: BgzfWriterP ready for bgzf_write; NULL if fn cannot be
+   opened or not enough memories, in which case nothing is left open
+   or allocated, and no fn is left behind
+*/
+BgzfWriterP bgzf_open( const char* fn, int threads ) ;
+
+/* bgzf_write
+   Args: (1) BgzfWriterP bw
+         (2) const char* data - what to write
+	 (3) size_t len - how many bytes of it
+   Returns: 1 if success; 0 if compressing or writing failed
+   Only one thread may write to bw
+*/
+int bgzf_write( BgzfWriterP bw, const char* data, size_t len ) ;
+
+/* bgzf_close
+   Args: (1) BgzfWriterP bw
+   Returns: 1 if success; 0 if compressing or writing any of it failed
+   Writes whatever is left and the BGZF end of file block, stops the
+   compression threads, closes the file, and frees bw
+*/
+int bgzf_close( BgzfWriterP bw ) ;
+
+#endif
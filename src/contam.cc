@@ -0,0 +1,402 @@
+#include <map>
+#include <string>
+#include <utility>
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+
+extern "C" {
+#include "map_align.h"
+#include "mia.h"
+#include "myers_align.h"
+#include "contam.h"
+}
+
+/*
+ * Contamination Checker.  Outline:
+ *
+ * - align reference-consensus and assembly globally
+ *   This uses Myers' O(nd) aligner, for it grasps ambiguity codes and
+ *   runs fast enough for long, but similar sequences.
+ * - find "diagnostic positions", positions where ass and ref differ
+ * - for every "end" fragment: store it  and later join with its other
+ *   half
+ * - for every "full" fragment: if it crosses at least one diagnostic
+ *   position, cut out that range from ref and align to it globally
+ *   using the mia aligner
+ * - for every position where the bases agree, classify it, then
+ *   classify the fragment (conflicting, uninformative, contaminant,
+ *   endogenous)
+ * - produce a summary
+ *
+ * Reading the human reference and the maln file is left to the caller
+ * (ccheck does it from files, mia hands over what it has in memory).
+ */
+
+static void print_aln( FILE* out, const char* aln1, const char* aln2 )
+{
+	int p ;
+	const char* a ;
+	while( *aln1 && *aln2 ) {
+		for( p = 0, a = aln1 ; *a && p != 72 ; ++p ) putc( *a++, out ) ;
+		putc( '\n', out ) ;
+
+		for( p = 0, a = aln2 ; *a && p != 72 ; ++p ) putc( *a++, out ) ;
+		putc( '\n', out ) ;
+
+		for( p = 0 ; *aln1 && *aln2 && p != 72 ; ++p )
+			putc( ( *aln1++ == *aln2++ ? '*' : ' ' ), out ) ;
+		putc( '\n', out ) ;
+		putc( '\n', out ) ;
+	}
+}
+
+// List of diagnostic positions: Coordinates are relative to assembly
+// (we want to quickly know whether a fragment overlaps a DP).  We'll
+// store the reference bases along with it.
+typedef std::map< int, std::pair< char, char > > dp_list ;
+
+// Everything that differs counts as diagnostic, unless it's a gap.  In
+// principle, Ns could be diagnostic, too, even though in only one
+// direction.  In practice, however, it turned out that Ns produce noise
+// and little in the way of useable results.  So Ns don't count as
+// diagnostic for now.
+static bool is_diagnostic( const char* aln1, const char* aln2 )
+{
+	return *aln1 != *aln2
+				&& *aln1 != 'N' && *aln2 != 'N'
+				&& *aln1 != '-' && *aln2 != '-' ;
+}
+
+static bool is_transversion( char a, char b )
+{
+	char u = a & ~32 ;
+	char v = b & ~32 ;
+	switch( u )
+	{
+		case 'A': return v != 'G' ;
+		case 'C': return v != 'T' ;
+		case 'G': return v != 'A' ;
+		case 'T':
+		case 'U': return v != 'C' ;
+		default: return false ;
+	}
+}
+
+
+static dp_list mk_dp_list( const char* aln1, const char* aln2, bool transversions, int span_from, int span_to )
+{
+	dp_list l ;
+	while( span_from != span_to && *aln1 && *aln2 )
+	{
+		if( is_diagnostic( aln1, aln2 ) && ( !transversions || is_transversion( *aln1, *aln2 )))
+			l[span_from] = std::make_pair( *aln1, *aln2 ) ;
+		if( *aln2 != '-' ) ++span_from ;
+		++aln1 ;
+		++aln2 ;
+	}
+	return l ;
+}
+
+static std::pair< dp_list::const_iterator, dp_list::const_iterator >
+overlapped_diagnostic_positions( const dp_list& l, const AlnSeqP s )
+{
+	dp_list::const_iterator left  = l.lower_bound( s->start ) ;
+	dp_list::const_iterator right = l.lower_bound( s->end + 1 ) ;
+	return std::make_pair( left, right ) ;
+}
+
+// XXX: linear scan --> O(n)
+// This could be faster (O(log n)) if precompiled into some sort of index.
+static std::string lift_over( const char* aln1, const char* aln2, int s, int e )
+{
+	std::string r ;
+	int p ;
+	for( p = 0 ; p < e && *aln1 && *aln2 ; ++aln1, ++aln2 )
+	{
+		if( *aln1 != '-' && p >= s ) r.push_back( *aln1 ) ;
+		if( *aln2 != '-' ) ++p ;
+	}
+	return r ;
+}
+
+static bool consistent( bool adna, char x, char y )
+{
+	char x_ = x == 'G' ? 'R' : x == 'C' ? 'Y' : x ;
+	return x == '-' || y == '-' || (char_to_bitmap( adna ? x_ : x ) & char_to_bitmap(y)) != 0 ;
+}
+
+enum whatsit { unknown, clean, dirt, conflict, nonsense, maxwhatsits } ;
+
+static const char *label[] = { "unclassified", "clean       ", "polluting   ", "conflicting ", "nonsensical " } ;
+
+static whatsit merge_whatsit( whatsit a, whatsit b )
+{
+	if( a == b ) return a ;
+	if( a == unknown ) return b ;
+	if( b == unknown ) return a ;
+	if( a == nonsense || b == nonsense ) return nonsense ;
+	return conflict ;
+}
+
+void init_contam_opts( ContamOptsP co )
+{
+	co->adna = 0 ;
+	co->transversions = 0 ;
+	co->span_from = 0 ;
+	co->span_to = INT_MAX ;
+	co->maxd = 1000 ;
+	co->verbose = 0 ;
+}
+
+int contam_check( FILE* out, MapAlignmentP maln, const char* contam_seq,
+		  ContamOptsP co )
+{
+	int summary[ maxwhatsits ] = {0} ;
+	bool adna = co->adna ;
+	int verbose = co->verbose ;
+	PSSMP submat = maln->fpsm ;
+
+	// The assembly as it is in the maln file; in memory, a circular
+	// one has the wrapped-around bit tacked onto the end
+	std::string ass_seq( maln->ref->seq, maln->ref->seq_len ) ;
+
+	char aln_con[ strlen(contam_seq) + co->maxd + 1 ] ;
+	char aln_ass[ ass_seq.size() + co->maxd + 1 ] ;
+	unsigned d = myers_diff( contam_seq, myers_align_globally, ass_seq.c_str(), co->maxd, aln_con, aln_ass ) ;
+
+	if( d == UINT_MAX ) { fputs( "Couldn't align references (try to increase maxd).\n", out ) ; return 0 ; }
+	if( verbose >= 1 ) fprintf( out, "%d total differences between reference and assembly.\n", d ) ;
+	if( verbose >= 6 ) print_aln( out, aln_con, aln_ass ) ;
+
+	dp_list l = mk_dp_list( aln_con, aln_ass, co->transversions, co->span_from, co->span_to ) ;
+
+	if( verbose >=1 )
+	{
+		int t = 0 ;
+		for( dp_list::const_iterator i = l.begin() ; i != l.end() ; ++i )
+			if( is_transversion( i->second.first, i->second.second ) ) ++t ;
+		fprintf( out, "%lu diagnostic positions, %d of which are transversions.\n", (unsigned long)l.size(), t ) ;
+	}
+	if( verbose >= 3 )
+	{
+		dp_list::const_iterator i = l.begin() ;
+		if( i != l.end() ) { fprintf( out, "<%d:%c,%c>", i->first, i->second.first, i->second.second ) ; ++i ; }
+		for( ; i != l.end() ; ++i ) fprintf( out, ", <%d:%c,%c>", i->first, i->second.first, i->second.second ) ;
+		putc( '\n', out ) ;
+	}
+
+	typedef std::map< std::string, std::pair< whatsit, int > > Bfrags ;
+	Bfrags bfrags ;
+	const AlnSeqP *s ;
+
+	for( s = maln->AlnSeqArray ; s != maln->AlnSeqArray + maln->num_aln_seqs ; ++s )
+	{
+		whatsit klass = unknown ;
+		int votes = 0 ;
+
+		std::pair< dp_list::const_iterator, dp_list::const_iterator > p =
+			overlapped_diagnostic_positions( l, *s ) ;
+		if( p.first == p.second ) {
+			if( verbose >= 3 ) {
+				fputs( (*s)->id, out ) ;
+				putc( '/', out ) ;
+				putc( (*s)->segment, out ) ;
+				fputs( ": no diagnostic positions\n", out ) ;
+			}
+		}
+		else
+		{
+			if( verbose >= 3 )
+			{
+				fprintf( out, "%s/%c: %ld diagnostic positions", (*s)->id, (*s)->segment, (long)std::distance( p.first, p.second ) ) ;
+				if( verbose >= 4 )
+				{
+					putc( ':', out ) ; putc( ' ', out ) ;
+					dp_list::const_iterator i = p.first ;
+					if( i != p.second ) { fprintf( out, "<%d:%c,%c>", i->first, i->second.first, i->second.second ) ; ++i ; }
+					for( ; i != p.second ; ++i ) fprintf( out, ", <%d:%c,%c>", i->first, i->second.first, i->second.second ) ;
+				}
+				fprintf( out, "\nrange:  %d..%d\n", (*s)->start, (*s)->end ) ;
+			}
+
+			std::string the_read ;
+			for( char *nt = (*s)->seq, **ins = (*s)->ins ; *nt ; ++nt, ++ins )
+			{
+				if( *nt != '-' ) the_read.push_back( *nt ) ;
+				if( *ins ) the_read.append( *ins ) ;
+			}
+			std::string the_ass( ass_seq, (*s)->start, (*s)->end - (*s)->start + 1 ) ;
+			std::string lifted = lift_over( aln_con, aln_ass, (*s)->start, (*s)->end + 1 ) ;
+
+			if( verbose >= 5 )
+			{
+				fprintf( out, "raw read: %s\nlifted:   %s\nassembly: %s\n\n"
+						"aln.read: %s\naln.assm: %s\nmatches:  %s",
+						the_read.c_str(), lifted.c_str(), the_ass.c_str(),
+						(*s)->seq, the_ass.c_str() ) ;
+				std::string::const_iterator b = the_ass.begin(), e = the_ass.end() ;
+				const char* pc = (*s)->seq ;
+				while( b != e && *pc ) putc( *b++ == *pc++ ? '*' : ' ', out ) ;
+				putc( '\n', out ) ;
+			}
+
+			int size = std::max( lifted.size(), the_read.size() ) ;
+
+			AlignmentP frag_aln = init_alignment( size, size, 0, 0 ) ;
+
+			frag_aln->seq1 = lifted.c_str() ;
+			frag_aln->seq2 = the_read.c_str() ;
+			frag_aln->len1 = size ;
+			frag_aln->len2 = size ;
+			frag_aln->sg5 = 1 ;
+			frag_aln->sg3 = 1 ;
+			frag_aln->submat = submat ;
+			pop_s1c_in_a( frag_aln ) ;
+			pop_s2c_in_a( frag_aln ) ;
+			dyn_prog( frag_aln ) ;
+
+			pw_aln_frag pwaln ;
+			max_sg_score( frag_aln ) ;			// ARGH!  This has a vital side-effect!!!
+			find_align_begin( frag_aln ) ;  	//        And so has this...
+			populate_pwaln_to_begin( frag_aln, &pwaln ) ;
+			pwaln.start = frag_aln->abc;
+
+			if( verbose >= 5 )
+			{
+				fprintf( out, "\naln.read: %s\naln.ref:  %s\nmatches:  ", pwaln.frag_seq, pwaln.ref_seq ) ;
+				const char *pc = pwaln.frag_seq, *pd = pwaln.ref_seq ;
+				while( *pc && *pd ) putc( *pd++ == *pc++ ? '*' : ' ', out ) ;
+				putc( '\n', out ) ;
+				putc( '\n', out ) ;
+			}
+
+			free_alignment( frag_aln ) ;
+
+			char *paln1 = aln_con, *paln2 = aln_ass ;
+			int ass_pos = 0 ;
+			while( ass_pos != (*s)->start && *paln1 && *paln2 )
+			{
+				if( *paln2 != '-' ) ass_pos++ ;
+				++paln1 ;
+				++paln2 ;
+			}
+
+			std::string in_ref = lifted.substr( 0, pwaln.start ) ;
+			in_ref.append( pwaln.ref_seq ) ;
+
+			char *in_frag_v_ref = pwaln.frag_seq ;
+			const char *in_ass = ass_seq.c_str() + (*s)->start ;
+			char *in_frag_v_ass = (*s)->seq ;
+
+			if( *paln1 != in_ref[0] || *paln1 == '-' ) fprintf( out, "huh? (R+%d) %.10s %.10s\n", pwaln.start, paln1, in_ref.c_str() ) ;
+			if( *paln2 != in_ass[0] && *paln2 != '-' ) fprintf( out, "huh? (A+%d) %.10s %.10s\n", pwaln.start, paln2, in_ass ) ;
+
+			while( ass_pos != (*s)->end +1 && *paln1 && *paln2 && !in_ref.empty() && *in_ass && *in_frag_v_ass && *in_frag_v_ref )
+			{
+				if( is_diagnostic( paln1, paln2 ) ) {
+					if( verbose >= 4 )
+						fprintf( out, "diagnostic pos.: %d %c/%c %c/%c",
+								ass_pos, in_ref[0], *in_frag_v_ref, *in_ass, *in_frag_v_ass ) ;
+					if( *in_frag_v_ref != *in_frag_v_ass )
+					{
+						if( verbose >= 4 ) fputs( "in disagreement.\n", out ) ;
+					}
+					else
+					{
+						bool maybe_clean = consistent( adna, *in_ass, *in_frag_v_ass ) ;
+						bool maybe_dirt =  consistent( adna, in_ref[0], *in_frag_v_ref ) ;
+
+						if( verbose >= 4 )
+						{
+							fputs( maybe_dirt  ? "" : "in", out ) ;
+							fputs( " consistent/", out ) ;
+							fputs( maybe_clean ? "" : "in", out ) ;
+							fputs( " consistent\n", out ) ;
+						}
+
+						if( maybe_clean && !maybe_dirt && klass == unknown ) klass = clean ;
+						if( maybe_clean && !maybe_dirt && klass == dirt    ) klass = conflict ;
+						if( !maybe_clean && maybe_dirt && klass == unknown ) klass = dirt ;
+						if( !maybe_clean && maybe_dirt && klass == clean   ) klass = conflict ;
+						if( !maybe_clean && !maybe_dirt )                    klass = nonsense ;
+						if( maybe_dirt != maybe_clean ) votes++ ;
+					}
+				}
+
+				if( *paln1 != '-' ) {
+					do {
+						in_ref=in_ref.substr(1) ;
+						in_frag_v_ref++ ;
+					} while( in_ref[0] == '-' ) ;
+				}
+				if( *paln2 != '-' ) {
+					ass_pos++ ;
+					do {
+						in_ass++ ;
+						in_frag_v_ass++ ;
+					} while( *in_ass == '-' ) ;
+				}
+				++paln1 ;
+				++paln2 ;
+			}
+		}
+
+		Bfrags::const_iterator i = bfrags.find( (*s)->id ) ;
+
+		switch( (*s)->segment )
+		{
+			case 'b':
+				bfrags[ (*s)->id ] = std::make_pair( klass, votes ) ;
+				break ;
+
+			case 'f':
+				if( i == bfrags.end() )
+				{
+					fputs( (*s)->id, out ) ;
+					fputs( "/f is missing its back.\n", out ) ;
+				}
+				else
+				{
+					votes += i->second.second ;
+					klass = merge_whatsit( klass, i->second.first ) ;
+				}
+
+			case 'a':
+				if( verbose >= 2 )
+					fprintf( out, "%s is %s (%d votes)\n", (*s)->id, label[klass], votes ) ;
+				if( verbose >= 3 ) putc( '\n', out ) ;
+				summary[klass]++ ;
+				break ;
+
+			default:
+				fputs( "don't know how to handle fragment type ", out ) ;
+				putc( (*s)->segment, out ) ;
+				putc( '\n', out ) ;
+		}
+	}
+
+	fputs( "\nSummary:\n", out ) ;
+	for( whatsit klass = unknown ; klass != maxwhatsits ; klass = (whatsit)( (int)klass +1 ) )
+	{
+		fprintf( out, "%s fragments: %d", label[klass], summary[klass] ) ;
+		if( klass == dirt )
+		{
+			double z = 1.96 ; // this is Z_{0.975}, giving a 95% confidence interval (I hope...)
+			double k = summary[dirt], n = k + summary[clean] ;
+			double p_ = k / n ;
+			double c = p_ + 0.5 * z * z / n ;
+			double w = z * sqrt( p_ * (1-p_) / n + 0.25 * z * z / (n*n) ) ;
+			double d = 1 + z * z / n ;
+
+			fprintf( out, " (%.1f .. %.1f .. %.1f%%)",
+				100.0 * (c-w) / d,         		// lower bound of CI
+				100.0 * p_,         			// ML estimate
+				100.0 * (c+w) / d ) ;      		// upper bound of CI
+		}
+		putc( '\n', out ) ;
+	}
+	putc( '\n', out ) ;
+	return 1 ;
+}
@@ -0,0 +1,40 @@
+#ifndef INCLUDED_contam_H
+#define INCLUDED_contam_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Contamination check, shared by ccheck and by mia (-K), which runs
+   it on the final maln while it is still in memory. C++ inside, but
+   callable from C; C++ callers include this within extern "C" */
+
+/* init_contam_opts
+   Args: (1) ContamOptsP co
+   Returns: void
+   Sets co to the ccheck defaults: not ancient, every difference is
+   diagnostic, the whole assembly, up to 1000 differences between the
+   references, and no verbosity
+*/
+void init_contam_opts( ContamOptsP co ) ;
+
+/* contam_check
+   Args: (1) FILE* out - where the report and summary go
+         (2) MapAlignmentP maln - assembly with its aligned fragments
+	     and substitution matrices (fpsm)
+	 (3) const char* contam_seq - the likely contaminant sequence;
+	     may have ambiguity codes
+	 (4) ContamOptsP co - settings
+   Returns: 1 if success; 0 if the assembly and contaminant could not
+   be aligned within co->maxd differences
+   Finds the positions where the assembly and contaminant differ,
+   realigns every fragment that covers any of them to the
+   contaminant, classifies the fragment as clean, polluting,
+   conflicting, nonsensical or unclassified by its bases there, and
+   writes a summary with the number of each kind and the 95%
+   confidence interval of the fraction that is polluting. Back and
+   front parts of fragments that wrap around are counted once.
+*/
+int contam_check( FILE* out, MapAlignmentP maln, const char* contam_seq,
+		  ContamOptsP co ) ;
+
+#endif
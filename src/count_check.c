@@ -0,0 +1,360 @@
+#include "map_align.h"
+#include <unistd.h>
+
+/*
+ * Count Checker.  The numbers of aligned fragments and IDs are size_t
+ * all the way from the structs through the maln file, so read sets of
+ * more than 2^31 fragments don't wrap around.  Nothing can allocate
+ * that many here, so this checks:
+ * - that each count holds a number past 2^32 as it is
+ * - that grow_alns_map_alignment, grow_ids_list and parse_ids keep
+ *   what they had while they grow
+ * - that write_ma and read_ma_header carry MALN_NAS and MALN_SIZ past
+ *   2^32 through a maln file, with the counts of a tiny alignment
+ *   faked that high
+ * Prints what failed and returns non-zero if anything did; run by
+ * make check.
+ */
+
+#define BIG_COUNT (((size_t)1 << 32) + 5)
+#define BIG_SIZ   (((size_t)1 << 33) + 3)
+#define BIG_NAS   (((size_t)3 << 31))
+#define NUM_GROWS (10)
+
+static int failures = 0;
+
+/* check
+   Args: (1) int ok - Boolean, FALSE means the check failed
+         (2) const char* what - what was checked
+   Returns: ok
+   Prints what if it failed, and counts the failure
+*/
+static int check( int ok, const char* what ) {
+  if ( !ok ) {
+    fprintf( stderr, "FAILED: %s\n", what );
+    failures++;
+  }
+  return ok;
+}
+
+/* temp_fn
+   Args: (1) char* fn - room for the name, a mkstemp template
+   Returns: void
+   Makes fn the name of a new, empty temporary file
+*/
+static void temp_fn( char* fn ) {
+  int fd;
+  strcpy( fn, "/tmp/count_check.XXXXXX" );
+  fd = mkstemp( fn );
+  if ( fd < 0 ) {
+    fprintf( stderr, "Cannot make a temporary file\n" );
+    exit( 1 );
+  }
+  close( fd );
+}
+
+/* check_count_types
+   Every count of fragments or IDs must hold BIG_COUNT as it is
+*/
+static void check_count_types( void ) {
+  MapAlignment maln;
+  IDsList ids;
+  FragSeqDB fsdb;
+
+  maln.num_aln_seqs = BIG_COUNT;
+  maln.size = BIG_COUNT;
+  ids.num_ids = BIG_COUNT;
+  ids.size = BIG_COUNT;
+  fsdb.num_fss = BIG_COUNT;
+  check( maln.num_aln_seqs == BIG_COUNT, "MapAlignment num_aln_seqs past 2^32" );
+  check( maln.size == BIG_COUNT, "MapAlignment size past 2^32" );
+  check( ids.num_ids == BIG_COUNT, "IDsList num_ids past 2^32" );
+  check( ids.size == BIG_COUNT, "IDsList size past 2^32" );
+  check( fsdb.num_fss == BIG_COUNT, "FragSeqDB num_fss past 2^32" );
+}
+
+/* check_grow_alns
+   Grows a MapAlignment of 2 AlnSeqs NUM_GROWS times. The AlnSeqs it
+   started with must still be where they were, the new ones zeroed
+*/
+static void check_grow_alns( void ) {
+  MapAlignmentP maln;
+  AlnSeqP first[2];
+  size_t i, want;
+  int grow, zeroed;
+
+  maln = (MapAlignmentP)save_malloc( sizeof(MapAlignment) );
+  maln->size = 2;
+  maln->num_aln_seqs = 2;
+  maln->AlnSeqArray = (AlnSeqP*)save_malloc( 2 * sizeof(AlnSeqP) );
+  for ( i = 0; i < 2; i++ ) {
+    first[i] = (AlnSeqP)save_malloc( sizeof(AlnSeq) );
+    memset( first[i], 0, sizeof(AlnSeq) );
+    sprintf( first[i]->id, "frag_%lu", (unsigned long)i );
+    maln->AlnSeqArray[i] = first[i];
+  }
+
+  want = 2;
+  for ( grow = 0; grow < NUM_GROWS; grow++ ) {
+    if ( !check( grow_alns_map_alignment( maln ),
+		 "grow_alns_map_alignment succeeds" ) ) {
+      return;
+    }
+    want *= 2;
+  }
+  check( maln->size == want, "grow_alns_map_alignment doubles size" );
+  check( maln->num_aln_seqs == 2,
+	 "grow_alns_map_alignment leaves num_aln_seqs" );
+  check( (maln->AlnSeqArray[0] == first[0]) &&
+	 (maln->AlnSeqArray[1] == first[1]) &&
+	 (strcmp( first[1]->id, "frag_1" ) == 0),
+	 "grow_alns_map_alignment keeps the AlnSeqs it had" );
+
+  zeroed = 1;
+  for ( i = 2; i < maln->size; i++ ) {
+    if ( (maln->AlnSeqArray[i]->id[0] != '\0') ||
+	 (maln->AlnSeqArray[i]->seq[0] != '\0') ||
+	 (maln->AlnSeqArray[i]->ins[0] != NULL) ) {
+      zeroed = 0;
+    }
+  }
+  check( zeroed, "grow_alns_map_alignment zeroes the new AlnSeqs" );
+}
+
+/* check_grow_ids
+   Grows an IDsList from init_ids_list NUM_GROWS times, and one that
+   starts with room for 3 IDs until it passes INIT_NUM_IDS
+*/
+static void check_grow_ids( void ) {
+  IDsListP ids;
+  char** first;
+  char* first_id;
+  size_t i, want;
+  int grow, kept;
+
+  ids = init_ids_list();
+  check( ids->size == INIT_NUM_IDS, "init_ids_list sets size" );
+  strcpy( ids->ids[INIT_NUM_IDS - 1], "last_id" );
+  grow_ids_list( ids );
+  check( ids->size == 2 * (size_t)INIT_NUM_IDS,
+	 "grow_ids_list doubles init_ids_list size" );
+  check( strcmp( ids->ids[INIT_NUM_IDS - 1], "last_id" ) == 0,
+	 "grow_ids_list keeps the IDs init_ids_list had" );
+
+  ids = (IDsListP)save_malloc( sizeof(IDsList) );
+  first = (char**)save_malloc( 3 * sizeof(char*) );
+  for ( i = 0; i < 3; i++ ) {
+    first[i] = (char*)save_malloc( MAX_ID_LEN * sizeof(char) );
+    sprintf( first[i], "id_%lu", (unsigned long)i );
+  }
+  first_id = first[0];
+  ids->ids = first;
+  ids->size = 3;
+  ids->num_ids = 3;
+  ids->sorted = 0;
+
+  want = 3;
+  for ( grow = 0; grow < NUM_GROWS; grow++ ) {
+    /* Fill in what the last grow added, as parse_ids would */
+    for ( i = ids->num_ids; i < ids->size; i++ ) {
+      sprintf( ids->ids[i], "id_%lu", (unsigned long)i );
+    }
+    ids->num_ids = ids->size;
+    grow_ids_list( ids );
+    want *= 2;
+  }
+  check( ids->size == want, "grow_ids_list doubles size" );
+
+  kept = 1;
+  for ( i = 0; i < ids->num_ids; i++ ) {
+    char id[MAX_ID_LEN];
+    sprintf( id, "id_%lu", (unsigned long)i );
+    if ( strcmp( ids->ids[i], id ) != 0 ) {
+      kept = 0;
+    }
+  }
+  check( kept, "grow_ids_list keeps the IDs it had" );
+  check( ids->ids[0] == first_id,
+	 "grow_ids_list keeps the ID memory it had" );
+}
+
+/* check_parse_ids
+   Has parse_ids read more IDs than INIT_NUM_IDS, so it must grow
+   its IDsList on the way
+*/
+static void check_parse_ids( void ) {
+  char fn[32];
+  FILE* IDS;
+  IDsListP ids;
+  size_t i, num;
+  int sorted;
+
+  num = INIT_NUM_IDS + 3;
+  temp_fn( fn );
+  IDS = fileOpen( fn, "w" );
+  for ( i = 0; i < num; i++ ) {
+    fprintf( IDS, "id_%09lu\n", (unsigned long)(num - 1 - i) );
+  }
+  fclose( IDS );
+
+  ids = parse_ids( fn );
+  unlink( fn );
+  check( ids->num_ids == num, "parse_ids counts past INIT_NUM_IDS" );
+  check( ids->size >= num, "parse_ids grows past INIT_NUM_IDS" );
+  sorted = 1;
+  for ( i = 1; i < ids->num_ids; i++ ) {
+    if ( strcmp( ids->ids[i-1], ids->ids[i] ) >= 0 ) {
+      sorted = 0;
+    }
+  }
+  check( sorted && (strcmp( ids->ids[num - 1], "id_001048578" ) == 0),
+	 "parse_ids keeps and sorts all the IDs" );
+}
+
+/* tiny_maln
+   Returns: MapAlignmentP with a reference of 10 bases, flat
+   substitution matrices and room for 2 AlnSeqs, of which num are
+   filled in
+*/
+static MapAlignmentP tiny_maln( size_t num ) {
+  MapAlignmentP maln;
+  AlnSeqP as;
+  size_t i;
+
+  maln = (MapAlignmentP)save_malloc( sizeof(MapAlignment) );
+  maln->ref = (RefSeqP)save_malloc( sizeof(RefSeq) );
+  memset( maln->ref, 0, sizeof(RefSeq) );
+  strcpy( maln->ref->id, "tiny_ref" );
+  strcpy( maln->ref->desc, "count_check" );
+  maln->ref->seq_len = 10;
+  maln->ref->size = 11;
+  maln->ref->seq = (char*)save_malloc( maln->ref->size * sizeof(char) );
+  strcpy( maln->ref->seq, "ACGTACGTAC" );
+  maln->ref->gaps = (int*)save_malloc( maln->ref->size * sizeof(int) );
+  memset( maln->ref->gaps, 0, maln->ref->size * sizeof(int) );
+  maln->ref->wrap_seq_len = maln->ref->seq_len;
+
+  maln->fpsm = (PSSMP)save_malloc( sizeof(PSSM) );
+  maln->rpsm = (PSSMP)save_malloc( sizeof(PSSM) );
+  memset( maln->fpsm, 0, sizeof(PSSM) );
+  memset( maln->rpsm, 0, sizeof(PSSM) );
+  maln->fpsm->depth = PSSM_DEPTH;
+  maln->rpsm->depth = PSSM_DEPTH;
+  maln->cons_code = 1;
+  maln->distant_ref = 0;
+
+  maln->size = 2;
+  maln->num_aln_seqs = num;
+  maln->AlnSeqArray = (AlnSeqP*)save_malloc( 2 * sizeof(AlnSeqP) );
+  for ( i = 0; i < 2; i++ ) {
+    as = (AlnSeqP)save_malloc( sizeof(AlnSeq) );
+    memset( as, 0, sizeof(AlnSeq) );
+    sprintf( as->id, "frag_%lu", (unsigned long)i );
+    strcpy( as->seq, "GTAC" );
+    as->start = 2 + i;
+    as->end = 5 + i;
+    as->num_inputs = 1;
+    as->segment = 'n';
+    set_depth_offsets( as, NULL );
+    maln->AlnSeqArray[i] = as;
+  }
+  return maln;
+}
+
+/* read_header
+   Args: (1) const char* fn - maln file
+         (2) size_t* maln_siz - where to put its MALN_SIZ
+   Returns: its MALN_NAS, as read_ma_header sees them
+*/
+static size_t read_header( const char* fn, size_t* maln_siz ) {
+  MapAlignmentP maln;
+  FILE* MAF;
+  char line[MAX_LINE_LEN + 1];
+
+  maln = tiny_maln( 0 );
+  free( maln->ref->seq );
+  free( maln->ref->gaps );
+  MAF = fileOpen( fn, "r" );
+  *maln_siz = read_ma_header( MAF, fn, maln, line );
+  fclose( MAF );
+  check( strcmp( maln->ref->seq, "ACGTACGTAC" ) == 0,
+	 "read_ma_header reads the reference after the counts" );
+  return maln->num_aln_seqs;
+}
+
+/* check_maln_counts
+   Writes a tiny maln with its size faked past 2^33, reads its header
+   back, then does the same with MALN_NAS past 2^32 written in
+*/
+static void check_maln_counts( void ) {
+  MapAlignmentP maln;
+  char fn[32], big_fn[32];
+  char line[MAX_LINE_LEN + 1];
+  char want[MAX_LINE_LEN + 1];
+  FILE* MAF;
+  FILE* BIG;
+  size_t nas, siz;
+  int line_num, seen;
+
+  maln = tiny_maln( 2 );
+  maln->size = BIG_SIZ; // only 2 are there, but write_ma just says how many
+  temp_fn( fn );
+  write_ma( fn, maln );
+
+  /* MALN_SIZ must be there as it is, not wrapped around */
+  sprintf( want, "MALN_SIZ %lu\n", (unsigned long)BIG_SIZ );
+  seen = 0;
+  MAF = fileOpen( fn, "r" );
+  while ( fgets( line, MAX_LINE_LEN, MAF ) != NULL ) {
+    if ( strcmp( line, want ) == 0 ) {
+      seen = 1;
+    }
+  }
+  fclose( MAF );
+  check( seen, "write_ma writes MALN_SIZ past 2^33" );
+
+  nas = read_header( fn, &siz );
+  check( siz == BIG_SIZ, "read_ma_header reads MALN_SIZ past 2^33" );
+  check( nas == 2, "read_ma_header reads MALN_NAS" );
+
+  /* Now the same file, claiming more fragments than an int can count */
+  temp_fn( big_fn );
+  MAF = fileOpen( fn, "r" );
+  BIG = fileOpen( big_fn, "w" );
+  line_num = 0;
+  while ( fgets( line, MAX_LINE_LEN, MAF ) != NULL ) {
+    if ( ++line_num == 2 ) {
+      fprintf( BIG, "MALN_NAS %lu\n", (unsigned long)BIG_NAS );
+    }
+    else {
+      fputs( line, BIG );
+    }
+  }
+  fclose( MAF );
+  fclose( BIG );
+
+  nas = read_header( big_fn, &siz );
+  check( nas == BIG_NAS, "read_ma_header reads MALN_NAS past 2^32" );
+  check( siz == BIG_SIZ, "read_ma_header reads MALN_SIZ with MALN_NAS" );
+  unlink( fn );
+  unlink( big_fn );
+}
+
+int main( void ) {
+  if ( sizeof(size_t) < 8 ) {
+    fprintf( stderr, "size_t is only %d bits here; nothing to check\n",
+	     (int)(8 * sizeof(size_t)) );
+    return 0;
+  }
+  check_count_types();
+  check_grow_alns();
+  check_grow_ids();
+  check_parse_ids();
+  check_maln_counts();
+  if ( failures > 0 ) {
+    fprintf( stderr, "%d count checks failed\n", failures );
+    return 1;
+  }
+  printf( "All count checks passed\n" );
+  return 0;
+}
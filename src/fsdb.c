@@ -1,4 +1,6 @@
 #include "fsdb.h"
+#include "bgzf.h"
+#include <unistd.h>
 
 
 /* fs_comp
@@ -175,13 +177,291 @@ int fs_comp_qscore ( const void* fs1_,
 
 
 
+/* clear_payload
+   Args: (1) FragSeqP fs - a FragSeq that has no payload
+   Returns: void
+   Sets up fs to have no payload in memory and none spilled
+*/
+void clear_payload( FragSeqP fs ) {
+  fs->id   = NULL;
+  fs->desc = NULL;
+  fs->seq  = NULL;
+  fs->qual = NULL;
+  fs->spill_pos = -1;
+  fs->qss  = NULL;
+}
+
+/* point_payload
+   Args: (1) FragSeqP fs
+         (2) char* payload - block of FS_PAYLOAD_LEN chars
+   Returns: void
+   Points fs->id, desc, seq, and qual to their places in payload
+*/
+static void point_payload( FragSeqP fs, char* payload ) {
+  fs->id   = payload;
+  fs->desc = fs->id + (MAX_ID_LEN + 1);
+  fs->seq  = fs->desc + (MAX_DESC_LEN + 1);
+  fs->qual = fs->seq + (INIT_ALN_SEQ_LEN + 1);
+}
+
+/* attach_payload
+   Args: (1) FSDB fsdb - database fs belongs to, or NULL if it
+             does not belong to one
+         (2) FragSeqP fs - FragSeq without a payload in memory
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Gets a payload block for fs and counts it as resident in fsdb
+*/
+int attach_payload( FSDB fsdb, FragSeqP fs ) {
+  char* payload;
+  payload = (char*)pool_get( &fs_payload_pool );
+  if ( payload == NULL ) {
+    return 0;
+  }
+  point_payload( fs, payload );
+  fs->id[0]   = '\0';
+  fs->desc[0] = '\0';
+  fs->seq[0]  = '\0';
+  fs->qual[0] = '\0';
+  if ( fsdb != NULL ) {
+    fsdb->num_resident++;
+  }
+  return 1;
+}
+
+/* detach_payload
+   Args: (1) FSDB fsdb - database fs belongs to, or NULL if it
+             does not belong to one
+         (2) FragSeqP fs
+   Returns: void
+   Gives the payload block of fs, if it has one in memory, back
+   to the pool. Used when fs is thrown out of fsdb.
+*/
+void detach_payload( FSDB fsdb, FragSeqP fs ) {
+  if ( fs->seq == NULL ) {
+    return;
+  }
+  pool_put( &fs_payload_pool, fs->id );
+  fs->id   = NULL;
+  fs->desc = NULL;
+  fs->seq  = NULL;
+  fs->qual = NULL;
+  if ( fsdb != NULL ) {
+    fsdb->num_resident--;
+  }
+}
+
+/* init_FragSeq
+   Args: void
+   Returns: FragSeqP with its own payload, not part of any FSDB,
+   or NULL if not enough memories
+*/
+FragSeqP init_FragSeq( void ) {
+  FragSeqP fs;
+  fs = (FragSeqP)save_malloc(sizeof(FragSeq));
+  if ( fs == NULL ) {
+    return NULL;
+  }
+  clear_payload( fs );
+  if ( !attach_payload( NULL, fs ) ) {
+    return NULL;
+  }
+  return fs;
+}
+
+/* free_FragSeq
+   Args: (1) FragSeqP fs - from init_FragSeq
+   Returns: void
+   Gives back fs and its payload
+*/
+void free_FragSeq( FragSeqP fs ) {
+  detach_payload( NULL, fs );
+  free( fs );
+}
+
+/* set_fsdb_mem_limit
+   Args: (1) FSDB fsdb
+         (2) size_t mem_limit - bytes allowed for the FragSeqs and
+	     their payloads; 0 means no limit
+	 (3) char* run_root - root name for the run file(s) where 
+	     payloads past the limit are spilled
+   Returns: void
+   Once fsdb is over the limit, the payload (id, desc, seq, and qual)
+   of each FragSeq added is written to the run file instead of being
+   kept in memory. The rest of the FragSeq (as, ae, score, etc.)
+   always stays in memory.
+*/
+void set_fsdb_mem_limit( FSDB fsdb, size_t mem_limit, char* run_root ) {
+  fsdb->mem_limit = mem_limit;
+  strcpy( fsdb->run_root, run_root );
+}
+
+/* fsdb_over_limit
+   Args: (1) FSDB fsdb
+   Returns: 1 if the FragSeqs and payloads in memory take more than
+   fsdb->mem_limit bytes; 0 if not, or if there is no limit
+*/
+static int fsdb_over_limit( FSDB fsdb ) {
+  if ( fsdb->mem_limit == 0 ) {
+    return 0;
+  }
+  return ( ((fsdb->num_fss * sizeof(FragSeq)) + 
+	    (fsdb->num_resident * FS_PAYLOAD_LEN)) > fsdb->mem_limit );
+}
+
+/* open_run_file
+   Args: (1) FSDB fsdb - with run_root set
+   Returns: FILE* to a new, empty run file. It is unlinked right 
+   away, so it goes away by itself when it is closed or we exit
+*/
+static FILE* open_run_file( FSDB fsdb ) {
+  char run_fn[MAX_FN_LEN + 1];
+  int fd;
+  FILE* run;
+  /* mkstemp needs all of the XXXXXX, so a cut off name won't do */
+  if ( snprintf( run_fn, sizeof(run_fn), "%s.fsdb.XXXXXX",
+		 fsdb->run_root ) >= (int)sizeof(run_fn) ) {
+    fprintf( stderr, "Run file name for spilling sequences is too long: %s.fsdb.XXXXXX\n",
+	     fsdb->run_root );
+    exit( 1 );
+  }
+  fd = mkstemp( run_fn );
+  if ( fd < 0 ) {
+    fprintf( stderr, "Cannot make run file %s for spilling sequences\n",
+	     run_fn );
+    exit( 1 );
+  }
+  unlink( run_fn );
+  run = fdopen( fd, "w+b" );
+  if ( run == NULL ) {
+    fprintf( stderr, "Cannot open run file %s for spilling sequences\n",
+	     run_fn );
+    exit( 1 );
+  }
+  return run;
+}
+
+/* spill_fs
+   Args: (1) FSDB fsdb - with mem_limit set
+         (2) FragSeqP fs - a FragSeq in fsdb with its payload in memory
+   Returns: void
+   Appends the payload of fs to the run file being written (next_run
+   during a pass, run otherwise), remembers where in fs->spill_pos, 
+   and gives the payload memory back. Only the used part of each
+   string is written.
+*/
+void spill_fs( FSDB fsdb, FragSeqP fs ) {
+  FILE* run;
+  size_t len[4];
+  if ( fsdb->next_run != NULL ) {
+    run = fsdb->next_run;
+  }
+  else {
+    if ( fsdb->run == NULL ) {
+      fsdb->run = open_run_file( fsdb );
+    }
+    run = fsdb->run;
+    fseek( run, 0, SEEK_END );
+  }
+  fs->spill_pos = ftell( run );
+  len[0] = strlen( fs->id );
+  len[1] = strlen( fs->desc );
+  len[2] = strlen( fs->seq );
+  len[3] = strlen( fs->qual );
+  if ( (fwrite( len, sizeof(size_t), 4, run ) != 4) ||
+       (fwrite( fs->id, 1, len[0], run ) != len[0]) ||
+       (fwrite( fs->desc, 1, len[1], run ) != len[1]) ||
+       (fwrite( fs->seq, 1, len[2], run ) != len[2]) ||
+       (fwrite( fs->qual, 1, len[3], run ) != len[3]) ) {
+    fprintf( stderr, "Cannot write to run file for spilling sequences\n" );
+    exit( 1 );
+  }
+  detach_payload( fsdb, fs );
+}
+
+/* load_fs
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - a FragSeq in fsdb
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Makes sure the payload of fs is in memory, reading it back from
+   the run file if it was spilled. Reading goes fastest when FragSeqs
+   are loaded in the same order they were spilled.
+*/
+int load_fs( FSDB fsdb, FragSeqP fs ) {
+  size_t len[4];
+  if ( fs->seq != NULL ) {
+    return 1;
+  }
+  if ( !attach_payload( fsdb, fs ) ) {
+    return 0;
+  }
+  if ( ftell( fsdb->run ) != fs->spill_pos ) {
+    fseek( fsdb->run, fs->spill_pos, SEEK_SET );
+  }
+  if ( (fread( len, sizeof(size_t), 4, fsdb->run ) != 4) ||
+       (fread( fs->id, 1, len[0], fsdb->run ) != len[0]) ||
+       (fread( fs->desc, 1, len[1], fsdb->run ) != len[1]) ||
+       (fread( fs->seq, 1, len[2], fsdb->run ) != len[2]) ||
+       (fread( fs->qual, 1, len[3], fsdb->run ) != len[3]) ) {
+    fprintf( stderr, "Cannot read back spilled sequence from run file\n" );
+    exit( 1 );
+  }
+  fs->id[len[0]]   = '\0';
+  fs->desc[len[1]] = '\0';
+  fs->seq[len[2]]  = '\0';
+  fs->qual[len[3]] = '\0';
+  return 1;
+}
+
+/* release_fs
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - a FragSeq in fsdb with its payload in memory
+   Returns: void
+   Says we are done with the payload of fs for now. If fsdb is over
+   its memory limit, the payload is spilled.
+*/
+void release_fs( FSDB fsdb, FragSeqP fs ) {
+  if ( fsdb_over_limit( fsdb ) ) {
+    spill_fs( fsdb, fs );
+  }
+}
+
+/* begin_fsdb_pass
+   Args: (1) FSDB fsdb
+   Returns: void
+   Starts a pass that will load_fs and release_fs every FragSeq in
+   fsdb->fss exactly once, in order. Payloads spilled during the pass
+   go to a fresh run file in that order, so the next pass in the same
+   order streams them back sequentially and the space of payloads no
+   longer needed is given back.
+*/
+void begin_fsdb_pass( FSDB fsdb ) {
+  if ( fsdb->run != NULL ) {
+    fsdb->next_run = open_run_file( fsdb );
+    rewind( fsdb->run );
+  }
+}
+
+/* end_fsdb_pass
+   Args: (1) FSDB fsdb
+   Returns: void
+   Finishes a pass started with begin_fsdb_pass; the run file written
+   during the pass replaces the old one
+*/
+void end_fsdb_pass( FSDB fsdb ) {
+  if ( fsdb->next_run != NULL ) {
+    fclose( fsdb->run );
+    fsdb->run = fsdb->next_run;
+    fsdb->next_run = NULL;
+  }
+}
+
 /* add_virgin_fs2fsdb
    Args: (1) FragSeqP fs - pointer to a "virgin" FragSeq
          (2) FSDB fsdb - database to add this FragSeq to
    Returns: 1 if success; 0 if failue (not enough memories)
    This function is only called from sg_align; the argument
    FragSeqP points to a FragSeq for which the following is
-   true: id, desc, as, ae, score, front_asp, back_asp,
+   true: id, desc, as, ae, score, asp,
    unique, and num_inputs are set to correct values.
    If trimmed is true, then this sequence is to be trimmed
    to the trim_point
@@ -193,7 +473,7 @@ int fs_comp_qscore ( const void* fs1_,
 */
 int add_virgin_fs2fsdb( FragSeqP fs, FSDB fsdb ) {
   int i, len, half_len;
-  char tmp_b, tmp_q;
+  char tmp_q;
 
   /* Trim it? */
   if ( fs->trimmed ) {
@@ -210,20 +490,12 @@ int add_virgin_fs2fsdb( FragSeqP fs, FSDB fsdb ) {
        fs->strand_known ) {
     len = fs->seq_len;
     half_len = len / 2;
+    revcom_seq( fs->seq, fs->seq, len );
     for ( i = 0; i < half_len; i++ ) {
-      tmp_b = fs->seq[i];
       tmp_q = fs->qual[i];
-      fs->seq[i] = revcom_char(fs->seq[len-(i+1)]);
-      fs->seq[len-(i+1)] = revcom_char(tmp_b);
       fs->qual[i] = fs->qual[len-(i+1)];
       fs->qual[len-(i+1)] = tmp_q;
     }
-    if ( len%2 == 1 ) {
-      /* Sequence length was odd, revcom the middle base;
-	 No need to adjust the quality score
-       */
-      fs->seq[half_len] = revcom_char(fs->seq[half_len]);
-    }
   }
 
   /* OK, now copy it over to fsdb */
@@ -253,9 +525,104 @@ void sort_fsdb_qscore( FSDB fsdb ) {
 }
 
 
+/* in_score_fit
+   Args: (1) FragSeqP fs
+   Returns: 1 if fs belongs in the length/score fit of its FSDB: it is
+   unique_best and has a sensible score as defined by
+   FIRST_ROUND_SCORE_CUTOFF. This is necessary in case the distant
+   reference option is used in which case we may have some total crap
+   sequences and scores that will screw up the fit. 0 if not
+*/
+static int in_score_fit( FragSeqP fs ) {
+  return ( fs->unique_best &&
+	   (fs->score >= FIRST_ROUND_SCORE_CUTOFF) );
+}
+
+/* reset_score_fit
+   Args: (1) FSDB fsdb
+   Returns: void
+   Empties the length/score fit of fsdb, so it can be made again
+   with fit_fs_score as the FragSeqs get their new scores
+*/
+void reset_score_fit( FSDB fsdb ) {
+  memset( &fsdb->fit, 0, sizeof(ScoreFit) );
+}
+
+/* fit_fs_score
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - with its current seq_len, score, and
+	     unique_best; must not be in the fit already
+   Returns: void
+   Adds fs to the length/score fit of fsdb if it belongs there
+*/
+void fit_fs_score( FSDB fsdb, FragSeqP fs ) {
+  ScoreFit* fit = &fsdb->fit;
+  double d_len;
+
+  if ( !in_score_fit( fs ) ) {
+    return;
+  }
+  fit->n++;
+  d_len = fs->seq_len - fit->mean_len;
+  fit->mean_len   += d_len / fit->n;
+  fit->mean_score += (fs->score - fit->mean_score) / fit->n;
+  fit->m2_len      += d_len * (fs->seq_len - fit->mean_len);
+  fit->c_len_score += d_len * (fs->score - fit->mean_score);
+
+  /* Is this the best score for this length? */
+  if ( (fit->len_count[fs->seq_len]++ == 0) ||
+       (fs->score > fit->max_score[fs->seq_len]) ) {
+    fit->max_score[fs->seq_len] = fs->score;
+    fit->max_count[fs->seq_len] = 1;
+  }
+  else if ( fs->score == fit->max_score[fs->seq_len] ) {
+    fit->max_count[fs->seq_len]++;
+  }
+}
+
+/* unfit_fs_score
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - with the seq_len and score it had when it
+	     was added to the fit
+   Returns: void
+   Takes fs back out of the length/score fit of fsdb, undoing
+   fit_fs_score
+*/
+static void unfit_fs_score( FSDB fsdb, FragSeqP fs ) {
+  ScoreFit* fit = &fsdb->fit;
+  double d_len, d_score;
+
+  if ( fit->n == 1 ) {
+    fit->n = 0;
+    fit->mean_len = 0;
+    fit->mean_score = 0;
+    fit->m2_len = 0;
+    fit->c_len_score = 0;
+  }
+  else {
+    /* Means without fs, then take out what fs added to the sums */
+    d_len   = fs->seq_len - fit->mean_len;
+    d_score = fs->score - fit->mean_score;
+    fit->n--;
+    fit->mean_len   -= d_len / fit->n;
+    fit->mean_score -= d_score / fit->n;
+    fit->m2_len      -= (fs->seq_len - fit->mean_len) * d_len;
+    fit->c_len_score -= (fs->seq_len - fit->mean_len) * d_score;
+  }
+
+  fit->len_count[fs->seq_len]--;
+  if ( fs->score == fit->max_score[fs->seq_len] ) {
+    fit->max_count[fs->seq_len]--;
+    if ( (fit->max_count[fs->seq_len] == 0) &&
+	 (fit->len_count[fs->seq_len] > 0) ) {
+      fit->max_stale = 1;
+    }
+  }
+}
+
 /* find_fsdb_score_cut
    Args: (1) FSDB fsdb - has valid data for seq_len, score, and
-             unique_best
+             unique_best, and an up to date fit (see fit_fs_score)
      (2) double* slope - pointer to slope to be calculated
      (3) double* intercept - pointer to intercept to be calc.
    Returns: void
@@ -265,91 +632,54 @@ void sort_fsdb_qscore( FSDB fsdb ) {
    That is, is determines the dependency of average score on the
    length of the sequence. This can then be used to determine
    what is an inappropriately scoring (for its length) alignment.
+   Everything needed is kept in fsdb->fit, so the FragSeqs are only
+   looked at again if the best score of some length has to be found
+   again (or in DEBUG mode).
 */
 void find_fsdb_score_cut( FSDB fsdb, double* slope, double* intercept ) {
-  /* Load up the lengths and scores of all unique guys that
-     had sensible scores as defined by FIRST_ROUND_SCORE_CUTOFF
-     This is necessary in case the distant reference option is
-     used in which case we may have some total crap sequences
-     and scores that will screw up the fit.  (This exact same loop is
-     repeated twice (three times in debug mode), the single pass
-     algorithm would be numerically unstable.)
-  */
+  ScoreFit* fit = &fsdb->fit;
   double slope_bf = 0, intercept_bf = 0; 
-  //  double slope_max = 0, intercept_max = 0;
   double slope_delta, max_slope_delta;
-  int max_sc_len[INIT_ALN_SEQ_LEN+1]; // place to put maximum 
-  // scores at each length
-  size_t j = 0, i ;
+  size_t i;
+  int len;
+  FragSeqP fs;
   FILE* LVSLOG;
-  /* Initialization */
-  double xbar = 0, ybar = 0 ;
-  for ( i = 0; i < (INIT_ALN_SEQ_LEN+1); i++ ) {
-    max_sc_len[i] = 0;
-  }
-
-  for ( i = 0; i < fsdb->num_fss; i++ ) {
-    if ( fsdb->fss[i]->unique_best &&
-	(fsdb->fss[i]->score >= FIRST_ROUND_SCORE_CUTOFF) ) {
-      xbar += fsdb->fss[i]->seq_len;
-      ybar += fsdb->fss[i]->score;
-      j++;
-      /* Is this the best score for this length? */
-      if ( fsdb->fss[i]->score > max_sc_len[fsdb->fss[i]->seq_len] ) {
-        max_sc_len[fsdb->fss[i]->seq_len] = fsdb->fss[i]->score;
-      }
-    }
-  }
-  xbar /= j ;
-  ybar /= j ;
-
-  double ssxy = 0, ssxx = 0 ;
-  for ( i = 0; i < fsdb->num_fss; i++ ) {
-    if ( fsdb->fss[i]->unique_best &&
-	(fsdb->fss[i]->score >= FIRST_ROUND_SCORE_CUTOFF) ) {
-      ssxy += (fsdb->fss[i]->seq_len - xbar) * (fsdb->fss[i]->score - ybar) ;
-      ssxx += (fsdb->fss[i]->seq_len - xbar) * (fsdb->fss[i]->seq_len - xbar) ;
-    }
-  }
-  slope_bf     = ssxy / ssxx ;
-  intercept_bf = ybar - slope_bf * xbar ;
 
+  slope_bf     = fit->c_len_score / fit->m2_len;
+  intercept_bf = fit->mean_score - slope_bf * fit->mean_len;
 
-  /* Now find the slope_max and intercept_max */
-  /*  xbar = 0;
-  ybar = 0;
-  j = 0;
-  for ( i = 0; i < (INIT_ALN_SEQ_LEN+1); i++ ) {
-    if ( max_sc_len[i] > 0 ) {
-      xbar += i;
-      ybar += max_sc_len[i];
-      j++;
+  /* Some length lost its only best scoring guy, so find the best
+     scores again */
+  if ( fit->max_stale ) {
+    for ( len = 0; len <= INIT_ALN_SEQ_LEN; len++ ) {
+      fit->max_count[len] = 0;
     }
-  }
-  xbar /= j;
-  ybar /= j;
-  
-  ssxy = 0;
-  ssxx = 0;
-  for ( i = 0; i < (INIT_ALN_SEQ_LEN+1); i++ ) {
-    if ( max_sc_len[i] > 0 ) {
-      ssxy += (i - xbar) * (max_sc_len[i] - ybar);
-      ssxx += (i - xbar) * (i - xbar);
+    for ( i = 0; i < fsdb->num_fss; i++ ) {
+      fs = fsdb->fss[i];
+      if ( in_score_fit( fs ) ) {
+	if ( (fit->max_count[fs->seq_len] == 0) ||
+	     (fs->score > fit->max_score[fs->seq_len]) ) {
+	  fit->max_score[fs->seq_len] = fs->score;
+	  fit->max_count[fs->seq_len] = 1;
+	}
+	else if ( fs->score == fit->max_score[fs->seq_len] ) {
+	  fit->max_count[fs->seq_len]++;
+	}
+      }
     }
+    fit->max_stale = 0;
   }
-  slope_max = (ssxy / ssxx);
-  intercept_max = ybar - slope_max * xbar;
-  */
 
+  /* The guy that is furthest above the line for his length is the
+     best scoring one of that length */
   max_slope_delta = 0;
-  for ( i = 0; i < fsdb->num_fss; i++ ) {
-    if ( fsdb->fss[i]->unique_best &&
-	 (fsdb->fss[i]->score >= FIRST_ROUND_SCORE_CUTOFF) ) {
-      slope_delta = ( fsdb->fss[i]->score - 
-		      ((slope_bf * fsdb->fss[i]->seq_len) + 
+  for ( len = 0; len <= INIT_ALN_SEQ_LEN; len++ ) {
+    if ( fit->len_count[len] > 0 ) {
+      slope_delta = ( fit->max_score[len] - 
+		      ((slope_bf * len) + 
 		       intercept_bf) ) 
 	/ 
-	fsdb->fss[i]->seq_len;
+	len;
       if ( slope_delta > max_slope_delta ) {
 	max_slope_delta = slope_delta;
       }
@@ -373,8 +703,7 @@ void find_fsdb_score_cut( FSDB fsdb, double* slope, double* intercept ) {
 	"# score = %0.4f + (length x %0.4f)\n",
 	*intercept, *slope );
     for ( i = 0; i < fsdb->num_fss; i++ ) {
-      if ( fsdb->fss[i]->unique_best &&
-	  (fsdb->fss[i]->score >= FIRST_ROUND_SCORE_CUTOFF) ) {
+      if ( in_score_fit( fsdb->fss[i] ) ) {
 	fprintf( LVSLOG, "%d\t%d\n", fsdb->fss[i]->seq_len, fsdb->fss[i]->score );
       }
     }
@@ -382,21 +711,52 @@ void find_fsdb_score_cut( FSDB fsdb, double* slope, double* intercept ) {
   }
 }
 
-/* write_fastq
-   Args: (1) char* fn
-         (2) FSDB fsdb
-   Returns: void
-   Writes a fastq database of sequences to the filename given of all
-   sequences and quality scores in the fsdb
+/* open_fastq
+   Args: (1) FastqJobP job - with fn and fsdb set
+         (2) int zip_threads - number of threads compressing the
+	     output if fn ends in .gz
+   Returns: 1 if success; 0 if job->fn cannot be written
+   Opens job->fn, as job->bw if it ends in .gz and as job->f if not.
+   This is done by the thread that starts the job, since only one
+   thread may allocate at a time
 */
-void write_fastq( char* fn, FSDB fsdb ) {
-  FILE* f;
+static int open_fastq( FastqJobP job, int zip_threads ) {
+  size_t fn_len;
+  job->f  = NULL;
+  job->bw = NULL;
+  fn_len = strlen( job->fn );
+  if ( (fn_len > 3) && (strcmp( &job->fn[fn_len - 3], ".gz" ) == 0) ) {
+    job->bw = bgzf_open( job->fn, zip_threads );
+    if ( job->bw == NULL ) {
+      fprintf( stderr, "Cannot write %s\n", job->fn );
+      return 0;
+    }
+  }
+  else {
+    job->f = fileOpen( job->fn, "w" );
+  }
+  return 1;
+}
+
+/* write_fastq_records
+   Args: (1) void* arg - FastqJobP opened by open_fastq
+   Returns: NULL
+   Writes every sequence of job->fsdb to job->f or job->bw, closes
+   it, and sets job->ok
+*/
+static void* write_fastq_records( void* arg ) {
+  FastqJobP job = (FastqJobP)arg;
+  FSDB fsdb = job->fsdb;
   char rc, tr;
+  char rec[FS_PAYLOAD_LEN + MAX_ID_LEN + 8]; // one fastq record
+  int rec_len, ok = 1;
   FragSeqP fs;
-  f = fileOpen( fn, "w" );
   size_t i;
+
+  begin_fsdb_pass( fsdb );
   for ( i = 0; i < fsdb->num_fss; i++ ) {
     fs = fsdb->fss[i];
+    load_fs( fsdb, fs );
     if (fs->rc) {
       rc = 'R';
     }
@@ -409,13 +769,91 @@ void write_fastq( char* fn, FSDB fsdb ) {
     else {
       tr = 'U';
     }
-    fprintf( f, "@%s %c %c\n", fs->id, rc, tr );
-    fprintf( f, "%s\n", fs->seq );
-    fprintf( f, "+%s\n", fs->id );
-    fprintf( f, "%s\n", fs->qual );
+    rec_len = sprintf( rec, "@%s %c %c\n%s\n+%s\n%s\n",
+		       fs->id, rc, tr, fs->seq, fs->id, fs->qual );
+    if ( job->bw != NULL ) {
+      ok = bgzf_write( job->bw, rec, rec_len ) && ok;
+    }
+    else {
+      fwrite( rec, 1, rec_len, job->f );
+    }
+    release_fs( fsdb, fs );
+  }
+  end_fsdb_pass( fsdb );
+  if ( job->bw != NULL ) {
+    ok = bgzf_close( job->bw ) && ok;
+  }
+  else {
+    ok = ( fclose( job->f ) == 0 ) && ok;
   }
-  fclose( f );
-  return;
+  if ( !ok ) {
+    fprintf( stderr, "Problem writing %s\n", job->fn );
+  }
+  job->ok = ok;
+  return NULL;
+}
+
+/* write_fastq
+   Args: (1) char* fn
+         (2) FSDB fsdb
+	 (3) int zip_threads - number of threads compressing the
+	     output if fn ends in .gz
+   Returns: 1 if success; 0 if fn could not be written
+   Writes a fastq database of sequences to the filename given of all
+   sequences and quality scores in the fsdb. If fn ends in .gz, it is
+   BGZF compressed
+*/
+int write_fastq( char* fn, FSDB fsdb, int zip_threads ) {
+  return finish_write_fastq( start_write_fastq( fn, fsdb, zip_threads, 0 ) );
+}
+
+/* start_write_fastq
+   Args: (1) char* fn
+         (2) FSDB fsdb
+	 (3) int zip_threads - as for write_fastq
+	 (4) int background - Boolean, TRUE means write it in its own
+	     thread if that can be done
+   Returns: FastqJobP to give to finish_write_fastq
+   Starts write_fastq, in its own thread if background, so something
+   else (the maln file) can be written meanwhile. Nothing may change
+   fsdb until finish_write_fastq. If fsdb has a memory limit, its
+   payloads are loaded from and spilled to the run file as it is
+   written, which allocates, so then it is written here and now.
+*/
+FastqJobP start_write_fastq( char* fn, FSDB fsdb, int zip_threads,
+			     int background ) {
+  FastqJobP job;
+  job = (FastqJobP)save_malloc( sizeof(FastqJob) );
+  strcpy( job->fn, fn );
+  job->fsdb = fsdb;
+  job->threaded = 0;
+  job->ok = 0;
+  if ( !open_fastq( job, zip_threads ) ) {
+    return job;
+  }
+  if ( background && (fsdb->mem_limit == 0) &&
+       (pthread_create( &job->thread, NULL, write_fastq_records, job ) == 0) ) {
+    job->threaded = 1;
+  }
+  else {
+    write_fastq_records( job );
+  }
+  return job;
+}
+
+/* finish_write_fastq
+   Args: (1) FastqJobP job - from start_write_fastq
+   Returns: 1 if all of the fastq was written; 0 if not
+   Waits for the write to be done and frees job
+*/
+int finish_write_fastq( FastqJobP job ) {
+  int ok;
+  if ( job->threaded ) {
+    pthread_join( job->thread, NULL );
+  }
+  ok = job->ok;
+  free( job );
+  return ok;
 }
 
 /* set_uniq_in_fsdb
@@ -432,19 +870,26 @@ void write_fastq( char* fn, FSDB fsdb ) {
    Returns: void
    Goes through each sequence and the sets the unique_best flag
    to true for the first of each kind (same as, ae, and rc) and
-   sets unique_best to false for all others
+   sets unique_best to false for all others. Sequences that were
+   not realigned this iteration (realign is FALSE) have stale
+   coordinates, so they are left out and keep their unique_best
 */
 void set_uniq_in_fsdb( FSDB fsdb, const int just_outer_coords ) {
-  int i, curr_rc, curr_as, curr_ae;
+  size_t i;
+  int curr_rc, curr_as, curr_ae;
+  int was_fit; // Boolean, TRUE means fs was in the length/score fit
   FragSeqP fs;
-  fs = fsdb->fss[0];
-  /* initialize */
-  curr_rc = fs->rc;
-  curr_as = fs->as;
-  curr_ae = fs->ae;
-  fs->unique_best = 1;
-  for ( i = 1; i < fsdb->num_fss; i++ ) {
+  /* initialize; no sequence has these coordinates, so the first
+     one looked at is always a unique best */
+  curr_rc = -1;
+  curr_as = -1;
+  curr_ae = -1;
+  for ( i = 0; i < fsdb->num_fss; i++ ) {
     fs = fsdb->fss[i];
+    if ( !fs->realign ) {
+      continue;
+    }
+    was_fit = in_score_fit( fs );
 
     /* If new guy is same as last guy, on strand, start, and end,
        he's redundant (not unique) */
@@ -501,98 +946,32 @@ void set_uniq_in_fsdb( FSDB fsdb, const int just_outer_coords ) {
       curr_as = fs->as;
       curr_ae = fs->ae;
     }
+
+    /* Keep the length/score fit up to date */
+    if ( was_fit && !in_score_fit( fs ) ) {
+      unfit_fs_score( fsdb, fs );
+    }
+    if ( !was_fit && in_score_fit( fs ) ) {
+      fit_fs_score( fsdb, fs );
+    }
   }
 }
 
 
-/* pop_smp_from_FSDB
-   Args: (1) FSDB fsdb with valid data
-         (2) Depth of PSSM matrices
+/* realign_all_fsdb
+   Args: (1) FSDB fsdb
    Returns: void
-   Goes through all the AlnSeqs in the fsdb->fss array. Follows
-   the front_asp (and back_asp, if necessary) pointer to populate
-   the smp field of all AlnSeqs with the correct code for what
-   depth in the PSSM matrix to use for consensus calling */
-void pop_smp_from_FSDB( FSDB fsdb, int depth ) {
-  int i, aln_seq_pos, front_seq_len, back_seq_len,
-    distance_from_front,
-    distance_from_back,
-    aln_seq_len;
-  int act_seq_pos = 0;
-  AlnSeqP front_asp, back_asp;
-
+   Sets the realign flag of every FragSeq so that the next
+   iteration realigns all of them, including any that have been
+   carried forward
+*/
+void realign_all_fsdb( FSDB fsdb ) {
+  size_t i;
   for ( i = 0; i < fsdb->num_fss; i++ ) {
-    front_asp = fsdb->fss[i]->front_asp;
-    back_asp  = fsdb->fss[i]->back_asp;
-    act_seq_pos = 0;
-    front_seq_len = asp_len( front_asp );
-    if ( back_asp != NULL ) {
-      back_seq_len  = asp_len( back_asp );
-    }
-    else {
-      back_seq_len = 0;
-    }
-
-    /* First, fill in the front_asp->smp array */
-    aln_seq_len = front_asp->end - front_asp->start + 1;
-    for( aln_seq_pos = 0; aln_seq_pos < aln_seq_len; aln_seq_pos++ ) {
-      if ( front_asp->ins[aln_seq_pos] != NULL ) {
-	act_seq_pos += strlen( front_asp->ins[aln_seq_pos] );
-      }
-      distance_from_front = act_seq_pos;
-      distance_from_back  = (front_seq_len + back_seq_len) -
-	act_seq_pos - 1;
-
-      if ( distance_from_front <= depth ) {
-	front_asp->smp[aln_seq_pos] = ('A'+distance_from_front);
-      }
-      else {
-	if ( distance_from_back < depth ) {
-	  front_asp->smp[aln_seq_pos] = ('A'+(depth*2)-distance_from_back);
-	}
-	else {
-	  front_asp->smp[aln_seq_pos] = ('A' + depth);
-	}
-      }
-
-      if ( front_asp->seq[aln_seq_pos] != '-' ) {
-	act_seq_pos++;
-      }
-    }
-    front_asp->smp[aln_seq_pos] = '\0';
-
-    /* Then, fill in the back_asp->smp array */
-    if ( back_asp != NULL ) {
-      aln_seq_len = back_asp->end - back_asp->start + 1;
-      for( aln_seq_pos = 0; aln_seq_pos < aln_seq_len; aln_seq_pos++ ) {
-	if ( back_asp->ins[aln_seq_pos] != NULL ) {
-	  act_seq_pos += strlen( back_asp->ins[aln_seq_pos] );
-	}
-	distance_from_front = (front_seq_len + act_seq_pos);
-	distance_from_back = (front_seq_len + back_seq_len) -
-	  act_seq_pos - 1;
-	if ( distance_from_front <= depth ) {
-	  back_asp->smp[aln_seq_pos] = ('A' + distance_from_front);
-	}
-	else {
-	  if ( distance_from_back < depth ) {
-	    back_asp->smp[aln_seq_pos] = ('A'+(depth*2)-distance_from_back);
-	  }
-	  else {
-	    back_asp->smp[aln_seq_pos] = ('A' + depth);
-	  }
-	}
-
-	if ( back_asp->seq[aln_seq_pos] != '-' ) {
-	  act_seq_pos++;
-	}
-      }
-      back_asp->smp[aln_seq_pos] = '\0';
-    }
+    fsdb->fss[i]->realign = 1;
   }
 }
 
-
 /* add_fs2fsdb
    Args: (1) FragSeqP fs - pointer to a fully valid FragSeq
          (2) FSdb fsdb - database to add this FragSeq to
@@ -609,8 +988,14 @@ int add_fs2fsdb( FragSeqP fs, FSDB fsdb ) {
     }
   }
 
-  /* Get a pointer to the next available FragSeq */
+  /* Get a pointer to the next available FragSeq and give it
+     a payload if it has never been used */
   next_fs = fsdb->fss[fsdb->num_fss];
+  if ( next_fs->seq == NULL ) {
+    if ( !attach_payload( fsdb, next_fs ) ) {
+      return 0;
+    }
+  }
 
   /* Copy over the input fs into next_fs */
   strcpy( next_fs->id, fs->id );
@@ -626,13 +1011,18 @@ int add_fs2fsdb( FragSeqP fs, FSDB fsdb ) {
   next_fs->as         = fs->as;
   next_fs->ae         = fs->ae;
   next_fs->score      = fs->score;
-  next_fs->front_asp  = fs->front_asp;
-  next_fs->back_asp   = fs->back_asp;
+  next_fs->asp        = fs->asp;
   next_fs->unique_best = fs->unique_best;
+  next_fs->realign     = 1;
   next_fs->num_inputs  = fs->num_inputs;
   next_fs->qss = NULL;
   /* Bump up the num_fss */
   fsdb->num_fss += 1;
+  fit_fs_score( fsdb, next_fs );
+
+  /* Spill this new guy's payload right away if we're now over
+     the memory limit */
+  release_fs( fsdb, next_fs );
   return 1;
 }
 
@@ -648,7 +1038,7 @@ int add_fs2fsdb( FragSeqP fs, FSDB fsdb ) {
    The old fsdb->fss array is freed
 */
 int grow_FSDB( FSDB fsdb ) {
-  int i, j, new_size;
+  size_t i, j, new_size;
   FragSeqP first_seq;
   FragSeqP* new_fss;
 
@@ -656,8 +1046,8 @@ int grow_FSDB( FSDB fsdb ) {
 
   /* DEBUG INFO */
   if ( DEBUG ) {
-    fprintf( stderr, "Growing fsdb from %d to %d\n",
-	     fsdb->size, new_size );
+    fprintf( stderr, "Growing fsdb from %lu to %lu\n",
+	     (unsigned long)fsdb->size, (unsigned long)new_size );
   }
 
   /* Allocate another chunck of memories as big as the
@@ -685,6 +1075,7 @@ int grow_FSDB( FSDB fsdb ) {
   j = 0;
   for( i = fsdb->size; i < new_size; i++ ) {
     new_fss[i] = &first_seq[j++];
+    clear_payload( new_fss[i] );
   }
 
   /* Now, free the old fsdb->fss and slot in the new one */
@@ -726,11 +1117,142 @@ FSDB init_FSDB ( void ) {
 
   for ( i = 0; i < INIT_NUM_ALN_SEQS; i++ ) {
     fsdb->fss[i] = &first_seq[i];
+    clear_payload( fsdb->fss[i] );
   }
 
   fsdb->size = INIT_NUM_ALN_SEQS;
   fsdb->num_fss = 0;
+  fsdb->mem_limit = 0;
+  fsdb->num_resident = 0;
+  fsdb->run = NULL;
+  fsdb->next_run = NULL;
+  fsdb->run_root[0] = '\0';
+  reset_score_fit( fsdb );
 
   return fsdb;
 }
 
+/* init_read_set
+   Args: void
+   Returns: ReadSetP with no sequences in it, or NULL if not enough
+   memories
+*/
+ReadSetP init_read_set( void ) {
+  ReadSetP rs;
+  rs = (ReadSetP)save_malloc(sizeof(ReadSet));
+  if ( rs == NULL ) {
+    return NULL;
+  }
+  rs->buf = (char*)save_malloc(INIT_READ_SET_LEN * sizeof(char));
+  rs->reads = (ReadInfo*)save_malloc(INIT_NUM_ALN_SEQS * sizeof(ReadInfo));
+  if ( (rs->buf == NULL) || (rs->reads == NULL) ) {
+    return NULL;
+  }
+  rs->buf_size = INIT_READ_SET_LEN;
+  rs->buf_len = 0;
+  rs->size = INIT_NUM_ALN_SEQS;
+  rs->num_reads = 0;
+  return rs;
+}
+
+/* add_read
+   Args: (1) ReadSetP rs
+         (2) FragSeqP fs - as it was read, and trimmed if wanted
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Copies the id, desc, seq, and qual of fs, and what the reader
+   and trimmer set, to the end of rs, growing it if necessary
+*/
+int add_read( ReadSetP rs, FragSeqP fs ) {
+  size_t id_len, desc_len, seq_len, qual_len, need, new_size;
+  char* new_buf;
+  ReadInfo* new_reads;
+  ReadInfo* ri;
+
+  id_len   = strlen( fs->id ) + 1;
+  desc_len = strlen( fs->desc ) + 1;
+  seq_len  = strlen( fs->seq ) + 1;
+  qual_len = strlen( fs->qual ) + 1;
+  need = id_len + desc_len + seq_len + qual_len;
+
+  if ( rs->buf_len + need > rs->buf_size ) {
+    new_size = rs->buf_size * 2;
+    while ( rs->buf_len + need > new_size ) {
+      new_size *= 2;
+    }
+    new_buf = (char*)save_malloc(new_size * sizeof(char));
+    if ( new_buf == NULL ) {
+      return 0;
+    }
+    memcpy( new_buf, rs->buf, rs->buf_len );
+    free( rs->buf );
+    rs->buf = new_buf;
+    rs->buf_size = new_size;
+  }
+  if ( rs->num_reads == rs->size ) {
+    new_reads = (ReadInfo*)save_malloc(2 * rs->size * sizeof(ReadInfo));
+    if ( new_reads == NULL ) {
+      return 0;
+    }
+    memcpy( new_reads, rs->reads, rs->num_reads * sizeof(ReadInfo) );
+    free( rs->reads );
+    rs->reads = new_reads;
+    rs->size *= 2;
+  }
+
+  ri = &rs->reads[rs->num_reads];
+  ri->off        = rs->buf_len;
+  ri->seq_len    = fs->seq_len;
+  ri->qual_sum   = fs->qual_sum;
+  ri->trimmed    = fs->trimmed;
+  ri->trim_point = fs->trim_point;
+  memcpy( &rs->buf[rs->buf_len], fs->id, id_len );
+  rs->buf_len += id_len;
+  memcpy( &rs->buf[rs->buf_len], fs->desc, desc_len );
+  rs->buf_len += desc_len;
+  memcpy( &rs->buf[rs->buf_len], fs->seq, seq_len );
+  rs->buf_len += seq_len;
+  memcpy( &rs->buf[rs->buf_len], fs->qual, qual_len );
+  rs->buf_len += qual_len;
+  rs->num_reads++;
+  return 1;
+}
+
+/* get_read
+   Args: (1) ReadSetP rs
+         (2) size_t i - which sequence of rs, in the order added
+	 (3) FragSeqP fs - with a payload, to put it in
+   Returns: 1 if success; 0 if rs has no sequence i
+   Puts sequence i of rs into fs as add_read got it
+*/
+int get_read( ReadSetP rs, size_t i, FragSeqP fs ) {
+  const char* p;
+  ReadInfo* ri;
+  if ( i >= rs->num_reads ) {
+    return 0;
+  }
+  ri = &rs->reads[i];
+  p = &rs->buf[ri->off];
+  strcpy( fs->id, p );
+  p += strlen( p ) + 1;
+  strcpy( fs->desc, p );
+  p += strlen( p ) + 1;
+  strcpy( fs->seq, p );
+  p += strlen( p ) + 1;
+  strcpy( fs->qual, p );
+  fs->seq_len    = ri->seq_len;
+  fs->qual_sum   = ri->qual_sum;
+  fs->trimmed    = ri->trimmed;
+  fs->trim_point = ri->trim_point;
+  return 1;
+}
+
+/* free_read_set
+   Args: (1) ReadSetP rs
+   Returns: void
+*/
+void free_read_set( ReadSetP rs ) {
+  free( rs->buf );
+  free( rs->reads );
+  free( rs );
+}
+
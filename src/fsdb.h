@@ -34,13 +34,116 @@ extern "C" {
 
   int fs_comp_qscore ( const void* fs1_,
 		       const void* fs2_ );
+/* clear_payload
+   Args: (1) FragSeqP fs - a FragSeq that has no payload
+   Returns: void
+   Sets up fs to have no payload in memory and none spilled
+*/
+  void clear_payload( FragSeqP fs );
+
+/* attach_payload
+   Args: (1) FSDB fsdb - database fs belongs to, or NULL if it
+             does not belong to one
+         (2) FragSeqP fs - FragSeq without a payload in memory
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Gets a payload block for fs and counts it as resident in fsdb
+*/
+  int attach_payload( FSDB fsdb, FragSeqP fs );
+
+/* detach_payload
+   Args: (1) FSDB fsdb - database fs belongs to, or NULL if it
+             does not belong to one
+         (2) FragSeqP fs
+   Returns: void
+   Gives the payload block of fs, if it has one in memory, back
+   to the pool. Used when fs is thrown out of fsdb.
+*/
+  void detach_payload( FSDB fsdb, FragSeqP fs );
+
+/* init_FragSeq
+   Args: void
+   Returns: FragSeqP with its own payload, not part of any FSDB,
+   or NULL if not enough memories
+*/
+  FragSeqP init_FragSeq( void );
+
+/* free_FragSeq
+   Args: (1) FragSeqP fs - from init_FragSeq
+   Returns: void
+   Gives back fs and its payload
+*/
+  void free_FragSeq( FragSeqP fs );
+
+/* set_fsdb_mem_limit
+   Args: (1) FSDB fsdb
+         (2) size_t mem_limit - bytes allowed for the FragSeqs and
+	     their payloads; 0 means no limit
+	 (3) char* run_root - root name for the run file(s) where 
+	     payloads past the limit are spilled
+   Returns: void
+   Once fsdb is over the limit, the payload (id, desc, seq, and qual)
+   of each FragSeq added is written to the run file instead of being
+   kept in memory. The rest of the FragSeq (as, ae, score, etc.)
+   always stays in memory.
+*/
+  void set_fsdb_mem_limit( FSDB fsdb, size_t mem_limit, char* run_root );
+
+/* spill_fs
+   Args: (1) FSDB fsdb - with mem_limit set
+         (2) FragSeqP fs - a FragSeq in fsdb with its payload in memory
+   Returns: void
+   Appends the payload of fs to the run file being written (next_run
+   during a pass, run otherwise), remembers where in fs->spill_pos, 
+   and gives the payload memory back. Only the used part of each
+   string is written.
+*/
+  void spill_fs( FSDB fsdb, FragSeqP fs );
+
+/* load_fs
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - a FragSeq in fsdb
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Makes sure the payload of fs is in memory, reading it back from
+   the run file if it was spilled. Reading goes fastest when FragSeqs
+   are loaded in the same order they were spilled.
+*/
+  int load_fs( FSDB fsdb, FragSeqP fs );
+
+/* release_fs
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - a FragSeq in fsdb with its payload in memory
+   Returns: void
+   Says we are done with the payload of fs for now. If fsdb is over
+   its memory limit, the payload is spilled.
+*/
+  void release_fs( FSDB fsdb, FragSeqP fs );
+
+/* begin_fsdb_pass
+   Args: (1) FSDB fsdb
+   Returns: void
+   Starts a pass that will load_fs and release_fs every FragSeq in
+   fsdb->fss exactly once, in order. Payloads spilled during the pass
+   go to a fresh run file in that order, so the next pass in the same
+   order streams them back sequentially and the space of payloads no
+   longer needed is given back.
+*/
+  void begin_fsdb_pass( FSDB fsdb );
+
+/* end_fsdb_pass
+   Args: (1) FSDB fsdb
+   Returns: void
+   Finishes a pass started with begin_fsdb_pass; the run file written
+   during the pass replaces the old one
+*/
+  void end_fsdb_pass( FSDB fsdb );
+
 /* add_virgin_fs2fsdb
    Args: (1) FragSeqP fs - pointer to a "virgin" FragSeq
          (2) FSDB fsdb - database to add this FragSeq to
    Returns: 1 if success; 0 if failue (not enough memories)
    This function is only called from sg_align; the argument
    FragSeqP points to a FragSeq for which the following is
-   true: id, desc, as, ae, score, front_asp, back_asp and
+   true: id, desc, as, ae, score, asp and
    unique are set to correct values.
    If trimmed is true, then this sequence is to be trimmed
    to the trim_point
@@ -61,9 +164,26 @@ extern "C" {
   void sort_fsdb_qscore( FSDB fsdb );
 
 
+/* reset_score_fit
+   Args: (1) FSDB fsdb
+   Returns: void
+   Empties the length/score fit of fsdb, so it can be made again
+   with fit_fs_score as the FragSeqs get their new scores
+*/
+  void reset_score_fit( FSDB fsdb ) ;
+
+/* fit_fs_score
+   Args: (1) FSDB fsdb
+         (2) FragSeqP fs - with its current seq_len, score, and
+	     unique_best; must not be in the fit already
+   Returns: void
+   Adds fs to the length/score fit of fsdb if it belongs there
+*/
+  void fit_fs_score( FSDB fsdb, FragSeqP fs ) ;
+
 /* find_fsdb_score_cut
    Args: (1) FSDB fsdb - has valid data for seq_len, score, and
-             unique_best
+             unique_best, and an up to date fit (see fit_fs_score)
      (2) double* slope - pointer to slope to be calculated
      (3) double* intercept - pointer to intercept to be calc.
    Returns: void
@@ -73,17 +193,46 @@ extern "C" {
    That is, is determines the dependency of average score on the
    length of the sequence. This can then be used to determine
    what is an inappropriately scoring (for its length) alignment.
+   Everything needed is kept in fsdb->fit, so the FragSeqs are only
+   looked at again if the best score of some length has to be found
+   again (or in DEBUG mode).
 */
   void find_fsdb_score_cut( FSDB fsdb, double* slope, double* intercept ) ;
   
 /* write_fastq
    Args: (1) char* fn
          (2) FSDB fsdb
-   Returns: void
+	 (3) int zip_threads - number of threads compressing the
+	     output if fn ends in .gz
+   Returns: 1 if success; 0 if fn could not be written
    Writes a fastq database of sequences to the filename given of all
-   sequences and quality scores in the fsdb
+   sequences and quality scores in the fsdb. If fn ends in .gz, it is
+   BGZF compressed
+*/
+  int write_fastq( char* fn, FSDB fsdb, int zip_threads );
+
+/* start_write_fastq
+   Args: (1) char* fn
+         (2) FSDB fsdb
+	 (3) int zip_threads - as for write_fastq
+	 (4) int background - Boolean, TRUE means write it in its own
+	     thread if that can be done
+   Returns: FastqJobP to give to finish_write_fastq
+   Starts write_fastq, in its own thread if background, so something
+   else (the maln file) can be written meanwhile. Nothing may change
+   fsdb until finish_write_fastq. If fsdb has a memory limit, its
+   payloads are loaded from and spilled to the run file as it is
+   written, which allocates, so then it is written here and now.
+*/
+  FastqJobP start_write_fastq( char* fn, FSDB fsdb, int zip_threads,
+			       int background );
+
+/* finish_write_fastq
+   Args: (1) FastqJobP job - from start_write_fastq
+   Returns: 1 if all of the fastq was written; 0 if not
+   Waits for the write to be done and frees job
 */
-  void write_fastq( char* fn, FSDB fsdb );
+  int finish_write_fastq( FastqJobP job );
 
 
 /* set_uniq_in_fsdb
@@ -100,20 +249,21 @@ extern "C" {
    Returns: void
    Goes through each sequence and the sets the unique_best flag
    to true for the first of each kind (same as, ae, and rc) and
-   sets unique_best to false for all others
+   sets unique_best to false for all others. Sequences that were
+   not realigned this iteration (realign is FALSE) have stale
+   coordinates, so they are left out and keep their unique_best
 */
 
   void set_uniq_in_fsdb( FSDB fsdb, const int just_outer_coords ) ;
 
-/* pop_smp_from_FSDB
-   Args: (1) FSDB fsdb with valid data
-         (2) Depth of PSSM matrices
+/* realign_all_fsdb
+   Args: (1) FSDB fsdb
    Returns: void
-   Goes through all the AlnSeqs in the fsdb->fss array. Follows
-   the front_asp (and back_asp, if necessary) pointer to populate
-   the smp field of all AlnSeqs with the correct code for what
-   depth in the PSSM matrix to use for consensus calling */
-void pop_smp_from_FSDB( FSDB fsdb, int depth ) ;
+   Sets the realign flag of every FragSeq so that the next
+   iteration realigns all of them, including any that have been
+   carried forward
+*/
+  void realign_all_fsdb( FSDB fsdb ) ;
 
 /* add_fs2fsdb
    Args: (1) FragSeqP fs - pointer to a fully valid FragSeq
@@ -145,6 +295,37 @@ int grow_FSDB( FSDB fsdb ) ;
 */
 FSDB init_FSDB ( void );
 
+/* init_read_set
+   Args: void
+   Returns: ReadSetP with no sequences in it, or NULL if not enough
+   memories
+*/
+ReadSetP init_read_set( void );
+
+/* add_read
+   Args: (1) ReadSetP rs
+         (2) FragSeqP fs - as it was read, and trimmed if wanted
+   Returns: 1 if success; 0 if failure (not enough memories)
+   Copies the id, desc, seq, and qual of fs, and what the reader
+   and trimmer set, to the end of rs, growing it if necessary
+*/
+int add_read( ReadSetP rs, FragSeqP fs );
+
+/* get_read
+   Args: (1) ReadSetP rs
+         (2) size_t i - which sequence of rs, in the order added
+	 (3) FragSeqP fs - with a payload, to put it in
+   Returns: 1 if success; 0 if rs has no sequence i
+   Puts sequence i of rs into fs as add_read got it
+*/
+int get_read( ReadSetP rs, size_t i, FragSeqP fs );
+
+/* free_read_set
+   Args: (1) ReadSetP rs
+   Returns: void
+*/
+void free_read_set( ReadSetP rs );
+
 
 
 
@@ -6,16 +6,21 @@
             this is:
 	    0 => fasta
 	    1 => fastq
+	    2 => read cache; read_cache_header must be called next
    Resets the input FILE pointer to the beginning of the file
 */
 int find_input_type( FILE * FF ) {
-  char c;
+  int c;
   c = fgetc( FF );
   ungetc( c, FF );  
   if ( c == '@' ) {
     return 1;
   }
 
+  if ( c == (unsigned char)READ_CACHE_MAGIC[0] ) {
+    return 2;
+  }
+
   if ( c == '>' ) {
     return 0;
   }
@@ -39,6 +44,10 @@ int read_next_seq( FILE * FF, FragSeqP frag_seq, int seq_code ) {
   if ( seq_code == 1 ) {
     return read_fastq( FF, frag_seq );
   }
+  if ( seq_code == 2 ) {
+    return read_cache_seq( FF, frag_seq );
+  }
+  return 0;
 }
 
 /* read_fastq
@@ -103,12 +112,12 @@ int read_fastq ( FILE * fastq, FragSeqP frag_seq ) {
       ;
     }
     else {
-      c = toupper( c );
       frag_seq->seq[i++] = c;
     }
     c = fgetc( fastq );
   }
   frag_seq->seq[i] = '\0';
+  upcase_seq( frag_seq->seq, i );
   frag_seq->seq_len = i;
   /* If the reading stopped because the sequence was longer than
      INIT_ALN_SEQ_LEN, then we need to advance the file pointer
@@ -176,7 +185,7 @@ int read_fastq ( FILE * fastq, FragSeqP frag_seq ) {
    This assumes that quality scores are represented as the 
    ASCII code + 64
 */
-inline int calc_qual_sum( const char* qual_str ) {
+int calc_qual_sum( const char* qual_str ) {
   size_t i, len;
   int qual_sum = 0;
 
@@ -205,6 +214,7 @@ int read_fasta ( FILE * fasta, FragSeqP frag_seq ) {
   /* No quality scores, so initialize this to keep
      stupid valgrind from stupid complaining */
   frag_seq->qual[0] = '\0';
+  frag_seq->qual_sum = 0;
 
   // get id
   i = 0;
@@ -252,12 +262,12 @@ int read_fasta ( FILE * fasta, FragSeqP frag_seq ) {
       ;
     }
     else {
-      c = toupper( c );
       frag_seq->seq[i++] = c;
     }
     c = fgetc( fasta );
   }
   frag_seq->seq[i] = '\0';
+  upcase_seq( frag_seq->seq, i );
 
   frag_seq->seq_len = i;
 
@@ -284,7 +294,290 @@ int read_fasta ( FILE * fasta, FragSeqP frag_seq ) {
   return 1;
 }
 
+/* put_u16, get_u16
+   Read cache numbers are written low byte first, whatever the
+   machine. get_u16 returns -1 at EOF
+*/
+static void put_u16( FILE* CF, unsigned int n ) {
+  fputc( n & 0xff, CF );
+  fputc( (n >> 8) & 0xff, CF );
+}
+
+static int get_u16( FILE* CF ) {
+  int lo, hi;
+  lo = fgetc( CF );
+  hi = fgetc( CF );
+  if ( (lo == EOF) || (hi == EOF) ) {
+    return -1;
+  }
+  return lo | (hi << 8);
+}
+
+/* write_cache_header
+   Args: (1) FILE* CF - read cache file, just opened for writing
+         (2) int trimmed - Boolean, TRUE means the sequences written
+	     to it are adapter trimmed
+	 (3) const char* adapter - the adapter they are trimmed of
+   Returns: void
+*/
+void write_cache_header( FILE* CF, int trimmed, const char* adapter ) {
+  size_t adapt_len;
+  adapt_len = trimmed ? strlen( adapter ) : 0;
+  fwrite( READ_CACHE_MAGIC, 1, READ_CACHE_MAGIC_LEN, CF );
+  fputc( READ_CACHE_VERSION, CF );
+  fputc( trimmed, CF );
+  put_u16( CF, adapt_len );
+  fwrite( adapter, 1, adapt_len, CF );
+}
+
+/* read_cache_header
+   Args: (1) FILE* CF - read cache file, just opened for reading
+         (2) int* trimmed - set as it was given to write_cache_header
+	 (3) char* adapter - room for INIT_ALN_SEQ_LEN+1 chars; set to
+	     the adapter the sequences are trimmed of, if trimmed
+   Returns: 1 if success; 0 if CF is not a read cache this version
+   of mia can read
+*/
+int read_cache_header( FILE* CF, int* trimmed, char* adapter ) {
+  char magic[READ_CACHE_MAGIC_LEN];
+  int adapt_len;
+  if ( (fread( magic, 1, READ_CACHE_MAGIC_LEN, CF ) != READ_CACHE_MAGIC_LEN) ||
+       (memcmp( magic, READ_CACHE_MAGIC, READ_CACHE_MAGIC_LEN ) != 0) ||
+       (fgetc( CF ) != READ_CACHE_VERSION) ) {
+    fprintf( stderr, "Not a read cache from this version of mia\n" );
+    return 0;
+  }
+  *trimmed = fgetc( CF );
+  adapt_len = get_u16( CF );
+  if ( (*trimmed == EOF) || (adapt_len < 0) ||
+       (adapt_len > INIT_ALN_SEQ_LEN) ||
+       (fread( adapter, 1, adapt_len, CF ) != adapt_len) ) {
+    fprintf( stderr, "Read cache header is cut off\n" );
+    return 0;
+  }
+  adapter[adapt_len] = '\0';
+  return 1;
+}
+
+/* write_cache_seq
+   Args: (1) FILE* CF - read cache file, after its header
+         (2) FragSeqP fs - as it was read, and trimmed if wanted
+   Returns: void
+   Writes the id, desc, seq, qual, and trimming of fs. A, C, G, and T
+   take 2 bits each; the position and character of anything else is
+   written after them
+*/
+void write_cache_seq( FILE* CF, FragSeqP fs ) {
+  size_t id_len, desc_len;
+  int i, num_other = 0;
+  unsigned char packed = 0;
+  id_len = strlen( fs->id );
+  desc_len = strlen( fs->desc );
+  for( i = 0; i < fs->seq_len; i++ ) {
+    if ( strchr( "ACGT", fs->seq[i] ) == NULL ) {
+      num_other++;
+    }
+  }
+
+  fputc( id_len, CF );
+  fputc( desc_len, CF );
+  put_u16( CF, fs->seq_len );
+  put_u16( CF, num_other );
+  fputc( (fs->trimmed ? 1 : 0) | ((fs->qual[0] != '\0') ? 2 : 0), CF );
+  put_u16( CF, fs->trimmed ? fs->trim_point + 1 : 0 );
+  fwrite( fs->id, 1, id_len, CF );
+  fwrite( fs->desc, 1, desc_len, CF );
+
+  for( i = 0; i < fs->seq_len; i++ ) {
+    switch( fs->seq[i] ) {
+    case 'C' :
+      packed |= 1 << (2 * (i % 4));
+      break;
+    case 'G' :
+      packed |= 2 << (2 * (i % 4));
+      break;
+    case 'T' :
+      packed |= 3 << (2 * (i % 4));
+      break;
+    }
+    if ( (i % 4 == 3) || (i == fs->seq_len - 1) ) {
+      fputc( packed, CF );
+      packed = 0;
+    }
+  }
+  for( i = 0; i < fs->seq_len; i++ ) {
+    if ( strchr( "ACGT", fs->seq[i] ) == NULL ) {
+      put_u16( CF, i );
+      fputc( fs->seq[i], CF );
+    }
+  }
+  if ( fs->qual[0] != '\0' ) {
+    fwrite( fs->qual, 1, fs->seq_len, CF );
+  }
+}
+
+/* read_cache_seq
+   Args: (1) FILE* CF - read cache file, after its header
+         (2) FragSeqP fs - where the sequence goes
+   Returns: TRUE if a sequence was read,
+            FALSE if EOF
+   Gets back what write_cache_seq wrote, and the qual_sum read_fastq
+   would have found. fs is trimmed (trimmed and trim_point set) as it
+   was when it was written.
+*/
+int read_cache_seq( FILE* CF, FragSeqP fs ) {
+  int c, id_len, desc_len, seq_len, num_other, flags, trim_end, pos;
+  int i;
+  static const char bases[] = "ACGT";
+
+  id_len = fgetc( CF );
+  if ( id_len == EOF ) {
+    return 0;
+  }
+  desc_len = fgetc( CF );
+  seq_len = get_u16( CF );
+  num_other = get_u16( CF );
+  flags = fgetc( CF );
+  trim_end = get_u16( CF );
+  if ( (desc_len == EOF) || (seq_len < 0) || (num_other < 0) ||
+       (flags == EOF) || (trim_end < 0) ||
+       (id_len > MAX_ID_LEN) || (desc_len > MAX_DESC_LEN) ||
+       (seq_len > INIT_ALN_SEQ_LEN) ||
+       (fread( fs->id, 1, id_len, CF ) != id_len) ||
+       (fread( fs->desc, 1, desc_len, CF ) != desc_len) ) {
+    fprintf( stderr, "Read cache is cut off or damaged\n" );
+    return 0;
+  }
+  fs->id[id_len] = '\0';
+  fs->desc[desc_len] = '\0';
+
+  for( i = 0; i < seq_len; i += 4 ) {
+    if ( (c = fgetc( CF )) == EOF ) {
+      fprintf( stderr, "Read cache is cut off at %s\n", fs->id );
+      return 0;
+    }
+    fs->seq[i] = bases[c & 3];
+    if ( i + 1 < seq_len ) fs->seq[i + 1] = bases[(c >> 2) & 3];
+    if ( i + 2 < seq_len ) fs->seq[i + 2] = bases[(c >> 4) & 3];
+    if ( i + 3 < seq_len ) fs->seq[i + 3] = bases[(c >> 6) & 3];
+  }
+  for( i = 0; i < num_other; i++ ) {
+    pos = get_u16( CF );
+    c = fgetc( CF );
+    if ( (pos < 0) || (pos >= seq_len) || (c == EOF) ) {
+      fprintf( stderr, "Read cache is cut off or damaged at %s\n", fs->id );
+      return 0;
+    }
+    fs->seq[pos] = c;
+  }
+  fs->seq[seq_len] = '\0';
+  fs->seq_len = seq_len;
+
+  fs->qual[0] = '\0';
+  if ( flags & 2 ) {
+    if ( fread( fs->qual, 1, seq_len, CF ) != seq_len ) {
+      fprintf( stderr, "Read cache is cut off at %s\n", fs->id );
+      return 0;
+    }
+    fs->qual[seq_len] = '\0';
+    fs->qual_sum = calc_qual_sum( fs->qual );
+  }
+  else {
+    fs->qual_sum = 0; // as read_fasta leaves it
+  }
+
+  fs->trimmed = flags & 1;
+  if ( fs->trimmed ) {
+    fs->trim_point = trim_end - 1;
+  }
+  return 1;
+}
+
+
+/* read_sam
+   Args: (1) FILE* SF - SAM file of alignments to the reference
+         (2) char* line - room for MAX_LINE_LEN+1 chars
+	 (3) FragSeqP frag_seq - where the read goes
+	 (4) char** rname - set to the name of the reference the read
+	     is aligned to
+	 (5) int* pos - set to the 1-based leftmost aligned reference
+	     position
+	 (6) int* flag - set to the SAM flag
+	 (7) char** cigar - set to the CIGAR string
+   Returns: TRUE if a record was read,
+            FALSE if EOF
+   Header lines (starting with @) are skipped. rname and cigar point
+   into line. frag_seq gets the read as it was sequenced, so one
+   aligned to the reverse strand (flag 0x10) is reverse complemented
+   back, along with its qualities. A QUAL of * leaves no qualities, as
+   for fasta input. A record with no sequence (SEQ of *), one longer
+   than INIT_ALN_SEQ_LEN, or one that is cut off gets a seq_len of 0.
+*/
+int read_sam ( FILE * SF, char* line, FragSeqP frag_seq, char** rname,
+	       int* pos, int* flag, char** cigar ) {
+  char* field[11];
+  size_t i, len;
+  int num_fields;
+
+  do {
+    if ( fgets( line, MAX_LINE_LEN, SF ) == NULL ) {
+      return 0;
+    }
+  } while ( line[0] == '@' );
+
+  num_fields = 0;
+  field[num_fields] = strtok( line, "\t\n" );
+  while ( (field[num_fields] != NULL) && (num_fields < 10) ) {
+    field[++num_fields] = strtok( NULL, "\t\n" );
+  }
+
+  frag_seq->desc[0] = '\0';
+  frag_seq->qual[0] = '\0';
+  frag_seq->seq[0]  = '\0';
+  frag_seq->seq_len = 0;
+  if ( (num_fields < 10) || (field[10] == NULL) ) {
+    /* Truncated record; there's nothing to align */
+    frag_seq->id[0] = '\0';
+    *flag = 0x4;
+    return 1;
+  }
+
+  strncpy( frag_seq->id, field[0], MAX_ID_LEN );
+  frag_seq->id[MAX_ID_LEN] = '\0';
+  *flag  = atoi( field[1] );
+  *rname = field[2];
+  *pos   = atoi( field[3] );
+  *cigar = field[5];
+
+  len = strlen( field[9] );
+  if ( (strcmp( field[9], "*" ) == 0) ||
+       (len > INIT_ALN_SEQ_LEN) ) {
+    return 1;
+  }
+  upcase_seq( field[9], len );
+  if ( *flag & 0x10 ) {
+    revcom_seq( frag_seq->seq, field[9], len );
+  }
+  else {
+    memcpy( frag_seq->seq, field[9], len );
+  }
+  frag_seq->seq[len] = '\0';
+  frag_seq->seq_len = len;
 
+  if ( strlen( field[10] ) == len ) {
+    for( i = 0; i < len; i++ ) {
+      if ( *flag & 0x10 ) {
+	frag_seq->qual[i] = field[10][len-(i+1)];
+      }
+      else {
+	frag_seq->qual[i] = field[10][i];
+      }
+    }
+    frag_seq->qual[len] = '\0';
+  }
+  frag_seq->qual_sum = calc_qual_sum( frag_seq->qual );
+  return 1;
+}
 
 /* Return 1 success
  0 failure
@@ -292,7 +585,7 @@ int read_fasta ( FILE * fasta, FragSeqP frag_seq ) {
 int read_fasta_ref(RefSeqP ref, const char* fn) {
   int head_done = 0;
   char c;
-  int len, i;
+  int len;
   FILE* ref_f;
 
   ref->seq = (char*)save_malloc(INIT_REF_SEQ_LEN*sizeof(char));
@@ -396,9 +689,7 @@ int read_fasta_ref(RefSeqP ref, const char* fn) {
     fprintf( stderr, "Not enough memories for revcom of reference\n");
     exit( 1);
   }
-  for (i = 0; i < ref->seq_len; i++) {
-    ref->rcseq[i] = revcom_char(ref->seq[ref->seq_len - (i+1)]);
-  }
+  revcom_seq(ref->rcseq, ref->seq, ref->seq_len);
   ref->rcseq[ref->seq_len] = '\0';
   return 1;
 }
@@ -584,7 +875,6 @@ int read_align_aln(FILE* align_f, PWAlnFragP af) {
     if (c == '\n' || c == ' ') {
       c = fgetc(align_f);
     } else {
-      c = toupper(c);
       af->ref_seq[len] = c;
       len++;
 
@@ -597,6 +887,7 @@ int read_align_aln(FILE* align_f, PWAlnFragP af) {
     }
   }
   af->ref_seq[ len ] = '\0';
+  upcase_seq(af->ref_seq, len);
 
   if (c == '>')
     ungetc( '>', align_f);
@@ -670,7 +961,6 @@ int read_align_aln(FILE* align_f, PWAlnFragP af) {
     if (c == '\n' || c == ' ') {
       c = fgetc(align_f);
     } else {
-      c = toupper(c);
       af->frag_seq[len++] = c;
 
       if (len > INIT_ALN_SEQ_LEN) {
@@ -688,6 +978,7 @@ int read_align_aln(FILE* align_f, PWAlnFragP af) {
     }
   }
   af->frag_seq[ len ] = '\0';
+  upcase_seq(af->frag_seq, len);
 
   if (c == '>')
     ungetc( '>', align_f);
@@ -761,24 +1052,27 @@ int read_align_aln(FILE* align_f, PWAlnFragP af) {
 
 void ace_output(MapAlignmentP maln) {
 	int number_of_contigs = 1;
-	char* consensus = get_consensus(maln);
+	int* pad = padded_map(maln); // padded coordinate of each position
+	int number_bases = pad[maln->ref->seq_len];
+	int* qual = (int*)save_malloc((number_bases + 1) * sizeof(int));
+	char* consensus = get_consensus(maln, qual);
 	int number_of_BS = 1;
-	int number_of_reads = maln->num_aln_seqs;
-	const int QUALITY_SCORE = 40;
-	int number_bases = get_consensus_length(maln);
+	size_t number_of_reads = maln->num_aln_seqs;
 	char* contig_name = maln->ref->id;
 
-	int i, j, line_pos = 0, gaps;
+	int i, j, line_pos = 0;
+	size_t read_num;
 
 	int max_line_length = 50;
 	AlnSeqP aln_seq;
 
 	//////////////////////////////////////////// ASSEMBLY INFORMATION (AS) ////////////////////////////////////////////////
-	printf("AS %d %d\n\n", number_of_contigs, number_of_reads + 1); // if we allow repairing we have one (fake) read more
+	printf("AS %d %lu\n\n", number_of_contigs,
+			(unsigned long)(number_of_reads + 1)); // if we allow repairing we have one (fake) read more
 
 	//////////////////////////////////////////// CONTIG INFORMATION (CO) //////////////////////////////////////////////////
-	printf("CO %s %d %d %d %c\n", contig_name, number_bases, number_of_reads + 1,
-			number_of_BS, 'U');
+	printf("CO %s %d %lu %d %c\n", contig_name, number_bases,
+			(unsigned long)(number_of_reads + 1), number_of_BS, 'U');
 
 	//////////////////////////////////////////// CONSENSUS  ///////////////////////////////////////////////////////////////
 	// print consenus --> padded positions must be * in ace
@@ -804,7 +1098,7 @@ void ace_output(MapAlignmentP maln) {
 	printf("BQ\n");
 	for (i = 0; i < number_bases; i++) {
 		if (consensus[i] != '-')
-			printf("%d ", QUALITY_SCORE); // mia has no quality scores -> Maybe I can build something from the coverage informations ...
+			printf("%d ", qual[i]);
 		if (i % max_line_length == 0)
 			printf("\n");
 	}
@@ -813,11 +1107,10 @@ void ace_output(MapAlignmentP maln) {
 	/////////////////////////////////////////////// ORDER OF THE READS (AF) (PADDED!) ////////////////////////////
 
 	printf("AF FAKE_READ-IGNORE_ME U %d\n", 1);
-	for (i = 0; i < number_of_reads; i++) {
-		aln_seq = maln->AlnSeqArray[i];
-		gaps = sum_of_gaps(maln, aln_seq->start); // How many gaps upstream?
+	for (read_num = 0; read_num < number_of_reads; read_num++) {
+		aln_seq = maln->AlnSeqArray[read_num];
 		printf("AF %s %c %d\n", aln_seq->id, (aln_seq->revcom) ? 'C' : 'U',
-				aln_seq->start + gaps+1);
+				pad[aln_seq->start] + 1);
 	}
 
 	printf("\n");
@@ -828,10 +1121,9 @@ void ace_output(MapAlignmentP maln) {
 	printf("\n");
 
 	///////////////////////////////////////////////// PRINT THE READS  (RD) ////////////////////////////////////////
-	int tmp;
         maln->ref->gaps[maln->ref->seq_len] = 0;
-	for (tmp = 0; tmp < number_of_reads; tmp++) {
-		aln_seq = maln->AlnSeqArray[tmp];
+	for (read_num = 0; read_num < number_of_reads; read_num++) {
+		aln_seq = maln->AlnSeqArray[read_num];
 		int gaps = 0;
                 int n_gaps = 0;
                 int ix = 0;
@@ -844,9 +1136,8 @@ void ace_output(MapAlignmentP maln) {
                // printf("%d %d %d\n", aln_seq->end, maln->ref->seq_len , maln->ref->gaps[aln_seq->end]);
 
                 /* Find how many gaps are in this region */
-                for (i = aln_seq->start; i <= aln_seq->end; i++) {
-                    gaps += maln->ref->gaps[i];
-                }
+                gaps = pad[aln_seq->end + 1] - pad[aln_seq->start]
+                    - (aln_seq->end - aln_seq->start + 1);
 
 		printf("RD %s %d %d %d\n", aln_seq->id,
 				strlen(aln_seq->seq) + gaps, 0, 0);
@@ -915,7 +1206,8 @@ void ace_output(MapAlignmentP maln) {
 		printf("QA %d %d %d %d\n", 1, number_bases, 1, number_bases);
 		printf("DS CHROMAT_FILE: %s PHD_FILE: %s_FAKE.phd TIME: Tue Feb 21 23:23:23 1984\n", "FAKE_READ", "FAKE_READ");
 
-
+	free(pad);
+	free(qual);
 	return;
 }
 
@@ -957,6 +1249,24 @@ void fasta_print_cons(char* cons, char* id) {
 	printf("%s\n", curr_line);
 }
 
+void fastq_print_cons(char* cons, int* qual, char* id) {
+	int len, i;
+	len = strlen(cons);
+	printf("@%s\n", id);
+	for (i = 0; i < len; i++) {
+		if ( !(cons[i] == '-')) {
+			putchar((cons[i] == ' ') ? 'X' : cons[i]);
+		}
+	}
+	printf("\n+\n");
+	for (i = 0; i < len; i++) {
+		if ( !(cons[i] == '-')) {
+			putchar(qual[i] + QUAL_ASCII_OFFSET);
+		}
+	}
+	printf("\n");
+}
+
 void fasta_aln_print(char* seq, char* id) {
 	int len, i, line_pos;
 	char curr_line[FASTA_LINE_WIDTH + 1];
@@ -1094,7 +1404,7 @@ void color_print(char* string) {
 
 IDsListP parse_ids(char* fn) {
 	int i;
-	int id_num = 0;
+	size_t id_num = 0;
 	int c_num = 0;
 	IDsListP ids;
 	FILE* IDS;
@@ -1141,4 +1451,74 @@ IDsListP parse_ids(char* fn) {
 	return ids;
 }
 
-
+/* parse_manifest
+   Args: (1) char* fn - name of a batch manifest file
+   Returns: SampleListP with one Sample for each line of the file
+   Each line of the manifest gives, separated by whitespace, the
+   sample name, the fasta or fastq file of its fragments, the root
+   file name for its maln output and, optionally, the name of its
+   fastq output file. Blank lines and lines starting with # are
+   skipped. Exits if a line does not have at least three fields.
+*/
+SampleListP parse_manifest(char* fn) {
+	int num_fields;
+	int line_num = 0;
+	SampleListP sl;
+	SampleP s, new_samples;
+	FILE* MF;
+	char line[MAX_ID_LEN + (4 * (MAX_FN_LEN + 1))];
+	char fmt[64];
+	char* p;
+
+	sl = (SampleListP)save_malloc(sizeof(SampleList));
+	sl->samples = (SampleP)save_malloc(INIT_NUM_SAMPLES * sizeof(Sample));
+	sl->size = INIT_NUM_SAMPLES;
+	sl->num_samples = 0;
+
+	/* Read no more of each field than its Sample has room for */
+	sprintf(fmt, "%%%ds %%%ds %%%ds %%%ds", MAX_ID_LEN, MAX_FN_LEN,
+		MAX_FN_LEN, MAX_FN_LEN);
+
+	MF = fileOpen(fn, "r");
+	while (fgets(line, sizeof(line), MF) != NULL) {
+		line_num++;
+		p = line;
+		while (isspace(*p)) {
+			p++;
+		}
+		if ((*p == '\0') || (*p == '#')) {
+			continue;
+		}
+		if (sl->num_samples == sl->size) {
+			new_samples = (SampleP)save_malloc(2 * sl->size * sizeof(Sample));
+			memcpy(new_samples, sl->samples, sl->size * sizeof(Sample));
+			free(sl->samples);
+			sl->samples = new_samples;
+			sl->size *= 2;
+		}
+		s = &sl->samples[sl->num_samples];
+		s->fastq_fn[0] = '\0';
+		num_fields = sscanf(p, fmt,
+				    s->name, s->frag_fn, s->maln_root, s->fastq_fn);
+		if (num_fields < 3) {
+			fprintf(stderr, "Line %d of manifest %s needs a sample name, fragment file, and output root\n",
+				line_num, fn);
+			exit(1);
+		}
+		if ((strlen(s->name) == MAX_ID_LEN) ||
+		    (strlen(s->frag_fn) == MAX_FN_LEN) ||
+		    (strlen(s->fastq_fn) == MAX_FN_LEN)) {
+			fprintf(stderr, "Line %d of manifest %s has a name longer than %d or file name longer than %d characters\n",
+				line_num, fn, MAX_ID_LEN - 1, MAX_FN_LEN - 1);
+			exit(1);
+		}
+		if (strlen(s->maln_root) > (MAX_FN_LEN - MAX_ROOT_SUFFIX_LEN)) {
+			fprintf(stderr, "Line %d of manifest %s has an output root longer than %d characters\n",
+				line_num, fn, MAX_FN_LEN - MAX_ROOT_SUFFIX_LEN);
+			exit(1);
+		}
+		sl->num_samples++;
+	}
+	fclose(MF);
+	return sl;
+}
@@ -27,6 +27,7 @@ extern "C" {
             this is:
 	    0 => fasta
 	    1 => fastq
+	    2 => read cache; read_cache_header must be called next
    Resets the input FILE pointer to the beginning of the file
 */
   int find_input_type( FILE * FF );
@@ -58,13 +59,75 @@ int read_fasta ( FILE * fasta, FragSeqP frag_seq );
 
 int read_fastq ( FILE * fastq, FragSeqP frag_seq );
 
+/* write_cache_header
+   Args: (1) FILE* CF - read cache file, just opened for writing
+         (2) int trimmed - Boolean, TRUE means the sequences written
+	     to it are adapter trimmed
+	 (3) const char* adapter - the adapter they are trimmed of
+   Returns: void
+*/
+void write_cache_header( FILE* CF, int trimmed, const char* adapter );
+
+/* read_cache_header
+   Args: (1) FILE* CF - read cache file, just opened for reading
+         (2) int* trimmed - set as it was given to write_cache_header
+	 (3) char* adapter - room for INIT_ALN_SEQ_LEN+1 chars; set to
+	     the adapter the sequences are trimmed of, if trimmed
+   Returns: 1 if success; 0 if CF is not a read cache this version
+   of mia can read
+*/
+int read_cache_header( FILE* CF, int* trimmed, char* adapter );
+
+/* write_cache_seq
+   Args: (1) FILE* CF - read cache file, after its header
+         (2) FragSeqP fs - as it was read, and trimmed if wanted
+   Returns: void
+   Writes the id, desc, seq, qual, and trimming of fs. A, C, G, and T
+   take 2 bits each; the position and character of anything else is
+   written after them
+*/
+void write_cache_seq( FILE* CF, FragSeqP fs );
+
+/* read_cache_seq
+   Args: (1) FILE* CF - read cache file, after its header
+         (2) FragSeqP fs - where the sequence goes
+   Returns: TRUE if a sequence was read,
+            FALSE if EOF
+   Gets back what write_cache_seq wrote, and the qual_sum read_fastq
+   would have found. fs is trimmed (trimmed and trim_point set) as it
+   was when it was written.
+*/
+int read_cache_seq( FILE* CF, FragSeqP fs );
+
+/* read_sam
+   Args: (1) FILE* SF - SAM file of alignments to the reference
+         (2) char* line - room for MAX_LINE_LEN+1 chars
+	 (3) FragSeqP frag_seq - where the read goes
+	 (4) char** rname - set to the name of the reference the read
+	     is aligned to
+	 (5) int* pos - set to the 1-based leftmost aligned reference
+	     position
+	 (6) int* flag - set to the SAM flag
+	 (7) char** cigar - set to the CIGAR string
+   Returns: TRUE if a record was read,
+            FALSE if EOF
+   Header lines (starting with @) are skipped. rname and cigar point
+   into line. frag_seq gets the read as it was sequenced, so one
+   aligned to the reverse strand (flag 0x10) is reverse complemented
+   back, along with its qualities. A QUAL of * leaves no qualities, as
+   for fasta input. A record with no sequence (SEQ of *), one longer
+   than INIT_ALN_SEQ_LEN, or one that is cut off gets a seq_len of 0.
+*/
+int read_sam ( FILE * SF, char* line, FragSeqP frag_seq, char** rname,
+	       int* pos, int* flag, char** cigar );
+
 /* calc_qual_sum
    Args: 1. pointer to a string of quality scores for this sequence
    Returns: 1. int - the sum of quality scores for this sequence
    This assumes that quality scores are represented as the 
    ASCII code + 64
 */
-  inline int calc_qual_sum( const char* qual_str );
+  int calc_qual_sum( const char* qual_str );
 
 
 
@@ -98,6 +161,20 @@ int read_fasta_ref(RefSeqP ref, const char* fn);
   FILE * fileOpen(const char *name, char access_mode[]);
   
   IDsListP parse_ids(char* fn);
+
+/* parse_manifest
+   Args: (1) char* fn - name of a batch manifest file
+   Returns: SampleListP with one Sample for each line of the file
+   Each line of the manifest gives, separated by whitespace, the
+   sample name, the fasta or fastq file of its fragments, the root
+   file name for its maln output and, optionally, the name of its
+   fastq output file. Blank lines and lines starting with # are
+   skipped. Exits if a line does not have at least three fields, if
+   one of them is too long for its Sample, or if the output root leaves
+   less than MAX_ROOT_SUFFIX_LEN characters of MAX_FN_LEN for the names
+   made from it.
+*/
+  SampleListP parse_manifest(char* fn);
   
   // Prints this string colored
 void color_print(char* string);
@@ -109,6 +186,16 @@ void color_print(char* string);
 
   void clustalw_print_cons(char* cons, char* aln_ref, char* ref_id);
 
+/* fastq_print_cons
+   Args: (1) char* cons - aligned consensus
+         (2) int* qual - consensus quality of each column of cons
+         (3) char* id - ID for the record
+   Returns: void
+   Prints the consensus, without gaps, as one fastq record with the
+   qualities offset by QUAL_ASCII_OFFSET
+*/
+  void fastq_print_cons(char* cons, int* qual, char* id);
+
 
 
 #ifdef	__cplusplus
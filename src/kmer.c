@@ -47,6 +47,273 @@ int kmer2inx( const char* kmer,
   return 1; // valid!
 }
 
+/* seed2inx
+   Args: (1) const char* kmer - might not be null-terminated
+         (2) const KmerSeed* ks - which bases to look at, and how
+	 (3) size_t* inx - where to put the index
+   Returns: TRUE if the index was set, FALSE if it could not be
+            set because a base that is looked at is not A, C, G, T
+   Same as kmer2inx, but only the bases ks cares about count, and
+   with ks->ry, A and G are both 0 and C and T are both 1 (1 bit each)
+*/
+int seed2inx( const char* kmer, const KmerSeed* ks, size_t* inx ) {
+  size_t l_inx = 0;
+  int i;
+
+  for( i = 0; i < ks->len; i++ ) {
+    if ( !ks->care[i] ) {
+      continue;
+    }
+    if ( ks->ry ) {
+      l_inx = l_inx << 1;
+      switch( toupper(kmer[i]) ) {
+      case 'A' :
+      case 'G' :
+	break;
+      case 'C' :
+      case 'T' :
+	l_inx += 1;
+	break;
+      default :
+	return 0; // not valid!
+      }
+    }
+    else {
+      l_inx = l_inx << 2;
+      switch( toupper(kmer[i]) ) {
+      case 'A' :
+	break;
+      case 'C' :
+	l_inx += 1;
+	break;
+      case 'G' :
+	l_inx += 2;
+	break;
+      case 'T' :
+	l_inx += 3;
+	break;
+      default :
+	return 0; // not valid!
+      }
+    }
+  }
+  *inx = l_inx;
+  return 1; // valid!
+}
+
+/* kmer_seed_bits
+   Args: (1) const KmerSeed* ks
+   Returns: number of bits in the indeces seed2inx gives
+*/
+static int kmer_seed_bits( const KmerSeed* ks ) {
+  return ks->ry ? ks->weight : 2 * ks->weight;
+}
+
+/* seed_pattern_ok
+   Args: (1) const char* pattern - spaced seed pattern; may be NULL
+   Returns: 1 if pattern is NULL or a string of 1s and 0s; 0 if not,
+   after saying so
+*/
+static int seed_pattern_ok( const char* pattern ) {
+  if ( (pattern != NULL) &&
+       ((pattern[0] == '\0') ||
+	(strspn( pattern, "01" ) != strlen( pattern ))) ) {
+    fprintf( stderr, "Spaced seed pattern %s is not a string of 1s and 0s\n",
+	     pattern );
+    return 0;
+  }
+  return 1;
+}
+
+/* make_kmer_seed
+   Args: (1)-(4) as for init_kmer_seed, but kmer_len must be > 0
+         and pattern must be OK (see seed_pattern_ok)
+	 (5) int quiet - Boolean, TRUE means don't say what is wrong
+   Returns: 1 if success; 0 if the kmers look at no bases or need
+   more than 2 * MAX_KMER_LEN bits of index
+*/
+static int make_kmer_seed( KmerSeedP ks, int kmer_len, int ry,
+			   const char* pattern, int quiet ) {
+  int i, pat_len;
+  ks->len = kmer_len;
+  ks->ry = ry;
+  ks->weight = 0;
+  if ( kmer_len > MAX_KMER_SPAN ) {
+    if ( !quiet ) {
+      fprintf( stderr, "Cannot use kmer length greater than %d\n",
+	       MAX_KMER_SPAN );
+    }
+    return 0;
+  }
+
+  pat_len = (pattern == NULL) ? 0 : strlen( pattern );
+  for( i = 0; i < kmer_len; i++ ) {
+    ks->care[i] = (pattern == NULL) || (pattern[i % pat_len] == '1');
+    ks->weight += ks->care[i];
+  }
+
+  if ( ks->weight == 0 ) {
+    if ( !quiet ) {
+      fprintf( stderr, "Spaced seed pattern %s looks at no bases\n",
+	       pattern );
+    }
+    return 0;
+  }
+  if ( kmer_seed_bits( ks ) > 2 * MAX_KMER_LEN ) {
+    if ( !quiet ) {
+      fprintf( stderr,
+	       "Kmers of length %d look at %d bases; at most %d can be used%s\n",
+	       kmer_len, ks->weight, ry ? 2 * MAX_KMER_LEN : MAX_KMER_LEN,
+	       ry ? " with purine/pyrimidine kmers" : "" );
+    }
+    return 0;
+  }
+  return 1;
+}
+
+/* init_kmer_seed
+   Args: (1) KmerSeedP ks - to set up
+         (2) int kmer_len - number of bases each kmer spans (-k);
+	     < 0 means no kmer filtering
+	 (3) int ry - Boolean, TRUE means only purine/pyrimidine is
+	     looked at, so A = G and C = T
+	 (4) const char* pattern - string of 1s and 0s saying which
+	     bases of a kmer are looked at (1) and which are not (0),
+	     repeated as needed to cover kmer_len; NULL means all are
+   Returns: 1 if success; 0 if the pattern is not valid or the
+   kmers need more than 2 * MAX_KMER_LEN bits of index
+*/
+int init_kmer_seed( KmerSeedP ks, int kmer_len, int ry,
+		    const char* pattern ) {
+  if ( kmer_len <= 0 ) {
+    ks->len = -1; // no kmer filtering
+    ks->ry = ry;
+    ks->weight = 0;
+    return 1;
+  }
+  if ( !seed_pattern_ok( pattern ) ) {
+    return 0;
+  }
+  return make_kmer_seed( ks, kmer_len, ry, pattern, 0 );
+}
+
+/* codeCmp
+   For qsort of size_t kmer codes
+*/
+static int codeCmp( const void* c1_, const void* c2_ ) {
+  size_t c1 = *(const size_t*)c1_;
+  size_t c2 = *(const size_t*)c2_;
+  return (c1 > c2) - (c1 < c2);
+}
+
+/* kmer_places
+   Args: (1) const KmerSeed* ks - kmers to look at
+         (2) RefSeqP ref - with seq and rcseq, wrap_seq_len long
+	 (3) size_t* codes - room for two codes per base of ref
+   Returns: how many places, in ref->seq and ref->rcseq together,
+   the average kmer of ref->seq is found; 0 if it has no kmers
+   This is what a sequence from the reference would find per kmer
+   in the fkpa and rkpa made with ks. Only kmers starting in the
+   first seq_len bases count, so the wrap copy of a circular
+   reference (see add_ref_wrap) is not taken for a repeat; those
+   near the end still read on into it, across the join
+*/
+static double kmer_places( const KmerSeed* ks, RefSeqP ref, size_t* codes ) {
+  size_t i, j, inx, num_codes = 0, num_fw = 0, fw_in_run;
+  double sum = 0.0;
+  for( i = 0; (i < (size_t)ref->seq_len) &&
+	 (i + ks->len <= (size_t)ref->wrap_seq_len);
+       i++ ) {
+    /* The low bit says which strand it came from */
+    if ( seed2inx( &ref->seq[i], ks, &inx ) ) {
+      codes[num_codes++] = (inx << 1) | 1;
+      num_fw++;
+    }
+    if ( seed2inx( &ref->rcseq[i], ks, &inx ) ) {
+      codes[num_codes++] = (inx << 1);
+    }
+  }
+  if ( num_fw == 0 ) {
+    return 0.0;
+  }
+  qsort( codes, num_codes, sizeof(size_t), codeCmp );
+
+  /* Each forward kmer finds every copy of itself */
+  for( i = 0; i < num_codes; i = j ) {
+    fw_in_run = 0;
+    for( j = i; (j < num_codes) && ((codes[j] >> 1) == (codes[i] >> 1)); j++ ) {
+      fw_in_run += (codes[j] & 1);
+    }
+    sum += (double)fw_in_run * (double)(j - i);
+  }
+  return sum / (double)num_fw;
+}
+
+/* tune_kmer_seed
+   Args: (1) KmerSeedP ks - set to the chosen kmers
+         (2) int ry - as for init_kmer_seed
+	 (3) const char* pattern - as for init_kmer_seed
+	 (4) RefSeqP ref - with seq and rcseq, wrap_seq_len long
+	 (5) int read_len - typical length of the sequences to filter
+	 (6) double* extra - set to the expected number of extra places
+	     per sequence with the chosen kmers
+	 (7) unsigned int* saturate - set to the number of kmer places
+	     past which a sequence might as well be aligned to the whole
+	     reference
+   Returns: 1 if success; 0 if no kmer length can be used
+   A sequence of read_len has read_len - k + 1 kmers. Each finds
+   kmer_places - 1 places besides where it came from, and a random
+   kmer finds 2 * seq_len / 2^bits places by chance. Tries each
+   kmer length from AUTO_KMER_MIN up and picks the shortest (most
+   sensitive) one that expects at most AUTO_KMER_WINDOWS extra places
+   per sequence, or the longest that can be used if none does. The
+   whole reference costs as much to align to as seq_len /
+   (read_len + 2 * ALIGN_MASK_BUFFER) places, so that many on top of
+   the kmers of the sequence itself is where it saturates.
+*/
+int tune_kmer_seed( KmerSeedP ks, int ry, const char* pattern,
+		    RefSeqP ref, int read_len,
+		    double* extra, unsigned int* saturate ) {
+  KmerSeed try_ks;
+  size_t* codes;
+  int k, found = 0, num_kmers;
+  double places, try_extra;
+
+  if ( !seed_pattern_ok( pattern ) ) {
+    return 0;
+  }
+  codes = (size_t*)save_malloc( 2 * ref->wrap_seq_len * sizeof(size_t) );
+  for( k = AUTO_KMER_MIN; (k <= read_len) && (k <= MAX_KMER_SPAN); k++ ) {
+    if ( !make_kmer_seed( &try_ks, k, ry, pattern, 1 ) ) {
+      if ( try_ks.weight == 0 ) {
+	continue; // pattern looks at nothing this short
+      }
+      break; // longer kmers won't fit either
+    }
+    num_kmers = read_len - k + 1;
+    places = kmer_places( &try_ks, ref, codes );
+    try_extra = num_kmers *
+      ( ((places > 1.0) ? (places - 1.0) : 0.0) +
+	2.0 * ref->seq_len / ldexp( 1.0, kmer_seed_bits( &try_ks ) ) );
+    *ks = try_ks;
+    *extra = try_extra;
+    found = 1;
+    if ( try_extra <= AUTO_KMER_WINDOWS ) {
+      break;
+    }
+  }
+  free( codes );
+
+  if ( !found ) {
+    fprintf( stderr, "No kmer length can be used for %d nt sequences\n",
+	     read_len );
+    return 0;
+  }
+  *saturate = (read_len - ks->len + 1) +
+    (ref->seq_len + read_len + 2 * ALIGN_MASK_BUFFER - 1) /
+    (read_len + 2 * ALIGN_MASK_BUFFER);
+  return 1;
+}
 
 /* add_kmer
    Args: (1) KPL* kmer array
@@ -68,6 +335,7 @@ void add_kmer( KPL* kpa, const size_t inx, const size_t i ) {
     kpa[inx] = (KPL)save_malloc(sizeof(KmerPosList));
     kpa[inx]->num_pos = 0;
     kpa[inx]->sorted  = 0;
+    kpa[inx]->low_complexity = 0;
   }
 
   /* Check to make sure we're not over the maximum number
@@ -84,23 +352,24 @@ void add_kmer( KPL* kpa, const size_t inx, const size_t i ) {
   return;
 }
 /* init_kpa
-   Args: (1) length of kmers to use
-   Returns: pointer to KPL; an array of pointers to KmerPosList
+   Args: (1) const KmerSeed* ks - kmers to use
+   Returns: pointer to KPL; an array of pointers to KmerPosList,
+   one for each index seed2inx can give
 */
-KPL* init_kpa( const int kmer_len ) {
+KPL* init_kpa( const KmerSeed* ks ) {
   KPL* kpa;
   unsigned int size = 1;
-  if ( kmer_len > MAX_KMER_LEN ) {
+  if ( kmer_seed_bits( ks ) > 2 * MAX_KMER_LEN ) {
     fprintf( stderr, "Cannot use kmer length greater than %d\n",
 	     MAX_KMER_LEN );
     exit( 2 );
   }
-  size = size << (2*kmer_len);
+  size = size << kmer_seed_bits( ks );
   kpa = (KPL*)calloc(size, sizeof(KPL));
   if ( kpa == NULL ) {
     fprintf( stderr,
 	     "Not enough memories for kmers of length %d\n",
-	     kmer_len );
+	     ks->len );
     exit( 1 );
   }
   return kpa;
@@ -148,19 +417,126 @@ inline int all_upper( const char* seq, const int kmer_len ) {
 }
 
 
+/* dust_mask
+   Args: (1) const char* seq - sequence to look at
+         (2) size_t seq_len - length of seq
+	 (3) int level - DUST score above which sequence is low complexity
+	 (4) char* mask - room for seq_len; set to TRUE for bases in
+	     low-complexity sequence and FALSE for the rest
+   Returns: number of bases masked
+   Scores every stretch of up to DUST_WINDOW bases as DUST does: the
+   number of pairs of identical triplets in it over one less than the
+   number of triplets. Any stretch scoring above level is masked.
+   Stretches do not run over anything but A, C, G, T.
+*/
+size_t dust_mask( const char* seq, size_t seq_len, int level, char* mask ) {
+  int* trip; // code of the triplet starting at each base; -1 if none
+  int counts[64];
+  int pairs, n, b, code;
+  size_t i, j, first, num_trips, masked = 0;
+  ssize_t best; // earliest start of a low-complexity stretch
+
+  memset( mask, 0, seq_len );
+  if ( seq_len < 3 ) {
+    return 0;
+  }
+  num_trips = seq_len - 2;
+  trip = (int*)save_malloc( num_trips * sizeof(int) );
+  code = 0;
+  n = 0; // number of good bases in a row
+  for( i = 0; i < seq_len; i++ ) {
+    switch( toupper( seq[i] ) ) {
+    case 'A' :
+      b = 0;
+      break;
+    case 'C' :
+      b = 1;
+      break;
+    case 'G' :
+      b = 2;
+      break;
+    case 'T' :
+      b = 3;
+      break;
+    default :
+      b = -1;
+    }
+    if ( b < 0 ) {
+      n = 0;
+    }
+    else {
+      code = ((code << 2) | b) & 63;
+      n++;
+    }
+    if ( i >= 2 ) {
+      trip[i-2] = (n >= 3) ? code : -1;
+    }
+  }
+
+  memset( counts, 0, sizeof(counts) );
+  for( i = 0; i < num_trips; i++ ) {
+    /* Grow a stretch back from the triplet at i, keeping track of
+       the number of pairs of identical triplets in it */
+    pairs = 0;
+    best = -1;
+    first = (i + 3 > DUST_WINDOW) ? i + 3 - DUST_WINDOW : 0;
+    for( j = i + 1; j-- > first; ) {
+      if ( trip[j] < 0 ) {
+	break;
+      }
+      pairs += counts[trip[j]]++;
+      if ( (j < i) && (pairs > level * (int)(i - j)) ) {
+	best = j;
+      }
+    }
+    for( j = i + 1; j-- > first; ) {
+      if ( trip[j] < 0 ) {
+	break;
+      }
+      counts[trip[j]] = 0;
+    }
+    /* Mask from the start of the first triplet to the end of the last */
+    for( j = (best < 0) ? i + 3 : (size_t)best; j < i + 3; j++ ) {
+      if ( !mask[j] ) {
+	mask[j] = 1;
+	masked++;
+      }
+    }
+  }
+
+  free( trip );
+  return masked;
+}
+
 /* populate_kpa
- */
+   Args: (1) KPL* kpa - from init_kpa( ks )
+         (2) const char* seq - sequence to index
+	 (3) const size_t seq_len - length of seq
+	 (4) const KmerSeed* ks - kmers to use
+	 (5) const int soft_mask - Boolean, TRUE means skip kmers with
+	     any lower case base
+	 (6) const char* lc_mask - TRUE for each base of seq that is in
+	     low-complexity sequence (see dust_mask); may be NULL
+   Returns: 1
+   Adds the position of every kmer of seq to kpa. Kmers that are
+   anywhere in low-complexity sequence are marked low_complexity.
+*/
 int populate_kpa( KPL* kpa, const char* seq,
 		  const size_t seq_len,
-		  const int kmer_len,
-		  const int soft_mask ) {
+		  const KmerSeed* ks,
+		  const int soft_mask,
+		  const char* lc_mask ) {
   size_t i, inx;
-  for( i = 0; i <= (seq_len - kmer_len); i++ ) {
+  for( i = 0; i <= (seq_len - ks->len); i++ ) {
     /* Add this kmer if we're not check for softmasking or
        if we are and it passes the test */
-    if ( !soft_mask || all_upper(&seq[i], kmer_len) ) {
-      if ( kmer2inx( &seq[i], kmer_len, &inx ) ) {
+    if ( !soft_mask || all_upper(&seq[i], ks->len) ) {
+      if ( seed2inx( &seq[i], ks, &inx ) ) {
 	add_kmer( kpa, inx, i );
+	if ( (lc_mask != NULL) &&
+	     (memchr( &lc_mask[i], 1, ks->len ) != NULL) ) {
+	  kpa[inx]->low_complexity = 1;
+	}
       }
     }
   }
@@ -232,20 +608,74 @@ KmersP pop_kmers( RefSeqP ref, int kmer_filt_len ) {
 }
 
 
-/* Returns: TRUE (1) if we should align this sequence
+/* unmask_kmer_hits
+   Args: (1) KPL kpl - reference positions of a kmer of the fragment
+         (2) size_t frag_pos - where that kmer is in the fragment
+	 (3) size_t frag_len - length of the fragment
+	 (4) int tail - how far past the end of the fragment to unmask
+	 (5) AlignmentP a - alignment whose align_mask to update
+   Returns: void
+   Unmasks the reference around each place the fragment would be if
+   its kmer came from there
+*/
+static void unmask_kmer_hits( KPL kpl, size_t frag_pos, size_t frag_len,
+			      int tail, AlignmentP a ) {
+  size_t ref_len, ref_pos, i;
+  int mask_min, mask_max; // Sometimes these become negative
+  ref_len = a->len1;
+  for( i = 0; i < kpl->num_pos; i++ ) {
+    /* Unmask the region surrounding this kmer */
+    ref_pos = kpl->positions[i];
+    mask_min = ref_pos - frag_pos - ALIGN_MASK_BUFFER;
+    if ( mask_min < 0 ) {
+      mask_min = 0;
+    }
+    mask_max = ref_pos + (frag_len - frag_pos) + tail;
+    if ( mask_max >= ref_len ) {
+      mask_max = (ref_len - 1);
+    }
+    memset( &a->align_mask[mask_min], 1, (mask_max-mask_min+1) );
+  }
+}
+
+/* new_kmer_filter
+   Args: (1) FragSeqP fs - fragment to look for
+         (2) KPL* fkpa - kmers of the forward reference
+	 (3) KPL* rkpa - kmers of the reverse complement reference
+	 (4) const KmerSeed* ks - kmers to use; ks->len < 0 means
+	     no kmer filtering
+	 (5) AlignmentP fwa - forward alignment, for its align_mask
+	 (6) AlignmentP rca - reverse complement alignment, for its
+	     align_mask
+	 (7) unsigned int saturate - number of kmer places at which the
+	     whole reference is aligned to
+	 (8) KmerFiltStatsP kfs - where to count what happened; may
+	     be NULL
+   Returns: TRUE (1) if we should align this sequence
             FALSE (0) if we should NOT align this sequence because
                       it shares no kmers with the reference
+   Sets the align_masks so that only the reference around the kmers
+   the fragment shares with it is aligned to, or all of it if there
+   are saturate or more places. Kmers marked low_complexity are
+   left out unless the fragment shares no other kmers with the
+   reference.
 */
 int new_kmer_filter( FragSeqP fs,
 		     KPL* fkpa,
 		     KPL* rkpa,
-		     int kmer_len,
+		     const KmerSeed* ks,
 		     AlignmentP fwa,
-		     AlignmentP rca ) {
-  size_t frag_len, frag_pos, inx, ref_len, ref_pos, i;
-  int mask_min, mask_max; // Sometimes these become negative
+		     AlignmentP rca,
+		     unsigned int saturate,
+		     KmerFiltStatsP kfs ) {
+  size_t frag_len, frag_pos, inx;
+  int kmer_len = ks->len;
+  int use_lc; // Boolean, TRUE => low-complexity kmers count, too
   unsigned int num_f_kmers_found = 0;
   unsigned int num_r_kmers_found = 0;
+  unsigned int num_f_lc_found = 0; // places of low-complexity kmers
+  unsigned int num_r_lc_found = 0; // that were left out
+  KPL kpl;
 
   /* Check for no kmer filtering */
   if ( kmer_len < 0 ) {
@@ -267,60 +697,70 @@ int new_kmer_filter( FragSeqP fs,
   }
 
   if ( frag_len < kmer_len ) {
+    if ( kfs != NULL ) {
+      kfs->failed++;
+    }
     return 0;
   }
 
   /* Zip through all the kmers in this fragment sequence. If any
      are present in the forward or reverse kpa's, then we pass
-     the filter, i.e., return 1 */
-  for( frag_pos = 0; frag_pos <= (frag_len - kmer_len); frag_pos++ ) {
-    if ( kmer2inx( &fs->seq[frag_pos], kmer_len, &inx ) ) {
-      if ( fkpa[inx] != NULL ) {
-	ref_len = fwa->len1;
+     the filter, i.e., return 1. Low-complexity kmers only get
+     a second look if nothing else was found */
+  for( use_lc = 0; use_lc <= 1; use_lc++ ) {
+    for( frag_pos = 0; frag_pos <= (frag_len - kmer_len); frag_pos++ ) {
+      if ( !seed2inx( &fs->seq[frag_pos], ks, &inx ) ) {
+	continue;
+      }
+
+      kpl = fkpa[inx];
+      if ( (kpl != NULL) && kpl->low_complexity && !use_lc ) {
+	num_f_lc_found += kpl->num_pos;
+      }
+      else if ( kpl != NULL ) {
 	/* There are some kmers here. Add them to the total
 	   count and update the align_mask */
-	num_f_kmers_found += fkpa[inx]->num_pos;
-	if ( num_f_kmers_found >= KMER_SATURATE ) {
+	num_f_kmers_found += kpl->num_pos;
+	if ( num_f_kmers_found >= saturate ) {
 	  memset( fwa->align_mask, 1, fwa->len1 );
 	}
-
-	for( i = 0; i < fkpa[inx]->num_pos; i++ ) {
-	  /* Unmask the region surrounding this kmer */
-	  ref_pos = fkpa[inx]->positions[i];
-	  mask_min = ref_pos - frag_pos - ALIGN_MASK_BUFFER;
-	  if ( mask_min < 0 ) {
-	    mask_min = 0;
-	  }
-	  mask_max = ref_pos + (frag_len - frag_pos) + ALIGN_MASK_BUFFER;
-	  if ( mask_max >= ref_len ) {
-	    mask_max = (ref_len - 1);
-	  }
-	  memset( &fwa->align_mask[mask_min], 1, (mask_max-mask_min+1) );
-	}
+	unmask_kmer_hits( kpl, frag_pos, frag_len, ALIGN_MASK_BUFFER, fwa );
       }
 
-      if ( rkpa[inx] != NULL ) {
-	ref_len = rca->len1;
-	/* There are some kmers here. Add them to the total
-	   count and update the align_mask */
-	num_r_kmers_found += rkpa[inx]->num_pos;
-	if ( num_r_kmers_found >= KMER_SATURATE ) {
+      kpl = rkpa[inx];
+      if ( (kpl != NULL) && kpl->low_complexity && !use_lc ) {
+	num_r_lc_found += kpl->num_pos;
+      }
+      else if ( kpl != NULL ) {
+	num_r_kmers_found += kpl->num_pos;
+	if ( num_r_kmers_found >= saturate ) {
 	  memset( rca->align_mask, 1, rca->len1 );
 	}
+	unmask_kmer_hits( kpl, frag_pos, frag_len, ALIGN_MASK_BUFFER - 1, rca );
+      }
+    }
+    if ( (num_f_kmers_found + num_r_kmers_found > 0) ||
+	 (num_f_lc_found + num_r_lc_found == 0) ) {
+      break;
+    }
+  }
 
-	for( i = 0; i < rkpa[inx]->num_pos; i++ ) {
-	  /* Unmask the region surrounding this kmer */
-	  ref_pos = rkpa[inx]->positions[i];
-	  mask_min = ref_pos - frag_pos - ALIGN_MASK_BUFFER;
-	  if ( mask_min < 0 ) {
-	    mask_min = 0;
-	  }
-
-	  mask_max = ref_pos + frag_len - frag_pos - 1 + ALIGN_MASK_BUFFER;
-	  if ( mask_max >= ref_len ) {
-	    mask_max = (ref_len - 1);
-	  }
-	  memset( &rca->align_mask[mask_min], 1, (mask_max-mask_min+1) );
+  if ( kfs != NULL ) {
+    if ( num_f_kmers_found + num_r_kmers_found == 0 ) {
+      kfs->failed++;
+    }
+    else {
+      kfs->passed++;
+      if ( use_lc ) {
+	kfs->lc_only++;
+      }
+      else if ( num_f_lc_found + num_r_lc_found > 0 ) {
+	kfs->lc_left_out++;
+	if ( ((num_f_kmers_found < saturate) &&
+	      (num_f_kmers_found + num_f_lc_found >= saturate)) ||
+	     ((num_r_kmers_found < saturate) &&
+	      (num_r_kmers_found + num_r_lc_found >= saturate)) ) {
+	  kfs->unsaturated++;
 	}
       }
     }
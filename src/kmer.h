@@ -33,20 +33,91 @@ extern "C" {
 void add_kmer( KPL* kpa, const size_t inx, const size_t i ) ;
 
 /* init_kpa
-   Args: (1) length of kmers to use
-   Returns: pointer to KPL; an array of pointers to KmerPosList
+   Args: (1) const KmerSeed* ks - kmers to use
+   Returns: pointer to KPL; an array of pointers to KmerPosList,
+   one for each index seed2inx can give
 */
-KPL* init_kpa( const int kmer_len ) ;
+KPL* init_kpa( const KmerSeed* ks ) ;
+
+/* init_kmer_seed
+   Args: (1) KmerSeedP ks - to set up
+         (2) int kmer_len - number of bases each kmer spans (-k);
+	     < 0 means no kmer filtering
+	 (3) int ry - Boolean, TRUE means only purine/pyrimidine is
+	     looked at, so A = G and C = T
+	 (4) const char* pattern - string of 1s and 0s saying which
+	     bases of a kmer are looked at (1) and which are not (0),
+	     repeated as needed to cover kmer_len; NULL means all are
+   Returns: 1 if success; 0 if the pattern is not valid or the
+   kmers need more than 2 * MAX_KMER_LEN bits of index
+   Both the reference and the fragments are looked at through the
+   same seed, so a base that is not looked at (or a C->T or G->A
+   change when ry) cannot keep a fragment from being found. With
+   ry, each base looked at takes 1 bit instead of 2, so kmers can
+   be twice as long.
+*/
+int init_kmer_seed( KmerSeedP ks, int kmer_len, int ry,
+		    const char* pattern ) ;
+
+/* tune_kmer_seed
+   Args: (1) KmerSeedP ks - set to the chosen kmers
+         (2) int ry - as for init_kmer_seed
+	 (3) const char* pattern - as for init_kmer_seed
+	 (4) RefSeqP ref - with seq and rcseq, wrap_seq_len long
+	 (5) int read_len - typical length of the sequences to filter
+	 (6) double* extra - set to the expected number of extra places
+	     per sequence with the chosen kmers
+	 (7) unsigned int* saturate - set to the number of kmer places
+	     past which a sequence might as well be aligned to the whole
+	     reference
+   Returns: 1 if success; 0 if no kmer length can be used
+   Looks at how often each kmer is in the reference for each kmer
+   length from AUTO_KMER_MIN up, and picks the shortest (most
+   sensitive) one that expects at most AUTO_KMER_WINDOWS places per
+   sequence besides the one it came from, counting both repeats in
+   the reference and chance hits. The saturation threshold is the
+   number of places at which aligning around each of them costs as
+   much as aligning to the whole reference.
+*/
+int tune_kmer_seed( KmerSeedP ks, int ry, const char* pattern,
+		    RefSeqP ref, int read_len,
+		    double* extra, unsigned int* saturate ) ;
 
 
 void grow_kmers ( KmersP k ) ;
 
+/* dust_mask
+   Args: (1) const char* seq - sequence to look at
+         (2) size_t seq_len - length of seq
+	 (3) int level - DUST score above which sequence is low complexity
+	 (4) char* mask - room for seq_len; set to TRUE for bases in
+	     low-complexity sequence and FALSE for the rest
+   Returns: number of bases masked
+   Scores every stretch of up to DUST_WINDOW bases as DUST does: the
+   number of pairs of identical triplets in it over one less than the
+   number of triplets. Any stretch scoring above level is masked.
+   Stretches do not run over anything but A, C, G, T.
+*/
+size_t dust_mask( const char* seq, size_t seq_len, int level, char* mask ) ;
+
 /* populate_kpa
- */
+   Args: (1) KPL* kpa - from init_kpa( ks )
+         (2) const char* seq - sequence to index
+	 (3) const size_t seq_len - length of seq
+	 (4) const KmerSeed* ks - kmers to use
+	 (5) const int soft_mask - Boolean, TRUE means skip kmers with
+	     any lower case base
+	 (6) const char* lc_mask - TRUE for each base of seq that is in
+	     low-complexity sequence (see dust_mask); may be NULL
+   Returns: 1
+   Adds the position of every kmer of seq to kpa. Kmers that are
+   anywhere in low-complexity sequence are marked low_complexity.
+*/
 int populate_kpa( KPL* kpa, const char* seq,
 		  const size_t seq_len,
-		  const int kmer_len,
-		  const int soft_mask ) ;
+		  const KmerSeed* ks,
+		  const int soft_mask,
+		  const char* lc_mask ) ;
 
 /* pop_kmers
    Args: (1) RefSeqP ref - reference sequence with forward and reverse sequence
@@ -76,16 +147,47 @@ int kmer2inx( const char* kmer,
 		     const unsigned int kmer_len,
 		     size_t* inx ) ;
 
-/* Returns: TRUE (1) if we should align this sequence
+/* seed2inx
+   Args: (1) const char* kmer - might not be null-terminated
+         (2) const KmerSeed* ks - which bases to look at, and how
+	 (3) size_t* inx - where to put the index
+   Returns: TRUE if the index was set, FALSE if it could not be
+            set because a base that is looked at is not A, C, G, T
+   Same as kmer2inx, but only the bases ks cares about count, and
+   with ks->ry, A and G are both 0 and C and T are both 1 (1 bit each)
+*/
+int seed2inx( const char* kmer, const KmerSeed* ks, size_t* inx ) ;
+
+/* new_kmer_filter
+   Args: (1) FragSeqP fs - fragment to look for
+         (2) KPL* fkpa - kmers of the forward reference
+	 (3) KPL* rkpa - kmers of the reverse complement reference
+	 (4) const KmerSeed* ks - kmers to use; ks->len < 0 means
+	     no kmer filtering
+	 (5) AlignmentP fwa - forward alignment, for its align_mask
+	 (6) AlignmentP rca - reverse complement alignment, for its
+	     align_mask
+	 (7) unsigned int saturate - number of kmer places at which the
+	     whole reference is aligned to
+	 (8) KmerFiltStatsP kfs - where to count what happened; may
+	     be NULL
+   Returns: TRUE (1) if we should align this sequence
             FALSE (0) if we should NOT align this sequence because
                       it shares no kmers with the reference
+   Sets the align_masks so that only the reference around the kmers
+   the fragment shares with it is aligned to, or all of it if there
+   are saturate or more places. Kmers marked low_complexity are
+   left out unless the fragment shares no other kmers with the
+   reference.
 */
 int new_kmer_filter( FragSeqP fs,
 		     KPL* fkpa,
 		     KPL* rkpa,
-		     int kmer_len,
+		     const KmerSeed* ks,
 		     AlignmentP fwa,
-		     AlignmentP rca ) ;
+		     AlignmentP rca,
+		     unsigned int saturate,
+		     KmerFiltStatsP kfs ) ;
 
 int kmer_filter( int kmer_filt_len, FragSeqP fs, KmersP k ) ;
 
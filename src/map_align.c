@@ -13,7 +13,7 @@
  the order: A, C, G, T, N
  */
 
-inline short int base2inx(const char base) {
+short int base2inx(const char base) {
 	switch (base) {
 	case 'A':
 		return 0;
@@ -58,6 +58,25 @@ inline int alnseq_ol_reg(AlnSeqP as, const int rs, const int re) {
             return 1;*/
 }
 
+/* aln_seq_col
+ Args: (1) AlnSeqP as
+       (2) int pos - position on the reference
+       (3) int ref_len - length of the reference
+ Returns: the column of as at pos, or -1 if as does not cover pos.
+ An AlnSeq that runs past the end of a circular reference (as->end >=
+ ref_len) covers pos both where it starts and, after the end, again
+ from the beginning of the reference
+ */
+int aln_seq_col(AlnSeqP as, const int pos, const int ref_len) {
+  if ((as->start <= pos) && (as->end >= pos)) {
+    return pos - as->start;
+  }
+  if ((as->end >= ref_len) && (as->end >= pos + ref_len)) {
+    return pos + ref_len - as->start;
+  }
+  return -1;
+}
+
 /* This IDsList */
 IDsListP init_ids_list(void) {
 	IDsListP ids;
@@ -77,6 +96,7 @@ IDsListP init_ids_list(void) {
 
 	ids->num_ids = 0;
 	ids->sorted = 0;
+	ids->size = INIT_NUM_IDS;
 	ids->ids = ids_array;
 	return ids;
 }
@@ -91,7 +111,7 @@ void add_id(char* new_id, IDsListP used_ids_list) {
 }
 
 void grow_ids_list(IDsListP ids) {
-	int new_size, i, k;
+	size_t new_size, i, k;
 	char** ids_array;
 	char* first_id;
 	new_size = (ids->size) * 2;
@@ -183,13 +203,34 @@ void show_single_pos(int ref_pos, char ref_base,
 	 );
 }
 
+/* 2^(-i/SCORE_PER_BIT) for i = 0..SCORE_PER_BIT-1; filled in the
+   first time find_phred_qscore is called */
+static double frac_pow2[SCORE_PER_BIT];
+static int frac_pow2_set = 0;
+
+/* pow2_down
+   Args: (1) int d - score difference >= 0 in 1/SCORE_PER_BIT bits
+   Returns: 2^(-d/SCORE_PER_BIT), looked up in frac_pow2 and shifted
+   by the whole number of bits
+*/
+static double pow2_down( int d ) {
+  return ldexp( frac_pow2[d % SCORE_PER_BIT], -(d / SCORE_PER_BIT) );
+}
+
 int find_phred_qscore( BaseCountsP bcs ) {
   size_t i;
   int best_score;
   int not_best_scores[3];
-  double p_best_score;
-  double p_nbs[3];
+  double p_nbs;
   double p_correct;
+
+  if ( !frac_pow2_set ) {
+    for( i = 0; i < SCORE_PER_BIT; i++ ) {
+      frac_pow2[i] = pow( 2, -((double)i / SCORE_PER_BIT) );
+    }
+    frac_pow2_set = 1;
+  }
+
   /* Is A the best-scoring base? */
   if ( (bcs->scoreA >= bcs->scoreC) &&
        (bcs->scoreA >= bcs->scoreG) &&
@@ -227,18 +268,44 @@ int find_phred_qscore( BaseCountsP bcs ) {
     }
   }
 
-  p_best_score = pow(2,((double)best_score/100));
+  /* The odds of the best base over the others are
+     2^(best/SCORE_PER_BIT) / sum 2^(other/SCORE_PER_BIT); dividing
+     through by the top keeps everything in range and turns the
+     powers into table lookups */
+  p_nbs = 0.0;
   for( i = 0; i < 3; i++ ) {
-    p_nbs[i] = pow(2,((double)not_best_scores[i]/100));
+    p_nbs += pow2_down( best_score - not_best_scores[i] );
   }
-  p_correct = p_best_score / ( p_nbs[0] + p_nbs[1] + p_nbs[2] );
   /* Check for overflow */
-  if ( p_correct >= DBL_MAX ) {
+  if ( p_nbs <= 1.0 / DBL_MAX ) {
     p_correct = DBL_MAX;
   }
+  else {
+    p_correct = 1.0 / p_nbs;
+  }
   return 10 * log10(p_correct);
 }
 
+int cons_qual( BaseCountsP bcs, char cons_base ) {
+  int q;
+  switch( cons_base ) {
+  case 'A' :
+  case 'C' :
+  case 'G' :
+  case 'T' :
+    q = find_phred_qscore( bcs );
+    if ( q < 0 ) {
+      return 0;
+    }
+    if ( q > MAX_CONS_QUAL ) {
+      return MAX_CONS_QUAL;
+    }
+    return q;
+  default :
+    return 0;
+  }
+}
+
 void add_base(char b, BaseCountsP bcs, PSSMP psm, int pssm_code) {
   short int b_inx;
   int depth;
@@ -275,6 +342,125 @@ void add_base(char b, BaseCountsP bcs, PSSMP psm, int pssm_code) {
   
 }
 
+/* front_dist
+ Args: (1) AlnSeqP as
+       (2) int col
+ Returns: number of read bases in as before the base in col, including
+ any inserted before it
+ */
+static int front_dist(AlnSeqP as, int col) {
+  int i, dist = 0;
+  for (i = 0; i < col; i++) {
+    if (as->ins[i] != NULL) {
+      dist += strlen(as->ins[i]);
+    }
+    if (as->seq[i] != '-') {
+      dist++;
+    }
+  }
+  if (as->ins[col] != NULL) {
+    dist += strlen(as->ins[col]);
+  }
+  return dist;
+}
+
+/* back_dist
+ Args: (1) AlnSeqP as
+       (2) int col
+ Returns: number of read bases in as from the base in col to the end,
+ not counting any inserted before col
+ */
+static int back_dist(AlnSeqP as, int col) {
+  int i, dist = 0;
+  for (i = as->end - as->start; i >= col; i--) {
+    if (as->seq[i] != '-') {
+      dist++;
+    }
+    if ((i > col) && (as->ins[i] != NULL)) {
+      dist += strlen(as->ins[i]);
+    }
+  }
+  return dist;
+}
+
+/* set_asp_depth_offsets
+ Args: (1) AlnSeqP as
+       (2) int front_off - distance from the front of the read at col 0
+       (3) int back_off - distance from the back of the read after the
+           last column
+ Sets the smp_ fields of as, finding the columns near the ends
+ */
+static void set_asp_depth_offsets(AlnSeqP as, int front_off, int back_off) {
+  int col, aln_seq_len;
+  aln_seq_len = as->end - as->start + 1;
+  as->smp_front_off = front_off;
+  as->smp_back_off = back_off;
+
+  col = 0;
+  while ((col < aln_seq_len) &&
+	 ((front_off + front_dist(as, col)) <= PSSM_DEPTH)) {
+    col++;
+  }
+  as->smp_front_cols = col;
+
+  col = aln_seq_len;
+  while ((col > 0) &&
+	 ((back_off + back_dist(as, col - 1)) < PSSM_DEPTH)) {
+    col--;
+  }
+  as->smp_back_col = col;
+}
+
+/* asp_bases
+ Args: (1) AlnSeqP as
+       (2) int* len - set to the number of columns plus inserted bases
+ Returns: number of read bases in as, including inserted ones
+ */
+static int asp_bases(AlnSeqP as, int* len) {
+  int i, aln_seq_len, bases;
+  aln_seq_len = as->end - as->start + 1;
+  *len = aln_seq_len;
+  bases = 0;
+  for (i = 0; i < aln_seq_len; i++) {
+    if (as->ins[i] != NULL) {
+      *len += strlen(as->ins[i]);
+      bases += strlen(as->ins[i]);
+    }
+    if (as->seq[i] != '-') {
+      bases++;
+    }
+  }
+  return bases;
+}
+
+void set_depth_offsets(AlnSeqP front_asp, AlnSeqP back_asp) {
+  int front_bases, front_len, back_bases, back_len;
+
+  front_bases = asp_bases(front_asp, &front_len);
+  if (back_asp == NULL) {
+    set_asp_depth_offsets(front_asp, 0, front_len - front_bases - 1);
+    return;
+  }
+  back_bases = asp_bases(back_asp, &back_len);
+
+  set_asp_depth_offsets(front_asp, 0,
+			(front_len + back_len) - front_bases - 1);
+  set_asp_depth_offsets(back_asp, front_bases,
+			(front_len + back_len) - front_bases - 
+			back_bases - 1);
+}
+
+char depth_code(AlnSeqP as, int col) {
+  if (col < as->smp_front_cols) {
+    return 'A' + as->smp_front_off + front_dist(as, col);
+  }
+  if (col >= as->smp_back_col) {
+    return 'A' + (PSSM_DEPTH * 2) - 
+      (as->smp_back_off + back_dist(as, col));
+  }
+  return 'A' + PSSM_DEPTH;
+}
+
 void reset_base_counts(BaseCountsP bc) {
   bc->As = 0;
   bc->Cs = 0;
@@ -420,7 +606,8 @@ int alnSeqCmp(const void* as1_, const void* as2_) {
 			return 1;
 		}
 		if ( ((*as1)->end) == ((*as2)->end)) {
-			return 0;
+			/* Same place; keep the order the same every time */
+			return strcmp((*as1)->id, (*as2)->id);
 		}
 	}
 	return 0;
@@ -468,105 +655,118 @@ char revcom_char(const char base) {
   }
 }
 
-/* Takes a MapAlignmentP and a position where some of
- the aligned fragments have an insert relative to the
- reference. That is, maln->ref->gaps[position] > 0.
- Populates the char* ins_cons and int* cons_cov
- arrays with the consensus sequence and consensus
- coverage, respectively. These must be appropriately
- sized elsewhere. If out_format is the special value
- of 4, then we just show these differences now and
- do not return anything.
- */
-void find_ins_cons(MapAlignmentP maln, int pos, char* ins_cons, int* cons_cov,
-		int out_format) {
+/* ins_base_counts
+   Args: (1) MapAlignmentP maln
+         (2) int pos - a position where some of the aligned fragments
+	     have an insert, that is, maln->ref->gaps[pos] > 0
+	 (3) BaseCountsP bcs - room for maln->ref->gaps[pos] BaseCounts
+   Returns: void
+   Counts up the bases and gaps of all the aligned fragments covering
+   pos for each column of the insert before it, one BaseCounts per
+   column
+*/
+void ins_base_counts(MapAlignmentP maln, int pos, BaseCountsP bcs) {
 	int i, j, ins_len, this_frag_ins_len;
+	size_t seq_num;
 	char* ins_seq;
+	char smp_code;
+	int col;
 	AlnSeqP aln_seq;
-	BaseCountsP* bcs_array;
-	BaseCountsP first_bcs;
 	PSSMP psm;
 
 	ins_len = maln->ref->gaps[pos];
-
-	bcs_array = (BaseCountsP*)save_malloc(ins_len * sizeof(BaseCountsP));
-	first_bcs = (BaseCountsP)save_malloc(ins_len * sizeof(BaseCounts));
-
 	for (i = 0; i < ins_len; i++) {
-		bcs_array[i] = &first_bcs[i];
-		reset_base_counts(bcs_array[i]);
+		reset_base_counts(&bcs[i]);
 	}
 
-	for (i = 0; i < maln->num_aln_seqs; i++) {
-		aln_seq = maln->AlnSeqArray[i];
+	for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+		aln_seq = maln->AlnSeqArray[seq_num];
 		/* Does this aligned fragment cover this position? */
-		if ( (aln_seq->start < pos) && // It does not cover this position
+		col = aln_seq_col(aln_seq, pos, maln->ref->seq_len);
+		if ( (col > 0) && // It does not cover this position
 				//if it starts exactly here because the gap is, by convention,
 				//just upstream of this position
-				(aln_seq->end >= pos)) {
+				(pos > 0)) { // nor the start of a circular reference
 			if (aln_seq->revcom) {
 				psm = maln->rpsm;
 			} else {
 				psm = maln->fpsm;
 			}
+			smp_code = depth_code(aln_seq, col);
 			/* Does it have some actual inserted sequence? */
-			ins_seq = aln_seq->ins[pos - aln_seq->start];
+			ins_seq = aln_seq->ins[col];
 			if (ins_seq == NULL) {
 				for (j = 0; j < ins_len; j++) {
-					add_base( '-', bcs_array[j], psm,
-							aln_seq->smp[pos - aln_seq->start]);
+					add_base( '-', &bcs[j], psm, smp_code);
 				}
 			} else {
 				this_frag_ins_len = strlen(ins_seq);
 				for (j = 0; j < ins_len; j++) {
 					if (j < this_frag_ins_len) {
-						add_base(ins_seq[j], bcs_array[j], psm,
-								aln_seq->smp[pos - aln_seq->start]);
+						add_base(ins_seq[j], &bcs[j], psm, smp_code);
 					} else {
-						add_base( '-', bcs_array[j], psm,
-								aln_seq->smp[pos - aln_seq->start]);
+						add_base( '-', &bcs[j], psm, smp_code);
 					}
 				}
 			}
 		}
 	}
+}
+
+/* Takes a MapAlignmentP and a position where some of
+ the aligned fragments have an insert relative to the
+ reference. That is, maln->ref->gaps[position] > 0.
+ Populates the char* ins_cons and int* cons_cov
+ arrays with the consensus sequence and consensus
+ coverage, respectively. These must be appropriately
+ sized elsewhere. If out_format is the special value
+ of 4, then we just show these differences now and
+ do not return anything.
+ */
+void find_ins_cons(MapAlignmentP maln, int pos, char* ins_cons, int* cons_cov,
+		int* ins_qual, int out_format) {
+	int j, ins_len;
+	BaseCountsP bcs;
+
+	ins_len = maln->ref->gaps[pos];
+
+	/* This is called for every insert position whenever a consensus
+	   is made, so the BaseCounts come from a recycled pool */
+	if (ins_len <= MAX_INS_LEN) {
+		bcs = (BaseCountsP)pool_get(&ins_bcs_pool);
+	} else {
+		bcs = (BaseCountsP)save_malloc(ins_len * sizeof(BaseCounts));
+	}
+
+	ins_base_counts(maln, pos, bcs);
 
 	for (j = 0; j < ins_len; j++) {
-		ins_cons[j] = find_consensus(bcs_array[j], maln->cons_code);
-		cons_cov[j] = bcs_array[j]->cov;
+		ins_cons[j] = find_consensus(&bcs[j], maln->cons_code);
+		cons_cov[j] = bcs[j].cov;
+		if (ins_qual != NULL) {
+			ins_qual[j] = cons_qual(&bcs[j], ins_cons[j]);
+		}
 		if ( (out_format == 4) && !(ins_cons[j] == '-')) {
-			show_single_pos(pos, '-', ins_cons[j], bcs_array[j]);
+			show_single_pos(pos, '-', ins_cons[j], &bcs[j]);
 		}
 		if (out_format == 41) {
-			show_single_pos(pos, '-', ins_cons[j], bcs_array[j]);
+			show_single_pos(pos, '-', ins_cons[j], &bcs[j]);
 		}
 	}
 
-	free(first_bcs);
-	free(bcs_array);
+	if (ins_len <= MAX_INS_LEN) {
+		pool_put(&ins_bcs_pool, bcs);
+	} else {
+		free(bcs);
+	}
 }
 
 void revcom_PWAF(PWAlnFragP pwaln) {
-  char tmp_ref, tmp_frag;
-  int len, i;
+  int len;
   len = strlen(pwaln->ref_seq);
 
-  for (i = 0; i < len/2; i++) {
-    tmp_ref = pwaln->ref_seq[i];
-    pwaln->ref_seq[i] = revcom_char(pwaln->ref_seq[len-(i+1)]);
-    pwaln->ref_seq[len-(i+1)] = revcom_char(tmp_ref);
-    
-    tmp_frag = pwaln->frag_seq[i];
-    pwaln->frag_seq[i] = revcom_char(pwaln->frag_seq[len-(i+1)]);
-    pwaln->frag_seq[len-(i+1)] = revcom_char(tmp_frag);
-  }
-  
-  /* If sequence length is even, we're done, otherwise there is
-     the base right in the center to revcom */
-  if (len%2 == 1) {
-    pwaln->ref_seq[i] = revcom_char(pwaln->ref_seq[len-(i+1)]);
-    pwaln->frag_seq[i] = revcom_char(pwaln->frag_seq[len-(i+1)]);
-  }
+  revcom_seq(pwaln->ref_seq, pwaln->ref_seq, len);
+  revcom_seq(pwaln->frag_seq, pwaln->frag_seq, len);
   pwaln->revcom = 1;
 
 }
@@ -580,7 +780,9 @@ void revcom_PWAF(PWAlnFragP pwaln) {
 void print_region( MapAlignmentP maln, int reg_start, int reg_end,
 		   int out_format, int in_color ) {
   int i, ref_pos, ref_gaps, j, cons_pos, ins_len;
-  int num_gaps = 0;
+  size_t seq_num;
+  int num_gaps;
+  int* pad;
   int ins_seq_len;
   int read_out_pos;
   char* consensus;
@@ -607,9 +809,9 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
   reset_base_counts(bcs);
   
   /* Find how many gaps are in this region */
-  for (i = reg_start-1; i <= reg_end; i++) {
-    num_gaps += maln->ref->gaps[i];
-  }
+  pad = padded_map(maln);
+  num_gaps = pad[reg_end] - pad[reg_start-1] - (reg_end - reg_start + 1);
+  free(pad);
   
   /* Make char arrays long enough for the sequence plus
      gaps for the reference, the consensus, and a single 
@@ -634,7 +836,7 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
     /* Add these gaps to the reference aligned string and the inserted
        sequence to the consensus[] */
     if (ref_gaps > 0) {
-      find_ins_cons(maln, ref_pos, ins_cons, ins_cov, out_format);
+      find_ins_cons(maln, ref_pos, ins_cons, ins_cov, NULL, out_format);
       for (j = 0; j < ref_gaps; j++) {
 	aln_ref[cons_pos] = '-';
 	consensus[cons_pos] = ins_cons[j];
@@ -646,8 +848,8 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
     
     /* Find all the aligned fragments that include this
        position and make a consensus from it */
-    for (j = 0; j < maln->num_aln_seqs; j++) {
-      aln_seq = maln->AlnSeqArray[j];
+    for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+      aln_seq = maln->AlnSeqArray[seq_num];
       /* Does this aligned fragment cover this position? */
       if ( (aln_seq->start <= ref_pos) && // checked
 	   (aln_seq->end >= ref_pos)) {
@@ -657,7 +859,7 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
 	  psm = maln->fpsm;
 	}
 	add_base(aln_seq->seq[ref_pos - aln_seq->start], bcs, psm,
-		 aln_seq->smp[ref_pos - aln_seq->start]);
+		 depth_code(aln_seq, ref_pos - aln_seq->start));
       }
     }
     
@@ -694,8 +896,8 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
   read_id  = (char*)save_malloc((MAX_ID_LEN + 4) * sizeof(char) + 1);
   /* Find every sequence that overlaps this region and print
      the overlapping segment */
-  for (j = 0; j < maln->num_aln_seqs; j++) {
-    aln_seq = maln->AlnSeqArray[j];
+  for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+    aln_seq = maln->AlnSeqArray[seq_num];
     if (alnseq_ol_reg(aln_seq, (reg_start-1), (reg_end-1)) ) {
       read_out_pos = 0;
       if (aln_seq->trimmed) {
@@ -788,81 +990,62 @@ void print_region( MapAlignmentP maln, int reg_start, int reg_end,
   free(read_id);
 }
 
-void col_print_cons(char* consensus, char* aln_ref, int* cov, int* ref_poss,
-		MapAlignmentP maln) {
-	int len, i;
-	char c;
-	int* starts_f;
-	int* starts_r;
-	int* ends_f;
-	int* ends_r;
-	AlnSeqP as;
-
-	len = strlen(consensus);
-
-	starts_f = (int* )save_malloc(len * sizeof(int));
-	starts_r = (int* )save_malloc(len * sizeof(int));
-	ends_f = (int* )save_malloc(len * sizeof(int));
-	ends_r = (int* )save_malloc(len * sizeof(int));
-
-	/* Initialize everything to zero */
-	for (i = 0; i < len; i++) {
-		starts_f[i] = 0;
-		starts_r[i] = 0;
-		ends_f[i] = 0;
-		ends_r[i] = 0;
+void add_frag_ends(AlnSeqP as, int* starts_f, int* starts_r,
+		int* ends_f, int* ends_r) {
+	if (as->revcom) {
+		switch (as->segment) {
+		case 'f':
+			/* only the start is correct for front fragments */
+			starts_r[as->start]++;
+			break;
+		case 'b':
+			/* only the end is correct for back fragments */
+			ends_r[as->end]++;
+			break;
+		default:
+			starts_r[as->start]++;
+			ends_r[as->end]++;
+			break;
+		}
 	}
 
-	/* Now, go through all the aligned fragments and update
-	 the starts and ends arrays based on where each fragment...
-	 starts and ends! */
-	for (i = 0; i < maln->num_aln_seqs; i++) {
-		as = maln->AlnSeqArray[i];
-		if (as->revcom) {
-			switch (as->segment) {
-			case 'f':
-				/* only the start is correct for front fragments */
-				starts_r[as->start]++;
-				break;
-			case 'b':
-				/* only the end is correct for back fragments */
-				ends_r[as->end]++;
-				break;
-			default:
-				starts_r[as->start]++;
-				ends_r[as->end]++;
-				break;
-			}
-		}
-
-		/* Not reverse complement */
-		else {
-			switch (as->segment) {
-			case 'f':
-				/* only the start is correct for front fragments */
-				starts_f[as->start]++;
-				break;
-			case 'b':
-				/* only the end is correct for back fragments */
-				ends_f[as->end]++;
-				break;
-			default:
-				starts_f[as->start]++;
-				ends_f[as->end]++;
-				break;
-			}
+	/* Not reverse complement */
+	else {
+		switch (as->segment) {
+		case 'f':
+			/* only the start is correct for front fragments */
+			starts_f[as->start]++;
+			break;
+		case 'b':
+			/* only the end is correct for back fragments */
+			ends_f[as->end]++;
+			break;
+		default:
+			starts_f[as->start]++;
+			ends_f[as->end]++;
+			break;
 		}
 	}
+}
+
+void col_print_ends(char* consensus, char* aln_ref, int* cov, int* qual,
+		int* ref_poss, char* ref_id, int* starts_f, int* starts_r, int* ends_f,
+		int* ends_r) {
+	int len, i;
+	char c;
+
+	len = strlen(consensus);
 
 	printf("# Columns:\n");
 	printf("# 1. Assembly consensus base\n");
-	printf("# 2. Reference %s base\n", maln->ref->id);
+	printf("# 2. Reference %s base\n", ref_id);
 	printf("# 3. Coverage (number of reads overlapping this position)\n");
 	printf("# 4. Coordinate on reference sequence (1-based)\n");
 	printf("# 5. Number of fragments on forward strand that start here\n");
 	printf("# 6. Number of fragments on reverse strand that start here\n");
 	printf("# 7. Number of fragments on forward strand that end here\n");
 	printf("# 8. Number of fragments on reverse strand that end here\n");
+	printf("# 9. Consensus quality (Phred)\n");
 	for (i = 0; i < len; i++) {
 		if ( !((consensus[i] == '-') && (aln_ref[i] == '-') )) {
 			if (consensus[i] == ' ') {
@@ -870,16 +1053,14 @@ void col_print_cons(char* consensus, char* aln_ref, int* cov, int* ref_poss,
 			} else {
 				c = consensus[i];
 			}
-			printf("%c\t%c\t%d\t%d\t%d\t%d\t%d\t%d\n", c, aln_ref[i], cov[i],
-					(ref_poss[i]+1), starts_f[ref_poss[i]],
+			printf("%c\t%c\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", c, aln_ref[i],
+					cov[i], (ref_poss[i]+1), starts_f[ref_poss[i]],
 					starts_r[ref_poss[i]], ends_f[ref_poss[i]],
-					ends_r[ref_poss[i]]);
+					ends_r[ref_poss[i]], qual[i]);
 		}
 	}
 }
 
-
-
 /* Takes a pointer to a populated PWAlnFrag (pwaln) and
  a pointer to a populated MapAlignent (maln)
  Does:
@@ -940,7 +1121,7 @@ int merge_pwaln_into_maln(PWAlnFragP pwaln, MapAlignmentP maln) {
 	ins_seq[j++] = pwaln->frag_seq[i];
       } else {
 	// Starting a new gap
-	ins_seq = (char*)save_malloc(MAX_INS_LEN * sizeof(char));
+	ins_seq = (char*)pool_get(&ins_buf_pool);
 	j = 0;
 	ins_seq[j++] = f;
       }
@@ -970,6 +1151,10 @@ int merge_pwaln_into_maln(PWAlnFragP pwaln, MapAlignmentP maln) {
   ref_frag_len = asp->end - asp->start + 1;
   for (i = 0; i < ref_frag_len; i++) {
     ref_pos = asp->start + i;
+    if (ref_pos >= maln->ref->seq_len) {
+      /* Wrapped around the end of a circular reference */
+      ref_pos -= maln->ref->seq_len;
+    }
     gap_compare = this_ref_gaps[i] - maln->ref->gaps[ref_pos];
     
     if (gap_compare > 0) {
@@ -15,6 +15,7 @@
 #include <string.h>
 #include "io.h"
 #include "map_alignment.h"
+#include "seqops.h"
 
 
 /* Function Prototypes */
@@ -31,7 +32,7 @@
  the order: A, C, G, T, N
  */
 
-inline short int base2inx(const char base) ;
+short int base2inx(const char base) ;
 
 int idCmp(const void* id1_, const void* id2_) ;
 
@@ -55,8 +56,59 @@ int allowed_alignment(int ids_rest, IDsListP rest_ids_list, int no_dups,
 
 void show_single_pos(int ref_pos, char ref_base, char cons_base, BaseCountsP bcs) ;
 
+/* find_phred_qscore
+ Args: (1) BaseCountsP bcs - with valid aggregate scores
+ Returns: int - 10 * log10 of the odds of the best-scoring base over
+ the other three, where each base's weight is 2 to the power of its
+ aggregate score in bits. Powers of two come from a table at the
+ integer granularity of the scores, so no pow is called per position.
+ */
+int find_phred_qscore( BaseCountsP bcs ) ;
+
+/* cons_qual
+ Args: (1) BaseCountsP bcs - with valid data
+       (2) char cons_base - the consensus called from bcs
+ Returns: int - the Phred quality of the consensus call for output;
+ find_phred_qscore held to 0..MAX_CONS_QUAL for a called base, or 0
+ for N and gap calls
+ */
+int cons_qual( BaseCountsP bcs, char cons_base ) ;
+
 void add_base(char b, BaseCountsP bcs, PSSMP psm, int pssm_code) ;
 
+/* aln_seq_col
+ Args: (1) AlnSeqP as
+       (2) int pos - position on the reference
+       (3) int ref_len - length of the reference
+ Returns: the column of as at pos, or -1 if as does not cover pos.
+ An AlnSeq that runs past the end of a circular reference (as->end >=
+ ref_len) covers pos both where it starts and, after the end, again
+ from the beginning of the reference
+ */
+int aln_seq_col(AlnSeqP as, const int pos, const int ref_len) ;
+
+/* set_depth_offsets
+ Args: (1) AlnSeqP front_asp - the (first) aligned part of a read
+       (2) AlnSeqP back_asp - the part of the same read that wrapped
+           around to the beginning of the reference, split off from
+           it for an MA file (segment b), or NULL
+ Returns: void
+ Sets the smp_ fields of front_asp and back_asp so that depth_code
+ can find the substitution matrix depth code at any column. Must be
+ called again whenever an AlnSeq's seq or ins change.
+ */
+void set_depth_offsets(AlnSeqP front_asp, AlnSeqP back_asp) ;
+
+/* depth_code
+ Args: (1) AlnSeqP as - with smp_ fields set by set_depth_offsets
+       (2) int col - column in as->seq
+ Returns: the code ('A' + depth) for which PSSM_DEPTH matrix to use
+ for the base in this column. It depends on how far this base is from
+ the front and back of the read. Only the few columns near the ends
+ need a look at the sequence; the rest are all 'A' + PSSM_DEPTH
+ */
+char depth_code(AlnSeqP as, int col) ;
+
 void reset_base_counts(BaseCountsP bc) ;
 
 /* Takes a pointer to a BaseCounts bcs and the maln->cons_code
@@ -79,18 +131,32 @@ int alnSeqCmp(const void* as1_, const void* as2_) ;
 
 char revcom_char(const char base) ;
 
+/* ins_base_counts
+   Args: (1) MapAlignmentP maln
+         (2) int pos - a position where some of the aligned fragments
+	     have an insert, that is, maln->ref->gaps[pos] > 0
+	 (3) BaseCountsP bcs - room for maln->ref->gaps[pos] BaseCounts
+   Returns: void
+   Counts up the bases and gaps of all the aligned fragments covering
+   pos for each column of the insert before it, one BaseCounts per
+   column
+*/
+void ins_base_counts(MapAlignmentP maln, int pos, BaseCountsP bcs) ;
+
 /* Takes a MapAlignmentP and a position where some of
  the aligned fragments have an insert relative to the
  reference. That is, maln->ref->gaps[position] > 0.
  Populates the char* ins_cons and int* cons_cov
  arrays with the consensus sequence and consensus
- coverage, respectively. These must be appropriately
+ coverage, respectively, and int* ins_qual, unless it
+ is NULL, with the consensus qualities (see cons_qual).
+ These must be appropriately
  sized elsewhere. If out_format is the special value
  of 4, then we just show these differences now and
  do not return anything.
  */
 void find_ins_cons(MapAlignmentP maln, int pos, char* ins_cons, int* cons_cov,
-		int out_format) ;
+		int* ins_qual, int out_format) ;
 
 void revcom_PWAF(PWAlnFragP pwaln) ;
 
@@ -102,8 +168,33 @@ void revcom_PWAF(PWAlnFragP pwaln) ;
 void print_region(MapAlignmentP maln, int reg_start, int reg_end,
 		int out_format, int in_color) ;
 
-void col_print_cons(char* consensus, char* aln_ref, int* cov, int* ref_poss,
-		MapAlignmentP maln) ;
+/* add_frag_ends
+ Args: (1) AlnSeqP as - an aligned fragment
+       (2) int* starts_f - number of forward strand fragments starting
+           at each reference position
+       (3) int* starts_r - same for reverse strand fragments
+       (4) int* ends_f - number of forward strand fragments ending at
+           each reference position
+       (5) int* ends_r - same for reverse strand fragments
+ Returns: void
+ Counts where as starts and ends. Only the start of a front (f) segment
+ and the end of a back (b) segment are the ends of the read.
+ */
+void add_frag_ends(AlnSeqP as, int* starts_f, int* starts_r,
+		int* ends_f, int* ends_r) ;
+
+/* col_print_ends
+ Args: (1)-(5) the aligned consensus, the aligned reference, the
+           coverage, the consensus quality, and the reference position
+           of each column
+       (6) char* ref_id - ID of the reference
+       (7)-(10) the fragment start and end counts from add_frag_ends
+ Returns: void
+ Prints the column format (3) table
+ */
+void col_print_ends(char* consensus, char* aln_ref, int* cov, int* qual,
+		int* ref_poss, char* ref_id, int* starts_f, int* starts_r,
+		int* ends_f, int* ends_r) ;
 
 /* Takes a pointer to a populated PWAlnFrag (pwaln) and
  a pointer to a populated MapAlignent (maln)
@@ -1,10 +1,41 @@
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "map_alignment.h"
 
+/* zero_aln_seq
+ Args: (1) AlnSeqP as - fresh memory for an AlnSeq
+ Returns: void
+ Clears out as and sets all its char* ins to NULL
+ */
+static void zero_aln_seq(AlnSeqP as) {
+    int j;
+    for (j = 0; j <= MAX_ID_LEN; j++) {
+        as->id[j] = '\0';
+    }
+    for (j = 0; j <= MAX_DESC_LEN; j++) {
+        as->desc[j] = '\0';
+    }
+    for (j = 0; j <= INIT_ALN_SEQ_LEN; j++) {
+        as->seq[j] = '\0';
+    }
+    for (j = 0; j <= (2 * INIT_ALN_SEQ_LEN); j++) {
+        as->ins[j] = NULL;
+    }
+    as->start = 0;
+    as->end = 0;
+    as->revcom = 0;
+    as->trimmed = 0;
+    as->score = 0;
+    as->segment = 'n';
+}
+
 /* Initialize a MapAlignment object and return a pointer to it */
 MapAlignmentP init_map_alignment(void) {
     MapAlignmentP aln;
-    AlnSeqP first_seq, as;
-    size_t i, j;
+    AlnSeqP first_seq;
+    size_t i;
 
     // First, allocate the alignment
     aln = (MapAlignmentP) save_malloc(sizeof (MapAlignment));
@@ -47,26 +78,7 @@ MapAlignmentP init_map_alignment(void) {
     for (i = 0; i < INIT_NUM_ALN_SEQS; i++) {
         aln->AlnSeqArray[i] = &first_seq[i];
         /* Zero them out */
-        as = aln->AlnSeqArray[i];
-        for (j = 0; j <= MAX_ID_LEN; j++) {
-            as->id[j] = '\0';
-        }
-        for (j = 0; j <= MAX_DESC_LEN; j++) {
-            as->desc[j] = '\0';
-        }
-        for (j = 0; j <= INIT_ALN_SEQ_LEN; j++) {
-            as->seq[j] = '\0';
-        }
-        /* Set all their char* ins to NULL */
-        for (j = 0; j <= INIT_ALN_SEQ_LEN; j++) {
-            as->ins[j] = NULL;
-        }
-        as->start = 0;
-        as->end = 0;
-        as->revcom = 0;
-        as->trimmed = 0;
-        as->score = 0;
-        as->segment = 'n';
+        zero_aln_seq(aln->AlnSeqArray[i]);
     }
 
     aln->size = INIT_NUM_ALN_SEQS;
@@ -100,121 +112,235 @@ void free_map_alignment(MapAlignmentP maln) {
     return;
 }
 
-void show_consensus(MapAlignmentP maln, int out_format) {
-    char* consensus;
-    char* aln_ref;
-    char* ins_cons;
-    char cons_id[MAX_ID_LEN + 1];
-    int i, j, cons_pos, ref_pos, ref_gaps;
-    int* cov;
-    int* ins_cov;
-    int* ref_poss;
-    int len_consensus = get_consensus_length(maln);
+/* init_pileup
+ Args: (1) const char* ref_id
+       (2) int ref_len - length of the reference
+       (3) int size - most columns the padded alignment can have
+ Returns: PileupP with room for size columns and zeroed start and
+ end counts, and no columns yet
+ */
+static PileupP init_pileup(const char* ref_id, int ref_len, int size) {
+    PileupP pile;
+    int i;
+    pile = (PileupP) save_malloc(sizeof (Pileup));
+    strcpy(pile->ref_id, ref_id);
+    pile->ref_len = ref_len;
+    pile->num_cols = 0;
+    pile->size = size;
+    pile->num_frags = 0;
+    pile->total_frag_len = 0;
+    pile->aln_ref = (char*) save_malloc((size + 1) * sizeof (char));
+    pile->ref_poss = (int*) save_malloc((size + 1) * sizeof (int));
+    pile->bcs = (BaseCountsP) save_malloc((size + 1) * sizeof (BaseCounts));
+    pile->starts_f = (int*) save_malloc((ref_len + 1) * sizeof (int));
+    pile->starts_r = (int*) save_malloc((ref_len + 1) * sizeof (int));
+    pile->ends_f = (int*) save_malloc((ref_len + 1) * sizeof (int));
+    pile->ends_r = (int*) save_malloc((ref_len + 1) * sizeof (int));
+    for (i = 0; i <= ref_len; i++) {
+        pile->starts_f[i] = 0;
+        pile->starts_r[i] = 0;
+        pile->ends_f[i] = 0;
+        pile->ends_r[i] = 0;
+    }
+    return pile;
+}
+
+/* free_pileup
+ Args: (1) PileupP pile
+ Returns: void
+ */
+void free_pileup(PileupP pile) {
+    free(pile->aln_ref);
+    free(pile->ref_poss);
+    free(pile->bcs);
+    free(pile->starts_f);
+    free(pile->starts_r);
+    free(pile->ends_f);
+    free(pile->ends_r);
+    free(pile);
+}
+
+/* pile_pos
+ Args: (1) MapAlignmentP maln - has all the aligned fragments that cover
+           ref_pos (and maybe others)
+       (2) int ref_pos - position on the reference
+       (3) PileupP pile - with the columns before ref_pos
+ Returns: void
+ Adds the columns for the inserts before ref_pos and for ref_pos to
+ pile
+ */
+static void pile_pos(MapAlignmentP maln, int ref_pos, PileupP pile) {
+    int j, ref_gaps, col;
+    size_t seq_num;
     AlnSeqP aln_seq;
-    BaseCountsP bcs;
     PSSMP psm;
+    BaseCountsP bcs;
 
-    bcs = (BaseCountsP) save_malloc(sizeof (BaseCounts));
+    /* How many gaps preceeded this position? */
+    ref_gaps = maln->ref->gaps[ref_pos];
+    col = pile->num_cols;
+
+    /* Add these gaps to the reference aligned string */
+    if ((ref_gaps > 0) && (ref_pos > 0)) {
+        ins_base_counts(maln, ref_pos, &pile->bcs[col]);
+        for (j = 0; j < ref_gaps; j++) {
+            pile->aln_ref[col] = '-';
+            pile->ref_poss[col] = ref_pos;
+            col++;
+        }
+    }
+    /* Re-zero all the base counts */
+    bcs = &pile->bcs[col];
     reset_base_counts(bcs);
 
-    consensus = (char*) save_malloc((len_consensus + 1) * sizeof (char));
-    aln_ref = (char*) save_malloc((len_consensus + 1) * sizeof (char));
-    cov = (int*) save_malloc((len_consensus + 1) * sizeof (int));
-    ref_poss = (int*) save_malloc((len_consensus + 1) * sizeof (int));
+    /* Find all the aligned fragments that include this
+       position and pile them up */
+    for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+        aln_seq = maln->AlnSeqArray[seq_num];
+        /* Does this aligned fragment cover this position? */
+        if ((aln_seq->start <= ref_pos) && // checked
+                (aln_seq->end >= ref_pos)) {
+
+            if (aln_seq->revcom) {
+                psm = maln->rpsm;
+            } else {
+                psm = maln->fpsm;
+            }
+
+            add_base(aln_seq->seq[ref_pos - aln_seq->start], bcs, psm,
+                    depth_code(aln_seq, ref_pos - aln_seq->start));
+        }
+    }
+    pile->aln_ref[col] = maln->ref->seq[ref_pos];
+    pile->ref_poss[col] = ref_pos;
+    pile->num_cols = col + 1;
+}
 
-    ins_cons = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
-    ins_cov = (int*) save_malloc(MAX_INS_LEN * sizeof (int));
+/* maln_pileup
+ Args: (1) MapAlignmentP maln
+ Returns: PileupP of all the aligned fragments of maln; free it with
+ free_pileup
+ */
+PileupP maln_pileup(MapAlignmentP maln) {
+    PileupP pile;
+    int ref_pos;
+    size_t seq_num;
 
-    cons_pos = 0;
-    ref_pos = 0;
+    pile = init_pileup(maln->ref->id, maln->ref->seq_len,
+            get_consensus_length(maln));
     /* Go through each position of the reference sequence */
     for (ref_pos = 0; ref_pos < maln->ref->seq_len; ref_pos++) {
-        /* How many gaps preceeded this position? */
-        ref_gaps = maln->ref->gaps[ref_pos];
-
-        /* Add these gaps to the reference aligned string */
-        if ((ref_gaps > 0) && (ref_pos > 0)) {
-            find_ins_cons(maln, ref_pos, ins_cons, ins_cov, out_format);
-            for (j = 0; j < ref_gaps; j++) {
-                aln_ref[cons_pos] = '-';
-                consensus[cons_pos] = ins_cons[j];
-                cov[cons_pos] = ins_cov[j];
-                ref_poss[cons_pos] = ref_pos;
-                cons_pos++;
-            }
-        }
-        /* Re-zero all the base counts */
-        reset_base_counts(bcs);
-
-        /* Find all the aligned fragments that include this
-           position and make a consensus from it */
-        for (j = 0; j < maln->num_aln_seqs; j++) {
-            aln_seq = maln->AlnSeqArray[j];
-            /* Does this aligned fragment cover this position? */
-            if ((aln_seq->start <= ref_pos) && // checked
-                    (aln_seq->end >= ref_pos)) {
-
-                if (aln_seq->revcom) {
-                    psm = maln->rpsm;
-                } else {
-                    psm = maln->fpsm;
-                }
+        pile_pos(maln, ref_pos, pile);
+    }
 
-                add_base(aln_seq->seq[ref_pos - aln_seq->start], bcs, psm,
-                        aln_seq->smp[ref_pos - aln_seq->start]);
-            }
-        }
-        consensus[cons_pos] = find_consensus(bcs, maln->cons_code);
-        aln_ref[cons_pos] = maln->ref->seq[ref_pos];
-        cov[cons_pos] = bcs->cov;
-        ref_poss[cons_pos] = ref_pos;
-        if ((out_format == 4) && !(aln_ref[cons_pos] == consensus[cons_pos])) {
-            show_single_pos(ref_pos, aln_ref[cons_pos], consensus[cons_pos],
-                    bcs);
-        }
-        if (out_format == 41) {
-            show_single_pos(ref_pos, aln_ref[cons_pos], consensus[cons_pos],
-                    bcs);
+    /* Now, go through all the aligned fragments and update
+     the starts and ends arrays based on where each fragment...
+     starts and ends! */
+    for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+        add_frag_ends(maln->AlnSeqArray[seq_num], pile->starts_f,
+                pile->starts_r, pile->ends_f, pile->ends_r);
+        pile->total_frag_len += (maln->AlnSeqArray[seq_num]->end
+                - maln->AlnSeqArray[seq_num]->start + 1);
+    }
+    pile->num_frags = count_aln_seqs(maln);
+    return pile;
+}
+
+/* print_summary
+ Args: (1) const char* ref_id - ID of the reference
+       (2) int ref_len - length of the reference
+       (3) size_t num_frags - number of fragments aligned to it, not
+           counting the back parts of the ones that wrap around
+       (4) size_t total_frag_len - sum of the lengths of all the aligned
+           fragments
+ Returns: void
+ Prints the header of the column format (3) output
+ */
+static void print_summary(const char* ref_id, int ref_len, size_t num_frags,
+        size_t total_frag_len) {
+    printf("# Map reference ID: %s\n", ref_id);
+    printf("# Map reference length: %d\n", ref_len);
+    printf("# Number of fragments aligned to reference: %lu\n",
+            (unsigned long) num_frags);
+    printf("# Total length of aligned fragments: %lu\n",
+            (unsigned long) total_frag_len);
+    printf("# Average coverage: %0.3f\n", ((double) total_frag_len
+            / (double) ref_len));
+}
+
+/* show_pileup
+ Args: (1) PileupP pile
+       (2) int cons_code - consensus calling code
+       (3) const char* ref_id - ID to give the assembly; NULL keeps the
+           one in pile
+       (4) int out_format - 1, 2, 3, 4, 41, 5, or 51
+ Returns: void
+ Calls the consensus of each column of pile and shows it the way
+ show_consensus does
+ */
+void show_pileup(PileupP pile, int cons_code, const char* ref_id,
+        int out_format) {
+    char* consensus;
+    char* id;
+    int* cov;
+    int* qual;
+    int col;
+    BaseCounts bcs;
+
+    id = (ref_id == NULL) ? pile->ref_id : (char*) ref_id;
+    consensus = (char*) save_malloc((pile->num_cols + 1) * sizeof (char));
+    cov = (int*) save_malloc((pile->num_cols + 1) * sizeof (int));
+    qual = (int*) save_malloc((pile->num_cols + 1) * sizeof (int));
+
+    /* Call each column; 4 and 41 show them as they are called */
+    for (col = 0; col < pile->num_cols; col++) {
+        bcs = pile->bcs[col];
+        consensus[col] = find_consensus(&bcs, cons_code);
+        cov[col] = bcs.cov;
+        qual[col] = cons_qual(&bcs, consensus[col]);
+        if (((out_format == 4) && (pile->aln_ref[col] != consensus[col])) ||
+                (out_format == 41)) {
+            show_single_pos(pile->ref_poss[col], pile->aln_ref[col],
+                    consensus[col], &bcs);
         }
-        cons_pos++;
     }
-    consensus[cons_pos] = '\0';
-    aln_ref[cons_pos] = '\0';
+    consensus[pile->num_cols] = '\0';
+    pile->aln_ref[pile->num_cols] = '\0';
 
     /* Now, output the reference and consensus sequences and the
        coverage in specified way */
     switch (out_format) {
         case 1:
-            clustalw_print_cons(consensus, aln_ref, maln->ref->id);
+            clustalw_print_cons(consensus, pile->aln_ref, id);
             break;
         case 2:
-            line_print_cons(consensus, aln_ref, maln->ref->id, cov);
+            line_print_cons(consensus, pile->aln_ref, id, cov);
             break;
         case 3:
-            /* Add starts and ends info */
-            print_assembly_summary(maln);
-            col_print_cons(consensus, aln_ref, cov, ref_poss, maln);
-            break;
-        case 4:
-            ; /* Do nothing, this one is checked along the way */
-            break;
-        case 41:
-            ; /* Do nothing, this one is checked along the way */
+            print_summary(id, pile->ref_len, pile->num_frags,
+                    pile->total_frag_len);
+            col_print_ends(consensus, pile->aln_ref, cov, qual,
+                    pile->ref_poss, id, pile->starts_f, pile->starts_r,
+                    pile->ends_f, pile->ends_r);
             break;
         case 5:
-            //		sprintf(cons_id, "%s-assembled", maln->ref->id);
-            fasta_print_cons(consensus, maln->ref->id);
+            fasta_print_cons(consensus, id);
+            break;
+        case 51:
+            fastq_print_cons(consensus, qual, id);
             break;
     }
 
-    /* Free memory! */
-    free(bcs);
     free(consensus);
-    free(aln_ref);
     free(cov);
-    free(ref_poss);
-    free(ins_cons);
-    free(ins_cov);
+    free(qual);
+}
+
+void show_consensus(MapAlignmentP maln, int out_format) {
+    PileupP pile;
+    pile = maln_pileup(maln);
+    show_pileup(pile, maln->cons_code, NULL, out_format);
+    free_pileup(pile);
 }
 
 int get_consensus_length(MapAlignmentP maln) {
@@ -224,70 +350,154 @@ int get_consensus_length(MapAlignmentP maln) {
     return maln->ref->seq_len + num_gaps;
 }
 
-char* get_consensus(MapAlignmentP maln) {
-    int len_consensus = get_consensus_length(maln);
-    char* consensus = (char*) save_malloc((len_consensus + 1) * sizeof (char));
-    char* ins_cons = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
-    int i, j, cons_pos, ref_pos, ref_gaps;    
-    int* ins_cov = (int*) save_malloc(MAX_INS_LEN * sizeof (int));    
-    AlnSeqP aln_seq;
-    BaseCountsP bcs;
-    PSSMP psm;
-    bcs = (BaseCountsP) save_malloc(sizeof (BaseCounts));
-    reset_base_counts(bcs);
+char* get_consensus(MapAlignmentP maln, int* qual) {
+    PileupP pile;
+    char* consensus;
+    int col;
+
+    pile = maln_pileup(maln);
+    consensus = (char*) save_malloc((pile->num_cols + 1) * sizeof (char));
+    for (col = 0; col < pile->num_cols; col++) {
+        consensus[col] = find_consensus(&pile->bcs[col], maln->cons_code);
+        if (qual != NULL) {
+            qual[col] = cons_qual(&pile->bcs[col], consensus[col]);
+        }
+    }
+    consensus[pile->num_cols] = '\0';
+    free_pileup(pile);
+    return consensus;
+}
 
-    cons_pos = 0;
-    ref_pos = 0;
-    /* Go through each position of the reference sequence */
-    for (ref_pos = 0; ref_pos < maln->ref->seq_len; ref_pos++) {
-        /* How many gaps preceeded this position? */
-        ref_gaps = maln->ref->gaps[ref_pos];
-
-        /* Add these gaps to the reference aligned string */
-        if ((ref_gaps > 0) && (ref_pos > 0)) {
-            find_ins_cons(maln, ref_pos, ins_cons, ins_cov, 5);
-            for (j = 0; j < ref_gaps; j++) {
-                consensus[cons_pos] = ins_cons[j];
-                cons_pos++;
-            }
+/* split_aln_seq
+ Args: (1) AlnSeqP as - runs past the end of the reference
+       (2) int ref_len - length of the reference
+       (3) AlnSeqP front - where the part up to the end goes
+       (4) AlnSeqP back - where the part from the beginning on goes
+ Returns: void
+ Splits as the way MA files keep a read that wraps around a circular
+ reference: front (segment f) and back (segment b), with _f and _b
+ added to the ID. Both point to the inserted sequences of as.
+ */
+static void split_aln_seq(AlnSeqP as, int ref_len,
+        AlnSeqP front, AlnSeqP back) {
+    int j, id_len, front_cols;
+
+    *front = *as;
+    *back = *as;
+    front_cols = ref_len - as->start;
+
+    id_len = strlen(as->id);
+    if (id_len > (MAX_ID_LEN - 2)) {
+        id_len = MAX_ID_LEN - 2;
+    }
+    front->id[id_len] = '_';
+    front->id[id_len + 1] = 'f';
+    front->id[id_len + 2] = '\0';
+    strcpy(back->id, front->id);
+    back->id[id_len + 1] = 'b';
+
+    front->end = ref_len - 1;
+    front->segment = 'f';
+    front->seq[front_cols] = '\0';
+
+    back->start = 0;
+    back->end = as->end - ref_len;
+    back->segment = 'b';
+    strcpy(back->seq, &as->seq[front_cols]);
+
+    /* Anything inserted before the first base of the back part
+       goes with the back part */
+    for (j = 0; j <= (2 * INIT_ALN_SEQ_LEN); j++) {
+        if (j >= front_cols) {
+            front->ins[j] = NULL;
         }
-        /* Re-zero all the base counts */
-        reset_base_counts(bcs);
+        if ((j + front_cols) <= (2 * INIT_ALN_SEQ_LEN)) {
+            back->ins[j] = as->ins[j + front_cols];
+        } else {
+            back->ins[j] = NULL;
+        }
+    }
+    set_depth_offsets(front, back);
+}
 
-        /* Find all the aligned fragments that include this
-           position and make a consensus from it */
-        for (j = 0; j < maln->num_aln_seqs; j++) {
-            aln_seq = maln->AlnSeqArray[j];
-            /* Does this aligned fragment cover this position? */
-            if ((aln_seq->start <= ref_pos) && // checked
-                    (aln_seq->end >= ref_pos)) {
+/* split_wrapped_aln_seqs
+ Args: (1) MapAlignmentP maln
+ Returns: MapAlignmentP with the same reference, matrices and consensus
+ code as maln, and its AlnSeqs the way MA files keep them: each one that
+ runs past the end of a circular reference is split in two by
+ split_aln_seq, and they are sorted by alnSeqCmp. The split parts live
+ in the same block as its AlnSeqArray. If no AlnSeq wraps around, this
+ is just maln. Either way, give it back with free_split_aln_seqs.
+ */
+MapAlignmentP split_wrapped_aln_seqs(MapAlignmentP maln) {
+    MapAlignmentP split;
+    size_t seq_num, num_wrapped, split_num;
+    AlnSeqP as;
+    AlnSeqP parts;
 
-                psm = (aln_seq->revcom) ? (maln->rpsm) : (maln->fpsm);
+    num_wrapped = 0;
+    for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+        if (maln->AlnSeqArray[seq_num]->end >= maln->ref->seq_len) {
+            num_wrapped++;
+        }
+    }
+    if (num_wrapped == 0) {
+        return maln;
+    }
 
-                add_base(aln_seq->seq[ref_pos - aln_seq->start], bcs, psm,
-                        aln_seq->smp[ref_pos - aln_seq->start]);
-            }
+    split = (MapAlignmentP) save_malloc(sizeof (MapAlignment));
+    *split = *maln;
+    split->num_aln_seqs = maln->num_aln_seqs + num_wrapped;
+    split->size = split->num_aln_seqs;
+    split->AlnSeqArray = (AlnSeqP*) save_malloc(split->size *
+            sizeof (AlnSeqP) + (2 * num_wrapped * sizeof (AlnSeq)));
+    parts = (AlnSeqP) (split->AlnSeqArray + split->size);
+
+    split_num = 0;
+    for (seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++) {
+        as = maln->AlnSeqArray[seq_num];
+        if (as->end >= maln->ref->seq_len) {
+            split_aln_seq(as, maln->ref->seq_len, &parts[0], &parts[1]);
+            split->AlnSeqArray[split_num++] = &parts[0];
+            split->AlnSeqArray[split_num++] = &parts[1];
+            parts += 2;
+        } else {
+            split->AlnSeqArray[split_num++] = as;
         }
-        consensus[cons_pos] = find_consensus(bcs, maln->cons_code);
-        cons_pos++;
     }
-    consensus[cons_pos] = '\0';
-    return consensus;
+    sort_aln_frags(split);
+    return split;
+}
+
+/* free_split_aln_seqs
+ Args: (1) MapAlignmentP split - from split_wrapped_aln_seqs
+       (2) MapAlignmentP maln - what split was made from
+ Returns: void
+ */
+void free_split_aln_seqs(MapAlignmentP split, MapAlignmentP maln) {
+    if (split != maln) {
+        free(split->AlnSeqArray);
+        free(split);
+    }
 }
 
 /* Write out the data in a MapAlignment data structure
- to a file
+ to a file. AlnSeqs that wrap around a circular reference are
+ split in two (see split_wrapped_aln_seqs) on the way out.
  */
 int write_ma(char* fn, MapAlignmentP maln) {
     int i, j, row, col;
+    size_t seq_num;
     //    char* at;
     time_t t;
     int aln_seq_len;
     FILE* MAF;
     AlnSeqP as;
     PSSMP fpsm, rpsm;
+    MapAlignmentP out; // maln as it goes in the file
 
     MAF = fileOpen(fn, "w");
+    out = split_wrapped_aln_seqs(maln);
 
     t = time(NULL);
     //at = (char*) save_malloc(64 * sizeof (char));
@@ -298,8 +508,8 @@ int write_ma(char* fn, MapAlignmentP maln) {
 	    asctime(localtime(&t)) );
 
     /* Write MapAlignment Info */
-    fprintf(MAF, "MALN_NAS %d\n", maln->num_aln_seqs);
-    fprintf(MAF, "MALN_SIZ %d\n", maln->size);
+    fprintf(MAF, "MALN_NAS %lu\n", (unsigned long) out->num_aln_seqs);
+    fprintf(MAF, "MALN_SIZ %lu\n", (unsigned long) out->size);
     fprintf(MAF, "MALN_COC %d\n", maln->cons_code);
 
     /* Write the reference sequence and associated data */
@@ -350,8 +560,8 @@ int write_ma(char* fn, MapAlignmentP maln) {
 
     /* Write all the aligned fragments */
     fprintf(MAF, "__ALNSEQS__\n");
-    for (i = 0; i < maln->num_aln_seqs; i++) {
-      as = maln->AlnSeqArray[i];
+    for (seq_num = 0; seq_num < out->num_aln_seqs; seq_num++) {
+      as = out->AlnSeqArray[seq_num];
       aln_seq_len = strlen(as->seq);
       fprintf(MAF, "ID %s\n", as->id);
       fprintf(MAF, "DESC %s\n", as->desc);
@@ -363,7 +573,11 @@ int write_ma(char* fn, MapAlignmentP maln) {
       fprintf(MAF, "TR %d\n", as->trimmed);
       fprintf(MAF, "SEG %c\n", as->segment);
       fprintf(MAF, "SEQ %s\n", as->seq);
-      fprintf(MAF, "SMP %s\n", as->smp);
+      fprintf(MAF, "SMP ");
+      for (j = 0; j < aln_seq_len; j++) {
+        fputc(depth_code(as, j), MAF);
+      }
+      fprintf(MAF, "\n");
       fprintf(MAF, "INS_POS");
         for (j = 0; j < aln_seq_len; j++) {
             if (as->ins[j] == NULL) {
@@ -375,24 +589,60 @@ int write_ma(char* fn, MapAlignmentP maln) {
         fprintf(MAF, "\n");
     }
     fclose(MAF);
+    free_split_aln_seqs(out, maln);
     return 1;
 }
 
-MapAlignmentP read_ma(const char* fn) {
-    MapAlignmentP maln;
-    AlnSeqP as;
-    FILE* MAF;
-    char* line;
-    char* tmp_ins;
-    char c;
-    int tmp, i, as_num, ins_pos, depth, row, A, C, G, T, N;
+/* set_aln_seqs_depth_offsets
+ Args: (1) AlnSeqP* asa - AlnSeqs just read in
+       (2) size_t num - how many there are
+ Returns: void
+ Sets up the depth codes of all AlnSeqs in asa. The back (segment b)
+ part of a read that wraps around the reference goes with the front
+ (segment f) part having the same ID, apart from the _b or _f ending.
+ */
+static void set_aln_seqs_depth_offsets(AlnSeqP* asa, size_t num) {
+    size_t i, j;
+    size_t id_len;
+    AlnSeqP as, back_as;
 
-    line = (char*) save_malloc((MAX_LINE_LEN + 1) * sizeof (char));
-    MAF = fileOpen(fn, "r");
+    for (i = 0; i < num; i++) {
+        set_depth_offsets(asa[i], NULL);
+    }
 
-    maln = init_map_alignment();
-    maln->fpsm = (PSSMP) save_malloc(sizeof (PSSM));
-    maln->rpsm = (PSSMP) save_malloc(sizeof (PSSM));
+    for (i = 0; i < num; i++) {
+        as = asa[i];
+        if (as->segment != 'f') {
+            continue;
+        }
+        id_len = strlen(as->id);
+        for (j = 0; j < num; j++) {
+            back_as = asa[j];
+            if ((back_as->segment == 'b') &&
+                    (strlen(back_as->id) == id_len) &&
+                    (strncmp(back_as->id, as->id, id_len - 1) == 0)) {
+                set_depth_offsets(as, back_as);
+                break;
+            }
+        }
+    }
+}
+
+/* read_ma_header
+ Args: (1) FILE* MAF - maln file, open at the beginning
+       (2) const char* fn - its name, for error messages
+       (3) MapAlignmentP maln - with memory for ref, fpsm, and rpsm
+       (4) char* line - MAX_LINE_LEN + 1 chars of scratch space
+ Returns: the MALN_SIZ of the MapAlignment that was written
+ Reads everything up to the aligned fragments into maln, setting
+ maln->num_aln_seqs to how many of them follow. Exits if fn does not
+ look like a maln file.
+ */
+size_t read_ma_header(FILE* MAF, const char* fn, MapAlignmentP maln,
+        char* line) {
+    char c;
+    int i, depth, row, A, C, G, T, N;
+    unsigned long maln_nas = 0, maln_siz = 0;
 
     /* Check header */
     fgets(line, MAX_LINE_LEN, MAF);
@@ -404,15 +654,12 @@ MapAlignmentP read_ma(const char* fn) {
 
     /* Parse MALN_NAS */
     fgets(line, MAX_LINE_LEN, MAF);
-    sscanf(line, "MALN_NAS %d", &maln->num_aln_seqs);
+    sscanf(line, "MALN_NAS %lu", &maln_nas);
+    maln->num_aln_seqs = maln_nas;
 
-    /* Parse MALN_SIZ; grow the AlnSeqArray of the MapAlignment until
-     it's at least as big as before */
+    /* Parse MALN_SIZ */
     fgets(line, MAX_LINE_LEN, MAF);
-    sscanf(line, "MALN_SIZ %d", &tmp);
-    while (maln->size < tmp) {
-        grow_alns_map_alignment(maln);
-    }
+    sscanf(line, "MALN_SIZ %lu", &maln_siz);
 
     /* Parse MALN_NAS */
     fgets(line, MAX_LINE_LEN, MAF);
@@ -533,78 +780,118 @@ MapAlignmentP read_ma(const char* fn) {
         exit(1);
     }
 
-    /* Go through the parsing for as many aligned fragments as we're
-     expecting */
-    for (as_num = 0; as_num < maln->num_aln_seqs; as_num++) {
-        as = maln->AlnSeqArray[as_num];
+    return maln_siz;
+}
 
-        /* Get ID line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "ID %s\n", as->id);
+/* read_aln_seq
+ Args: (1) FILE* MAF - maln file, open at the start of an aligned fragment
+       (2) AlnSeqP as - where to put it; all its ins must be NULL
+       (3) char* line - MAX_LINE_LEN + 1 chars of scratch space
+       (4) char* tmp_ins - MAX_INS_LEN chars of scratch space
+ Returns: 1 if an aligned fragment was read; 0 if MAF is at its end
+ Reads the next aligned fragment from MAF into as. Its depth codes
+ are not set up.
+ */
+static int read_aln_seq(FILE* MAF, AlnSeqP as, char* line, char* tmp_ins) {
+    int ins_pos;
 
-        /* Get DESC line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        strcpy(as->desc, &line[5]);
-        as->desc[strlen(as->desc) - 1] = '\0'; // get rid of \n
+    /* Get ID line */
+    if (fgets(line, MAX_LINE_LEN, MAF) == NULL) {
+        return 0;
+    }
+    sscanf(line, "ID %s\n", as->id);
+
+    /* Get DESC line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    strcpy(as->desc, &line[5]);
+    as->desc[strlen(as->desc) - 1] = '\0'; // get rid of \n
+
+    /* Get SCORE line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "SCORE %d\n", &as->score);
 
-        /* Get SCORE line */
+    /* Get NUM_INPUTS line, if there */
+    fgets(line, MAX_LINE_LEN, MAF);
+    if (sscanf(line, "NUM_INPUTS %d\n", &as->num_inputs) == 1) {
         fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "SCORE %d\n", &as->score);
+    } else {
+        as->num_inputs = 1;
+    }
 
-	/* Get NUM_INPUTS line, if there */
-	fgets(line, MAX_LINE_LEN, MAF);
-	if ( sscanf( line, "NUM_INPUTS %d\n", &as->num_inputs ) == 1 ) {
-	  fgets(line, MAX_LINE_LEN, MAF);
-	}
-	else {
-	  as->num_inputs = 1;
-	}
+    /* Get START line */
+    sscanf(line, "START %d\n", &as->start);
 
-        /* Get START line */
-        sscanf(line, "START %d\n", &as->start);
+    /* Get END line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "END %d\n", &as->end);
 
-        /* Get END line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "END %d\n", &as->end);
+    /* Get RC line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "RC %d\n", &as->revcom);
 
-        /* Get RC line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "RC %d\n", &as->revcom);
+    /* Get TR line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "TR %d\n", &as->trimmed);
 
-        /* Get TR line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "TR %d\n", &as->trimmed);
+    /* Get SEG line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "SEG %c\n", &as->segment);
 
-        /* Get SEG line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "SEG %c\n", &as->segment);
+    /* Get SEQ line */
+    fgets(line, MAX_LINE_LEN, MAF);
+    sscanf(line, "SEQ %s\n", as->seq);
 
-        /* Get SEQ line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "SEQ %s\n", as->seq);
+    /* Skip SMP line; the depth codes are worked out from the
+       sequences below */
+    fgets(line, MAX_LINE_LEN, MAF);
 
-        /* Get SMP line */
-        fgets(line, MAX_LINE_LEN, MAF);
-        sscanf(line, "SMP %s\n", as->smp);
+    /* Get INS line */
+    fscanf(MAF, "INS_POS");
+    while (fscanf(MAF, " %d %s", &ins_pos, tmp_ins) == 2) {
+        as->ins[ins_pos] = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
+        strcpy(as->ins[ins_pos], tmp_ins);
+    }
+    return 1;
+}
+
+MapAlignmentP read_ma(const char* fn) {
+    MapAlignmentP maln;
+    FILE* MAF;
+    char* line;
+    char* tmp_ins;
+    size_t maln_siz, as_num;
 
-        /* Get INS line */
-        tmp_ins = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
+    line = (char*) save_malloc((MAX_LINE_LEN + 1) * sizeof (char));
+    tmp_ins = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
+    MAF = fileOpen(fn, "r");
 
-        fscanf(MAF, "INS_POS");
-        while (fscanf(MAF, " %d %s", &ins_pos, tmp_ins) == 2) {
-            as->ins[ins_pos] = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
-            strcpy(as->ins[ins_pos], tmp_ins);
-        }
+    maln = init_map_alignment();
+    maln->fpsm = (PSSMP) save_malloc(sizeof (PSSM));
+    maln->rpsm = (PSSMP) save_malloc(sizeof (PSSM));
+
+    maln_siz = read_ma_header(MAF, fn, maln, line);
+
+    /* Grow the AlnSeqArray of the MapAlignment until it's at least
+     as big as before */
+    while (maln->size < maln_siz) {
+        grow_alns_map_alignment(maln);
+    }
 
+    /* Go through the parsing for as many aligned fragments as we're
+     expecting */
+    for (as_num = 0; as_num < maln->num_aln_seqs; as_num++) {
+        read_aln_seq(MAF, maln->AlnSeqArray[as_num], line, tmp_ins);
     }
     fclose(MAF);
     free(line);
+    free(tmp_ins);
+    set_aln_seqs_depth_offsets(maln->AlnSeqArray, maln->num_aln_seqs);
     return maln;
 }
 
-int count_aln_seqs(MapAlignmentP maln) {
-    int i;
-    int tot_aln_seqs = 0;
+size_t count_aln_seqs(MapAlignmentP maln) {
+    size_t i;
+    size_t tot_aln_seqs = 0;
 
     /* Count each one that is segment a, n, or f */
     for (i = 0; i < maln->num_aln_seqs; i++) {
@@ -625,27 +912,22 @@ void sort_aln_frags(MapAlignmentP maln) {
 }
 
 void print_assembly_summary(MapAlignmentP maln) {
-    int i;
-    int total_frag_len = 0;
+    size_t i;
+    size_t total_frag_len = 0;
 
     for (i = 0; i < maln->num_aln_seqs; i++) {
         total_frag_len += (maln->AlnSeqArray[i]->end
                 - maln->AlnSeqArray[i]->start + 1);
     }
 
-    printf("# Map reference ID: %s\n", maln->ref->id);
-    printf("# Map reference length: %d\n", maln->ref->seq_len);
-    printf("# Number of fragments aligned to reference: %d\n",
-            count_aln_seqs(maln));
-    //	  maln->num_aln_seqs );
-    printf("# Total length of aligned fragments: %d\n", total_frag_len);
-    printf("# Average coverage: %0.3f\n", ((double) total_frag_len
-            / (double) maln->ref->seq_len));
-
+    print_summary(maln->ref->id, maln->ref->seq_len, count_aln_seqs(maln),
+            total_frag_len);
 }
 
 
 // Return the absolute number of gaps upstream of this position
+// This walks the whole gaps array up to pos; for more than a few
+// positions, use padded_map instead
 
 int sum_of_gaps(MapAlignmentP maln, int pos) {
     int i, gaps;
@@ -655,6 +937,26 @@ int sum_of_gaps(MapAlignmentP maln, int pos) {
     return gaps;
 }
 
+/* padded_map
+ Args: (1) MapAlignmentP maln
+ Returns: int* to maln->ref->seq_len + 1 ints; the one at pos is the
+ 0-based padded (gapped) coordinate of the first column for pos, that
+ is, pos plus the number of gaps upstream of it. The gaps inserted
+ just before pos come first, so pos itself is at the next one minus
+ one. The last int is the padded length of the whole alignment.
+ The caller must free it.
+ */
+int* padded_map(MapAlignmentP maln) {
+    int i;
+    int* pad;
+    pad = (int*) save_malloc((maln->ref->seq_len + 1) * sizeof (int));
+    pad[0] = 0;
+    for (i = 0; i < maln->ref->seq_len; i++) {
+        pad[i + 1] = pad[i] + maln->ref->gaps[i] + 1;
+    }
+    return pad;
+}
+
 /* Grow the space for a MapAlignment to twice its current
  size. Actually, just grow the array of aligned sequences.
  Copy the current aligned sequences into the new array
@@ -663,9 +965,8 @@ int sum_of_gaps(MapAlignmentP maln, int pos) {
  0 if failure
  */
 int grow_alns_map_alignment(MapAlignmentP aln) {
-    int i, j, k;
-    int new_size;
-    AlnSeqP as;
+    size_t i, k;
+    size_t new_size;
     AlnSeqP first_seq;
     AlnSeqP* NewAlnSeqArray;
 
@@ -698,26 +999,7 @@ int grow_alns_map_alignment(MapAlignmentP aln) {
          clean new memories */
         NewAlnSeqArray[i] = &first_seq[k++];
         /* Zero them out */
-        as = NewAlnSeqArray[i];
-        for (j = 0; j <= MAX_ID_LEN; j++) {
-            as->id[j] = '\0';
-        }
-        for (j = 0; j <= MAX_DESC_LEN; j++) {
-            as->desc[j] = '\0';
-        }
-        for (j = 0; j <= INIT_ALN_SEQ_LEN; j++) {
-            as->seq[j] = '\0';
-        }
-        /* Set all their char* ins to NULL */
-        for (j = 0; j <= INIT_ALN_SEQ_LEN; j++) {
-            as->ins[j] = NULL;
-        }
-        as->start = 0;
-        as->end = 0;
-        as->revcom = 0;
-        as->trimmed = 0;
-        as->score = 0;
-        as->segment = 'n';
+        zero_aln_seq(NewAlnSeqArray[i]);
     }
 
     // Now, the old aln->AlnSeqArray can be freed like a bird
@@ -728,3 +1010,425 @@ int grow_alns_map_alignment(MapAlignmentP aln) {
     aln->size = new_size;
     return 1;
 }
+
+/* new_aln_seq
+ Returns: AlnSeqP to a freshly allocated and zeroed AlnSeq
+ */
+static AlnSeqP new_aln_seq(void) {
+    AlnSeqP as;
+    as = (AlnSeqP) save_malloc(sizeof (AlnSeq));
+    zero_aln_seq(as);
+    return as;
+}
+
+/* clear_ins
+ Args: (1) AlnSeqP as
+ Returns: void
+ Frees the inserted sequences of as so it can be read into again
+ */
+static void clear_ins(AlnSeqP as) {
+    int j;
+    for (j = 0; j <= (2 * INIT_ALN_SEQ_LEN); j++) {
+        if (as->ins[j] != NULL) {
+            free(as->ins[j]);
+            as->ins[j] = NULL;
+        }
+    }
+}
+
+/* stream_pileup
+ Args: (1) const char* fn - maln file with the aligned fragments sorted
+           by start, as mia and ma -m write them
+ Returns: PileupP of fn; NULL if the aligned fragments in fn are not
+ sorted by start
+ Makes the same Pileup as maln_pileup on the MapAlignment from
+ read_ma, but only holds the aligned fragments that cover the current
+ position, so memory goes with the coverage instead of with the number
+ of fragments. fn is read twice: first to check the order, count the
+ fragments, and pair up the front and back segments of reads that wrap
+ around the reference (these are at opposite ends of the file), and
+ then to pile them up.
+ */
+PileupP stream_pileup(const char* fn) {
+    MapAlignmentP win;
+    AlnSeqP next, tmp;
+    AlnSeqP* wrapped;
+    AlnSeqP* new_array;
+    FILE* MAF;
+    char* line;
+    char* tmp_ins;
+    PileupP pile;
+    long alnseqs_pos;
+    int have_next, sorted, last_start;
+    size_t nas, num_read, num_held, seq_num;
+    size_t num_wrapped, size_wrapped, wrapped_inx;
+    int ref_pos;
+
+    line = (char*) save_malloc((MAX_LINE_LEN + 1) * sizeof (char));
+    tmp_ins = (char*) save_malloc(MAX_INS_LEN * sizeof (char));
+    MAF = fileOpen(fn, "r");
+
+    /* Set up a MapAlignment for just the fragments covering the
+     current position */
+    win = (MapAlignmentP) save_malloc(sizeof (MapAlignment));
+    win->ref = (RefSeqP) save_malloc(sizeof (RefSeq));
+    win->ref->rcseq = NULL;
+    win->ref->circular = 0;
+    win->ref->wrap_seq_len = 0;
+    win->fpsm = (PSSMP) save_malloc(sizeof (PSSM));
+    win->rpsm = (PSSMP) save_malloc(sizeof (PSSM));
+    win->AlnSeqArray = (AlnSeqP*) save_malloc(INIT_WIN_ALN_SEQS *
+            sizeof (AlnSeqP));
+    win->size = INIT_WIN_ALN_SEQS;
+    win->distant_ref = 0;
+
+    read_ma_header(MAF, fn, win, line);
+    nas = win->num_aln_seqs;
+    win->num_aln_seqs = 0;
+    alnseqs_pos = ftell(MAF);
+    pile = init_pileup(win->ref->id, win->ref->seq_len,
+            get_consensus_length(win));
+
+    /* First pass: check the order, count the fragments, and keep the
+     segments of reads that wrap around */
+    size_wrapped = INIT_WIN_ALN_SEQS;
+    wrapped = (AlnSeqP*) save_malloc(size_wrapped * sizeof (AlnSeqP));
+    num_wrapped = 0;
+    sorted = 1;
+    last_start = 0;
+    next = new_aln_seq();
+    for (num_read = 0; num_read < nas; num_read++) {
+        clear_ins(next);
+        if (!read_aln_seq(MAF, next, line, tmp_ins)) {
+            break;
+        }
+        if (next->start < last_start) {
+            sorted = 0;
+            break;
+        }
+        last_start = next->start;
+
+        if (next->segment != 'b') {
+            pile->num_frags++;
+        }
+        pile->total_frag_len += (next->end - next->start + 1);
+        add_frag_ends(next, pile->starts_f, pile->starts_r, pile->ends_f,
+                pile->ends_r);
+
+        if ((next->segment == 'f') || (next->segment == 'b')) {
+            if (num_wrapped == size_wrapped) {
+                size_wrapped *= 2;
+                new_array = (AlnSeqP*) save_malloc(size_wrapped *
+                        sizeof (AlnSeqP));
+                memcpy(new_array, wrapped, num_wrapped * sizeof (AlnSeqP));
+                free(wrapped);
+                wrapped = new_array;
+            }
+            wrapped[num_wrapped++] = next;
+            next = new_aln_seq();
+        }
+    }
+    nas = num_read;
+    set_aln_seqs_depth_offsets(wrapped, num_wrapped);
+
+    /* Second pass: take in each fragment when the position it starts
+     at is reached and let it go once it has been passed. The AlnSeqs
+     in win->AlnSeqArray from win->num_aln_seqs up to num_held are
+     spares to read into */
+    num_held = 0;
+    if (sorted) {
+        fseek(MAF, alnseqs_pos, SEEK_SET);
+        num_read = 0;
+        have_next = 0;
+        wrapped_inx = 0;
+        for (ref_pos = 0; ref_pos < win->ref->seq_len; ref_pos++) {
+            /* Take in the fragments that start here */
+            while (1) {
+                if (!have_next) {
+                    if (num_read == nas) {
+                        break;
+                    }
+                    clear_ins(next);
+                    read_aln_seq(MAF, next, line, tmp_ins);
+                    num_read++;
+                    if ((next->segment == 'f') || (next->segment == 'b')) {
+                        tmp = wrapped[wrapped_inx++];
+                        next->smp_front_off = tmp->smp_front_off;
+                        next->smp_back_off = tmp->smp_back_off;
+                        next->smp_front_cols = tmp->smp_front_cols;
+                        next->smp_back_col = tmp->smp_back_col;
+                    } else {
+                        set_depth_offsets(next, NULL);
+                    }
+                    have_next = 1;
+                }
+                if (next->start > ref_pos) {
+                    break;
+                }
+                if (win->num_aln_seqs < num_held) {
+                    tmp = win->AlnSeqArray[win->num_aln_seqs];
+                    win->AlnSeqArray[win->num_aln_seqs++] = next;
+                    next = tmp;
+                } else {
+                    if (num_held == win->size) {
+                        new_array = (AlnSeqP*) save_malloc(2 * win->size *
+                                sizeof (AlnSeqP));
+                        memcpy(new_array, win->AlnSeqArray,
+                                num_held * sizeof (AlnSeqP));
+                        free(win->AlnSeqArray);
+                        win->AlnSeqArray = new_array;
+                        win->size *= 2;
+                    }
+                    win->AlnSeqArray[win->num_aln_seqs++] = next;
+                    num_held++;
+                    next = new_aln_seq();
+                }
+                have_next = 0;
+            }
+
+            /* Let go of the fragments that end before here */
+            seq_num = 0;
+            while (seq_num < win->num_aln_seqs) {
+                if (win->AlnSeqArray[seq_num]->end < ref_pos) {
+                    tmp = win->AlnSeqArray[seq_num];
+                    win->num_aln_seqs--;
+                    win->AlnSeqArray[seq_num] =
+                            win->AlnSeqArray[win->num_aln_seqs];
+                    win->AlnSeqArray[win->num_aln_seqs] = tmp;
+                } else {
+                    seq_num++;
+                }
+            }
+
+            pile_pos(win, ref_pos, pile);
+        }
+    } else {
+        free_pileup(pile);
+        pile = NULL;
+    }
+
+    /* Free memory! */
+    fclose(MAF);
+    for (seq_num = 0; seq_num < num_held; seq_num++) {
+        clear_ins(win->AlnSeqArray[seq_num]);
+        free(win->AlnSeqArray[seq_num]);
+    }
+    for (seq_num = 0; seq_num < num_wrapped; seq_num++) {
+        clear_ins(wrapped[seq_num]);
+        free(wrapped[seq_num]);
+    }
+    clear_ins(next);
+    free(next);
+    free(wrapped);
+    free(win->AlnSeqArray);
+    free(win->fpsm);
+    free(win->rpsm);
+    free(win->ref->seq);
+    free(win->ref->gaps);
+    free(win->ref);
+    free(win);
+    free(line);
+    free(tmp_ins);
+    return pile;
+}
+
+/* maln_stamp
+ Args: (1) const char* fn - maln file
+       (2) long long* stamp - room for 3; set to the size and
+           modification time of fn, and the time now
+ Returns: 1 if success; 0 if fn cannot be looked at
+ Take it before reading fn and give it to write_pileup
+ */
+int maln_stamp(const char* fn, long long* stamp) {
+    struct stat st;
+    if (stat(fn, &st) != 0) {
+        return 0;
+    }
+    stamp[0] = (long long) st.st_size;
+    stamp[1] = (long long) st.st_mtime;
+    stamp[2] = (long long) time(NULL);
+    return 1;
+}
+
+/* bcs_field
+ Args: (1) BaseCountsP bc
+       (2) int f - 0 to PILEUP_FIELDS - 1
+ Returns: int* to field f of bc; the fields are kept in the pileup
+ sidecar in this order, each for all columns before the next
+ */
+#define PILEUP_FIELDS (10)
+static int* bcs_field(BaseCountsP bc, int f) {
+    switch (f) {
+        case 0: return &bc->As;
+        case 1: return &bc->Cs;
+        case 2: return &bc->Gs;
+        case 3: return &bc->Ts;
+        case 4: return &bc->gaps;
+        case 5: return &bc->cov;
+        case 6: return &bc->scoreA;
+        case 7: return &bc->scoreC;
+        case 8: return &bc->scoreG;
+        default: return &bc->scoreT;
+    }
+}
+
+/* The numbers at the start of a pileup sidecar, after its magic and
+ version. The first is PILEUP_ORDER, so a sidecar written on a machine
+ that lays out numbers differently is not used */
+#define PILEUP_ORDER (0x0102030405060708LL)
+enum { PH_ORDER, PH_INT_SIZE, PH_MALN_SIZE, PH_MALN_MTIME, PH_STAMPED,
+    PH_REF_LEN, PH_NUM_COLS, PH_NUM_FRAGS, PH_TOTAL_FRAG_LEN, PH_ID_LEN,
+    PILEUP_HEAD_LEN };
+
+/* write_pileup
+ Args: (1) const char* fn - pileup sidecar to write, the maln file name
+           with PILEUP_SUFFIX added
+       (2) PileupP pile - made from the maln file
+       (3) const long long* stamp - from maln_stamp, before the maln was
+           read
+ Returns: 1 if success; 0 if fn could not be written, which is left
+ as it was
+ The sidecar keeps pile column by column: the reference base and
+ position of every column, then each base count and aggregate score
+ of every column, then the fragment start and end counts
+ */
+int write_pileup(const char* fn, PileupP pile, const long long* stamp) {
+    char tmp_fn[MAX_FN_LEN + 32];
+    long long head[PILEUP_HEAD_LEN];
+    FILE* PF;
+    int* buf;
+    int f, col, ok;
+
+    /* Write it under another name and move it into place when it's
+     all there, so no one reads half of it */
+    if (strlen(fn) > MAX_FN_LEN) {
+        return 0;
+    }
+    sprintf(tmp_fn, "%s.%ld", fn, (long) getpid());
+    PF = fopen(tmp_fn, "wb");
+    if (PF == NULL) {
+        return 0;
+    }
+
+    head[PH_ORDER] = PILEUP_ORDER;
+    head[PH_INT_SIZE] = sizeof (int);
+    head[PH_MALN_SIZE] = stamp[0];
+    head[PH_MALN_MTIME] = stamp[1];
+    head[PH_STAMPED] = stamp[2];
+    head[PH_REF_LEN] = pile->ref_len;
+    head[PH_NUM_COLS] = pile->num_cols;
+    head[PH_NUM_FRAGS] = pile->num_frags;
+    head[PH_TOTAL_FRAG_LEN] = pile->total_frag_len;
+    head[PH_ID_LEN] = strlen(pile->ref_id);
+    fwrite(PILEUP_MAGIC, 1, PILEUP_MAGIC_LEN, PF);
+    fputc(PILEUP_VERSION, PF);
+    fwrite(head, sizeof (long long), PILEUP_HEAD_LEN, PF);
+    fwrite(pile->ref_id, 1, head[PH_ID_LEN], PF);
+
+    fwrite(pile->aln_ref, 1, pile->num_cols, PF);
+    fwrite(pile->ref_poss, sizeof (int), pile->num_cols, PF);
+    buf = (int*) save_malloc((pile->num_cols + 1) * sizeof (int));
+    for (f = 0; f < PILEUP_FIELDS; f++) {
+        for (col = 0; col < pile->num_cols; col++) {
+            buf[col] = *bcs_field(&pile->bcs[col], f);
+        }
+        fwrite(buf, sizeof (int), pile->num_cols, PF);
+    }
+    free(buf);
+    fwrite(pile->starts_f, sizeof (int), pile->ref_len, PF);
+    fwrite(pile->starts_r, sizeof (int), pile->ref_len, PF);
+    fwrite(pile->ends_f, sizeof (int), pile->ref_len, PF);
+    fwrite(pile->ends_r, sizeof (int), pile->ref_len, PF);
+
+    ok = !ferror(PF);
+    if ((fclose(PF) != 0) || !ok || (rename(tmp_fn, fn) != 0)) {
+        remove(tmp_fn);
+        return 0;
+    }
+    return 1;
+}
+
+/* read_pileup
+ Args: (1) const char* fn - pileup sidecar from write_pileup
+       (2) const char* maln_fn - the maln file it was made from
+ Returns: PileupP as it was written; NULL if fn is not there, cannot
+ be read, or is not of maln_fn as it is now
+ */
+PileupP read_pileup(const char* fn, const char* maln_fn) {
+    char magic[PILEUP_MAGIC_LEN];
+    char ref_id[MAX_ID_LEN + 1];
+    long long head[PILEUP_HEAD_LEN];
+    long long stamp[3];
+    FILE* PF;
+    PileupP pile;
+    int* buf;
+    int f, ok;
+    size_t num_cols, ref_len, id_len, col;
+
+    PF = fopen(fn, "rb");
+    if (PF == NULL) {
+        return NULL;
+    }
+    /* Is it a sidecar this version of ma can read, of the maln as it
+     is now? A maln changed in the same second it was stamped might
+     still have the same size and time, so those aren't trusted */
+    if ((fread(magic, 1, PILEUP_MAGIC_LEN, PF) != PILEUP_MAGIC_LEN) ||
+            (memcmp(magic, PILEUP_MAGIC, PILEUP_MAGIC_LEN) != 0) ||
+            (fgetc(PF) != PILEUP_VERSION) ||
+            (fread(head, sizeof (long long), PILEUP_HEAD_LEN, PF) !=
+            PILEUP_HEAD_LEN) ||
+            (head[PH_ORDER] != PILEUP_ORDER) ||
+            (head[PH_INT_SIZE] != (long long) sizeof (int)) ||
+            !maln_stamp(maln_fn, stamp) ||
+            (head[PH_MALN_SIZE] != stamp[0]) ||
+            (head[PH_MALN_MTIME] != stamp[1]) ||
+            (head[PH_MALN_MTIME] >= head[PH_STAMPED]) ||
+            (head[PH_REF_LEN] < 0) || (head[PH_REF_LEN] > INT_MAX) ||
+            (head[PH_NUM_COLS] < 0) || (head[PH_NUM_COLS] > INT_MAX) ||
+            (head[PH_NUM_FRAGS] < 0) || (head[PH_TOTAL_FRAG_LEN] < 0) ||
+            (head[PH_ID_LEN] < 0) || (head[PH_ID_LEN] > MAX_ID_LEN)) {
+        fclose(PF);
+        return NULL;
+    }
+    /* All in range now, so they can be held as they are used */
+    id_len = (size_t) head[PH_ID_LEN];
+    ref_len = (size_t) head[PH_REF_LEN];
+    num_cols = (size_t) head[PH_NUM_COLS];
+    if (fread(ref_id, 1, id_len, PF) != id_len) {
+        fclose(PF);
+        return NULL;
+    }
+    ref_id[id_len] = '\0';
+
+    pile = init_pileup(ref_id, (int) ref_len, (int) num_cols);
+    pile->num_cols = (int) num_cols;
+    pile->num_frags = (size_t) head[PH_NUM_FRAGS];
+    pile->total_frag_len = (size_t) head[PH_TOTAL_FRAG_LEN];
+    ok = (fread(pile->aln_ref, 1, num_cols, PF) == num_cols) &&
+            (fread(pile->ref_poss, sizeof (int), num_cols, PF) == num_cols);
+    /* Reference positions index the start and end counts */
+    for (col = 0; ok && (col < num_cols); col++) {
+        ok = (pile->ref_poss[col] >= 0) &&
+                ((size_t) pile->ref_poss[col] < ref_len);
+    }
+    buf = (int*) save_malloc((num_cols + 1) * sizeof (int));
+    for (f = 0; ok && (f < PILEUP_FIELDS); f++) {
+        ok = (fread(buf, sizeof (int), num_cols, PF) == num_cols);
+        for (col = 0; ok && (col < num_cols); col++) {
+            *bcs_field(&pile->bcs[col], f) = buf[col];
+        }
+    }
+    free(buf);
+    ok = ok &&
+            (fread(pile->starts_f, sizeof (int), ref_len, PF) == ref_len) &&
+            (fread(pile->starts_r, sizeof (int), ref_len, PF) == ref_len) &&
+            (fread(pile->ends_f, sizeof (int), ref_len, PF) == ref_len) &&
+            (fread(pile->ends_r, sizeof (int), ref_len, PF) == ref_len) &&
+            (fgetc(PF) == EOF);
+    fclose(PF);
+    if (!ok) {
+        free_pileup(pile);
+        return NULL;
+    }
+    return pile;
+}
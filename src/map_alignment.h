@@ -31,13 +31,46 @@ extern "C" {
     void free_map_alignment(MapAlignmentP maln);
 
 
+    /* split_wrapped_aln_seqs
+     Args: (1) MapAlignmentP maln
+     Returns: MapAlignmentP with the same reference, matrices and
+     consensus code as maln, and its AlnSeqs the way MA files keep
+     them: each one that runs past the end of a circular reference is
+     split into a front (segment f, ID ending _f) up to the end and a
+     back (segment b, ID ending _b) from the beginning on, and they
+     are sorted by alnSeqCmp. If no AlnSeq wraps around, this is just
+     maln. Either way, give it back with free_split_aln_seqs.
+     */
+    MapAlignmentP split_wrapped_aln_seqs(MapAlignmentP maln);
+
+    /* free_split_aln_seqs
+     Args: (1) MapAlignmentP split - from split_wrapped_aln_seqs
+           (2) MapAlignmentP maln - what split was made from
+     Returns: void
+     */
+    void free_split_aln_seqs(MapAlignmentP split, MapAlignmentP maln);
+
     /* Write out the data in a MapAlignment data structure
-     to a file
+     to a file. AlnSeqs that wrap around a circular reference are
+     split in two (see split_wrapped_aln_seqs) on the way out.
      */
     int write_ma(char* fn, MapAlignmentP maln);
 
     MapAlignmentP read_ma(const char* fn);
 
+    /* read_ma_header
+     Args: (1) FILE* MAF - maln file, open at the beginning
+           (2) const char* fn - its name, for error messages
+           (3) MapAlignmentP maln - with memory for ref, fpsm, and rpsm
+           (4) char* line - MAX_LINE_LEN + 1 chars of scratch space
+     Returns: the MALN_SIZ of the MapAlignment that was written
+     Reads everything up to the aligned fragments into maln, setting
+     maln->num_aln_seqs to how many of them follow. Exits if fn does
+     not look like a maln file.
+     */
+    size_t read_ma_header(FILE* MAF, const char* fn, MapAlignmentP maln,
+            char* line);
+
     /* Grow the space for a MapAlignment to twice its current
  size. Actually, just grow the array of aligned sequences.
  Copy the current aligned sequences into the new array
@@ -50,9 +83,20 @@ extern "C" {
     // Return the absolute number of gaps upstream of this position
     int sum_of_gaps(MapAlignmentP maln, int pos);
 
+    /* padded_map
+     Args: (1) MapAlignmentP maln
+     Returns: int* to maln->ref->seq_len + 1 ints; the one at pos is the
+     0-based padded (gapped) coordinate of the first column for pos, that
+     is, pos plus the number of gaps upstream of it. The gaps inserted
+     just before pos come first, so pos itself is at the next one minus
+     one. The last int is the padded length of the whole alignment.
+     The caller must free it.
+     */
+    int* padded_map(MapAlignmentP maln);
+
 
     MapAlignmentP init_map_alignment(void);
-    int count_aln_seqs(MapAlignmentP maln);
+    size_t count_aln_seqs(MapAlignmentP maln);
     void sort_aln_frags(MapAlignmentP maln);
 
 
@@ -60,12 +104,87 @@ extern "C" {
 
     void show_consensus(MapAlignmentP maln, int out_format);
 
+    /* stream_pileup
+     Args: (1) const char* fn - maln file with the aligned fragments sorted
+               by start, as mia and ma -m write them
+     Returns: PileupP of fn; NULL if the aligned fragments in fn are not
+     sorted by start
+     Makes the same Pileup as maln_pileup on the MapAlignment from
+     read_ma, but only holds the aligned fragments that cover the current
+     position, so memory goes with the coverage instead of with the number
+     of fragments.
+     */
+    PileupP stream_pileup(const char* fn);
+
+    /* maln_pileup
+     Args: (1) MapAlignmentP maln
+     Returns: PileupP of all the aligned fragments of maln; free it with
+     free_pileup
+     */
+    PileupP maln_pileup(MapAlignmentP maln);
+
+    /* free_pileup
+     Args: (1) PileupP pile
+     Returns: void
+     */
+    void free_pileup(PileupP pile);
+
+    /* show_pileup
+     Args: (1) PileupP pile
+           (2) int cons_code - consensus calling code
+           (3) const char* ref_id - ID to give the assembly; NULL keeps the
+               one in pile
+           (4) int out_format - 1, 2, 3, 4, 41, 5, or 51
+     Returns: void
+     Calls the consensus of each column of pile and shows it the way
+     show_consensus does
+     */
+    void show_pileup(PileupP pile, int cons_code, const char* ref_id,
+            int out_format);
+
+    /* maln_stamp
+     Args: (1) const char* fn - maln file
+           (2) long long* stamp - room for 3; set to the size and
+               modification time of fn, and the time now
+     Returns: 1 if success; 0 if fn cannot be looked at
+     Take it before reading fn and give it to write_pileup
+     */
+    int maln_stamp(const char* fn, long long* stamp);
+
+    /* write_pileup
+     Args: (1) const char* fn - pileup sidecar to write, the maln file name
+               with PILEUP_SUFFIX added
+           (2) PileupP pile - made from the maln file
+           (3) const long long* stamp - from maln_stamp, before the maln was
+               read
+     Returns: 1 if success; 0 if fn could not be written, which is left
+     as it was
+     The sidecar keeps pile column by column: the reference base and
+     position of every column, then each base count and aggregate score
+     of every column, then the fragment start and end counts
+     */
+    int write_pileup(const char* fn, PileupP pile, const long long* stamp);
+
+    /* read_pileup
+     Args: (1) const char* fn - pileup sidecar from write_pileup
+           (2) const char* maln_fn - the maln file it was made from
+     Returns: PileupP as it was written; NULL if fn is not there, cannot
+     be read, or is not of maln_fn as it is now
+     */
+    PileupP read_pileup(const char* fn, const char* maln_fn);
+
 
 
 
     //some more convenient functions
     int get_consensus_length(MapAlignmentP maln);
-    char* get_consensus(MapAlignmentP maln);
+    /* get_consensus
+     Args: (1) MapAlignmentP maln
+           (2) int* qual - if not NULL, room for get_consensus_length
+               ints to put the consensus quality of each column in
+     Returns: the aligned consensus sequence; caller frees
+     */
+    char* get_consensus(MapAlignmentP maln, int* qual);
 
 
     void print_assembly_summary(MapAlignmentP maln);
@@ -21,6 +21,8 @@ void help( void ) {
   printf( "   -f <output format>\n" );
   printf( "   -R <REGION_START:REGION_END>\n" );
   printf( "   -I <ID to assign to assembly sequence>\n" );
+  printf( "   -n don't read or write the pileup sidecar (maln file name + %s)\n",
+	  PILEUP_SUFFIX );
   printf( "ma reports information from a maln assembly file as generated by mia\n" );
   printf( "How the assembly calls each base can be determined by the\n" );
   printf( "consensus code. 1 = highest, positive aggregate score base (if any)\n" );
@@ -39,6 +41,7 @@ void help( void ) {
   printf( "     between consensus and CURRENT reference sequence (see FORMATS, below)\n" );
   printf( "41 => same as above, but for ALL positions\n" );
   printf( "5 => fasta format output of assembled sequence only\n" );
+  printf( "51 => fastq format output of assembled sequence with qualities\n" );
   printf( "6 => show all fragments in a region specified by -R\n" );
   printf( " -C Color format 6 output -> don't pipe this output to file!\n" );
   printf( "7 => ACE\n\n" ); 
@@ -51,7 +54,8 @@ void help( void ) {
   printf( "      fourth line is the sequence coverage at each position in a space-\n" );
   printf( "      separated list of integers\n" );
   printf( "3 => column format; header shows summary statistics; table has one row\n" );
-  printf( "      per position; columns are described in the output\n" );
+  printf( "      per position; columns are described in the output; the last\n" );
+  printf( "      is the Phred quality of the consensus base\n" );
   printf( "4 => alternative column format with one row per base that differes between\n" );
   printf( "      the consensus assembly and the reference of this iteration. \n" );
   printf( "      Note that in the FINAL iteration reference and consensus are equal! \n" );
@@ -63,11 +67,21 @@ void help( void ) {
   printf( "      (12) aggregate score for G, (13) aggregate score for T\n" );
   printf( "41=> same as above, but for every position\n" );
   printf( "5 => fasta format using ID \"Consensus\" for the assembly\n" );
+  printf( "51=> fastq format of the same; qualities are 10 log10 of the odds of\n" );
+  printf( "     the best-scoring base over the others, held to 0..%d, and 0\n",
+	  MAX_CONS_QUAL );
+  printf( "     for N and gaps. ACE (7) BQ lines give the same qualities\n" );
   printf( "6 => region; shows the reference sequence, the consensus sequence, and then\n" );
   printf( "      all assembled fragments in a region specified by option -R\n" );
   printf( "61=> same as above, but in multi-fasta format for viewing in Bioedit, e.g.\n" );
   printf( "     (also requires a region as specified by the option -R\n" );
   printf( "7 => ACE format\n" ); 
+  printf( "\nFormats 1, 2, 3, 4, 41, 5 and 51 are made from the pileup of the\n" );
+  printf( "maln, which ma keeps next to it in a sidecar file named for it plus\n" );
+  printf( "%s. Later runs on the same maln, with any of these formats or\n",
+	  PILEUP_SUFFIX );
+  printf( "consensus codes, read the pileup from the sidecar instead of the maln.\n" );
+  printf( "When the maln changes, the sidecar is made again.\n" );
 }
 
 void parse_region( char* reg_str, int* reg_start, int* reg_end ) {
@@ -84,6 +98,8 @@ void parse_region( char* reg_str, int* reg_start, int* reg_end ) {
 int main( int argc, char* argv[] ) {
   char mafn[MAX_FN_LEN+1];
   char ma_in_fn[MAX_FN_LEN+1];
+  char pile_fn[MAX_FN_LEN+sizeof(PILEUP_SUFFIX)];
+  long long stamp[3];
   char assign_id[MAX_ID_LEN+1];
   unsigned int any_arg;
   int id_assigned = 0; // Boolean, set to true if -I is given
@@ -95,7 +111,10 @@ int main( int argc, char* argv[] ) {
   int reg_start  = 90;
   int reg_end    = 109;
   int in_color   = 0;  // Output f6 format colored -> bad when you want to pipe it into a file
+  int use_pile   = 1;  // Boolean, FALSE means no pileup sidecar (-n)
+  int stamped;
   MapAlignmentP maln;
+  PileupP pile;
   PWAlnFragP pwaln; 
   IDsListP rest_ids_list, // the IDs in the -i argument, if any, will go here
     used_ids_list;        // the IDs seen thusfar; just for this list,
@@ -110,7 +129,7 @@ int main( int argc, char* argv[] ) {
   cons_scheme = cons_scheme_def;
   score_int = -1.0; // Set the score intercept to -1 => not specified (yet)
   score_slo = -1.0; // Set the score intercept to -1 => not specified (yet)
-  while( (ich=getopt( argc, argv, "I:c:i:f:R:s:m:M:Cb:s:d" )) != -1 ) {
+  while( (ich=getopt( argc, argv, "I:c:i:f:R:s:m:M:Cb:s:dn" )) != -1 ) {
     switch(ich) {
     case 'h' :
       help();
@@ -164,6 +183,9 @@ int main( int argc, char* argv[] ) {
       used_ids_list = init_ids_list();
       any_arg = 1;
       break;
+    case 'n' :
+      use_pile = 0;
+      break;
     default :
       help();
       any_arg = 1;
@@ -177,6 +199,36 @@ int main( int argc, char* argv[] ) {
     exit( 0 );
   }
 
+  /* The consensus-only formats need just the pileup, whatever the
+     consensus code. Take it from the sidecar if it is of the maln as
+     it is now; otherwise, stream through the input file to make it,
+     holding only the aligned fragments that cover one position at a
+     time (or read it all in if it isn't sorted), and keep it in the
+     sidecar for next time */
+  if ( in_ma && !out_ma &&
+       ( (out_format == 1) || (out_format == 2) || (out_format == 3) ||
+	 (out_format == 4) || (out_format == 41) || (out_format == 5) ||
+	 (out_format == 51) ) ) {
+    sprintf( pile_fn, "%s%s", ma_in_fn, PILEUP_SUFFIX );
+    pile = use_pile ? read_pileup( pile_fn, ma_in_fn ) : NULL;
+    if ( pile == NULL ) {
+      stamped = maln_stamp( ma_in_fn, stamp );
+      pile = stream_pileup( ma_in_fn );
+      if ( pile == NULL ) {
+	maln = read_ma( ma_in_fn );
+	pile = maln_pileup( maln );
+	free_map_alignment( maln );
+      }
+      if ( use_pile && stamped ) {
+	write_pileup( pile_fn, pile, stamp );
+      }
+    }
+    show_pileup( pile, cons_scheme, id_assigned ? assign_id : NULL,
+		 out_format );
+    free_pileup( pile );
+    exit( 0 );
+  }
+
   /* Initialize maln, either from specified input file or 
      brand new */
   if ( in_ma ) {
@@ -204,13 +256,12 @@ int main( int argc, char* argv[] ) {
        (out_format == 61) ) {
     print_region( maln, reg_start, reg_end, out_format, in_color );
   }
+  else if (out_format == 7){
+	  ace_output(maln);
+  }
   else {
     show_consensus( maln, out_format );
   }
-  
-  if (out_format == 7){
-	  ace_output(maln);
-  }
 
   /* Write MapAlignment output to a file */
   if ( out_ma ) {
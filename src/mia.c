@@ -325,8 +325,10 @@ void collapse_FSDB( FSDB fsdb, int Hard_cut,
     slope = slope_def;
   }
  
+  begin_fsdb_pass( fsdb );
   for ( i = 0; i < fsdb->num_fss; i++ ) {
     fs = fsdb->fss[i];
+    load_fs( fsdb, fs );
     if ( SCORE_CUT_SET ) {
       min_score_for_len = (double)(intercept + (slope * fs->seq_len));
     }
@@ -348,8 +350,10 @@ void collapse_FSDB( FSDB fsdb, int Hard_cut,
       }
       i++;
       while( (i < fsdb->num_fss) &&
-	     (fsdb->fss[i]->unique_best == 0) ) {
+	     (fsdb->fss[i]->unique_best == 0) &&
+	     fsdb->fss[i]->realign ) {
 	fs = fsdb->fss[i];
+	load_fs( fsdb, fs );
 	if ( fs->score >= min_score_for_len ) {
 	  /* Collapsing puts these two together, increments
 	     the num_inputs field in the current_collapsing_fs,
@@ -358,11 +362,24 @@ void collapse_FSDB( FSDB fsdb, int Hard_cut,
 	  //collapse_fs( current_collapsing_fs, fs );
 	  add_fs( current_collapsing_fs, fs );
 	}
+	if ( fs->num_inputs == 0 ) {
+	  /* Going away, so no need to keep (or spill) its sequence */
+	  detach_payload( fsdb, fs );
+	}
+	else {
+	  release_fs( fsdb, fs );
+	}
 	i++;
       }
       i--;
+      /* Done changing this guy's seq */
+      release_fs( fsdb, current_collapsing_fs );
+    }
+    else {
+      release_fs( fsdb, fs );
     }
   }
+  end_fsdb_pass( fsdb );
 
   /* Time to take out the trash */
   j = 0; // j will be the next available slot
@@ -378,17 +395,25 @@ void collapse_FSDB( FSDB fsdb, int Hard_cut,
 /* cull_maln_from_fsdb
    Args: (1) MapAlignmentP culled_maln - maln with enough room to put the
 	     unique AlnSeq's
-	 (2) FSDB fsdb - has valid data in front_asp, back_asp, and
-	     unique_best fields
+	 (2) FSDB fsdb - has valid data in asp and unique_best fields
+	 (3) int Hard_cut - if > 0, the score cutoff for all lengths
+	 (4) int SCORE_CUT_SET - boolean; TRUE means use s and n
+	 (5) double s - slope of the length/score cutoff line
+	 (6) double n - intercept of the length/score cutoff line
+	 (7) int realign_margin - if >= 0, only guys that are unique_best
+	     and score no more than this below their cutoff are marked
+	     for realigning next iteration; if < 0, all of them are
    Returns: void
    Goes through each FragSeq pointed to by fsdb->fss. For all guys that
-   are unique_best and score >= SCORE_CUTOFF, copies front_asp and 
-   back_asp into culled_maln->AlnSeqArray. Then res
+   were realigned this iteration, are unique_best, and score >=
+   SCORE_CUTOFF, copies asp into culled_maln->AlnSeqArray. Then res
 */
 void cull_maln_from_fsdb( MapAlignmentP culled_maln,
 			  FSDB fsdb, int Hard_cut, 
-			  int SCORE_CUT_SET, double s, double n ) {
-  int i, j, ref_gaps, new_ref_gaps, culled_nas, alignable_len;
+			  int SCORE_CUT_SET, double s, double n,
+			  int realign_margin ) {
+  int i, col, ref_gaps, new_ref_gaps, alignable_len;
+  size_t fs_num, seq_num, culled_nas;
   FragSeqP fs;
   AlnSeqP aln_seq;
   char* ins_seq;
@@ -418,8 +443,8 @@ void cull_maln_from_fsdb( MapAlignmentP culled_maln,
   }
 
   culled_nas = 0;
-  for ( i = 0; i < fsdb->num_fss; i++ ) {
-    fs = fsdb->fss[i];
+  for ( fs_num = 0; fs_num < fsdb->num_fss; fs_num++ ) {
+    fs = fsdb->fss[fs_num];
     if ( SCORE_CUT_SET ) {
       min_score_for_len = (double)(intercept + (slope * fs->seq_len));
     }
@@ -439,12 +464,20 @@ void cull_maln_from_fsdb( MapAlignmentP culled_maln,
     if ( Hard_cut > 0 ) {
       min_score_for_len = Hard_cut;
     }
-    if ( fs->unique_best && 
+    if ( fs->realign &&
+	 fs->unique_best && 
 	 (fs->score >= min_score_for_len) ) {
-      culled_maln->AlnSeqArray[culled_nas++] = fs->front_asp;
-      if ( fs->back_asp != NULL ) {
-	culled_maln->AlnSeqArray[culled_nas++] = fs->back_asp;
-      }
+      culled_maln->AlnSeqArray[culled_nas++] = fs->asp;
+    }
+
+    /* Guys that are repeats or score hopelessly low will be culled
+       again next time, so don't bother realigning them */
+    if ( realign_margin >= 0 ) {
+      fs->realign = ( fs->unique_best &&
+		      (fs->score >= (min_score_for_len - realign_margin)) );
+    }
+    else {
+      fs->realign = 1;
     }
   }
   culled_maln->num_aln_seqs = culled_nas;
@@ -455,12 +488,12 @@ void cull_maln_from_fsdb( MapAlignmentP culled_maln,
     ref_gaps = culled_maln->ref->gaps[i];
     if ( ref_gaps > 0 ) {
       new_ref_gaps = 0;
-      for( j = 0; j < culled_maln->num_aln_seqs; j++ ) {
-	aln_seq = culled_maln->AlnSeqArray[j];
-	if ( (aln_seq->start <  i) &&
-	     (aln_seq->end   >= i) ) {
+      for( seq_num = 0; seq_num < culled_maln->num_aln_seqs; seq_num++ ) {
+	aln_seq = culled_maln->AlnSeqArray[seq_num];
+	col = aln_seq_col( aln_seq, i, culled_maln->ref->seq_len );
+	if ( (col > 0) && (i > 0) ) {
 	  /* Does it have some actual inserted sequence? */
-	  ins_seq = aln_seq->ins[i - aln_seq->start];
+	  ins_seq = aln_seq->ins[col];
 	  if ( (ins_seq != NULL) &&
 	       (strlen( ins_seq ) > new_ref_gaps ) ) {
 	    new_ref_gaps = strlen( ins_seq );
@@ -505,7 +538,8 @@ int asp_len( AlnSeqP asp ) {
 */
 char* consensus_assembly_string ( MapAlignmentP maln ) {
 
-  int cons_pos, ref_pos, ref_gaps, j, num_gaps;
+  int cons_pos, ref_pos, ref_gaps, j, num_gaps, col;
+  size_t seq_num;
   char ins_cons[MAX_INS_LEN + 1];
   int  ins_cov[MAX_INS_LEN + 1];
   char cons_base;
@@ -544,7 +578,7 @@ char* consensus_assembly_string ( MapAlignmentP maln ) {
     ref_gaps = maln->ref->gaps[ref_pos];
     if ( (ref_gaps > 0) &&
 	 (ref_pos  > 0) ) {
-      find_ins_cons( maln, ref_pos, ins_cons, ins_cov, 0 );
+      find_ins_cons( maln, ref_pos, ins_cons, ins_cov, NULL, 0 );
       for ( j = 0; j < ref_gaps; j++ ) {
 	/* Consensus is a gap, i.e., nothing. So, do not write this
 	   to the consensus assembly */
@@ -564,12 +598,12 @@ char* consensus_assembly_string ( MapAlignmentP maln ) {
 
     /* Find all the aligned fragments that include this
        position and make a consensus from it */
-    for( j = 0; j < maln->num_aln_seqs; j++ ) {
-      aln_seq = maln->AlnSeqArray[j];
+    for( seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++ ) {
+      aln_seq = maln->AlnSeqArray[seq_num];
 
       /* Does this aligned fragment cover this position */
-      if ( (aln_seq->start <= ref_pos) && // checked
-	   (aln_seq->end   >= ref_pos) ) {
+      col = aln_seq_col( aln_seq, ref_pos, maln->ref->seq_len );
+      if ( col >= 0 ) {
 
 	if ( aln_seq->revcom ) {
 	  psm = maln->rpsm;
@@ -578,9 +612,8 @@ char* consensus_assembly_string ( MapAlignmentP maln ) {
 	  psm = maln->fpsm;
 	}
 
-	add_base( aln_seq->seq[ref_pos - aln_seq->start], 
-		  bcs, psm,
-		  aln_seq->smp[ref_pos - aln_seq->start] );
+	add_base( aln_seq->seq[col], bcs, psm,
+		  depth_code( aln_seq, col ) );
       }
     }
     cons_base = find_consensus( bcs, maln->cons_code );
@@ -607,6 +640,10 @@ char* consensus_assembly_string ( MapAlignmentP maln ) {
 */
 void find_align_begin( AlignmentP a ) {
   int row, col;
+  if ( a->ungapped ) {
+    /* ungapped_align already set a->abc and a->abr */
+    return;
+  }
   row = a->aer;
   col = a->aec;
   
@@ -636,11 +673,8 @@ void find_align_begin( AlignmentP a ) {
 
 
 void make_ref_upper( RefSeqP ref ) {
-  size_t pos;
-  for( pos = 0; pos < ref->wrap_seq_len; pos++ ) {
-    ref->seq[pos]   = toupper( ref->seq[pos] );
-    ref->rcseq[pos] = toupper( ref->rcseq[pos] );
-  }
+  upcase_seq( ref->seq, ref->wrap_seq_len );
+  upcase_seq( ref->rcseq, ref->wrap_seq_len );
 }
 
 /* Takes a pointer to a RefSeq that has a valid 
@@ -694,13 +728,19 @@ DPMP init_dpm( int size1, int size2 ) {
   DPMP m;
   DPEP elements;
   int i;
+  size_t row_len;
 
   m = (DPMP)save_malloc(sizeof(Mat));
   m->rows = size1;
   m->cols = size2;
 
+  /* Pad each row out to a whole number of cache lines so that
+     every row starts on an ALLOC_ALIGN boundary */
+  row_len = ((m->cols * sizeof(DPE) + ALLOC_ALIGN - 1) / ALLOC_ALIGN) *
+    ALLOC_ALIGN / sizeof(DPE);
+
   /* Allocate the elements */
-  elements = (DPEP)save_malloc(m->rows * m->cols * sizeof(DPE));
+  elements = (DPEP)save_malloc(m->rows * row_len * sizeof(DPE));
   if ( elements == NULL ) {
     return NULL;
   }
@@ -714,7 +754,7 @@ DPMP init_dpm( int size1, int size2 ) {
 
   /* Assign the rows the proper values */
   for ( i = 0; i < m->rows; i++ ) {
-    m->mat[i] = &elements[m->cols * i];
+    m->mat[i] = &elements[row_len * i];
   }
   return m;
 }
@@ -731,7 +771,8 @@ void free_dpm( DPMP m ) {
 /* Takes a pointer to an Alignment
    that has valid sequence, length, submat, and sg data
    Does dynamic programming, filling in values in the 
-   a->m dynamic programming matrix
+   a->m dynamic programming matrix. The codes for seq1 are
+   read from a->c_off on in s1c, hpcl, and hpcs
    Returns nothing */
 void dyn_prog( AlignmentP a ) {
   int row, 
@@ -742,14 +783,24 @@ void dyn_prog( AlignmentP a ) {
     start_new_score,
     hp_disc_gap_col_score,
     hp_disc_gap_row_score,
+    hpc_start = 0,
+    hpc_len,
     sm_depth;
   size_t i;
   int HIM = (INT_MIN / 2); // half of the minimum int; this
   //is useful to avoid underflow from subtracting from the
   // smallest possible int
   int row_sm[5]; // row substitution matrix
+  const short int* s1c = a->s1c + a->c_off;
+  const int* hpcl = NULL;
+  const int* hpcs = NULL;
   
   /* Initialize */
+  a->ungapped = 0;
+  if ( a->hp ) {
+    hpcl = a->hpcl + a->c_off;
+    hpcs = a->hpcs + a->c_off;
+  }
   row = 0;
   col = 0;
   hp_disc_gap_col_score = HIM;
@@ -765,7 +816,7 @@ void dyn_prog( AlignmentP a ) {
   for( col = 0; col < a->len1; col++ ) {
     if ( a->align_mask[col] ) {
       a->m->mat[row][col].score =
-	row_sm[a->s1c[col]];
+	row_sm[s1c[col]];
 
       //      a->m->mat[row][col].score = 
       //sub_mat_score(a->s1c[col], a->s2c[row],
@@ -803,7 +854,7 @@ void dyn_prog( AlignmentP a ) {
 	sub_mat_score(a->s1c[col], a->s2c[row],
 	a->submat->sm, row, a->len2); */
       a->m->mat[row][col].score =
-	row_sm[a->s1c[col]];
+	row_sm[s1c[col]];
       // pay penalty at col 0 if sg
       if ( a->sg5 ) {
 	a->m->mat[row][col].score 
@@ -825,7 +876,7 @@ void dyn_prog( AlignmentP a ) {
 	  sub_mat_score(a->s1c[col], a->s2c[row],
 	  a->submat->sm, row, a->len2); */
 	a->m->mat[row][col].score =
-	  row_sm[a->s1c[col]];
+	  row_sm[s1c[col]];
 	
 	/* update best_gap_col by comparing new gap
 	   option to previous best, if we're far 
@@ -880,22 +931,33 @@ void dyn_prog( AlignmentP a ) {
 	  hp_disc_gap_col_score = HIM;
 	  hp_disc_gap_row_score = HIM;
 	  if ( a->seq1[col] == a->seq2[row] ) { // must be the same base
+	    /* The seq1 hp here, cut off at the ends of seq1 if hpcl
+	       and hpcs were made for a longer sequence */
+	    hpc_start = hpcs[col] - a->c_off;
+	    hpc_len   = hpcl[col];
+	    if ( (hpc_start + hpc_len) > a->len1 ) {
+	      hpc_len = a->len1 - hpc_start;
+	    }
+	    if ( hpc_start < 0 ) {
+	      hpc_len += hpc_start;
+	      hpc_start = 0;
+	    }
 	    if ( (a->hprs[row] == row) && // seq1 hp starts here
-		 (a->hpcs[col] != col) && // seq2 hp starts before here
-		 (a->hpcs[col] > 0) // can't gap outside of seq1!
+		 (hpc_start != col) && // seq2 hp starts before here
+		 (hpc_start > 0) // can't gap outside of seq1!
 		 ) {
 	      hp_disc_gap_col_score = 
-		(a->m->mat[row-1][(a->hpcs[col]-1)].score -
-		 hp_discount_penalty( (col - a->hpcs[col]),
-				      a->hpcl[col], a->hprl[row] ));
+		(a->m->mat[row-1][(hpc_start-1)].score -
+		 hp_discount_penalty( (col - hpc_start),
+				      hpc_len, a->hprl[row] ));
 	    }
-	    if ( (a->hpcs[col] == col) && // seq2 hp starts here
+	    if ( (hpc_start == col) && // seq2 hp starts here
 		 (a->hprs[row] != row) && // seq1 hp starts before here
 		 (a->hprs[row] > 0) ) { // can't gap outside of seq2!
 	      hp_disc_gap_row_score = 
 		(a->m->mat[(a->hprs[row]-1)][col-1].score -
-		 hp_discount_penalty( (col - a->hpcs[col]),
-				      a->hpcl[col], a->hprl[row] ));
+		 hp_discount_penalty( (col - hpc_start),
+				      hpc_len, a->hprl[row] ));
 	    }
 	  }
 	}
@@ -947,7 +1009,7 @@ void dyn_prog( AlignmentP a ) {
 		  /* Best option is homopolymer discounted gapping
 		     of columns */
 		  a->m->mat[row][col].score += hp_disc_gap_col_score;
-		  a->m->mat[row][col].trace = a->hpcs[col] - 1;
+		  a->m->mat[row][col].trace = hpc_start - 1;
 		}
 		else {
 		  /* Best option is homopolymer discounted gapping
@@ -1007,6 +1069,8 @@ AlignmentP init_alignment( int size1, int size2,
   al->sg5 = 0; // initialize to local alignment
   al->sg3 = 0; // initialize to local alignment
   al->rc = rc; // set reverse complement boolean
+  al->ungapped = 0;
+  al->c_off = 0;
 
   /* If user wants special hp gap discount, allocate
      memories for hpc1l, hpcs, hprl, and hprs */
@@ -1044,36 +1108,17 @@ void free_alignment( AlignmentP al ) {
    valid values
    Returns: void
    Populates the a->s1c array with code for quick lookup
-   in submat
+   in submat. a->s1c[0] is for a->seq1[0], so a->c_off
+   should be 0 when it is used
 */
 void pop_s1c_in_a ( AlignmentP a ) {
-  size_t i;
   int r_len;
-  char b;
   r_len = a->len1;
   /*  if ( r_len < 1 ) {
     return;
     }*/
 
-  for ( i = 0; i < r_len; i++ ) {
-    b = a->seq1[i];
-    switch( b ) {
-    case 'A' :
-      a->s1c[i] = 0;
-      break;
-    case 'C' :
-      a->s1c[i] = 1;
-      break;
-    case 'G' :
-      a->s1c[i] = 2;
-      break;
-    case 'T' :
-      a->s1c[i] = 3;
-      break;
-    default:
-      a->s1c[i] = 4;
-    }
-  }
+  encode_seq( a->s1c, a->seq1, r_len );
 }
 
 /* hp_discount_penalty
@@ -1236,30 +1281,10 @@ void pop_hpl_and_hps ( const char* seq, int len, int* hpl, int* hps ) {
    in submat
 */
 void pop_s2c_in_a ( AlignmentP a ) {
-  size_t i;
   int s_len;
-  char b;
   s_len = a->len2;
 
-  for ( i = 0; i < s_len; i++ ) {
-    b = a->seq2[i];
-    switch( b ) {
-    case 'A' :
-      a->s2c[i] = 0;
-      break;
-    case 'C' :
-      a->s2c[i] = 1;
-      break;
-    case 'G' :
-      a->s2c[i] = 2;
-      break;
-    case 'T' :
-      a->s2c[i] = 3;
-      break;
-    default:
-      a->s2c[i] = 4;
-    }
-  }
+  encode_seq( a->s2c, a->seq2, s_len );
 }
    
 
@@ -1296,6 +1321,107 @@ int max_sg_score ( AlignmentP a ) {
   return best_score;
 }
 
+/* ungapped_align
+   Args: (1) AlignmentP a - with valid sequence, length, submat, s1c,
+             s2c, align_mask, and sg data; a->m is not touched
+   Returns: 1 if the best alignment is proven to be ungapped; 0 if not
+   Looks for the best ungapped placement of all of seq2 along seq1,
+   scoring each diagonal with the same substitution matrix rows as
+   dyn_prog. Every other alignment dyn_prog can find pays at least
+   GOP + GEP, either for a gap or for unaligned bases at the start of
+   seq2, and cannot score more than the sum of the best possible (or
+   zero) score for each base of seq2 minus that. So if the best
+   diagonal beats that bound, it is exactly what dyn_prog followed by
+   max_sg_score and find_align_begin would find, including the earliest
+   column in case of a tie. Then a->abc, abr, aec, aer, and best_score
+   are set just as they would be and a->ungapped is set to TRUE.
+   Diagonals are dropped as soon as they can no longer beat the bound
+   or the best one so far, so most of them cost only a few bases.
+   Only for semiglobal alignments without homopolymer discount,
+   where this bound holds.
+*/
+int ungapped_align( AlignmentP a ) {
+  int row, col, start_col, sm_depth, i;
+  int score, best_score, best_start_col;
+  int row_sm[INIT_ALN_SEQ_LEN][5]; // substitution scores for each row
+  int best_rest[INIT_ALN_SEQ_LEN + 1]; // best possible score for
+                                       // rows from here to the end
+  const short int* s1c = a->s1c + a->c_off;
+
+  a->ungapped = 0;
+  if ( !a->sg5 || a->hp ||
+       (a->len2 < 1) || (a->len2 > a->len1) ) {
+    return 0;
+  }
+
+  /* Set up the substitution matrix scores for each row and
+     the best any alignment could do from each row on */
+  best_rest[a->len2] = 0;
+  for( row = a->len2 - 1; row >= 0; row-- ) {
+    sm_depth = find_sm_depth( row, a->len2 );
+    score = 0;
+    for( i = 0; i <= 4; i++ ) {
+      row_sm[row][i] = a->submat->sm[sm_depth][i][a->s2c[row]];
+      if ( row_sm[row][i] > score ) {
+	score = row_sm[row][i];
+      }
+    }
+    best_rest[row] = best_rest[row + 1] + score;
+  }
+
+  /* To be proven best, a diagonal must score more than this */
+  best_score = best_rest[0] - (GOP + GEP);
+  best_start_col = -1;
+
+  for( start_col = 0; start_col <= (a->len1 - a->len2); start_col++ ) {
+    score = 0;
+    for( row = 0; row < a->len2; row++ ) {
+      col = start_col + row;
+      if ( !a->align_mask[col] ) {
+	break;
+      }
+      score += row_sm[row][s1c[col]];
+      if ( (score + best_rest[row + 1]) <= best_score ) {
+	break;
+      }
+    }
+    if ( row == a->len2 ) {
+      /* Made it all the way, so it's the best yet */
+      best_score = score;
+      best_start_col = start_col;
+    }
+  }
+
+  if ( best_start_col < 0 ) {
+    return 0;
+  }
+
+  a->abc = best_start_col;
+  a->abr = 0;
+  a->aec = best_start_col + a->len2 - 1;
+  a->aer = a->len2 - 1;
+  a->best_score = best_score;
+  a->ungapped = 1;
+  return 1;
+}
+
+/* sg_best_score
+   Args: (1) AlignmentP a - ready for dyn_prog
+   Returns: the best score of a semiglobal alignment of a->seq2 to
+   a->seq1, setting a->aec and a->aer as max_sg_score does. Uses
+   ungapped_align if it can prove the answer is ungapped; otherwise
+   does dyn_prog and max_sg_score. Either way, find_align_begin,
+   populate_pwaln_to_begin, and merge_align_into_maln can be used
+   afterwards.
+*/
+int sg_best_score( AlignmentP a ) {
+  if ( ungapped_align( a ) ) {
+    return a->best_score;
+  }
+  dyn_prog( a );
+  return max_sg_score( a );
+}
+
 /* trim_frag
    Args: (1) FragSeqP frag_seq pointer to a FragSeq
          (2) char* adapter pointer to a string of the adapter
@@ -1362,76 +1488,6 @@ void trim_frag (FragSeqP frag_seq, char* adapter,
   }
 }
 
-/* Takes pointers to two PWAlnFrag's
-   The first one (front_pwaln) is populated by an alignment that
-   crosses the wrap_point.
-   Moves all of the alignment that is behind the wrap point into
-   the back_pwaln and copies over all the other info
-   Sets the correct segment flag for front and back */
-void split_pwaln (PWAlnFragP front_pwaln, PWAlnFragP back_pwaln,
-		  int wrap_point ) {
-  int aln_pos; // current position in alignment
-  int ref_pos; // current position in the reference sequence
-  int frag_pos;// current position in the fragment sequence
-  int aln_len; // length of reference alignment string
-
-  aln_len = strlen( front_pwaln->ref_seq );
-  ref_pos = front_pwaln->start;
-  frag_pos = 0;
-  aln_pos = 0;
-
-  // Change the names of both fragments to avoid name conflicts with other tools
-  int i = 0;
-  while ((i <= (MAX_ID_LEN - 2)) && (front_pwaln->frag_id[i] != '\0'))
-    i++; // Search for the end of fragment_id
-
-  front_pwaln->frag_id[i]   = '_';
-  front_pwaln->frag_id[i+1] = 'f';
-  front_pwaln->frag_id[i+2] = '\0';
-
-  strcpy( back_pwaln->frag_id, front_pwaln->frag_id );
-  back_pwaln->frag_id[i+1] = 'b';    
-
-  while ( ref_pos < wrap_point ) {
-    /* Valid base at this position in ref_seq */
-    if ( front_pwaln->ref_seq[aln_pos] != '-' ) {
-      ref_pos++;
-    }
-    if ( front_pwaln->frag_seq[aln_pos] != '-' ) {
-      frag_pos++;
-    }
-    aln_pos++;
-  }
-
-  /* OK, now aln_pos is at the first position that should go into
-     the back_pwaln */
-  strcpy( back_pwaln->ref_seq,  &front_pwaln->ref_seq[aln_pos] );
-  strcpy( back_pwaln->frag_seq, &front_pwaln->frag_seq[aln_pos] );
-
-  front_pwaln->ref_seq[aln_pos] = '\0';
-  front_pwaln->frag_seq[aln_pos] = '\0';
-
-  back_pwaln->start = 0;
-  back_pwaln->end = front_pwaln->end;
-
-  front_pwaln->end = wrap_point - 1;
-
-  back_pwaln->segment = 'b';
-  front_pwaln->segment = 'f';
-
-  back_pwaln->offset = frag_pos;
-
-  strcpy( back_pwaln->ref_id, front_pwaln->ref_id );
-  strcpy( back_pwaln->ref_desc, front_pwaln->ref_desc );
-//  strcpy( back_pwaln->frag_id, front_pwaln->frag_id );
-  strcpy( back_pwaln->frag_desc, front_pwaln->frag_desc );
-
-  back_pwaln->revcom     = front_pwaln->revcom;
-  back_pwaln->trimmed    = front_pwaln->trimmed;
-  back_pwaln->score      = front_pwaln->score;
-  back_pwaln->num_inputs = front_pwaln->num_inputs;
-}
-
 int populate_pwaln_to_begin( AlignmentP a, PWAlnFragP pwaln ) {
   int row, col, next_row, next_col, ras_i, fas_i;
   char ras[ (INIT_ALN_SEQ_LEN * 2) + 1 ]; // temp place for constructing reference
@@ -1439,6 +1495,15 @@ int populate_pwaln_to_begin( AlignmentP a, PWAlnFragP pwaln ) {
   char fas[ (INIT_ALN_SEQ_LEN * 2) + 1 ]; // temp place for constructing fragment
   //alignment string;
 
+  if ( a->ungapped ) {
+    /* No gaps, so it's just the aligned part of each sequence */
+    strncpy( pwaln->ref_seq, &a->seq1[a->abc], a->aec - a->abc + 1 );
+    pwaln->ref_seq[a->aec - a->abc + 1] = '\0';
+    strncpy( pwaln->frag_seq, a->seq2, a->len2 );
+    pwaln->frag_seq[a->len2] = '\0';
+    return 1;
+  }
+
   ras[(INIT_ALN_SEQ_LEN*2)] = '\0';
   ras_i = (INIT_ALN_SEQ_LEN*2)-1;
   fas[(INIT_ALN_SEQ_LEN*2)] = '\0';
@@ -1492,10 +1557,220 @@ int populate_pwaln_to_begin( AlignmentP a, PWAlnFragP pwaln ) {
 }
 
 
+/* put_aligned_base
+   Args: (1) AlnSeqP asp - AlnSeq being filled in
+         (2) AlignmentP a - alignment it comes from
+	 (3) int row - fragment position aligned at col
+	 (4) int col - reference column of a
+   Returns: void
+   Puts the base of a->seq2 at row where it goes in asp->seq, turned
+   around to the forward strand of the reference if a->rc
+*/
+static void put_aligned_base( AlnSeqP asp, AlignmentP a, int row, int col ) {
+  if ( a->rc ) {
+    asp->seq[a->aec - col] = revcom_char( a->seq2[row] );
+  }
+  else {
+    asp->seq[col - a->abc] = a->seq2[row];
+  }
+}
+
+/* merge_align_into_maln
+   Args: (1) AlignmentP a - with a->abc, abr, aec, and aer found by
+             find_align_begin (or ungapped_align)
+         (2) MapAlignmentP maln - where the alignment goes
+	 (3) FragSeqP fs - the fragment aligned in a, with rc, trimmed,
+	     and num_inputs set
+	 (4) int start - first reference position of the alignment
+	 (5) int end - last reference position; past the end of the
+	     reference if it wraps around
+   Returns: 1 if success; 0 if failure
+   Adds the next AlnSeq to maln as merge_pwaln_into_maln would from
+   the pairwise alignment of a (reverse complemented if a->rc), but
+   without making one: walks back through a->m once, putting the
+   fragment bases, its gaps, and its inserts straight into the AlnSeq,
+   and making maln->ref->gaps bigger where an insert needs it.
+*/
+int merge_align_into_maln( AlignmentP a, MapAlignmentP maln, FragSeqP fs,
+			   int start, int end ) {
+  int row, col, next_row, next_col, ins_len, pos, ref_pos, aln_len;
+  char* ins_seq;
+  AlnSeqP asp;
+
+  if ( maln->num_aln_seqs >= maln->size ) {
+    if ( !grow_alns_map_alignment( maln ) ) {
+      return 0;
+    }
+  }
+  asp = maln->AlnSeqArray[maln->num_aln_seqs];
+  strcpy( asp->id, fs->id );
+  strcpy( asp->desc, fs->desc );
+  asp->score      = a->best_score;
+  asp->start      = start;
+  asp->end        = end;
+  asp->revcom     = fs->rc;
+  asp->trimmed    = fs->trimmed;
+  asp->segment    = 'a';
+  asp->num_inputs = fs->num_inputs;
+
+  aln_len = a->aec - a->abc + 1;
+  asp->seq[aln_len] = '\0';
+  memset( asp->ins, 0, aln_len * sizeof(char*) );
+
+  if ( a->ungapped ) {
+    /* No gaps, so it's just the fragment */
+    if ( a->rc ) {
+      revcom_seq( asp->seq, a->seq2, a->len2 );
+    }
+    else {
+      memcpy( asp->seq, a->seq2, a->len2 );
+    }
+    maln->num_aln_seqs++;
+    return 1;
+  }
+
+  row = a->aer;
+  col = a->aec;
+  while( (a->m->mat[row][col].trace != col) &&
+	 (a->m->mat[row][col].trace != -row) ) {
+    put_aligned_base( asp, a, row, col );
+    if ( a->m->mat[row][col].trace == 0 ) {
+      row--;
+      col--;
+    }
+    else if ( a->m->mat[row][col].trace < 0 ) {
+      /* Negative number means gap up rows: fragment bases row - 1
+	 down to next_row + 1 are inserted between reference columns
+	 col - 1 and col */
+      next_row = -(a->m->mat[row][col].trace);
+      ins_len = row - next_row - 1;
+      if ( ins_len > 0 ) {
+	ins_seq = (char*)pool_get( &ins_buf_pool );
+	if ( a->rc ) {
+	  revcom_seq( ins_seq, &a->seq2[next_row + 1], ins_len );
+	  pos = a->aec - (col - 1);
+	}
+	else {
+	  memcpy( ins_seq, &a->seq2[next_row + 1], ins_len );
+	  pos = col - a->abc;
+	}
+	ins_seq[ins_len] = '\0';
+	asp->ins[pos] = ins_seq;
+
+	/* Longer gap in this fragment than known before, so the
+	   reference gap there must be made longer */
+	ref_pos = start + pos;
+	if ( ref_pos >= maln->ref->seq_len ) {
+	  /* Wrapped around the end of a circular reference */
+	  ref_pos -= maln->ref->seq_len;
+	}
+	if ( ins_len > maln->ref->gaps[ref_pos] ) {
+	  maln->ref->gaps[ref_pos] = ins_len;
+	}
+      }
+      row = next_row;
+      col--;
+    }
+    else {
+      /* Positive number means gap back columns: reference columns
+	 col - 1 down to next_col + 1 have no fragment base */
+      next_col = a->m->mat[row][col].trace;
+      row--;
+      for( col--; col > next_col; col-- ) {
+	asp->seq[a->rc ? a->aec - col : col - a->abc] = '-';
+      }
+    }
+  }
+  put_aligned_base( asp, a, row, col );
+
+  maln->num_aln_seqs++;
+  return 1;
+}
+
+
+/* merge_first_round
+   Args: (1) MapAlignmentP maln - first-round maln
+         (2) FragSeqP fs - with score, rc, and trimmed set for its
+	     alignment
+	 (3) FSDB fsdb
+	 (4) AlignmentP a - the alignment of fs from sg_align, or NULL
+	 (5) PWAlnFragP pwaln - the alignment of fs from sam_align, if
+	     a is NULL
+	 (6) int start - first reference position of the alignment
+	 (7) int end - last reference position of the alignment
+   Returns: 1 if success; 0 if failure
+   If the score is good enough (or the reference is distant), merges
+   the alignment into maln and adds fs to fsdb. An alignment that
+   wraps around the end of a circular reference stays in one piece,
+   with its end past the end of the reference; fs->as and fs->ae are
+   set to its start and end.
+*/
+static int merge_first_round( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
+			      AlignmentP a, PWAlnFragP pwaln,
+			      int start, int end ) {
+  RefSeqP rs;
+  rs = maln->ref;
+
+  /* Reverse complement coordinates come back around the wrap
+     point, and an alignment may be all in the wrapped bit; keep
+     start on the reference and end right after it */
+  if ( start > end ) {
+    end += rs->seq_len;
+  }
+  if ( start >= rs->seq_len ) {
+    start -= rs->seq_len;
+    end   -= rs->seq_len;
+  }
+  fs->as = start;
+  fs->ae = end;
+
+  /* Quit now if score is not good enough and distant_ref is not
+     true */
+  if ( (fs->score >= FIRST_ROUND_SCORE_CUTOFF) ||
+       maln->distant_ref ) {
+    /* Every sequence has its own soul */
+    fs->num_inputs  = 1;
+    if ( a != NULL ) {
+      if ( merge_align_into_maln( a, maln, fs, start, end ) == 0 ) {
+	return 0;
+      }
+    }
+    else {
+      pwaln->start = start;
+      pwaln->end   = end;
+      pwaln->num_inputs = fs->num_inputs;
+      if ( merge_pwaln_into_maln( pwaln, maln ) == 0 ) {
+	return 0;
+      }
+    }
+    /* Point this fs->asp to the newly created AlnSeqP in maln */
+    fs->asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
+
+    /* Know which matrices to use for *CALLING* a consensus */
+    set_depth_offsets( fs->asp, NULL );
+
+    /* Everyone is born unique until its discovered that they're not */
+    fs->unique_best = 1;
+
+    /* Did we see an alignment good enough for learning 
+       what strand this is on, i.e., a positive-scoring 
+       alignment? */
+    if ( fs->score > FIRST_ROUND_SCORE_CUTOFF ) {
+      fs->strand_known = 1;
+    }
+    else {
+      fs->strand_known = 0;
+    }
+
+    if ( add_virgin_fs2fsdb( fs, fsdb ) == 0 ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 int sg_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb, 
-	       AlignmentP fw_a, AlignmentP rc_a, 
-	       PWAlnFragP front_pwaln, 
-	       PWAlnFragP back_pwaln) {
+	       AlignmentP fw_a, AlignmentP rc_a ) {
   int max_fw_score = INT_MIN;
   int max_rc_score = INT_MIN;
   RefSeqP rs;
@@ -1532,13 +1807,9 @@ int sg_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
   rc_a->sg5 = 1;
   rc_a->sg3 = 1;
 
-  /* Align it! */
-  dyn_prog( fw_a );
-  dyn_prog( rc_a );
-
-  /* Find the best score */
-  max_fw_score = max_sg_score( fw_a );
-  max_rc_score = max_sg_score( rc_a );
+  /* Align it and find the best score! */
+  max_fw_score = sg_best_score( fw_a );
+  max_rc_score = sg_best_score( rc_a );
 
   /* Which alignment has better score? */
   if ( max_fw_score > max_rc_score ) {
@@ -1549,113 +1820,226 @@ int sg_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
   }
 
   find_align_begin( best_a );
- 
-  /* Load up front_pwaln */
-  strcpy( front_pwaln->ref_id, rs->id );
-  strcpy( front_pwaln->ref_desc, rs->desc );
-  
-  strcpy( front_pwaln->frag_id, fs->id );
-  strcpy( front_pwaln->frag_desc, fs->desc );
 
-  /* First, put all of alignment in front_pwaln */
-  populate_pwaln_to_begin( best_a, front_pwaln );
-      
-  front_pwaln->start = best_a->abc;
-  front_pwaln->end   = best_a->aec;
-  front_pwaln->trimmed = fs->trimmed;
-  front_pwaln->segment = 'a';
-  front_pwaln->score = best_a->best_score;
   fs->score = best_a->best_score;
+  fs->rc = best_a->rc;
 
-  /* Was this the rc alignment? */
   if ( best_a->rc ) {
-    /* reverse complement the sequences */
-    revcom_PWAF( front_pwaln );
-    front_pwaln->revcom = 1;
-    fs->rc = 1;
-  }
-  else {
-    front_pwaln->revcom = 0;
-    fs->rc = 0;
+    /* Adjust start and end coordinates if it's an rc alignment */
+    return merge_first_round( maln, fs, fsdb, best_a, NULL,
+			      c2rcc( best_a->aec, rs->seq_len ),
+			      c2rcc( best_a->abc, rs->seq_len ) );
   }
+  return merge_first_round( maln, fs, fsdb, best_a, NULL,
+			    best_a->abc, best_a->aec );
+}
 
-  if ( best_a->rc ) {
-    /* Adjust start and end coordinates if it's an rc alignment */
-    front_pwaln->start = c2rcc( best_a->aec,
-				rs->seq_len );
-    front_pwaln->end   = c2rcc( best_a->abc,
-				rs->seq_len );
-    fs->as = c2rcc( best_a->aec, rs->seq_len );
-    fs->ae = c2rcc( best_a->abc, rs->seq_len );
+/* sam_pair_score
+   Args: (1) PSSMP submat - first-round substitution matrices
+         (2) char ref_base - reference base, forward strand
+	 (3) char frag_base - fragment base as aligned, forward strand
+	 (4) int frag_pos - position of frag_base in the aligned
+	     (forward strand) fragment
+	 (5) int len - fragment length
+	 (6) int rc - Boolean, TRUE if the fragment is aligned to the
+	     reverse strand
+   Returns: the score sg_align would give this pair; reverse strand
+   alignments are scored as the fragment against the reverse
+   complemented reference, as sg_align does them
+*/
+static int sam_pair_score( PSSMP submat, char ref_base, char frag_base,
+			   int frag_pos, int len, int rc ) {
+  if ( rc ) {
+    return submat->sm[find_sm_depth( len - (frag_pos + 1), len )]
+      [base2inx( revcom_char( ref_base ) )]
+      [base2inx( revcom_char( frag_base ) )];
+  }
+  return submat->sm[find_sm_depth( frag_pos, len )]
+    [base2inx( ref_base )][base2inx( frag_base )];
+}
+
+int sam_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
+		PSSMP submat, const char* cigar, int pos, int rc,
+		PWAlnFragP pwaln ) {
+  RefSeqP rs;
+  char frag[INIT_ALN_SEQ_LEN + 1]; // fs->seq as aligned, forward strand
+  const char* c;
+  char op;
+  int op_len, i, start, ref_pos, frag_pos, aln_pos, score;
+  rs = maln->ref;
+
+  if ( (fs->seq_len == 0) || (fs->seq_len > INIT_ALN_SEQ_LEN) ) {
+    return -1;
   }
-  else {
-    fs->as = best_a->abc;
-    fs->ae = best_a->aec;
+  if ( rc ) {
+    revcom_seq( frag, fs->seq, fs->seq_len );
   }
-  if ( fs->as > fs->ae ) {
-    /* The fs->ae *should* be longer than the rs->seq_len
-       for ease next time aligning */
-    fs->ae = rs->seq_len + fs->as;
+  else {
+    memcpy( frag, fs->seq, fs->seq_len );
+  }
+  frag[fs->seq_len] = '\0';
+
+  /* Soft clipped bases are aligned, without gaps, to the reference
+     next to them since sg_align aligns every base of a fragment;
+     find where that puts the start */
+  start = pos - 1;
+  c = cigar;
+  while ( isdigit( *c ) ) {
+    op_len = strtol( c, (char**)&c, 10 );
+    if ( *c == 'S' ) {
+      start -= op_len;
+    }
+    else if ( *c != 'H' ) {
+      break;
+    }
+    c++;
   }
-
-  if ( front_pwaln->end > rs->seq_len ) {
-    /* This alignment wraps around - adjust the end to
-       demonstrate this for split_maln check */
-    front_pwaln->end = front_pwaln->end - rs->seq_len;
+  if ( start < 0 ) {
+    if ( !rs->circular ) {
+      return -1;
+    }
+    start += rs->seq_len;
   }
 
-  /* Quit now if score is not good enough and distant_ref is not
-     true */
-  if ( (fs->score >= FIRST_ROUND_SCORE_CUTOFF) ||
-       maln->distant_ref ) {
-    
-    /* Now, split up front_pwaln if this wrapped around the
-       wrap point and merge them into the maln */
-    if ( front_pwaln->start > front_pwaln->end ) {
-      split_pwaln( front_pwaln, back_pwaln, rs->seq_len );
-      if ( merge_pwaln_into_maln( front_pwaln, maln ) == 0 ) {
-	return 0;
+  /* Walk the CIGAR, building the pairwise alignment and scoring it
+     as sg_align would */
+  ref_pos  = start;
+  frag_pos = 0;
+  aln_pos  = 0;
+  score    = 0;
+  c = cigar;
+  while ( *c != '\0' ) {
+    if ( !isdigit( *c ) ) {
+      return -1;
+    }
+    op_len = strtol( c, (char**)&c, 10 );
+    op = *c++;
+    switch( op ) {
+    case 'M' :
+    case '=' :
+    case 'X' :
+    case 'S' :
+    case 'I' :
+    case 'D' :
+      if ( aln_pos + op_len > 2 * INIT_ALN_SEQ_LEN ) {
+	return -1;
       }
-      /* Point this fs->front_asp to the 
-	 newly created AlnSeqP in maln */
-      fs->front_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-
-      if ( merge_pwaln_into_maln( back_pwaln, maln ) == 0 ) {
-	return 0;
+      if ( (op != 'D') && (frag_pos + op_len > fs->seq_len) ) {
+	return -1;
       }
-      /* Point this fs->back_asp to the 
-	 newly created AlnSeqP in maln */
-      fs->back_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-    }
-    else {
-      if ( merge_pwaln_into_maln( front_pwaln, maln ) == 0 ) {
-	return 0;
+      if ( (op != 'I') && (ref_pos + op_len > rs->wrap_seq_len) ) {
+	return -1;
+      }
+      if ( (op == 'I') || (op == 'D') ) {
+	score -= (GOP + (GEP * op_len));
+      }
+      for( i = 0; i < op_len; i++ ) {
+	if ( op == 'I' ) {
+	  pwaln->ref_seq[aln_pos] = '-';
+	}
+	else {
+	  pwaln->ref_seq[aln_pos] = toupper( rs->seq[ref_pos++] );
+	}
+	if ( op == 'D' ) {
+	  pwaln->frag_seq[aln_pos] = '-';
+	}
+	else {
+	  pwaln->frag_seq[aln_pos] = frag[frag_pos];
+	  if ( op != 'I' ) {
+	    score += sam_pair_score( submat,
+				     pwaln->ref_seq[aln_pos],
+				     frag[frag_pos], frag_pos,
+				     fs->seq_len, rc );
+	  }
+	  frag_pos++;
+	}
+	aln_pos++;
       }
-      /* Point this fs->front_asp to the 
-	 newly created AlnSeqP in maln */
-      fs->front_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-      fs->back_asp = NULL;
+      break;
+    case 'H' :
+    case 'P' :
+      break;
+    default :
+      /* Skipped reference (N) or something we don't know */
+      return -1;
     }
+  }
+  if ( (frag_pos != fs->seq_len) || (aln_pos == 0) ) {
+    return -1;
+  }
+  pwaln->ref_seq[aln_pos]  = '\0';
+  pwaln->frag_seq[aln_pos] = '\0';
 
-    /* Everyone is born unique until its discovered that they're not */
-    fs->unique_best = 1;
-    /* Every sequence has its own soul */
-    fs->num_inputs  = 1;
+  strcpy( pwaln->ref_id, rs->id );
+  strcpy( pwaln->ref_desc, rs->desc );
+  strcpy( pwaln->frag_id, fs->id );
+  strcpy( pwaln->frag_desc, fs->desc );
+  pwaln->trimmed = 0;
+  pwaln->segment = 'a';
+  pwaln->score   = score;
+  pwaln->revcom  = rc;
 
-    /* Did we see an alignment good enough for learning 
-       what strand this is on, i.e., a positive-scoring 
-       alignment? */
-    if ( fs->score > FIRST_ROUND_SCORE_CUTOFF ) {
-      fs->strand_known = 1;
-    }
-    else {
-      fs->strand_known = 0;
-    }
+  fs->trimmed = 0;
+  fs->score   = score;
+  fs->rc      = rc;
 
-    if ( add_virgin_fs2fsdb( fs, fsdb ) == 0 ) {
-      return 0;
+  return merge_first_round( maln, fs, fsdb, NULL, pwaln,
+			    start, ref_pos - 1 );
+}
+
+/* init_depth_hist
+   Args: (1) int ref_len - length of the reference
+         (2) int target - depth we want
+	 (3) double frac - fraction of the reference that must
+	     reach target depth
+   Returns: DepthHistP with all positions at 0 depth, or NULL
+   if not enough memories
+*/
+DepthHistP init_depth_hist( int ref_len, int target, double frac ) {
+  DepthHistP dh;
+  dh = (DepthHistP)save_malloc( sizeof(DepthHist) );
+  if ( dh == NULL ) {
+    return NULL;
+  }
+  dh->depth = (int*)calloc( ref_len, sizeof(int) );
+  if ( dh->depth == NULL ) {
+    return NULL;
+  }
+  dh->ref_len = ref_len;
+  dh->target = target;
+  dh->num_at_target = 0;
+  dh->num_needed = (int)ceil( frac * ref_len );
+  return dh;
+}
+
+/* add_depth
+   Args: (1) DepthHistP dh
+         (2) int as - first reference position covered by an alignment
+	 (3) int ae - last reference position covered; may be past
+	     the end of the reference for alignments that wrap around
+	     a circular reference
+   Returns: 1 if enough of the reference has now reached the target
+   depth; 0 otherwise
+*/
+int add_depth( DepthHistP dh, int as, int ae ) {
+  int i, pos;
+  for( i = as; i <= ae; i++ ) {
+    pos = i % dh->ref_len;
+    if ( dh->depth[pos] < dh->target ) {
+      dh->depth[pos]++;
+      if ( dh->depth[pos] == dh->target ) {
+	dh->num_at_target++;
+      }
     }
   }
-  return 1;
+  return ( dh->num_at_target >= dh->num_needed );
 }
 
+/* free_depth_hist
+   Args: (1) DepthHistP dh
+   Returns: void
+*/
+void free_depth_hist( DepthHistP dh ) {
+  free( dh->depth );
+  free( dh );
+}
@@ -52,16 +52,23 @@ inline char best_base_at_pos( QSSP qss, size_t i );
 /* cull_maln_from_fsdb
    Args: (1) MapAlignmentP culled_maln - maln with enough room to put the
 	     unique AlnSeq's
-	 (2) FSDB fsdb - has valid data in front_asp, back_asp, and
-	     unique_best fields
+	 (2) FSDB fsdb - has valid data in asp and unique_best fields
+	 (3) int Hard_cut - if > 0, the score cutoff for all lengths
+	 (4) int SCORE_CUT_SET - boolean; TRUE means use s and n
+	 (5) double s - slope of the length/score cutoff line
+	 (6) double n - intercept of the length/score cutoff line
+	 (7) int realign_margin - if >= 0, only guys that are unique_best
+	     and score no more than this below their cutoff are marked
+	     for realigning next iteration; if < 0, all of them are
    Returns: void
    Goes through each FragSeq pointed to by fsdb->fss. For all guys that
-   are unique_best and score >= SCORE_CUTOFF, copies front_asp and
-   back_asp into culled_maln->AlnSeqArray. Then res
+   were realigned this iteration, are unique_best, and score >=
+   SCORE_CUTOFF, copies asp into culled_maln->AlnSeqArray. Then res
 */
 void cull_maln_from_fsdb( MapAlignmentP culled_maln,
 			  FSDB fsdb, int Hard_cut,
-			  int SCORE_CUT_SET, double s, double n ) ;
+			  int SCORE_CUT_SET, double s, double n,
+			  int realign_margin ) ;
 
 
 /* asp_len
@@ -121,7 +128,8 @@ void free_dpm( DPMP m ) ;
 /* Takes a pointer to an Alignment
    that has valid sequence, length, submat, and sg data
    Does dynamic programming, filling in values in the
-   a->m dynamic programming matrix
+   a->m dynamic programming matrix. The codes for seq1 are
+   read from a->c_off on in s1c, hpcl, and hpcs
    Returns nothing */
 void dyn_prog( AlignmentP a ) ;
 
@@ -140,7 +148,8 @@ void free_alignment( AlignmentP al ) ;
    valid values
    Returns: void
    Populates the a->s1c array with code for quick lookup
-   in submat
+   in submat. a->s1c[0] is for a->seq1[0], so a->c_off
+   should be 0 when it is used
 */
 void pop_s1c_in_a ( AlignmentP a ) ;
 
@@ -192,6 +201,27 @@ void pop_s2c_in_a ( AlignmentP a ) ;
    Returns the best score */
 int max_sg_score ( AlignmentP a ) ;
 
+/* ungapped_align
+   Args: (1) AlignmentP a - with valid sequence, length, submat, s1c,
+             s2c, align_mask, and sg data; a->m is not touched
+   Returns: 1 if the best alignment is proven to be ungapped; 0 if not
+   If the best ungapped placement of seq2 beats every alignment with a
+   gap (or with unaligned bases at the start) by the GOP + GEP such an
+   alignment must pay, sets a->abc, abr, aec, aer, and best_score
+   exactly as dyn_prog, max_sg_score, and find_align_begin would and
+   sets a->ungapped to TRUE.
+*/
+int ungapped_align( AlignmentP a ) ;
+
+/* sg_best_score
+   Args: (1) AlignmentP a - ready for dyn_prog
+   Returns: the best score of a semiglobal alignment of a->seq2 to
+   a->seq1, setting a->aec and a->aer as max_sg_score does. Uses
+   ungapped_align if it can prove the answer is ungapped; otherwise
+   does dyn_prog and max_sg_score.
+*/
+int sg_best_score( AlignmentP a ) ;
+
 /* trim_frag
    Args: (1) FragSeqP frag_seq pointer to a FragSeq
          (2) char* adapter pointer to a string of the adapter
@@ -209,20 +239,77 @@ int max_sg_score ( AlignmentP a ) ;
 void trim_frag (FragSeqP frag_seq, char* adapter,
 		AlignmentP align) ;
 
-/* Takes pointers to two PWAlnFrag's
-   The first one (front_pwaln) is populated by an alignment that
-   crosses the wrap_point.
-   Moves all of the alignment that is behind the wrap point into
-   the back_pwaln and copies over all the other info
-   Sets the correct segment flag for front and back */
-void split_pwaln (PWAlnFragP front_pwaln, PWAlnFragP back_pwaln,
-		  int wrap_point ) ;
-
 int populate_pwaln_to_begin( AlignmentP a, PWAlnFragP pwaln ) ;
 
+/* merge_align_into_maln
+   Args: (1) AlignmentP a - with a->abc, abr, aec, and aer found by
+             find_align_begin (or ungapped_align)
+         (2) MapAlignmentP maln - where the alignment goes
+	 (3) FragSeqP fs - the fragment aligned in a, with rc, trimmed,
+	     and num_inputs set
+	 (4) int start - first reference position of the alignment
+	 (5) int end - last reference position; past the end of the
+	     reference if it wraps around
+   Returns: 1 if success; 0 if failure
+   Adds the next AlnSeq to maln as merge_pwaln_into_maln would from
+   the pairwise alignment of a (reverse complemented if a->rc), but
+   without making one: walks back through a->m once, putting the
+   fragment bases, its gaps, and its inserts straight into the AlnSeq,
+   and making maln->ref->gaps bigger where an insert needs it.
+*/
+int merge_align_into_maln( AlignmentP a, MapAlignmentP maln, FragSeqP fs,
+			   int start, int end ) ;
+
 
 int sg_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
-	       AlignmentP fw_a, AlignmentP rc_a,
-	       PWAlnFragP front_pwaln,
-	       PWAlnFragP back_pwaln) ;
+	       AlignmentP fw_a, AlignmentP rc_a ) ;
+
+/* sam_align
+   Args: (1) MapAlignmentP maln - first-round maln
+         (2) FragSeqP fs - fragment as read by read_sam
+	 (3) PSSMP submat - substitution matrices to score with, as
+	     used by sg_align in the first round
+	 (4) const char* cigar - SAM CIGAR string of the alignment
+	 (5) int pos - SAM POS, 1-based leftmost reference position
+	 (6) int rc - Boolean, TRUE if aligned to the reverse strand
+	 (7) PWAlnFragP pwaln - scratch
+   Returns: 1 if success; 0 if failure; -1 if this alignment cannot
+   be used (no sequence, a skipped-reference CIGAR operation, or
+   running off the end of a linear reference)
+   Does what sg_align does, but takes the alignment from an external
+   mapper instead of aligning. Soft clipped bases are aligned to the
+   reference next to them without gaps. The alignment is scored with
+   submat and the GOP/GEP gap penalties (no homopolymer discount), so
+   it is held to the same FIRST_ROUND_SCORE_CUTOFF.
+*/
+int sam_align ( MapAlignmentP maln, FragSeqP fs, FSDB fsdb,
+		PSSMP submat, const char* cigar, int pos, int rc,
+		PWAlnFragP pwaln ) ;
+
+/* init_depth_hist
+   Args: (1) int ref_len - length of the reference
+         (2) int target - depth we want
+	 (3) double frac - fraction of the reference that must
+	     reach target depth
+   Returns: DepthHistP with all positions at 0 depth, or NULL
+   if not enough memories
+*/
+DepthHistP init_depth_hist( int ref_len, int target, double frac );
+
+/* add_depth
+   Args: (1) DepthHistP dh
+         (2) int as - first reference position covered by an alignment
+	 (3) int ae - last reference position covered; may be past
+	     the end of the reference for alignments that wrap around
+	     a circular reference
+   Returns: 1 if enough of the reference has now reached the target
+   depth; 0 otherwise
+*/
+int add_depth( DepthHistP dh, int as, int ae );
+
+/* free_depth_hist
+   Args: (1) DepthHistP dh
+   Returns: void
+*/
+void free_depth_hist( DepthHistP dh );
 #endif
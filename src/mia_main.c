@@ -1,4 +1,8 @@
 #include "mia.h"
+#include "contam.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 
 
@@ -7,22 +11,24 @@
          (2) a MapAlignmentP big enough to store all the alignments
 	 (3) a FSDB with sequences to be realigned
 	 (4) a AlignmentP big enough for the alignments
-	 (5) a front PWAlnFragP for storing front alignments
-	 (6) a back PWAlnFragP for storing back alignments
-	 (7) a PSSMP with the forward substitution matrices
-	 (8) a PSSMP with the revcom substitution matrices
+	 (5) a PSSMP with the forward substitution matrices
+	 (6) a PSSMP with the revcom substitution matrices
    Aligns all the FragSeqs from fsdb to the new reference, using the
    as and ae fields to narrow down where the alignment happens
-   Resets the maln and writes all the results there
+   FragSeqs whose realign flag is FALSE are carried forward as they
+   are, without any AlnSeq in the maln
+   Resets the maln and writes all the results there. The submat codes
+   and homopolymer arrays of the new reference are made once, and the
+   FragSeqs are realigned in reference order so their windows on
+   them move along instead of jumping around
    Returns void
 */
 void reiterate_assembly( char* new_ref_seq, int iter_num,
 			 MapAlignmentP maln,
 			 FSDB fsdb, AlignmentP a, 
-			 PWAlnFragP front_pwaln,
-			 PWAlnFragP back_pwaln, 
 			 PSSMP ancsubmat,
 			 PSSMP rcancsubmat ) {
+  size_t seq_num;
   int i, j,
     ref_len,
     ref_start, 
@@ -32,6 +38,7 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
     rc_score,
     aln_seq_len;
   FragSeqP fs;
+  FragSeqP* order; // FragSeqs in the order they are realigned
   char iter_ref_id[MAX_ID_LEN + 1];
   char tmp_rc[INIT_ALN_SEQ_LEN + 1];
   char iter_ref_desc[] = "iteration assembly";
@@ -74,20 +81,28 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
   }
 
   /* Reset its AlnSeqArray ->ins to all point to null */
-  for ( i = 0; i < maln->num_aln_seqs; i++ ) {
-    aln_seq_len = strlen(maln->AlnSeqArray[i]->seq);
+  for ( seq_num = 0; seq_num < maln->num_aln_seqs; seq_num++ ) {
+    aln_seq_len = strlen(maln->AlnSeqArray[seq_num]->seq);
     for ( j = 0; j < aln_seq_len; j++ ) {
       /* We couldn't have malloced any sequence for
 	 inserts past our length; anything non-NULL
 	 out there is cruft */
-      if ( maln->AlnSeqArray[i]->ins[j] != NULL ) {
-	free( maln->AlnSeqArray[i]->ins[j] );
-	maln->AlnSeqArray[i]->ins[j] = NULL;
+      if ( maln->AlnSeqArray[seq_num]->ins[j] != NULL ) {
+	pool_put( &ins_buf_pool, maln->AlnSeqArray[seq_num]->ins[j] );
+	maln->AlnSeqArray[seq_num]->ins[j] = NULL;
       }
     }
   }
 
-  /* Now, remake the hpcl and hprl arrays if hp_special */
+  /* Now, remake the s1c array, and the hpcl and hpcs arrays if
+     hp_special, for the whole new reference. Every FragSeq's window
+     on the reference just points a->c_off into them */
+  a->seq1 = maln->ref->seq;
+  a->len1 = maln->ref->wrap_seq_len;
+  a->c_off = 0;
+  free( a->s1c );
+  a->s1c = (short int*)save_malloc(maln->ref->wrap_seq_len*sizeof(short int));
+  pop_s1c_in_a( a );
   if ( a->hp ) {
     free( a->hpcl );
     free( a->hpcs );
@@ -104,9 +119,32 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
   /* OK, ref is set up. Let's go through all the sequences in fsdb
      and re-align them to the new reference. 
      If it's a revcom alignment,
-     just use the rcancsubmat */
-  for( i = 0; i < fsdb->num_fss; i++ ) {
-    fs = fsdb->fss[i];
+     just use the rcancsubmat. If some of the sequences are
+     spilled to disk, they're read back in this same order. The
+     length/score fit is made again as the new scores come in. */
+  order = fsdb->fss;
+  if ( fsdb->mem_limit == 0 ) {
+    /* Nothing is spilled, so go in reference order (fs_comp) without
+       changing the order of fsdb. If payloads may be spilled, they
+       must be loaded in fsdb order, which is reference order anyway
+       if the repeat filter has sorted it */
+    order = (FragSeqP*)save_malloc((fsdb->num_fss + 1) * sizeof(FragSeqP));
+    memcpy( order, fsdb->fss, fsdb->num_fss * sizeof(FragSeqP) );
+    qsort( order, fsdb->num_fss, sizeof(FragSeqP), fs_comp );
+  }
+  begin_fsdb_pass( fsdb );
+  reset_score_fit( fsdb );
+  for( seq_num = 0; seq_num < fsdb->num_fss; seq_num++ ) {
+    fs = order[seq_num];
+    load_fs( fsdb, fs );
+
+    /* Not worth realigning; keep as, ae, and score from last time */
+    if ( !fs->realign ) {
+      fs->asp = NULL;
+      fit_fs_score( fsdb, fs );
+      release_fs( fsdb, fs );
+      continue;
+    }
 
     /* Special case of distant reference and 
        !fs->strand_known => try to realign both strands
@@ -121,18 +159,15 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
       ref_frag_len = ref_end - ref_start;
       a->seq1 = &maln->ref->seq[0];
       a->len1 = ref_frag_len;
-      pop_s1c_in_a( a );
+      a->c_off = 0;
       a->seq2 = fs->seq;
       a->len2 = strlen( a->seq2 );
       pop_s2c_in_a( a );
       if ( a->hp ) {
 	pop_hpl_and_hps( a->seq2, a->len2, a->hprl, a->hprs );
-	pop_hpl_and_hps( a->seq1, a->len1, a->hpcl, a->hpcs );
       }
-      /* Align it! */
-      dyn_prog( a );
-      /* Find the best forward score */
-      max_score = max_sg_score( a );
+      /* Align it and find the best forward score! */
+      max_score = sg_best_score( a );
       if ( max_score > FIRST_ROUND_SCORE_CUTOFF ) {
 	fs->strand_known = 1;
 	fs->rc = 0;
@@ -145,18 +180,14 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
       /* Now, try reverse complement */
       aln_seq_len = strlen( fs->seq );
       a->submat = rcancsubmat;
-      for ( j = 0; j < aln_seq_len; j++ ) {
-	tmp_rc[j] = revcom_char(fs->seq[aln_seq_len-(j+1)]);
-      }
+      revcom_seq( tmp_rc, fs->seq, aln_seq_len );
       tmp_rc[aln_seq_len] = '\0';
       a->seq2 = tmp_rc;
       pop_s2c_in_a( a );
       if ( a->hp ) {
 	pop_hpl_and_hps( a->seq2, a->len2, a->hprl, a->hprs );
-	pop_hpl_and_hps( a->seq1, a->len1, a->hpcl, a->hpcs );
       }
-      dyn_prog( a );
-      max_score = max_sg_score( a );
+      max_score = sg_best_score( a );
       if ( (max_score > FIRST_ROUND_SCORE_CUTOFF) &&
 	   (max_score > fs->score) ) {
 	fs->strand_known = 1;
@@ -210,68 +241,46 @@ void reiterate_assembly( char* new_ref_seq, int iter_num,
       ref_frag_len = ref_end - ref_start;
       a->seq1 = &maln->ref->seq[ref_start];
       a->len1 = ref_frag_len;
-      pop_s1c_in_a( a );
+      a->c_off = ref_start;
       
       /* If we want the homopolymer discount, the necessary arrays of
-	 hp starts and lengths must be set up anew */
+	 hp starts and lengths must be set up anew for the fragment */
       if ( a->hp ) {
 	pop_hpl_and_hps( a->seq2, a->len2, a->hprl, a->hprs );
-	pop_hpl_and_hps( a->seq1, a->len1, a->hpcl, a->hpcs );
       }
 
-      /* Align it! */
-      dyn_prog( a );
-    
-      /* Find the best score */
-      max_score = max_sg_score( a );
+      /* Align it and find the best score! */
+      max_score = sg_best_score( a );
 
       find_align_begin( a );
 
-      /* First, put all alignment in front_pwaln */
-      populate_pwaln_to_begin( a, front_pwaln );
-      
-      /* Load up front_pwaln */
-      strcpy( front_pwaln->ref_id, maln->ref->id );
-      strcpy( front_pwaln->ref_desc, maln->ref->desc );
-      
-      strcpy( front_pwaln->frag_id, fs->id );
-      strcpy( front_pwaln->frag_desc, fs->desc );
-      
-      front_pwaln->trimmed = fs->trimmed;
-      front_pwaln->revcom  = fs->rc;
-      front_pwaln->num_inputs = fs->num_inputs;
-      front_pwaln->segment = 'a';
-      front_pwaln->score = a->best_score;
-  
-      front_pwaln->start = a->abc + ref_start;
-      front_pwaln->end   = a->aec + ref_start;
-
       /* Update stats for this FragSeq */
       fs->as = a->abc + ref_start;
       fs->ae = a->aec + ref_start;
+      if ( fs->as >= maln->ref->seq_len ) {
+	/* All in the wrapped bit; it's really at the beginning */
+	fs->as -= maln->ref->seq_len;
+	fs->ae -= maln->ref->seq_len;
+      }
       fs->unique_best = 1;
       fs->score = a->best_score;
 
-      if ( front_pwaln->end > maln->ref->seq_len ) {
-	/* This alignment wraps around - adjust the end to
-	   demonstrate this for split_maln check */
-	front_pwaln->end = front_pwaln->end - maln->ref->seq_len;
-      }
+      /* If this alignment wraps around, it stays in one piece with
+	 its end past the end of the reference */
+      merge_align_into_maln( a, maln, fs, fs->as, fs->ae );
+      fs->asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
 
-      if ( front_pwaln->start > front_pwaln->end ) {
-	/* Move wrapped bit to back_pwaln */
-	split_pwaln( front_pwaln, back_pwaln, maln->ref->seq_len );
-	merge_pwaln_into_maln( front_pwaln, maln );
-	fs->front_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-	merge_pwaln_into_maln( back_pwaln, maln );
-	fs->back_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-      }
-      else { 
-	merge_pwaln_into_maln( front_pwaln, maln );
-	fs->front_asp = maln->AlnSeqArray[maln->num_aln_seqs - 1];
-      }
+      /* Know which matrices to use for *CALLING* a consensus */
+      set_depth_offsets( fs->asp, NULL );
     }
+    fit_fs_score( fsdb, fs );
+    release_fs( fsdb, fs );
+  }
+  end_fsdb_pass( fsdb );
+  if ( order != fsdb->fss ) {
+    free( order );
   }
+  a->c_off = 0;
   return;
 }
 
@@ -301,9 +310,20 @@ void help( void ) {
   printf( "===============================+++++++++++++==\n");
   printf( "\nUsage:\n");
   printf( "mia -r <reference sequence>\n" );
-  printf( "    -f <fasta or fastq file of fragments to align>\n" );
+  printf( "    -f <fasta, fastq, or -o read cache file of fragments to align>\n" );
   printf( "    -s <substitution matrix file> (if not supplied an default matrix is used)\n" );
   printf( "    -m <root file name for maln output file(s)> (assembly.maln.iter)\n" );
+  printf( "    -q <fastq output file of the sequences in the assembly; BGZF (gzip)\n" );
+  printf( "       compressed if it ends in .gz>\n" );
+  printf( "    -Z, --zip-threads <threads compressing .gz -q output; default = %d>\n", DEF_ZIP_THREADS );
+  printf( "    -b <manifest file of samples to assemble; replaces -f and -m>\n" );
+  printf( "    -j <number of samples from -b manifest to assemble at once; default = 1>\n" );
+  printf( "    -o, --read-cache <write the -f sequences, read and trimmed, to this\n" );
+  printf( "       file and assemble from it; later runs with the same -T and -a can\n" );
+  printf( "       give it as -f to skip reading and trimming>\n" );
+  printf( "    -x, --sam fragment files are SAM alignments to the reference from an\n" );
+  printf( "       external mapper; use these as the first round instead of aligning\n" );
+  printf( "       every fragment to the whole reference; not with -T\n" );
   printf( "    \nFILTER parameters:\n" );
   printf( "    -u fasta database has repeat sequences, keep one based on alignment score\n" );
   printf( "    -U fasta database has repeat sequences, keep one based on sum of q-scores\n" );
@@ -313,12 +333,28 @@ void help( void ) {
   printf( "       already been adapter trimmed\n" );
   printf( "    -T fasta database has adapters, trim these\n" );
   printf( "    -a <adapter sequence or code>\n" );
-  printf( "    -k <use kmer filter with kmers of this length>\n" );
+  printf( "    -k <use kmer filter with kmers of this length, or auto to choose one\n" );
+  printf( "       from the reference and the length of the sequences>\n" );
+  printf( "    -w, --saturate <align sequences with this many kmer places to the whole\n" );
+  printf( "       reference; default = %d, or chosen with -k auto>\n", KMER_SATURATE );
+  printf( "    -Y, --ry-seeds kmers only tell purines (A, G) from pyrimidines (C, T),\n" );
+  printf( "       so they match despite deamination; -k can be up to %d\n", 2 * MAX_KMER_LEN );
+  printf( "    -G, --spaced-seeds <pattern of 1s and 0s; kmers only look at the bases\n" );
+  printf( "       where it has a 1, repeating it over the -k bases>\n" );
+  printf( "    -d, --dust <only use kmers from low-complexity reference sequence\n" );
+  printf( "       (DUST score above this) if a sequence has no others; 0 = off; default = %d>\n", DEF_DUST_LEVEL );
   printf( "    -I <filename of list of sequence IDs to use, ignoring all others>\n" );
+  printf( "    -t <stop reading sequences once -P percent of the reference is covered\n" );
+  printf( "       to this depth by good first-round alignments>\n" );
+  printf( "    -P <percent of reference that must reach -t depth; default = 95>\n" );
   printf( "    \nALIGNMENT parameters:\n" );
   printf( "    -p <consensus calling code; default = 1>\n" );
   printf( "    -c means reference/assembly is circular\n" );
   printf( "    -i iterate assembly until convergence\n" );
+  printf( "    -n, --reassemble assemble again from scratch with the consensus as the\n" );
+  printf( "       reference until it stops changing (what iterate_whmia_D.pl did)\n" );
+  printf( "    -R <when iterating, only realign unique sequences scoring within this\n" );
+  printf( "       much of the score cutoff; carry the rest forward until the end>\n" );
   printf( "    -F <only output the FINAL assembly, not each iteration>\n" );
   printf( "    -D <distantly related reference sequence>\n" );
   printf( "    -h give special discount for homopolymer gaps\n" );
@@ -326,6 +362,14 @@ void help( void ) {
   printf( "    -H <do not do dynamic score cutoff, instead use this Hard score cutoff>\n" );
   printf( "    -S <slope of length/score cutoff line>\n" );
   printf( "    -N <intercept of length/score cutoff line>\n" );
+  printf( "    -v report memory allocation statistics when finished\n" );
+  printf( "    -L, --mem-limit <MB of memory for holding sequences; the rest are\n" );
+  printf( "       kept in a temporary run file next to the maln output; default = no limit>\n" );
+  printf( "    \nCONTAMINATION CHECK parameters:\n" );
+  printf( "    -K, --ccheck <FASTA file of the likely contaminant; check the final\n" );
+  printf( "       assembly against it as ccheck does, writing <maln root>.ccheck>\n" );
+  printf( "    -E, --ccheck-ancient treat the DNA as ancient (ccheck -a)\n" );
+  printf( "    -W, --ccheck-transversions only transversions are diagnostic (ccheck -t)\n" );
   printf( "The default substitution matrix used the following parameters:\n" );
   printf( "  MATCH=%d, MISMATCH=%d, N=%d for all positions\n", FLAT_MATCH, FLAT_MISMATCH, N_SCORE);
 
@@ -341,6 +385,15 @@ void help( void ) {
   printf( "The kmer filter requires that a sequence fragment have at least one\n" );
   printf( "kmer of the specified length in common with the reference sequence in\n" );
   printf( "order to align it. For 36nt Solexa data, a value of 12 works well.\n" );
+  printf( "-Y and -G make kmers that still match with damage or other differences\n" );
+  printf( "in them; longer kmers then give the same sensitivity with fewer spurious\n" );
+  printf( "hits. With -Y each base is worth half as much, so -k 24 -Y is about as\n" );
+  printf( "specific as -k 12. -G 110 -k 18 looks at 12 of 18 bases. At most %d bases\n", MAX_KMER_LEN );
+  printf( "(%d with -Y) can be looked at.\n", 2 * MAX_KMER_LEN );
+  printf( "-k auto counts how often each kmer is in the reference and picks the\n" );
+  printf( "shortest kmers that expect at most %.1f spurious places per sequence,\n", AUTO_KMER_WINDOWS );
+  printf( "judging sequence length from the first %d sequences of the (first) fragment\n", AUTO_KMER_SAMPLE );
+  printf( "file. It works with -Y and -G.\n" );
   printf( "The -p option specifies how the new consensus assembly sequence is called\n" );
   printf( "at each iteration:\n" );
   printf( "1 => Any base whose aggregate score is MIN_SC_DIFF_CONS better than all\n" );
@@ -352,475 +405,344 @@ void help( void ) {
   printf( "one letter code as argument to -a. N or n => Neandertal adapter\n" );
   printf( "                  any other single letter => Standard GS FLX adapter\n" );
   printf( "              sequence (less than 127 nt) => user-specified adapter\n" );
+  printf( "If -b is specified, each line of the manifest file names one sample:\n" );
+  printf( "  <sample name> <fragment file> <maln output root> [fastq output file]\n" );
+  printf( "All samples are assembled against the same reference with the same\n" );
+  printf( "options, and the reference is only prepared once. The output files for\n" );
+  printf( "each sample are the same as from a separate run with -f and -m. If -q\n" );
+  printf( "is given and a line has no fastq output file, <maln output root>.fastq\n" );
+  printf( "is used. Blank lines and lines starting with # are skipped.\n" );
+  printf( "If -x is specified, the first-round alignments are read from the SAM\n" );
+  printf( "fragment file(s) instead of being made by mia. Only primary alignments to\n" );
+  printf( "the reference (by its ID) are used; soft clipped bases are aligned to\n" );
+  printf( "the reference next to them. Each alignment is scored as mia would score\n" );
+  printf( "it, without the -h discount, and must pass the same first-round cutoff.\n" );
+  printf( "They cannot be trimmed with -T, and -k does not apply to them. Later\n" );
+  printf( "iterations align as usual.\n" );
 }
 
-int main( int argc, char* argv[] ) {
+/* start_frag_file
+   Args: (1) MiaOptsP mo - run options
+         (2) FILE* FF - fragment file, just opened
+	 (3) const char* frag_fn - its name, for messages
+   Returns: sequence code of FF, as find_input_type; -1 if FF is a
+   read cache that cannot be used with these options
+   A read cache (-o) holds its sequences trimmed as they were when it
+   was written, so it can only stand in for the fragment file if the
+   adapter trimming asked for now is the same.
+*/
+static int start_frag_file( MiaOptsP mo, FILE* FF, const char* frag_fn ) {
+  int seq_code, trimmed;
+  char adapter[INIT_ALN_SEQ_LEN + 1];
 
-  char mat_fn[MAX_FN_LEN+1];
+  seq_code = find_input_type( FF );
+  if ( seq_code != 2 ) {
+    return seq_code;
+  }
+  if ( !read_cache_header( FF, &trimmed, adapter ) ) {
+    fprintf( stderr, "Cannot read %s\n", frag_fn );
+    return -1;
+  }
+  if ( (trimmed != mo->do_adapter_trimming) ||
+       (trimmed && (strcmp( adapter, mo->adapter ) != 0)) ) {
+    if ( trimmed ) {
+      fprintf( stderr, "Read cache %s was trimmed of adapter %s; run with -T -a %s\n",
+	       frag_fn, adapter, adapter );
+    }
+    else {
+      fprintf( stderr, "Read cache %s was written without adapter trimming; run without -T\n",
+	       frag_fn );
+    }
+    return -1;
+  }
+  return seq_code;
+}
+
+/* assemble_sample
+   Args: (1) MiaOptsP mo - run options and shared, read-only state
+         (2) MapAlignmentP maln - fresh maln with the prepared reference
+	 (3) AlignmentP fw_align - forward alignment set up for the reference
+	 (4) AlignmentP rc_align - revcom alignment set up for the reference
+	 (5) AlignmentP adapt_align - adapter alignment if mo->do_adapter_trimming
+	 (6) char* frag_fn - fasta, fastq, or read cache file of
+	     fragments to align
+	 (7) char* maln_root - root file name for maln output file(s)
+	 (8) char* fastq_out_fn - name of fastq output file if mo->make_fastq
+	 (9) ReadSetP reads - if not NULL, the fragments of frag_fn as
+	     load_reads read and trimmed them; they are taken from here
+	     instead
+	 (10) char** cons - if not NULL, set to the consensus of the
+	     final assembly, as ma -f 5 would call it from the maln file
+   Returns: 1 if success; 0 if failure
+   Aligns all the fragments in frag_fn to the reference in maln, then
+   filters, re-aligns and (if requested) iterates the assembly, writing
+   the maln file(s) and fastq output as it goes. maln, fw_align and
+   rc_align are changed along the way, so they must be set up anew
+   for each sample.
+*/
+int assemble_sample( MiaOptsP mo, MapAlignmentP maln,
+		     AlignmentP fw_align, AlignmentP rc_align,
+		     AlignmentP adapt_align,
+		     char* frag_fn, char* maln_root, char* fastq_out_fn,
+		     ReadSetP reads, char** cons ) {
   char maln_fn[MAX_FN_LEN+1];
-  char fastq_out_fn[MAX_FN_LEN+1];
-  char maln_root[MAX_FN_LEN+1];
-  char ref_fn[MAX_FN_LEN+1];
-  char frag_fn[MAX_FN_LEN+1];
-  char adapter_code[2]; // place to keep the argument for -a (which adapter to trim)
-  char* c_time; // place to keep asctime string
+  char ccheck_fn[MAX_FN_LEN+1];
   char* test_id;
-
-  int ich;
-  int any_arg = 0;
-  int Hard_cut = 0; // If 0 => use dynamic score cutoff, if > 0 use this instead
-  int circular = 0; // Boolean, TRUE if reference sequence is circular
-  int make_fastq = 0; // Boolean, TRUE if we should also output fastq database of seqs in assembly
-  int seq_code = 0; // code to indicate sequence input format; 0 => fasta; 1 => fastq
-  int do_adapter_trimming = 0; // Boolean, TRUE if we should try to trim
-                               // adapter from input sequences
-  int iterate = 0; //Boolean, TRUE means interate the assembly until convergence
-  // on an assembled sequence
-  int FINAL_ONLY = 0; //Boolean, TRUE means only write out the final assembly maln file
-                      //         FALSE (default) means write out each one
-  int ids_rest = 0; // Boolean, TRUE means restrict analysis to IDs in input file
-  int repeat_filt = 0; //Boolean, TRUE means remove sequences that are repeats, 
-                       // keeping best-scoring representative
-  int repeat_qual_filt = 0; //Boolean, TRUE means remove sequences that are repeats,
-                            // keeping best quality score sum representative
-  int just_outer_coords = 1; // Boolean, TRUE means just use strand, start, and end to
-                             // determine if sequences are redundant
-  int SCORE_CUT_SET = 0; //Boolean, TRUE means user has set a length/score cutoff line
-  int seen_seqs = 0;
-  int hp_special = 0; // Boolean, TRUE means user wants hp gap special discount
-  int distant_ref = 0; // Boolean, TRUE means the initial reference sequence is
-                       // known to be distantly related so keep trying to align all
-                       // sequences each round
-  int kmer_filt_len = -1; // length of kmer filtering, if user wants it; otherwise
-                          // special value of -1 indicates this is unset
-  int soft_mask = 0; //Boolean; TRUE => do not use kmers that are all lower-case
-                     //        FALSE => DO use all kmers, regardless of case
+  char* assembly_cons;
+  char* last_assembly_cons;
+  FastqJobP fq_job = NULL; // fastq output, written alongside the maln file
+  int fastq_ok = 1; // Boolean, FALSE means some fastq output was not written
+  int seq_code = 0; // code to indicate sequence input format; 0 => fasta; 1 => fastq;
+                    // 2 => read cache, already trimmed
+  size_t seen_seqs = 0;
+  size_t next_read = 0; // Next sequence to take from reads
   int iter_num; // Number of iterations of assembly done
-  int collapse = 0; // Boolean; TRUE => collapse input sequences in FSDB to improve
-                    //                  sequence quality
-                    //          FALSE => (default) keep all sequences
-  double slope     = DEF_S; // Set these to default unless, until user changes
-  double intercept = DEF_N; // them 
-  MapAlignmentP maln, // Contains all fragments initially better
-                      // than FIRST_ROUND_SCORE_CUTOFF
-    culled_maln;      // Contains all fragments with scores
-                      // better than SCORE_CUTOFF
-  AlignmentP fw_align, rc_align, adapt_align;
-  
-  PSSMP ancsubmat   = init_flatsubmat();
-  PSSMP rcancsubmat = revcom_submat(ancsubmat);
-  const PSSMP flatsubmat  = init_flatsubmat();
-
-  KPL* fkpa; // Place to keep forward kmer array if user requested kmer 
-  KPL* rkpa; // Place to keep reverse kmer array if user requested kmer 
-  IDsListP good_ids;
+  int converged; // Boolean, TRUE means the last iteration left the
+                 // consensus unchanged
+  int all_realigned; // Boolean, TRUE means no sequence was carried
+                     // forward in the last iteration
+  MapAlignmentP culled_maln; // Contains all fragments with scores
+                             // better than SCORE_CUTOFF
   FragSeqP frag_seq;
-  PWAlnFragP front_pwaln, back_pwaln;
+  PWAlnFragP pwaln = NULL; // SAM alignment being merged, if mo->sam_input
   FSDB fsdb; // Database to hold sequences to iterate over
+  size_t num_fss; // Number of sequences in fsdb before the latest one
+  DepthHistP dh; // Coverage so far, if stopping at target depth
   FILE* FF;
-  time_t curr_time;
+  FILE* CF; // contamination check output, if mo->contam_ref
+  MapAlignmentP split_maln; // culled_maln with wrapped guys in two parts
+  char* sam_line = NULL; // SAM input record, if mo->sam_input
+  char* sam_rname;
+  char* sam_cigar;
+  int sam_pos, sam_flag, sam_res;
+  int sam_unusable = 0; // Number of SAM alignments sam_align could not use
+  KmerFiltStats kfs; // What the kmer filter did with this sample
 
+  memset( &kfs, 0, sizeof(kfs) );
 
-  char maln_root_def[] = "assembly.maln.iter";
-  extern int optind;
-  extern char* optarg;
-  char neand_adapt[] = "GTCAGACACGCAACAGGGGATAGGCAAGGCACACAGGGGATAGG";
-  char stand_adapt[] = "CTGAGACACGCAACAGGGGATAGGCAAGGCACACAGGGGATAGG";
-  char user_def_adapt[128];
-  char* adapter; // set to either neand_adapt or stand_adapt based on user preference
-  adapter = neand_adapt; // Default is Neandertal
-  char* assembly_cons;
-  char* last_assembly_cons;
-  int cc = 1; // consensus code for calling consensus base
-  int i;
+  /* Set up the FSDB for keeping good-scoring sequence in memory */
+  fsdb = init_FSDB();
+  if ( fsdb == NULL ) {
+    fprintf( stderr, "Not enough memories for holding sequences\n" );
+    return 0;
+  }
+  if ( mo->mem_limit > 0 ) {
+    set_fsdb_mem_limit( fsdb, mo->mem_limit, maln_root );
+  }
 
-  /* Set the default output filename until the user overrides it */
-  strcpy( maln_root, maln_root_def );
+  /* Set up FragSeqP to point to a FragSeq */
+  frag_seq = init_FragSeq();
 
+  /* One by one, go through the input file of fragments to be aligned.
+     Align them to the reference. For each fragment generating an
+     alignment score better than the cutoff, merge it into the maln
+     alignment. Keep track of those that don't, too. */
+  FF = NULL;
+  if ( reads == NULL ) {
+    FF = fileOpen( frag_fn, "r" );
+  }
+  if ( mo->sam_input ) {
+    sam_line = (char*)save_malloc((MAX_LINE_LEN + 1) * sizeof(char));
+    pwaln = (PWAlnFragP)save_malloc( sizeof(PWAlnFrag));
+  }
+  else if ( reads == NULL ) {
+    seq_code = start_frag_file( mo, FF, frag_fn );
+    if ( seq_code < 0 ) {
+      fclose( FF );
+      free_FragSeq( frag_seq );
+      return 0;
+    }
+  }
 
-  /* Process command line arguments */
-  while( (ich=getopt( argc, argv, "s:r:f:m:a:p:H:I:S:N:k:q:FTciuhDMUAC" )) != -1 ) {
-    switch(ich) {
-    case 'c' :
-      circular = 1;
-      break;
-    case 'q' :
-      make_fastq = 1;
-      strcpy( fastq_out_fn, optarg );
-    case 'C' :
-      collapse = 1;
-      break;
-    case 'i' :
-      iterate = 1;
-      break;
-    case 'h' :
-      hp_special = 1;
-      break;
-    case 'u' :
-      repeat_filt = 1;
-      break;
-    case 'A' :
-      just_outer_coords = 0;
-      break;
-    case 'U' :
-      repeat_qual_filt = 1;
-      break;
-    case 'D' :
-      distant_ref = 1;
-      break;
-    case 'p' :
-      cc = atoi( optarg );
-      any_arg = 1;
-      break;
-    case 'I' :
-      good_ids = parse_ids( optarg );
-      ids_rest = 1;
-      break;
-    case 'H' :
-      Hard_cut = atoi( optarg );
-      if ( Hard_cut <= 0 ) {
-	fprintf( stderr, "Hard cutoff (-H) must be positive\n" );
-	help();
-	exit( 0 );
-      }
-      any_arg = 1;
-      break;
-    case 'M' :
-      soft_mask = 1;
-      break;
-    case 's' :
-      strcpy( mat_fn, optarg );
-      free( ancsubmat ); // trash the flat submat we initialized with
-      ancsubmat   = read_pssm( mat_fn );
-      free( rcancsubmat ); // trash the init rcsubmat, too
-      rcancsubmat = revcom_submat( ancsubmat );
-      any_arg = 1;
-      break;
-    case 'r' :
-      strcpy( ref_fn, optarg );
-      any_arg = 1;
-      break;
-    case 'k' :
-      kmer_filt_len = atoi( optarg );
-      any_arg = 1;
-      break;
-    case 'f' :
-      strcpy( frag_fn, optarg );
-      any_arg = 1;
-      break;
-    case 'm' :
-      strcpy( maln_root, optarg );
-      any_arg = 1;
-      break;
-    case 'T' :
-      do_adapter_trimming = 1;
-      break;
-    case 'a' :
-      if ( strlen( optarg ) > 127 ) {
-	  fprintf( stderr, "That adapter is too big!\nMIA will use the standard adapter.\n" );
-	  adapter = stand_adapt;
+  //LOG = fileOpen( log_fn, "w" );
+
+  /* Give some space to remember the IDs as we see them */
+  test_id = (char*)save_malloc(MAX_ID_LEN * sizeof(char));
+
+  /* If user wants to stop once the reference is covered deeply
+     enough, set up to keep track of the depth */
+  if ( mo->target_depth > 0 ) {
+    dh = init_depth_hist( maln->ref->seq_len, mo->target_depth,
+			  mo->target_frac );
+  }
+  else {
+    dh = NULL;
+  }
+
+  /* Announce we're strarting alignment of fragments */
+  fprintf( stderr, "Starting to align sequences to the reference...\n" );
+
+  while( mo->sam_input ?
+	 read_sam( FF, sam_line, frag_seq, &sam_rname, &sam_pos,
+		   &sam_flag, &sam_cigar ) :
+	 (reads != NULL) ?
+	 get_read( reads, next_read++, frag_seq ) :
+	 read_next_seq( FF, frag_seq, seq_code ) ) {
+    /* Only primary alignments to this reference are any use;
+       skip unmapped (0x4), secondary (0x100), and
+       supplementary (0x800) records */
+    if ( mo->sam_input &&
+	 ( (sam_flag & 0x904) ||
+	   (strcmp( sam_rname, maln->ref->id ) != 0) ) ) {
+      continue;
+    }
+    seen_seqs++;
+    strcpy( test_id, frag_seq->id );
+    if ( DEBUG ) {
+      fprintf( stderr, "%s\n", frag_seq->id );
+    }
+    if ( !mo->ids_rest ||
+	 ( bsearch( &test_id, mo->good_ids->ids, 
+		    mo->good_ids->num_ids,
+		    sizeof(char*), idCmp ) 
+	   != NULL ) ) {
+
+      num_fss = fsdb->num_fss;
+      if ( mo->sam_input ) {
+	/* The mapper already made the alignment, so just score
+	   it and merge it in */
+	sam_res = sam_align( maln, frag_seq, fsdb, mo->ancsubmat,
+			     sam_cigar, sam_pos, (sam_flag & 0x10) != 0,
+			     pwaln );
+	if ( sam_res == 0 ) {
+	  fprintf( stderr, "Problem handling %s\n", frag_seq->id );
+	}
+	if ( sam_res < 0 ) {
+	  sam_unusable++;
+	}
       }
       else {
-	strcpy( user_def_adapt, optarg );
-	  if ( strlen( user_def_adapt ) > 1 ) {
-	    adapter = user_def_adapt;
+	/* Sequences from reads were trimmed by load_reads, and
+	   those from a read cache when it was written */
+	if ( (reads == NULL) && (seq_code != 2) ) {
+	  if ( mo->do_adapter_trimming ) {
+	    /* Trim sequence (set frag_seg->trimmed and 
+	       frag_seg->trim_point field) */
+	    trim_frag( frag_seq, mo->adapter, adapt_align );
 	  }
 	  else {
-	    if ( !( (user_def_adapt[0] == 'n') ||
-		    (user_def_adapt[0] == 'N') ) ) {
-	      adapter = stand_adapt;
-	    }
-	    else {
-	      adapter = neand_adapt;
-	    }
+	    frag_seq->trimmed = 0;
+	  }
+	}
+
+	/* Check if kmer filtering. If so, filter */
+	if ( new_kmer_filter( frag_seq, mo->fkpa, mo->rkpa, 
+			      &mo->kmer_seed,
+			      fw_align, rc_align,
+			      mo->kmer_saturate, &kfs ) ) {
+	  /* Align this fragment to the reference and merge
+	     the result into maln; use the ancsubmat, not the reverse
+	     complemented rcsancsubmat during this first iteration because
+	     all sequence is forward strand
+	  */
+	  fw_align->submat = mo->ancsubmat;
+	  rc_align->submat = mo->ancsubmat;
+	
+	  if ( sg_align( maln, frag_seq, fsdb, 
+			 fw_align, rc_align ) == 0 ) {
+	    fprintf( stderr, "Problem handling %s\n", frag_seq->id );
 	  }
+	}
       }
-      break;
-    case 'S' :
-      slope = atof( optarg );
-      SCORE_CUT_SET = 1;
-      break;
-    case 'N' :
-      intercept = atof( optarg );
-      SCORE_CUT_SET = 1;
-      break;
-    case 'F' :
-      FINAL_ONLY = 1;
-      break;
-    default :
-      help();
-      exit( 0 );
+
+      /* If this one made it into fsdb with a good score, count
+	 its coverage and see if we have enough yet */
+      if ( (dh != NULL) &&
+	   (fsdb->num_fss > num_fss) &&
+	   (frag_seq->score >= FIRST_ROUND_SCORE_CUTOFF) ) {
+	if ( add_depth( dh, frag_seq->as, frag_seq->ae ) ) {
+	  fprintf( stderr, 
+		   "\n%d%% of reference at depth %d after %lu sequences; done reading\n",
+		   (int)(mo->target_frac * 100), mo->target_depth,
+		   (unsigned long)seen_seqs );
+	  break;
+	}
+      }
+    }
+    if ( seen_seqs % 1000 == 0 ) {
+      fprintf( stderr, "." );
+    }
+    if ( seen_seqs % 80000 == 0 ) {
+      fprintf( stderr, "\n" );
     }
   }
-
-  if ( !any_arg ) {
-    help();
-    exit( 0 );
+  if ( dh != NULL ) {
+    free_depth_hist( dh );
   }
-
-  if ( optind != argc ) {
-    fprintf( stderr, "There seems to be some extra cruff on the command line that mia does not understand.\n" );
+  if ( mo->sam_input ) {
+    free( sam_line );
+    if ( sam_unusable > 0 ) {
+      fprintf( stderr, "\n%d SAM alignments could not be used\n",
+	       sam_unusable );
+    }
+  }
+  else if ( mo->kmer_seed.len > 0 ) {
+    fprintf( stderr, "\nKmer filter passed %lu of %lu sequences\n",
+	     (unsigned long)kfs.passed,
+	     (unsigned long)(kfs.passed + kfs.failed) );
+    if ( mo->dust_level > 0 ) {
+      fprintf( stderr, "  %lu passed only on low-complexity kmers\n",
+	       (unsigned long)kfs.lc_only );
+      fprintf( stderr, "  %lu passed without their low-complexity kmers; "
+	       "%lu of these would have been aligned to the whole reference\n",
+	       (unsigned long)kfs.lc_left_out,
+	       (unsigned long)kfs.unsaturated );
+    }
   }
 
-  /* Start the clock... */
-  curr_time = time(NULL);
-  //  c_time = (char*)save_malloc(64*sizeof(char));
-  //  c_time = asctime(localtime(&curr_time));
+  //fprintf( LOG, "__Finished with initial alignments__" );
+  //fflush( LOG );
+  fprintf( stderr, "\n" );
+  iter_num = 1;
 
-  /* Announce that we're starting */
-  fprintf( stderr, 
-	   "Starting assembly of %s\nusing %s\nas reference at %s\n", 
-	   frag_fn, ref_fn, 
-	   asctime(localtime(&curr_time)) );
+  /* Now, we need a new MapAlignment, culled_maln, that is big
+     enough to hold all the unique guys from maln */
+  culled_maln = init_culled_map_alignment( maln );
 
+  /* Filtering repeats announcement */
+  fprintf( stderr, "Repeat and score filtering\n" );
 
-  /* Set up the maln structure */
-  maln = (MapAlignmentP)init_map_alignment();
-  maln->cons_code = cc; 
-  if ( maln == NULL ) {
-    fprintf( stderr, "Not enough memories for this\n" );
-    exit( 1 );
+  /* If user wants to filter against repeats by alignment score, do it */
+  if ( mo->repeat_filt ) {  
+    /* Sort fsdb by fsdb->as */
+    sort_fsdb( fsdb );
+    
+    /* Now, everything is sorted in fsdb, so I can easily see
+       which guys are unique by as, ae, and rc fields */
+    set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
   }
 
-  /* Set the distant_ref flag */
-  maln->distant_ref = distant_ref;
-
-  /* Set up the FSDB for keeping good-scoring sequence in memory */
-  fsdb = init_FSDB();
-  if ( fsdb == NULL ) {
-    fprintf( stderr, "Not enough memories for holding sequences\n" );
-    exit( 1 );
+  /* If user wants to filter against repeats by q-score sum, do it */
+  if ( mo->repeat_qual_filt ) {  
+    /* Sort fsdb by fsdb->as */
+    sort_fsdb_qscore( fsdb );
+    
+    /* Now, everything is sorted in fsdb, so I can easily see
+       which guys are unique by as, ae, and rc fields */
+    set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
   }
 
-  /* Read in the reference sequence and make reverse complement, too*/
-  if ( read_fasta_ref( maln->ref, ref_fn ) != 1 ) {
-    fprintf( stderr, "Problem reading reference sequence file %s\n", ref_fn );
-    exit( 1 );
-  }
+  /* Now, we know which sequences are unique, so make a
+     culled_maln with just the unique guys */
+  cull_maln_from_fsdb( culled_maln, fsdb, mo->Hard_cut, 
+		       mo->SCORE_CUT_SET, mo->slope, mo->intercept, -1 );
 
-  /* Add wrap-around sequence (rc, too) and set maln->ref->circular
-     if it's circular */
-  if ( circular ) {
-    add_ref_wrap( maln->ref );
-  }
-  else {
-    maln->ref->wrap_seq_len = maln->ref->seq_len;
+  if ( FF != NULL ) {
+    fclose(FF);
   }
-  /* Add space for the gaps array */
-  maln->ref->gaps = (int*)save_malloc((maln->ref->wrap_seq_len+1) *
-				      sizeof(int));
-  for( i = 0; i <= maln->ref->wrap_seq_len; i++ ) {
-    maln->ref->gaps[i] = 0;
-  }
-
-  /* Set up fkpa and rkpa for list of kmers in the reference (forward and
-     revcom strand) if user wants kmer filtering */
-  if ( kmer_filt_len > 0 ) {
-    fprintf( stderr, "Making kmer list for k-mer filtering...\n" );
-    fkpa = init_kpa(kmer_filt_len);
-    rkpa = init_kpa(kmer_filt_len);
-    /* 
-    kmer_list = (KmersP)pop_kmers( maln->ref, kmer_filt_len );
-    */
-    populate_kpa( fkpa, maln->ref->seq, 
-		  maln->ref->wrap_seq_len, kmer_filt_len, 
-		  soft_mask );
-    populate_kpa( rkpa, maln->ref->rcseq, 
-		  maln->ref->wrap_seq_len, kmer_filt_len,
-		  soft_mask );
-  }
-
-  /* Now kmer arrays have been made if requested. We can upper case
-     the reference sequences. */
-  make_ref_upper( maln->ref );
-
-  /* Set up FragSeqP to point to a FragSeq */
-  frag_seq = (FragSeqP)save_malloc(sizeof(FragSeq));
-
-  /* Set up the alignment structures for forward and reverse
-     complement alignments */
-  fw_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
-					 (maln->ref->wrap_seq_len + 
-					  (2*INIT_ALN_SEQ_LEN)),
-					 0, hp_special );
-  rc_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
-					 (maln->ref->wrap_seq_len + 
-					  (2*INIT_ALN_SEQ_LEN)),
-					 1, hp_special );
-
-  /* Set up the alignment structure for adapter trimming, if user
-     wants that */
-  if ( do_adapter_trimming ) {
-    adapt_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
-					      INIT_ALN_SEQ_LEN,
-					      0, hp_special );
-    /* Setup the flatsubmat */
-    //flatsubmat = init_flatsubmat();
-    adapt_align->submat = flatsubmat;
-
-    adapt_align->seq2   = adapter;
-    adapt_align->len2   = strlen( adapt_align->seq2 );
-    pop_s2c_in_a( adapt_align );
-    if ( hp_special ) {
-      pop_hpl_and_hps( adapt_align->seq2, adapt_align->len2,
-		       adapt_align->hprl, adapt_align->hprs );
-    }
-    /* Set for a semi-global that pays a penalty for unaligning the
-       beginning of the adapter, but not for the end of the adapter.
-       This is because if the sequence read (align->seq1) ends, then
-       we won't see any more of the adapter. When we search for the
-       best alignment, we'll only look in the last column, requiring that
-       all of align->seq1 is accounted for */
-    adapt_align->sg5    = 1;
-    adapt_align->sg3    = 0;
-  }
-
-  fw_align->seq1 = maln->ref->seq;
-  rc_align->seq1 = maln->ref->rcseq;
-  if ( circular ) {
-    fw_align->len1 = maln->ref->wrap_seq_len;
-    rc_align->len1 = maln->ref->wrap_seq_len;
-  }
-  else {
-    fw_align->len1 = maln->ref->seq_len;
-    rc_align->len1 = maln->ref->seq_len;
-  }
-
-  /* Now the reference sequence and its reverse complement are
-     prepared, put the s1c lookup codes in */
-  pop_s1c_in_a( fw_align );
-  pop_s1c_in_a( rc_align );
-
-  if ( hp_special ) {
-    pop_hpl_and_hps( fw_align->seq1, fw_align->len1,
-		     fw_align->hpcl, fw_align->hpcs );
-    pop_hpl_and_hps( rc_align->seq1, rc_align->len1,
-		     rc_align->hpcl, rc_align->hpcs );
-  }
-
-  /* One by one, go through the input file of fragments to be aligned.
-     Align them to the reference. For each fragment generating an
-     alignment score better than the cutoff, merge it into the maln
-     alignment. Keep track of those that don't, too. */
-  FF = fileOpen( frag_fn, "r" );
-  seq_code = find_input_type( FF );
-
-  //LOG = fileOpen( log_fn, "w" );
-  front_pwaln = (PWAlnFragP)save_malloc( sizeof(PWAlnFrag));
-  back_pwaln  = (PWAlnFragP)save_malloc( sizeof(PWAlnFrag));
-
-  /* Give some space to remember the IDs as we see them */
-  test_id = (char*)save_malloc(MAX_ID_LEN * sizeof(char));
-
-  /* Announce we're strarting alignment of fragments */
-  fprintf( stderr, "Starting to align sequences to the reference...\n" );
-
-  while( read_next_seq( FF, frag_seq, seq_code ) ) {
-    seen_seqs++;
-    strcpy( test_id, frag_seq->id );
-    if ( DEBUG ) {
-      fprintf( stderr, "%s\n", frag_seq->id );
-    }
-    if ( !ids_rest ||
-	 ( bsearch( &test_id, good_ids->ids, 
-		    good_ids->num_ids,
-		    sizeof(char*), idCmp ) 
-	   != NULL ) ) {
-
-      if ( do_adapter_trimming ) {
-	/* Trim sequence (set frag_seg->trimmed and 
-	   frag_seg->trim_point field) */
-	trim_frag( frag_seq, adapter, adapt_align );
-      }
-      else {
-	frag_seq->trimmed = 0;
-      }
-
-      /* Check if kmer filtering. If so, filter */
-      if ( new_kmer_filter( frag_seq, fkpa, rkpa, kmer_filt_len,
-			    fw_align, rc_align ) ) {
-	/* Align this fragment to the reference and write 
-	   the result into pwaln; use the ancsubmat, not the reverse
-	   complemented rcsancsubmat during this first iteration because
-	   all sequence is forward strand
-	*/
-	fw_align->submat = ancsubmat;
-	rc_align->submat = ancsubmat;
-	
-	if ( sg_align( maln, frag_seq, fsdb, 
-		       fw_align, rc_align,
-		       front_pwaln, 
-		       back_pwaln ) == 0 ) {
-	  fprintf( stderr, "Problem handling %s\n", frag_seq->id );
-	}
-      }  
-    }
-    if ( seen_seqs % 1000 == 0 ) {
-      fprintf( stderr, "." );
-    }
-    if ( seen_seqs % 80000 == 0 ) {
-      fprintf( stderr, "\n" );
-    }
-  }
-
-  /* Now, fsdb is complete and points to all the things in maln.
-     So we can fill in the AlnSeqP->smp array for everything in the 
-     maln->AlnSeqArray to know which matrices to use for *CALLING* 
-     a consensus; Conveniently, there are pointers to all of these
-     in the fss->fss[X]->front|back_asp */
-  pop_smp_from_FSDB( fsdb, PSSM_DEPTH );
-
-  //fprintf( LOG, "__Finished with initial alignments__" );
-  //fflush( LOG );
-  fprintf( stderr, "\n" );
-  iter_num = 1;
-
-  /* Now, we need a new MapAlignment, culled_maln, that is big
-     enough to hold all the unique guys from maln */
-  culled_maln = init_culled_map_alignment( maln );
-
-  /* Filtering repeats announcement */
-  fprintf( stderr, "Repeat and score filtering\n" );
-
-  /* If user wants to filter against repeats by alignment score, do it */
-  if ( repeat_filt ) {  
-    /* Sort fsdb by fsdb->as */
-    sort_fsdb( fsdb );
-    
-    /* Now, everything is sorted in fsdb, so I can easily see
-       which guys are unique by as, ae, and rc fields */
-    set_uniq_in_fsdb( fsdb, just_outer_coords );
-  }
-
-  /* If user wants to filter against repeats by q-score sum, do it */
-  if ( repeat_qual_filt ) {  
-    /* Sort fsdb by fsdb->as */
-    sort_fsdb_qscore( fsdb );
-    
-    /* Now, everything is sorted in fsdb, so I can easily see
-       which guys are unique by as, ae, and rc fields */
-    set_uniq_in_fsdb( fsdb, just_outer_coords );
-  }
-
-  /* Now, we know which sequences are unique, so make a
-     culled_maln with just the unique guys */
-  cull_maln_from_fsdb( culled_maln, fsdb, Hard_cut, 
-		       SCORE_CUT_SET, slope, intercept );
-
-  fclose(FF);
 
   /* Tell the culled_maln which matrices to use for assembly */
-  culled_maln->fpsm = ancsubmat;
-  culled_maln->rpsm = rcancsubmat;
+  culled_maln->fpsm = mo->ancsubmat;
+  culled_maln->rpsm = mo->rcancsubmat;
 
-  sort_aln_frags( culled_maln ); //invalidates fsdb->front|back_asp fields!
+  sort_aln_frags( culled_maln ); //invalidates fsdb->asp fields!
 
-  fw_align->submat = ancsubmat;
+  fw_align->submat = mo->ancsubmat;
   fw_align->sg5 = 1;
   fw_align->sg3 = 1;
 
   last_assembly_cons = (char*)save_malloc((maln->ref->seq_len +1) * 
-				     sizeof(char));
+					  sizeof(char));
   strncpy( last_assembly_cons, maln->ref->seq, 
 	   maln->ref->seq_len );
   last_assembly_cons[maln->ref->seq_len] = '\0';
@@ -831,48 +753,53 @@ int main( int argc, char* argv[] ) {
      if requested
   */
   memset(fw_align->align_mask, 1, fw_align->len1);
-  if ( collapse ) {
-    collapse_FSDB( fsdb, Hard_cut, SCORE_CUT_SET, 
-		   slope, intercept );
+  if ( mo->collapse ) {
+    collapse_FSDB( fsdb, mo->Hard_cut, mo->SCORE_CUT_SET, 
+		   mo->slope, mo->intercept );
   }
   reiterate_assembly( last_assembly_cons, iter_num, maln, fsdb,
-		      fw_align, front_pwaln, back_pwaln, 
-		      ancsubmat, rcancsubmat );
-  pop_smp_from_FSDB( fsdb, PSSM_DEPTH );
+		      fw_align,
+		      mo->ancsubmat, mo->rcancsubmat );
   fprintf( stderr, "Repeat and score filtering\n" );
-  if ( repeat_filt ) {
+  if ( mo->repeat_filt ) {
     sort_fsdb( fsdb );
-    set_uniq_in_fsdb( fsdb, just_outer_coords );
+    set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
   }
-  if ( repeat_qual_filt ) {  
+  if ( mo->repeat_qual_filt ) {  
     sort_fsdb_qscore( fsdb );
-    set_uniq_in_fsdb( fsdb, just_outer_coords );
+    set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
   }
-  cull_maln_from_fsdb( culled_maln, fsdb, Hard_cut,
-		       SCORE_CUT_SET, slope, intercept );
+  cull_maln_from_fsdb( culled_maln, fsdb, mo->Hard_cut,
+		       mo->SCORE_CUT_SET, mo->slope, mo->intercept,
+		       mo->realign_margin );
   
   
   /* Tell the culled_maln which matrices to use for assembly */
-  culled_maln->fpsm = ancsubmat;
-  culled_maln->rpsm = rcancsubmat;
+  culled_maln->fpsm = mo->ancsubmat;
+  culled_maln->rpsm = mo->rcancsubmat;
   
-  //invalidates fsdb->front|back_asp fields!
+  //invalidates fsdb->asp fields!
   sort_aln_frags( culled_maln );
-  sprintf( maln_fn, "%s.%d", maln_root, iter_num );
-  if ( !iterate || !FINAL_ONLY ) {
+  snprintf( maln_fn, sizeof(maln_fn), "%s.%d", maln_root, iter_num );
+  if ( !mo->iterate || !mo->FINAL_ONLY ) {
+    if ( mo->make_fastq ) {
+      fq_job = start_write_fastq( fastq_out_fn, fsdb, mo->zip_threads, 1 );
+    }
     write_ma( maln_fn, culled_maln );
-    if ( make_fastq ) {
-      write_fastq( fastq_out_fn, fsdb );
+    if ( mo->make_fastq ) {
+      fastq_ok = finish_write_fastq( fq_job ) && fastq_ok;
     }
   }
 
   /* Are we iterating (re-aligning to the a new consensus? */
-  if (iterate) {
+  if ( mo->iterate ) {
     /* New assembly consensus announcement */
     fprintf( stderr, "Generating new assembly consensus\n" );
     assembly_cons = consensus_assembly_string( culled_maln );
+    converged = ( strcmp( assembly_cons, last_assembly_cons ) == 0 );
+    all_realigned = 1;
 
-    while( ( strcmp( assembly_cons, last_assembly_cons ) != 0) &&
+    while( ( !converged || !all_realigned ) &&
 	   (iter_num < MAX_ITER) ) {
       /* Another round...*/
       iter_num++;
@@ -882,48 +809,61 @@ int main( int argc, char* argv[] ) {
       fprintf( stderr, "Starting assembly iteration %d\n", 
 	       iter_num );
 
+      /* Some sequences may have been carried forward without
+	 realigning. If the assembly has stopped changing, or this is
+	 the last chance, realign them all so the final maln has
+	 everything in it */
+      all_realigned = ( (mo->realign_margin < 0) || converged ||
+			(iter_num == MAX_ITER) );
+      if ( all_realigned ) {
+	realign_all_fsdb( fsdb );
+      }
+
       /* If the user wants collapsed sequences, now is the time */
-      if ( collapse ) {
-	collapse_FSDB( fsdb, Hard_cut, SCORE_CUT_SET, 
-		       slope, intercept );
+      if ( mo->collapse ) {
+	collapse_FSDB( fsdb, mo->Hard_cut, mo->SCORE_CUT_SET, 
+		       mo->slope, mo->intercept );
       }
 
       reiterate_assembly( assembly_cons, iter_num, maln, fsdb, 
-			  fw_align, front_pwaln, back_pwaln,
-			  ancsubmat, rcancsubmat );
-
-      pop_smp_from_FSDB( fsdb, PSSM_DEPTH );
+			  fw_align,
+			  mo->ancsubmat, mo->rcancsubmat );
 
       fprintf( stderr, "Repeat and score filtering\n" );
-      if ( repeat_filt ) {
+      if ( mo->repeat_filt ) {
 	sort_fsdb( fsdb );
-	set_uniq_in_fsdb( fsdb, just_outer_coords );
+	set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
       }
-      if ( repeat_qual_filt ) {
+      if ( mo->repeat_qual_filt ) {
 	sort_fsdb_qscore( fsdb );
-	set_uniq_in_fsdb( fsdb, just_outer_coords );
+	set_uniq_in_fsdb( fsdb, mo->just_outer_coords );
       }
-      cull_maln_from_fsdb( culled_maln, fsdb, Hard_cut,
-			   SCORE_CUT_SET, slope, intercept );
+      cull_maln_from_fsdb( culled_maln, fsdb, mo->Hard_cut,
+			   mo->SCORE_CUT_SET, mo->slope, mo->intercept,
+			   mo->realign_margin );
 
       
       /* Tell the culled_maln which matrices to use for assembly */
-      culled_maln->fpsm = ancsubmat;
-      culled_maln->rpsm = rcancsubmat;
+      culled_maln->fpsm = mo->ancsubmat;
+      culled_maln->rpsm = mo->rcancsubmat;
 
-      //invalidates fsdb->front|back_asp fields!
+      //invalidates fsdb->asp fields!
       sort_aln_frags( culled_maln );
 
-      sprintf( maln_fn, "%s.%d", maln_root, iter_num );
-      if ( !FINAL_ONLY ) {
+      snprintf( maln_fn, sizeof(maln_fn), "%s.%d", maln_root, iter_num );
+      if ( !mo->FINAL_ONLY ) {
 	fprintf( stderr, "Writing maln file for iteration %d\n", 
 		 iter_num );
 	write_ma( maln_fn, culled_maln );
       }
       assembly_cons = consensus_assembly_string( culled_maln );
+      converged = ( strcmp( assembly_cons, last_assembly_cons ) == 0 );
     }
   
     /* Convergence? */
+    if ( mo->make_fastq ) {
+      fq_job = start_write_fastq( fastq_out_fn, fsdb, mo->zip_threads, 1 );
+    }
     if ( strcmp( assembly_cons, last_assembly_cons ) == 0 ) {
       fprintf( stderr, "Assembly convergence - writing final maln\n" );
       write_ma( maln_fn, culled_maln );
@@ -932,8 +872,8 @@ int main( int argc, char* argv[] ) {
       fprintf( stderr, "Assembly did not converge after % rounds, quitting\n" );
       write_ma( maln_fn, culled_maln );
     }
-    if ( make_fastq ) {
-      write_fastq( fastq_out_fn, fsdb );
+    if ( mo->make_fastq ) {
+      fastq_ok = finish_write_fastq( fq_job ) && fastq_ok;
     }
   }
 
@@ -941,6 +881,1096 @@ int main( int argc, char* argv[] ) {
      sequence and substitution matrices to keep scores comparable to what
      they would have been had we iterated */
 
+  /* Call the consensus of the final maln as ma would, from it the
+     way it is in the maln file */
+  if ( cons != NULL ) {
+    split_maln = split_wrapped_aln_seqs( culled_maln );
+    *cons = get_consensus( split_maln, NULL );
+    free_split_aln_seqs( split_maln, culled_maln );
+  }
+
+  /* Check the final assembly for contamination now, while it and
+     all its fragments are still in memory */
+  if ( mo->contam_ref != NULL ) {
+    if ( snprintf( ccheck_fn, sizeof(ccheck_fn), "%s.ccheck",
+		   maln_root ) >= (int)sizeof(ccheck_fn) ) {
+      fprintf( stderr, "Contamination check file name is too long: %s.ccheck\n",
+	       maln_root );
+      return 0;
+    }
+    fprintf( stderr, "Checking %s for contamination, writing %s\n",
+	     maln_fn, ccheck_fn );
+    CF = fileOpen( ccheck_fn, "w" );
+    if ( CF == NULL ) {
+      return 0;
+    }
+    /* contam_check wants the front and back parts of guys that
+       wrap around separately, as they are in an MA file */
+    split_maln = split_wrapped_aln_seqs( culled_maln );
+    if ( !contam_check( CF, split_maln, mo->contam_ref->seq, 
+			&mo->contam ) ) {
+      fprintf( stderr, "Could not align the assembly to the contaminant %s\n",
+	       mo->contam_ref->id );
+    }
+    free_split_aln_seqs( split_maln, culled_maln );
+    fclose( CF );
+  }
+
+  if ( mo->show_alloc_stats ) {
+    print_alloc_stats( stderr );
+  }
+  return fastq_ok;
+}
+
+/* wrap_reference
+   Args: (1) MiaOptsP mo - run options
+         (2) MapAlignmentP maln - with the reference sequence read in
+   Returns: void
+   Adds the wrap-around sequence to the reference if it is circular,
+   and the gaps array
+*/
+static void wrap_reference( MiaOptsP mo, MapAlignmentP maln ) {
+  int i;
+
+  /* Add wrap-around sequence (rc, too) and set maln->ref->circular
+     if it's circular */
+  if ( mo->circular ) {
+    add_ref_wrap( maln->ref );
+  }
+  else {
+    maln->ref->wrap_seq_len = maln->ref->seq_len;
+  }
+  /* Add space for the gaps array */
+  maln->ref->gaps = (int*)save_malloc((maln->ref->wrap_seq_len+1) *
+				      sizeof(int));
+  for( i = 0; i <= maln->ref->wrap_seq_len; i++ ) {
+    maln->ref->gaps[i] = 0;
+  }
+}
+
+/* index_reference
+   Args: (1) MiaOptsP mo - run options, with kmer_seed set; fkpa and
+             rkpa are made here if kmer filtering
+         (2) MapAlignmentP maln - with the reference wrapped (see
+	     wrap_reference)
+	 (3) AlignmentP* fw_align - set to a new forward alignment
+	     for the reference
+	 (4) AlignmentP* rc_align - set to a new revcom alignment
+	     for the reference
+   Returns: void
+   Makes everything the alignments to the reference need: the kmer
+   arrays, the upper-cased reference, and the alignment structures
+   with its lookup codes
+*/
+static void index_reference( MiaOptsP mo, MapAlignmentP maln,
+			     AlignmentP* fw_align, AlignmentP* rc_align ) {
+  char* lc_mask; // DUST mask of the reference, forward or reverse complement
+  size_t lc_masked;
+
+  if ( mo->kmer_filt_len > 0 ) {
+    fprintf( stderr, "Making kmer list for k-mer filtering...\n" );
+    mo->fkpa = init_kpa( &mo->kmer_seed );
+    mo->rkpa = init_kpa( &mo->kmer_seed );
+    /* 
+    kmer_list = (KmersP)pop_kmers( maln->ref, kmer_filt_len );
+    */
+    lc_mask = NULL;
+    if ( mo->dust_level > 0 ) {
+      lc_mask = (char*)save_malloc( maln->ref->wrap_seq_len * sizeof(char) );
+      lc_masked = dust_mask( maln->ref->seq, maln->ref->wrap_seq_len,
+			     mo->dust_level, lc_mask );
+      fprintf( stderr, "%lu of %d reference bases are low complexity "
+	       "(DUST level %d)\n", (unsigned long)lc_masked,
+	       maln->ref->wrap_seq_len, mo->dust_level );
+    }
+    populate_kpa( mo->fkpa, maln->ref->seq, 
+		  maln->ref->wrap_seq_len, &mo->kmer_seed, 
+		  mo->soft_mask, lc_mask );
+    if ( lc_mask != NULL ) {
+      dust_mask( maln->ref->rcseq, maln->ref->wrap_seq_len,
+		 mo->dust_level, lc_mask );
+    }
+    populate_kpa( mo->rkpa, maln->ref->rcseq, 
+		  maln->ref->wrap_seq_len, &mo->kmer_seed,
+		  mo->soft_mask, lc_mask );
+    free( lc_mask );
+  }
+
+  /* Now kmer arrays have been made if requested. We can upper case
+     the reference sequences. */
+  make_ref_upper( maln->ref );
+
+  /* Set up the alignment structures for forward and reverse
+     complement alignments */
+  *fw_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
+					 (maln->ref->wrap_seq_len + 
+					  (2*INIT_ALN_SEQ_LEN)),
+					 0, mo->hp_special );
+  *rc_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
+					 (maln->ref->wrap_seq_len + 
+					  (2*INIT_ALN_SEQ_LEN)),
+					 1, mo->hp_special );
+
+  (*fw_align)->seq1 = maln->ref->seq;
+  (*rc_align)->seq1 = maln->ref->rcseq;
+  if ( mo->circular ) {
+    (*fw_align)->len1 = maln->ref->wrap_seq_len;
+    (*rc_align)->len1 = maln->ref->wrap_seq_len;
+  }
+  else {
+    (*fw_align)->len1 = maln->ref->seq_len;
+    (*rc_align)->len1 = maln->ref->seq_len;
+  }
+
+  /* Now the reference sequence and its reverse complement are
+     prepared, put the s1c lookup codes in */
+  pop_s1c_in_a( *fw_align );
+  pop_s1c_in_a( *rc_align );
+
+  if ( mo->hp_special ) {
+    pop_hpl_and_hps( (*fw_align)->seq1, (*fw_align)->len1,
+		     (*fw_align)->hpcl, (*fw_align)->hpcs );
+    pop_hpl_and_hps( (*rc_align)->seq1, (*rc_align)->len1,
+		     (*rc_align)->hpcl, (*rc_align)->hpcs );
+  }
+}
+
+/* load_reads
+   Args: (1) MiaOptsP mo - run options
+         (2) AlignmentP adapt_align - adapter alignment if
+	     mo->do_adapter_trimming
+	 (3) char* frag_fn - fasta, fastq, or read cache file of fragments
+   Returns: ReadSetP with the fragments of frag_fn that pass the -I
+   ID restriction, trimmed as assemble_sample would trim them; NULL
+   if frag_fn cannot be used or not enough memories
+*/
+static ReadSetP load_reads( MiaOptsP mo, AlignmentP adapt_align,
+			    char* frag_fn ) {
+  FILE* FF;
+  FragSeqP frag_seq;
+  ReadSetP reads;
+  int seq_code;
+  int ok; // Boolean, FALSE means frag_fn could not all be loaded
+  char* test_id;
+
+  reads = init_read_set();
+  frag_seq = init_FragSeq();
+  if ( (reads == NULL) || (frag_seq == NULL) ) {
+    fprintf( stderr, "Not enough memories for holding sequences\n" );
+    if ( reads != NULL ) {
+      free_read_set( reads );
+    }
+    if ( frag_seq != NULL ) {
+      free_FragSeq( frag_seq );
+    }
+    return NULL;
+  }
+  FF = fileOpen( frag_fn, "r" );
+  if ( FF == NULL ) {
+    free_read_set( reads );
+    free_FragSeq( frag_seq );
+    return NULL;
+  }
+  seq_code = start_frag_file( mo, FF, frag_fn );
+  ok = (seq_code >= 0);
+  while( ok && read_next_seq( FF, frag_seq, seq_code ) ) {
+    test_id = frag_seq->id;
+    if ( mo->ids_rest &&
+	 ( bsearch( &test_id, mo->good_ids->ids, 
+		    mo->good_ids->num_ids,
+		    sizeof(char*), idCmp ) 
+	   == NULL ) ) {
+      continue;
+    }
+    if ( seq_code != 2 ) {
+      if ( mo->do_adapter_trimming ) {
+	trim_frag( frag_seq, mo->adapter, adapt_align );
+      }
+      else {
+	frag_seq->trimmed = 0;
+      }
+    }
+    if ( !add_read( reads, frag_seq ) ) {
+      fprintf( stderr, "Not enough memories for holding sequences\n" );
+      ok = 0;
+    }
+  }
+  fclose( FF );
+  free_FragSeq( frag_seq );
+  if ( !ok ) {
+    free_read_set( reads );
+    return NULL;
+  }
+  return reads;
+}
+
+/* read_cons_pipe
+   Args: (1) int fd - read end of the pipe from a reassembly round
+   Returns: the consensus the round wrote to fd, or NULL if it
+   wrote nothing
+*/
+static char* read_cons_pipe( int fd ) {
+  char* cons;
+  char* new_cons;
+  size_t len = 0, size = INIT_REF_SEQ_LEN;
+  ssize_t got;
+
+  cons = (char*)save_malloc((size + 1) * sizeof(char));
+  while( (got = read( fd, &cons[len], size - len )) > 0 ) {
+    len += got;
+    if ( len == size ) {
+      new_cons = (char*)save_malloc((2 * size + 1) * sizeof(char));
+      memcpy( new_cons, cons, len );
+      free( cons );
+      cons = new_cons;
+      size *= 2;
+    }
+  }
+  if ( len == 0 ) {
+    free( cons );
+    return NULL;
+  }
+  cons[len] = '\0';
+  return cons;
+}
+
+/* reassembly_round
+   Args: (1) MiaOptsP mo - run options
+         (2) MapAlignmentP maln - fresh maln with the starting reference
+	 (3) AlignmentP fw_align - forward alignment set up for it
+	 (4) AlignmentP rc_align - revcom alignment set up for it
+	 (5) char* ref_seq - reference for this round; NULL means
+	     the starting one
+	 (6) ReadSetP reads - the fragments, from load_reads
+	 (7) char* frag_fn, (8) char* maln_root, (9) char* fastq_out_fn
+	     as for assemble_sample
+	 (10) int fd - where to write the consensus
+   Returns: does not return; exits 0 if success, 1 if failure
+   Runs in the child process for one round of reassemble_sample.
+   Makes a new reference from ref_seq, with the ID of the starting
+   one and no description, as reading it back from the FASTA file
+   ma -f 5 writes would, and the kmer arrays and alignments for it.
+   Then assembles reads to it and writes the consensus, with its
+   gaps left out and blanks made X as in that FASTA file, to fd
+*/
+static void reassembly_round( MiaOptsP mo, MapAlignmentP maln,
+			      AlignmentP fw_align, AlignmentP rc_align,
+			      char* ref_seq, ReadSetP reads,
+			      char* frag_fn, char* maln_root,
+			      char* fastq_out_fn, int fd ) {
+  MapAlignmentP round_maln;
+  char* cons;
+  size_t i, len, written;
+  ssize_t put;
+
+  if ( ref_seq != NULL ) {
+    round_maln = init_map_alignment();
+    if ( round_maln == NULL ) {
+      fprintf( stderr, "Not enough memories for this\n" );
+      exit( 1 );
+    }
+    round_maln->cons_code = maln->cons_code;
+    round_maln->distant_ref = maln->distant_ref;
+    strcpy( round_maln->ref->id, maln->ref->id );
+    round_maln->ref->desc[0] = '\0';
+    len = strlen( ref_seq );
+    round_maln->ref->size = len + 1;
+    round_maln->ref->seq = (char*)save_malloc((len + 1) * sizeof(char));
+    round_maln->ref->rcseq = (char*)save_malloc((len + 1) * sizeof(char));
+    strcpy( round_maln->ref->seq, ref_seq );
+    revcom_seq( round_maln->ref->rcseq, ref_seq, len );
+    round_maln->ref->rcseq[len] = '\0';
+    round_maln->ref->seq_len = len;
+    wrap_reference( mo, round_maln );
+    index_reference( mo, round_maln, &fw_align, &rc_align );
+    maln = round_maln;
+  }
+
+  if ( !assemble_sample( mo, maln, fw_align, rc_align, NULL,
+			 frag_fn, maln_root, fastq_out_fn,
+			 reads, &cons ) ) {
+    exit( 1 );
+  }
+
+  /* What ma -f 5 would write of it */
+  len = 0;
+  for( i = 0; cons[i] != '\0'; i++ ) {
+    if ( cons[i] != '-' ) {
+      cons[len++] = (cons[i] == ' ') ? 'X' : cons[i];
+    }
+  }
+  written = 0;
+  while( written < len ) {
+    put = write( fd, &cons[written], len - written );
+    if ( put <= 0 ) {
+      exit( 1 );
+    }
+    written += put;
+  }
+  close( fd );
+  exit( 0 );
+}
+
+/* reassemble_sample
+   Args: (1)-(8) as for assemble_sample
+   Returns: 1 if success; 0 if failure
+   Assembles the sample to the reference in maln, calls the consensus
+   as ma -f 5 does, and assembles it again from scratch to that, until
+   the consensus is the same as the last round's or MAX_ITER rounds
+   are done, as iterate_whmia_D.pl used to by running mia and ma
+   over and over. The fragments are read and trimmed once and kept in
+   memory. Each round runs in a child process, as the samples of
+   run_batch do, so the reference, kmer arrays and alignments it makes
+   go away with it; it hands the consensus back through a pipe. The
+   maln file (and fastq output) of the last round is what is left.
+*/
+int reassemble_sample( MiaOptsP mo, MapAlignmentP maln,
+		       AlignmentP fw_align, AlignmentP rc_align,
+		       AlignmentP adapt_align,
+		       char* frag_fn, char* maln_root, char* fastq_out_fn ) {
+  ReadSetP reads;
+  char* last_cons = NULL;
+  char* cons = NULL;
+  int round_num = 0, converged = 0, status;
+  int fds[2];
+  pid_t pid;
+
+  fprintf( stderr, "Reading sequences from %s\n", frag_fn );
+  reads = load_reads( mo, adapt_align, frag_fn );
+  if ( reads == NULL ) {
+    return 0;
+  }
+  fprintf( stderr, "Keeping %lu sequences for reassembly\n",
+	   (unsigned long)reads->num_reads );
+
+  while( !converged && (round_num < MAX_ITER) ) {
+    round_num++;
+    fprintf( stderr, "Starting reassembly round %d\n", round_num );
+    if ( pipe( fds ) != 0 ) {
+      fprintf( stderr, "Could not start reassembly round %d\n", round_num );
+      return 0;
+    }
+    fflush( stdout );
+    fflush( stderr );
+    pid = fork();
+    if ( pid < 0 ) {
+      fprintf( stderr, "Could not start reassembly round %d\n", round_num );
+      return 0;
+    }
+    if ( pid == 0 ) {
+      close( fds[0] );
+      reassembly_round( mo, maln, fw_align, rc_align, cons, reads,
+			frag_fn, maln_root, fastq_out_fn, fds[1] );
+    }
+    close( fds[1] );
+    free( last_cons );
+    last_cons = cons;
+    cons = read_cons_pipe( fds[0] );
+    close( fds[0] );
+    if ( (waitpid( pid, &status, 0 ) != pid) ||
+	 !WIFEXITED(status) || (WEXITSTATUS(status) != 0) ) {
+      fprintf( stderr, "Reassembly round %d failed\n", round_num );
+      return 0;
+    }
+    if ( cons == NULL ) {
+      fprintf( stderr, "Reassembly round %d left no consensus\n", round_num );
+      return 0;
+    }
+    converged = ( (last_cons != NULL) &&
+		  (strcmp( cons, last_cons ) == 0) );
+  }
+
+  if ( converged ) {
+    fprintf( stderr, "Reassembly converged after %d rounds\n", round_num );
+  }
+  else {
+    fprintf( stderr, "Reassembly did not converge after %d rounds\n",
+	     round_num );
+  }
+  free( last_cons );
+  free( cons );
+  free_read_set( reads );
+  return 1;
+}
+
+/* wait_for_sample
+   Args: (1) SampleListP sl - the samples being assembled
+         (2) pid_t* pids - process ID of the child assembling each sample
+	 (3) int num_started - number of samples started so far
+   Returns: 1 if the sample whose child finished failed; 0 if it
+   was assembled successfully
+   Waits for any one child started by run_batch to finish and reports
+   if its sample failed
+*/
+int wait_for_sample( SampleListP sl, pid_t* pids, int num_started ) {
+  int i, status;
+  pid_t pid;
+
+  pid = wait( &status );
+  for( i = 0; i < num_started; i++ ) {
+    if ( pids[i] == pid ) {
+      break;
+    }
+  }
+  if ( WIFEXITED(status) && (WEXITSTATUS(status) == 0) ) {
+    return 0;
+  }
+  if ( i < num_started ) {
+    fprintf( stderr, "Assembly of sample %s failed\n",
+	     sl->samples[i].name );
+  }
+  return 1;
+}
+
+/* run_batch
+   Args: (1) SampleListP sl - the samples to assemble
+         (2) int jobs - maximum number of samples to assemble at once
+	 (3) MiaOptsP mo - run options and shared, read-only state
+	 (4) MapAlignmentP maln - fresh maln with the prepared reference
+	 (5) AlignmentP fw_align - forward alignment set up for the reference
+	 (6) AlignmentP rc_align - revcom alignment set up for the reference
+	 (7) AlignmentP adapt_align - adapter alignment if mo->do_adapter_trimming
+   Returns: number of samples whose assembly failed
+   Each sample is assembled by assemble_sample in its own child process.
+   The children are forked after the reference, kmer arrays and
+   alignment workspaces are set up, so they all share that state with
+   this process and only get their own copy of the parts they write to.
+   Everything a sample allocates (fsdb, alignments in maln) goes away
+   with its child. At most jobs children run at once.
+*/
+int run_batch( SampleListP sl, int jobs, MiaOptsP mo, 
+	       MapAlignmentP maln, AlignmentP fw_align,
+	       AlignmentP rc_align, AlignmentP adapt_align ) {
+  int i, in_flight = 0, failed = 0;
+  char fastq_out_fn[MAX_FN_LEN+1];
+  pid_t pid;
+  pid_t* pids;
+  SampleP s;
+
+  pids = (pid_t*)save_malloc(sl->num_samples * sizeof(pid_t));
+
+  for( i = 0; i < sl->num_samples; i++ ) {
+    s = &sl->samples[i];
+    if ( in_flight == jobs ) {
+      failed += wait_for_sample( sl, pids, i );
+      in_flight--;
+    }
+
+    /* Don't let the children inherit anything still buffered */
+    fflush( stdout );
+    fflush( stderr );
+    pid = fork();
+    if ( pid < 0 ) {
+      fprintf( stderr, "Could not start assembly of sample %s\n", 
+	       s->name );
+      pids[i] = 0;
+      failed++;
+      continue;
+    }
+    if ( pid == 0 ) {
+      fprintf( stderr, "Starting assembly of sample %s from %s\n",
+	       s->name, s->frag_fn );
+      if ( s->fastq_fn[0] != '\0' ) {
+	strcpy( fastq_out_fn, s->fastq_fn );
+      }
+      else if ( snprintf( fastq_out_fn, sizeof(fastq_out_fn), "%s.fastq",
+			  s->maln_root ) >= (int)sizeof(fastq_out_fn) ) {
+	fprintf( stderr, "Fastq output file name is too long: %s.fastq\n",
+		 s->maln_root );
+	exit( 1 );
+      }
+      if ( mo->reassemble ?
+	   reassemble_sample( mo, maln, fw_align, rc_align, adapt_align,
+			      s->frag_fn, s->maln_root, fastq_out_fn ) :
+	   assemble_sample( mo, maln, fw_align, rc_align, adapt_align,
+			    s->frag_fn, s->maln_root, fastq_out_fn,
+			    NULL, NULL ) ) {
+	fprintf( stderr, "Finished assembly of sample %s\n", s->name );
+	exit( 0 );
+      }
+      exit( 1 );
+    }
+    pids[i] = pid;
+    in_flight++;
+  }
+
+  while( in_flight > 0 ) {
+    failed += wait_for_sample( sl, pids, sl->num_samples );
+    in_flight--;
+  }
+  free( pids );
+  return failed;
+}
+
+/* typical_read_len
+   Args: (1) const char* fn - fasta, fastq, or read cache file of
+             fragments
+   Returns: average length of the first AUTO_KMER_SAMPLE sequences
+   in fn; 0 if fn cannot be read or has none
+*/
+static int typical_read_len( const char* fn ) {
+  FILE* FF;
+  FragSeqP fs;
+  int seq_code, trimmed;
+  char adapter[INIT_ALN_SEQ_LEN + 1];
+  size_t num_seqs = 0, total_len = 0;
+
+  FF = fopen( fn, "r" );
+  if ( FF == NULL ) {
+    return 0;
+  }
+  fs = init_FragSeq();
+  if ( fs == NULL ) {
+    fclose( FF );
+    return 0;
+  }
+  seq_code = find_input_type( FF );
+  if ( (seq_code == 2) && !read_cache_header( FF, &trimmed, adapter ) ) {
+    seq_code = -1;
+  }
+  while( (seq_code >= 0) && (num_seqs < AUTO_KMER_SAMPLE) &&
+	 read_next_seq( FF, fs, seq_code ) ) {
+    total_len += strlen( fs->seq );
+    num_seqs++;
+  }
+  free_FragSeq( fs );
+  fclose( FF );
+  if ( num_seqs == 0 ) {
+    return 0;
+  }
+  return (int)(total_len / num_seqs);
+}
+
+/* write_read_cache
+   Args: (1) MiaOptsP mo - run options
+         (2) AlignmentP adapt_align - adapter alignment if
+	     mo->do_adapter_trimming
+	 (3) char* frag_fn - fasta or fastq file of fragments
+	 (4) char* cache_fn - read cache file to write
+   Returns: 1 if success; 0 if failure
+   Reads and trims every sequence in frag_fn, as assemble_sample
+   would, and writes them to cache_fn. The -I restriction is left
+   for the runs that read it.
+*/
+static int write_read_cache( MiaOptsP mo, AlignmentP adapt_align,
+			     char* frag_fn, char* cache_fn ) {
+  FILE* FF;
+  FILE* CF;
+  FragSeqP frag_seq;
+  int seq_code;
+  size_t num_seqs = 0;
+
+  FF = fileOpen( frag_fn, "r" );
+  seq_code = find_input_type( FF );
+  if ( seq_code == 2 ) {
+    fprintf( stderr, "%s is already a read cache\n", frag_fn );
+    fclose( FF );
+    return 0;
+  }
+  CF = fileOpen( cache_fn, "wb" );
+  frag_seq = init_FragSeq();
+  write_cache_header( CF, mo->do_adapter_trimming, mo->adapter );
+  while( read_next_seq( FF, frag_seq, seq_code ) ) {
+    if ( mo->do_adapter_trimming ) {
+      trim_frag( frag_seq, mo->adapter, adapt_align );
+    }
+    else {
+      frag_seq->trimmed = 0;
+    }
+    write_cache_seq( CF, frag_seq );
+    num_seqs++;
+  }
+  free_FragSeq( frag_seq );
+  fclose( FF );
+  if ( fclose( CF ) != 0 ) {
+    fprintf( stderr, "Problem writing read cache %s\n", cache_fn );
+    return 0;
+  }
+  fprintf( stderr, "Wrote %lu sequences from %s to read cache %s\n",
+	   (unsigned long)num_seqs, frag_fn, cache_fn );
+  return 1;
+}
+
+int main( int argc, char* argv[] ) {
+
+  char mat_fn[MAX_FN_LEN+1];
+  char fastq_out_fn[MAX_FN_LEN+1];
+  char maln_root[MAX_FN_LEN+1];
+  char ref_fn[MAX_FN_LEN+1];
+  char frag_fn[MAX_FN_LEN+1];
+  char cache_fn[MAX_FN_LEN+1]; // read cache to write, if write_cache
+  int write_cache = 0; // Boolean, TRUE means write frag_fn to cache_fn first
+  char manifest_fn[MAX_FN_LEN+1];
+  char contam_fn[MAX_FN_LEN+1];
+  char adapter_code[2]; // place to keep the argument for -a (which adapter to trim)
+  char* c_time; // place to keep asctime string
+
+  int ich;
+  int any_arg = 0;
+  int batch = 0; // Boolean, TRUE means assemble all samples listed in manifest_fn
+  int jobs = 1; // Number of samples to assemble at once in batch mode
+  int contam_check_set = 0; // Boolean, TRUE means check the final assembly
+                            // against the contaminant in contam_fn
+  int failed;
+  int distant_ref = 0; // Boolean, TRUE means the initial reference sequence is
+                       // known to be distantly related so keep trying to align all
+                       // sequences each round
+  int ry_seeds = 0; // Boolean; TRUE => kmers only tell purines from pyrimidines
+  char* seed_pattern = NULL; // which bases of each kmer to look at, if not all
+  int auto_k = 0; // Boolean; TRUE => choose the kmer length from the reference
+  int saturate_set = 0; // Boolean; TRUE => user gave the saturation (-w)
+  int read_len; // typical sequence length for -k auto
+  double extra_places; // extra kmer places per sequence expected with -k auto
+  unsigned int saturate; // kmer saturation chosen with -k auto
+  MiaOpts mo; // Options and state shared by all samples
+  MapAlignmentP maln; // Contains all fragments initially better
+                      // than FIRST_ROUND_SCORE_CUTOFF
+  AlignmentP fw_align, rc_align, adapt_align;
+  SampleListP samples = NULL; // Samples to assemble, if batch mode (-b)
+  
+  const PSSMP flatsubmat  = init_flatsubmat();
+
+  time_t curr_time;
+
+
+  char maln_root_def[] = "assembly.maln.iter";
+  extern int optind;
+  extern char* optarg;
+  char neand_adapt[] = "GTCAGACACGCAACAGGGGATAGGCAAGGCACACAGGGGATAGG";
+  char stand_adapt[] = "CTGAGACACGCAACAGGGGATAGGCAAGGCACACAGGGGATAGG";
+  char user_def_adapt[128];
+  int cc = 1; // consensus code for calling consensus base
+  int i;
+  static struct option long_opts[] = {
+    { "mem-limit", required_argument, NULL, 'L' },
+    { "sam", no_argument, NULL, 'x' },
+    { "ccheck", required_argument, NULL, 'K' },
+    { "ccheck-ancient", no_argument, NULL, 'E' },
+    { "ccheck-transversions", no_argument, NULL, 'W' },
+    { "ry-seeds", no_argument, NULL, 'Y' },
+    { "spaced-seeds", required_argument, NULL, 'G' },
+    { "dust", required_argument, NULL, 'd' },
+    { "saturate", required_argument, NULL, 'w' },
+    { "reassemble", no_argument, NULL, 'n' },
+    { "read-cache", required_argument, NULL, 'o' },
+    { "zip-threads", required_argument, NULL, 'Z' },
+    { 0, 0, 0, 0 }
+  };
+
+  /* Set the defaults until the user overrides them */
+  mo.Hard_cut = 0;
+  mo.circular = 0;
+  mo.make_fastq = 0;
+  mo.do_adapter_trimming = 0;
+  mo.iterate = 0;
+  mo.FINAL_ONLY = 0;
+  mo.ids_rest = 0;
+  mo.repeat_filt = 0;
+  mo.repeat_qual_filt = 0;
+  mo.just_outer_coords = 1;
+  mo.SCORE_CUT_SET = 0;
+  mo.hp_special = 0;
+  mo.kmer_filt_len = -1;
+  mo.collapse = 0;
+  mo.slope     = DEF_S;
+  mo.intercept = DEF_N;
+  mo.adapter = neand_adapt; // Default is Neandertal
+  mo.good_ids = NULL;
+  mo.ancsubmat   = init_flatsubmat();
+  mo.rcancsubmat = revcom_submat(mo.ancsubmat);
+  mo.fkpa = NULL;
+  mo.rkpa = NULL;
+  mo.dust_level = DEF_DUST_LEVEL;
+  mo.soft_mask = 0;
+  mo.reassemble = 0;
+  mo.kmer_saturate = KMER_SATURATE;
+  mo.show_alloc_stats = 0;
+  mo.mem_limit = 0;
+  mo.zip_threads = DEF_ZIP_THREADS;
+  mo.target_depth = 0;
+  mo.target_frac = 0.95;
+  mo.realign_margin = -1;
+  mo.sam_input = 0;
+  mo.contam_ref = NULL;
+  init_contam_opts( &mo.contam );
+  mo.contam.verbose = 1; // totals of differences and diagnostic positions
+  strcpy( maln_root, maln_root_def );
+
+
+  /* Process command line arguments */
+  while( (ich=getopt_long( argc, argv, 
+			   "s:r:f:m:a:p:H:I:S:N:k:q:b:j:L:t:P:R:K:G:d:w:o:Z:FTciuhDMUACvxEWYn",
+			   long_opts, NULL )) != -1 ) {
+    switch(ich) {
+    case 'c' :
+      mo.circular = 1;
+      break;
+    case 'q' :
+      mo.make_fastq = 1;
+      strcpy( fastq_out_fn, optarg );
+    case 'C' :
+      mo.collapse = 1;
+      break;
+    case 'i' :
+      mo.iterate = 1;
+      break;
+    case 'n' :
+      mo.reassemble = 1;
+      break;
+    case 'h' :
+      mo.hp_special = 1;
+      break;
+    case 'u' :
+      mo.repeat_filt = 1;
+      break;
+    case 'A' :
+      mo.just_outer_coords = 0;
+      break;
+    case 'U' :
+      mo.repeat_qual_filt = 1;
+      break;
+    case 'D' :
+      distant_ref = 1;
+      break;
+    case 'p' :
+      cc = atoi( optarg );
+      any_arg = 1;
+      break;
+    case 'I' :
+      mo.good_ids = parse_ids( optarg );
+      mo.ids_rest = 1;
+      break;
+    case 'H' :
+      mo.Hard_cut = atoi( optarg );
+      if ( mo.Hard_cut <= 0 ) {
+	fprintf( stderr, "Hard cutoff (-H) must be positive\n" );
+	help();
+	exit( 0 );
+      }
+      any_arg = 1;
+      break;
+    case 'M' :
+      mo.soft_mask = 1;
+      break;
+    case 's' :
+      strcpy( mat_fn, optarg );
+      free( mo.ancsubmat ); // trash the flat submat we initialized with
+      mo.ancsubmat   = read_pssm( mat_fn );
+      free( mo.rcancsubmat ); // trash the init rcsubmat, too
+      mo.rcancsubmat = revcom_submat( mo.ancsubmat );
+      any_arg = 1;
+      break;
+    case 'r' :
+      strcpy( ref_fn, optarg );
+      any_arg = 1;
+      break;
+    case 'k' :
+      if ( strcmp( optarg, "auto" ) == 0 ) {
+	auto_k = 1;
+      }
+      else {
+	mo.kmer_filt_len = atoi( optarg );
+      }
+      any_arg = 1;
+      break;
+    case 'w' :
+      if ( atoi( optarg ) <= 0 ) {
+	fprintf( stderr, "Kmer saturation (-w) must be positive\n" );
+	help();
+	exit( 0 );
+      }
+      mo.kmer_saturate = atoi( optarg );
+      saturate_set = 1;
+      break;
+    case 'Y' :
+      ry_seeds = 1;
+      break;
+    case 'G' :
+      seed_pattern = optarg;
+      break;
+    case 'd' :
+      mo.dust_level = atoi( optarg );
+      if ( mo.dust_level < 0 ) {
+	fprintf( stderr, "DUST level (-d) cannot be negative\n" );
+	help();
+	exit( 0 );
+      }
+      break;
+    case 'f' :
+      strcpy( frag_fn, optarg );
+      any_arg = 1;
+      break;
+    case 'o' :
+      strcpy( cache_fn, optarg );
+      write_cache = 1;
+      break;
+    case 'm' :
+      if ( strlen( optarg ) > (MAX_FN_LEN - MAX_ROOT_SUFFIX_LEN) ) {
+	fprintf( stderr, "The output root (-m) can be at most %d characters\n",
+		 MAX_FN_LEN - MAX_ROOT_SUFFIX_LEN );
+	exit( 2 );
+      }
+      strcpy( maln_root, optarg );
+      any_arg = 1;
+      break;
+    case 'b' :
+      strcpy( manifest_fn, optarg );
+      batch = 1;
+      any_arg = 1;
+      break;
+    case 'j' :
+      jobs = atoi( optarg );
+      if ( jobs <= 0 ) {
+	fprintf( stderr, "Number of samples to assemble at once (-j) must be positive\n" );
+	help();
+	exit( 0 );
+      }
+      break;
+    case 'T' :
+      mo.do_adapter_trimming = 1;
+      break;
+    case 'a' :
+      if ( strlen( optarg ) > 127 ) {
+	  fprintf( stderr, "That adapter is too big!\nMIA will use the standard adapter.\n" );
+	  mo.adapter = stand_adapt;
+      }
+      else {
+	strcpy( user_def_adapt, optarg );
+	  if ( strlen( user_def_adapt ) > 1 ) {
+	    mo.adapter = user_def_adapt;
+	  }
+	  else {
+	    if ( !( (user_def_adapt[0] == 'n') ||
+		    (user_def_adapt[0] == 'N') ) ) {
+	      mo.adapter = stand_adapt;
+	    }
+	    else {
+	      mo.adapter = neand_adapt;
+	    }
+	  }
+      }
+      break;
+    case 'S' :
+      mo.slope = atof( optarg );
+      mo.SCORE_CUT_SET = 1;
+      break;
+    case 'N' :
+      mo.intercept = atof( optarg );
+      mo.SCORE_CUT_SET = 1;
+      break;
+    case 'F' :
+      mo.FINAL_ONLY = 1;
+      break;
+    case 'v' :
+      mo.show_alloc_stats = 1;
+      break;
+    case 'L' :
+      mo.mem_limit = (size_t)atol( optarg ) * 1048576;
+      break;
+    case 'Z' :
+      mo.zip_threads = atoi( optarg );
+      if ( (mo.zip_threads < 0) || (mo.zip_threads > MAX_ZIP_THREADS) ) {
+	fprintf( stderr, "Compression threads (-Z) must be from 0 to %d\n",
+		 MAX_ZIP_THREADS );
+	help();
+	exit( 0 );
+      }
+      break;
+    case 't' :
+      mo.target_depth = atoi( optarg );
+      break;
+    case 'P' :
+      mo.target_frac = atof( optarg ) / 100.0;
+      break;
+    case 'R' :
+      mo.realign_margin = atoi( optarg );
+      break;
+    case 'x' :
+      mo.sam_input = 1;
+      break;
+    case 'K' :
+      strcpy( contam_fn, optarg );
+      contam_check_set = 1;
+      break;
+    case 'E' :
+      mo.contam.adna = 1;
+      break;
+    case 'W' :
+      mo.contam.transversions = 1;
+      break;
+    default :
+      help();
+      exit( 0 );
+    }
+  }
+
+  if ( !any_arg ) {
+    help();
+    exit( 0 );
+  }
+
+  if ( optind != argc ) {
+    fprintf( stderr, "There seems to be some extra cruff on the command line that mia does not understand.\n" );
+  }
+
+  if ( mo.reassemble && mo.sam_input ) {
+    fprintf( stderr, "SAM alignments (-x) are to the starting reference, so they cannot be reassembled (-n)\n" );
+    exit( 2 );
+  }
+
+  if ( mo.do_adapter_trimming && mo.sam_input ) {
+    fprintf( stderr, "SAM alignments (-x) are used as the mapper gave them, so their adapters cannot be trimmed (-T)\n" );
+    exit( 2 );
+  }
+
+  if ( write_cache && (batch || mo.sam_input) ) {
+    fprintf( stderr, "A read cache (-o) is written from one fasta or fastq -f file, not with -b or -x\n" );
+    exit( 2 );
+  }
+
+  /* Read the list of samples now so a bad manifest is found
+     before any work is done */
+  if ( batch ) {
+    samples = parse_manifest( manifest_fn );
+  }
+
+  /* Start the clock... */
+  curr_time = time(NULL);
+  //  c_time = (char*)save_malloc(64*sizeof(char));
+  //  c_time = asctime(localtime(&curr_time));
+
+  /* Announce that we're starting */
+  if ( batch ) {
+    fprintf( stderr, 
+	     "Starting batch assembly of %d samples from %s\nusing %s\nas reference at %s\n", 
+	     samples->num_samples, manifest_fn, ref_fn, 
+	     asctime(localtime(&curr_time)) );
+  }
+  else {
+    fprintf( stderr, 
+	     "Starting assembly of %s\nusing %s\nas reference at %s\n", 
+	     frag_fn, ref_fn, 
+	     asctime(localtime(&curr_time)) );
+  }
+
+
+  /* Set up the maln structure */
+  maln = (MapAlignmentP)init_map_alignment();
+  maln->cons_code = cc; 
+  if ( maln == NULL ) {
+    fprintf( stderr, "Not enough memories for this\n" );
+    exit( 1 );
+  }
+
+  /* Set the distant_ref flag */
+  maln->distant_ref = distant_ref;
+
+  /* Read in the reference sequence and make reverse complement, too*/
+  if ( read_fasta_ref( maln->ref, ref_fn ) != 1 ) {
+    fprintf( stderr, "Problem reading reference sequence file %s\n", ref_fn );
+    exit( 1 );
+  }
+
+  /* Read in the likely contaminant to check the final assembly
+     against */
+  if ( contam_check_set ) {
+    mo.contam_ref = (RefSeqP)save_malloc(sizeof(RefSeq));
+    if ( read_fasta_ref( mo.contam_ref, contam_fn ) != 1 ) {
+      fprintf( stderr, "Problem reading contaminant sequence file %s\n",
+	       contam_fn );
+      exit( 1 );
+    }
+  }
+
+  wrap_reference( &mo, maln );
+
+  /* Set up fkpa and rkpa for list of kmers in the reference (forward and
+     revcom strand) if user wants kmer filtering */
+  if ( auto_k && !mo.sam_input ) {
+    read_len = typical_read_len( batch ? samples->samples[0].frag_fn :
+				 frag_fn );
+    if ( read_len == 0 ) {
+      read_len = DEF_AUTO_KMER_READ_LEN;
+    }
+    if ( !tune_kmer_seed( &mo.kmer_seed, ry_seeds, seed_pattern,
+			  maln->ref, read_len, 
+			  &extra_places, &saturate ) ) {
+      exit( 2 );
+    }
+    mo.kmer_filt_len = mo.kmer_seed.len;
+    if ( !saturate_set ) {
+      mo.kmer_saturate = saturate;
+    }
+    fprintf( stderr, "Chose kmer length %d for %d nt sequences: %.2f extra places\n"
+	     "expected per sequence; aligning to the whole reference at %u places\n",
+	     mo.kmer_filt_len, read_len, extra_places, mo.kmer_saturate );
+  }
+  else if ( !init_kmer_seed( &mo.kmer_seed, mo.kmer_filt_len,
+			      ry_seeds, seed_pattern ) ) {
+    exit( 2 );
+  }
+  index_reference( &mo, maln, &fw_align, &rc_align );
+
+  /* Set up the alignment structure for adapter trimming, if user
+     wants that */
+  if ( mo.do_adapter_trimming ) {
+    adapt_align = (AlignmentP)init_alignment( INIT_ALN_SEQ_LEN,
+					      INIT_ALN_SEQ_LEN,
+					      0, mo.hp_special );
+    /* Setup the flatsubmat */
+    //flatsubmat = init_flatsubmat();
+    adapt_align->submat = flatsubmat;
+
+    adapt_align->seq2   = mo.adapter;
+    adapt_align->len2   = strlen( adapt_align->seq2 );
+    pop_s2c_in_a( adapt_align );
+    if ( mo.hp_special ) {
+      pop_hpl_and_hps( adapt_align->seq2, adapt_align->len2,
+		       adapt_align->hprl, adapt_align->hprs );
+    }
+    /* Set for a semi-global that pays a penalty for unaligning the
+       beginning of the adapter, but not for the end of the adapter.
+       This is because if the sequence read (align->seq1) ends, then
+       we won't see any more of the adapter. When we search for the
+       best alignment, we'll only look in the last column, requiring that
+       all of align->seq1 is accounted for */
+    adapt_align->sg5    = 1;
+    adapt_align->sg3    = 0;
+  }
+  else {
+    adapt_align = NULL;
+  }
+
+  /* Read and trim the sequences once into the read cache, and
+     assemble from that */
+  if ( write_cache ) {
+    if ( !write_read_cache( &mo, adapt_align, frag_fn, cache_fn ) ) {
+      exit( 1 );
+    }
+    strcpy( frag_fn, cache_fn );
+  }
+
+  /* Everything up to here depends only on the reference and the
+     options, so in batch mode it is done once and shared by all
+     samples */
+  if ( batch ) {
+    failed = run_batch( samples, jobs, &mo, maln, 
+			fw_align, rc_align, adapt_align );
+    curr_time = time(NULL);
+    fprintf( stderr, "Batch assembly of %d samples finished with %d failures at %s\n",
+	     samples->num_samples, failed, 
+	     asctime(localtime(&curr_time)) );
+    exit( failed > 0 );
+  }
+
+  if ( mo.reassemble ?
+       !reassemble_sample( &mo, maln, fw_align, rc_align, adapt_align,
+			   frag_fn, maln_root, fastq_out_fn ) :
+       !assemble_sample( &mo, maln, fw_align, rc_align, adapt_align,
+			 frag_fn, maln_root, fastq_out_fn, NULL, NULL ) ) {
+    exit( 1 );
+  }
+
   /* Announce we're finished */
   curr_time = time(NULL);
   //  c_time    = asctime(localtime(&curr_time));
@@ -21,6 +21,11 @@ extern "C" {
 #define MAX_LINE_LEN (1000000)
 #define PSSM_DEPTH (15)
 #define MAX_FN_LEN (1023)
+/* MAX_ROOT_SUFFIX_LEN is how much room the output root (-m, or the
+   batch manifest) must leave in MAX_FN_LEN for the names made from it,
+   such as <root>.fastq, <root>.ccheck, <root>.<iteration> and ma's
+   <root>.<iteration>.pile */
+#define MAX_ROOT_SUFFIX_LEN (16)
 #define SCORE_CUTOFF_BUFFER (80) // just a guess for now
 #define FIRST_ROUND_SCORE_CUTOFF (2000) // reference alignment original cutoff
 #define GOP (1000) // Gap open penalty
@@ -33,6 +38,9 @@ extern "C" {
 #define MAX_ITER (30) // maximum number of assembly iterations to do
 #define REALIGN_BUFFER (50) // amount of sequence padding to add in realignment
 #define QUAL_ASCII_OFFSET (33) // ascii code of lowest quality score, i.e. 0
+#define MAX_CONS_QUAL (93) // highest consensus quality written out; the
+                           // highest one a FASTQ character can hold
+#define SCORE_PER_BIT (100) // aggregate base scores are in 1/100 bits
 #define DEF_S 200.0
 #define DEF_N 0.0
 #define MIN_ALIGNABLE_LEN (15) // when distant reference is used, minimum amount of
@@ -50,6 +58,40 @@ extern "C" {
 */
 #define INIT_NUM_IDS (1048576)
 
+/* INIT_NUM_SAMPLES is the initial number of samples that
+   can be listed in a batch manifest file (-b). It grows
+   if necessary */
+#define INIT_NUM_SAMPLES (64)
+
+/* INIT_READ_SET_LEN is the initial number of bytes for keeping the
+   id, desc, seq, and qual of sequences in a ReadSet (-n). It grows
+   if necessary */
+#define INIT_READ_SET_LEN (1048576)
+
+/* READ_CACHE_MAGIC starts every read cache file (-o); READ_CACHE_VERSION
+   goes up whenever what comes after it changes */
+#define READ_CACHE_MAGIC "\211MRC\r\n\032\n"
+#define READ_CACHE_MAGIC_LEN (8)
+#define READ_CACHE_VERSION (1)
+
+/* PILEUP_SUFFIX is added to the name of a maln file to get the name
+   of the pileup sidecar ma keeps next to it; PILEUP_MAGIC starts it
+   and PILEUP_VERSION goes up whenever what comes after it changes */
+#define PILEUP_SUFFIX ".pile"
+#define PILEUP_MAGIC "\211MPU\r\n\032\n"
+#define PILEUP_MAGIC_LEN (8)
+#define PILEUP_VERSION (1)
+
+/* BGZF_BLOCK_LEN is the most -q output that goes into one BGZF block
+   (as samtools does it); compressed, a block is at most
+   BGZF_MAX_BLOCK_LEN bytes. BGZF_QUEUE_BLOCKS blocks per compression
+   thread are filled before waiting for the oldest to be written */
+#define BGZF_BLOCK_LEN (0xff00)
+#define BGZF_MAX_BLOCK_LEN (0x10000)
+#define BGZF_QUEUE_BLOCKS (4)
+#define DEF_ZIP_THREADS (4)
+#define MAX_ZIP_THREADS (64)
+
 /* MAX_INS_LEN is the size of the char array accomodating
    sequence inserts in an aligned fragment relative to the
    reference sequence. That is, it's the longest single
@@ -68,14 +110,31 @@ extern "C" {
 #define INIT_ALN_SEQ_LEN (256)
 #define INIT_NUM_ALN_SEQS (16000)
 
+/* INIT_WIN_ALN_SEQS is the initial number of aligned fragments
+   kept at once when ma streams through a maln file. It grows
+   with the coverage */
+#define INIT_WIN_ALN_SEQS (256)
+
+/* FS_PAYLOAD_LEN is the size of the block that holds the id, desc,
+   seq, and qual strings of a FragSeq, one after the other */
+#define FS_PAYLOAD_LEN ((MAX_ID_LEN + 1) + (MAX_DESC_LEN + 1) + \
+			(2 * (INIT_ALN_SEQ_LEN + 1)))
+
 
 #define MAX_FN_LEN (1023)
 
 
 #define MAX_KMER_POS (128)
 #define MAX_KMER_LEN (14)
+#define MAX_KMER_SPAN (64)
 #define KMER_SATURATE (128)
+#define AUTO_KMER_MIN (8) // shortest kmers -k auto tries
+#define AUTO_KMER_WINDOWS (1.0) // most extra places per sequence -k auto wants
+#define AUTO_KMER_SAMPLE (1000) // sequences -k auto looks at for their length
+#define DEF_AUTO_KMER_READ_LEN (50) // length -k auto assumes if it can't look
 #define ALIGN_MASK_BUFFER (10)
+#define DUST_WINDOW (64) // longest stretch of sequence DUST scores at once
+#define DEF_DUST_LEVEL (20)
 
 
 
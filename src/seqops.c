@@ -0,0 +1,341 @@
+#include <ctype.h>
+#include "seqops.h"
+#include "map_align.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define SEQOPS_X86 1
+#include <immintrin.h>
+#endif
+
+/* What the CPU we're running on can do; found the first time
+   it's needed */
+#define SEQOPS_UNKNOWN (-1)
+#define SEQOPS_SCALAR 0
+#define SEQOPS_SSE2 1
+#define SEQOPS_SSSE3 2
+#define SEQOPS_AVX2 3
+static int simd_level = SEQOPS_UNKNOWN;
+
+static int get_simd_level( void ) {
+  if ( simd_level == SEQOPS_UNKNOWN ) {
+    simd_level = SEQOPS_SCALAR;
+#ifdef SEQOPS_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+      simd_level = SEQOPS_AVX2;
+    }
+    else if ( __builtin_cpu_supports( "ssse3" ) ) {
+      simd_level = SEQOPS_SSSE3;
+    }
+    else if ( __builtin_cpu_supports( "sse2" ) ) {
+      simd_level = SEQOPS_SSE2;
+    }
+#endif
+  }
+  return simd_level;
+}
+
+/* Complement of each character revcom_char knows; 0 for the rest */
+static const char rc_tab[256] = {
+  ['A'] = 'T', ['C'] = 'G', ['G'] = 'C', ['T'] = 'A',
+  ['a'] = 't', ['c'] = 'g', ['g'] = 'c', ['t'] = 'a',
+  ['N'] = 'N', ['n'] = 'n', ['X'] = 'X', ['x'] = 'x',
+  ['-'] = '-'
+};
+
+static inline char rc_base( const char b ) {
+  char c = rc_tab[(unsigned char)b];
+  /* Let revcom_char complain about it */
+  return c ? c : revcom_char( b );
+}
+
+static inline short int enc_base( const char b ) {
+  switch( b ) {
+  case 'A' :
+    return 0;
+  case 'C' :
+    return 1;
+  case 'G' :
+    return 2;
+  case 'T' :
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+/* Works from both ends toward the middle, so dst may be src */
+static void revcom_scalar( char* dst, const char* src, size_t len ) {
+  size_t i, j;
+  char tmp;
+  if ( len == 0 ) {
+    return;
+  }
+  for ( i = 0, j = len - 1; i < j; i++, j-- ) {
+    tmp = src[i];
+    dst[i] = rc_base( src[j] );
+    dst[j] = rc_base( tmp );
+  }
+  if ( i == j ) {
+    dst[i] = rc_base( src[i] );
+  }
+}
+
+#ifdef SEQOPS_X86
+/* The bases revcom_char knows all have different low nibbles:
+   A=1, C=3, T=4, G=7, X=8, -=D, N=E. Looking up the low nibble of
+   each character tells what it would be (in upper case) if it is
+   one of them, and what its complement is. Entries for the other
+   nibbles are chosen so they never match. */
+static const char nib_base[16] = {
+  (char)0xff, 'A', 0, 'C', 'T', 0, 0, 'G', 'X', 0, 0, 0, 0, '-', 'N', 0
+};
+static const char nib_comp[16] = {
+  0, 'T', 0, 'G', 'A', 0, 0, 'C', 'X', 0, 0, 0, 0, '-', 'N', 0
+};
+/* Same for base2inx; only the upper case ACGT count */
+static const char nib_acgt[16] = {
+  (char)0xff, 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 0, 0
+};
+static const char nib_code[16] = {
+  4, 0, 4, 1, 3, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4
+};
+
+__attribute__((target("sse2")))
+static void upcase_sse2( char* seq, size_t len ) {
+  size_t i;
+  __m128i x, lc;
+  const __m128i a = _mm_set1_epi8( 'a' - 1 );
+  const __m128i z = _mm_set1_epi8( 'z' + 1 );
+  const __m128i diff = _mm_set1_epi8( 'a' - 'A' );
+  for ( i = 0; i + 16 <= len; i += 16 ) {
+    x  = _mm_loadu_si128( (const __m128i*)(seq + i) );
+    lc = _mm_and_si128( _mm_cmpgt_epi8( x, a ), _mm_cmplt_epi8( x, z ) );
+    x  = _mm_sub_epi8( x, _mm_and_si128( lc, diff ) );
+    _mm_storeu_si128( (__m128i*)(seq + i), x );
+  }
+  for ( ; i < len; i++ ) {
+    seq[i] = toupper( seq[i] );
+  }
+}
+
+__attribute__((target("avx2")))
+static void upcase_avx2( char* seq, size_t len ) {
+  size_t i;
+  __m256i x, lc;
+  const __m256i a = _mm256_set1_epi8( 'a' - 1 );
+  const __m256i z = _mm256_set1_epi8( 'z' + 1 );
+  const __m256i diff = _mm256_set1_epi8( 'a' - 'A' );
+  for ( i = 0; i + 32 <= len; i += 32 ) {
+    x  = _mm256_loadu_si256( (const __m256i*)(seq + i) );
+    lc = _mm256_and_si256( _mm256_cmpgt_epi8( x, a ),
+			   _mm256_cmpgt_epi8( z, x ) );
+    x  = _mm256_sub_epi8( x, _mm256_and_si256( lc, diff ) );
+    _mm256_storeu_si256( (__m256i*)(seq + i), x );
+  }
+  upcase_sse2( seq + i, len - i );
+}
+
+/* Reverse complement of 16 characters. If any of them is not a base
+   revcom_char knows, does them one at a time so it can complain */
+__attribute__((target("ssse3")))
+static inline __m128i rc_vec_ssse3( __m128i x ) {
+  const __m128i lo_mask = _mm_set1_epi8( 0x0f );
+  const __m128i lc_bit  = _mm_set1_epi8( 0x20 );
+  const __m128i rev = _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8,
+				     7, 6, 5, 4, 3, 2, 1, 0 );
+  __m128i lo, base, ok;
+  char in[16], out[16];
+  lo   = _mm_and_si128( x, lo_mask );
+  base = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)nib_base ), lo );
+  ok   = _mm_or_si128( _mm_cmpeq_epi8( x, base ),
+		       _mm_cmpeq_epi8( x, _mm_or_si128( base, lc_bit ) ) );
+  if ( _mm_movemask_epi8( ok ) != 0xffff ) {
+    _mm_storeu_si128( (__m128i*)in, x );
+    revcom_scalar( out, in, 16 );
+    return _mm_loadu_si128( (const __m128i*)out );
+  }
+  x = _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)nib_comp ),
+				      lo ),
+		    _mm_and_si128( x, lc_bit ) );
+  return _mm_shuffle_epi8( x, rev );
+}
+
+__attribute__((target("ssse3")))
+static void revcom_ssse3( char* dst, const char* src, size_t len ) {
+  size_t lo = 0, hi = len;
+  __m128i f, b;
+  /* Swap a block from each end until they meet; both are read before
+     either is written, so dst may be src */
+  while ( hi - lo >= 32 ) {
+    f = _mm_loadu_si128( (const __m128i*)(src + lo) );
+    b = _mm_loadu_si128( (const __m128i*)(src + hi - 16) );
+    _mm_storeu_si128( (__m128i*)(dst + lo), rc_vec_ssse3( b ) );
+    _mm_storeu_si128( (__m128i*)(dst + hi - 16), rc_vec_ssse3( f ) );
+    lo += 16;
+    hi -= 16;
+  }
+  revcom_scalar( dst + lo, src + lo, hi - lo );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rc_vec_avx2( __m256i x ) {
+  const __m256i lo_mask = _mm256_set1_epi8( 0x0f );
+  const __m256i lc_bit  = _mm256_set1_epi8( 0x20 );
+  const __m256i rev = _mm256_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8,
+					7, 6, 5, 4, 3, 2, 1, 0,
+					15, 14, 13, 12, 11, 10, 9, 8,
+					7, 6, 5, 4, 3, 2, 1, 0 );
+  __m256i lo, base, ok;
+  char in[32], out[32];
+  lo   = _mm256_and_si256( x, lo_mask );
+  base = _mm256_shuffle_epi8( _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)nib_base ) ), lo );
+  ok   = _mm256_or_si256( _mm256_cmpeq_epi8( x, base ),
+			  _mm256_cmpeq_epi8( x, _mm256_or_si256( base, lc_bit ) ) );
+  if ( _mm256_movemask_epi8( ok ) != -1 ) {
+    _mm256_storeu_si256( (__m256i*)in, x );
+    revcom_scalar( out, in, 32 );
+    return _mm256_loadu_si256( (const __m256i*)out );
+  }
+  x = _mm256_or_si256( _mm256_shuffle_epi8( _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)nib_comp ) ), lo ),
+		       _mm256_and_si256( x, lc_bit ) );
+  /* Reverse each half, then swap the halves */
+  x = _mm256_shuffle_epi8( x, rev );
+  return _mm256_permute2x128_si256( x, x, 0x01 );
+}
+
+__attribute__((target("avx2")))
+static void revcom_avx2( char* dst, const char* src, size_t len ) {
+  size_t lo = 0, hi = len;
+  __m256i f, b;
+  while ( hi - lo >= 64 ) {
+    f = _mm256_loadu_si256( (const __m256i*)(src + lo) );
+    b = _mm256_loadu_si256( (const __m256i*)(src + hi - 32) );
+    _mm256_storeu_si256( (__m256i*)(dst + lo), rc_vec_avx2( b ) );
+    _mm256_storeu_si256( (__m256i*)(dst + hi - 32), rc_vec_avx2( f ) );
+    lo += 32;
+    hi -= 32;
+  }
+  revcom_ssse3( dst + lo, src + lo, hi - lo );
+}
+
+__attribute__((target("ssse3")))
+static void encode_ssse3( short int* codes, const char* seq, size_t len ) {
+  size_t i;
+  const __m128i lo_mask = _mm_set1_epi8( 0x0f );
+  const __m128i four = _mm_set1_epi8( 4 );
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i acgt = _mm_loadu_si128( (const __m128i*)nib_acgt );
+  const __m128i code = _mm_loadu_si128( (const __m128i*)nib_code );
+  __m128i x, lo, ok, c;
+  for ( i = 0; i + 16 <= len; i += 16 ) {
+    x  = _mm_loadu_si128( (const __m128i*)(seq + i) );
+    lo = _mm_and_si128( x, lo_mask );
+    ok = _mm_cmpeq_epi8( x, _mm_shuffle_epi8( acgt, lo ) );
+    c  = _mm_or_si128( _mm_and_si128( ok, _mm_shuffle_epi8( code, lo ) ),
+		       _mm_andnot_si128( ok, four ) );
+    _mm_storeu_si128( (__m128i*)(codes + i), _mm_unpacklo_epi8( c, zero ) );
+    _mm_storeu_si128( (__m128i*)(codes + i + 8), _mm_unpackhi_epi8( c, zero ) );
+  }
+  for ( ; i < len; i++ ) {
+    codes[i] = enc_base( seq[i] );
+  }
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2( short int* codes, const char* seq, size_t len ) {
+  size_t i;
+  const __m256i lo_mask = _mm256_set1_epi8( 0x0f );
+  const __m256i acgt = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)nib_acgt ) );
+  const __m256i code = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)nib_code ) );
+  const __m256i four = _mm256_set1_epi8( 4 );
+  __m256i x, lo, ok, c;
+  for ( i = 0; i + 32 <= len; i += 32 ) {
+    x  = _mm256_loadu_si256( (const __m256i*)(seq + i) );
+    lo = _mm256_and_si256( x, lo_mask );
+    ok = _mm256_cmpeq_epi8( x, _mm256_shuffle_epi8( acgt, lo ) );
+    c  = _mm256_blendv_epi8( four, _mm256_shuffle_epi8( code, lo ), ok );
+    _mm256_storeu_si256( (__m256i*)(codes + i),
+			 _mm256_cvtepu8_epi16( _mm256_castsi256_si128( c ) ) );
+    _mm256_storeu_si256( (__m256i*)(codes + i + 16),
+			 _mm256_cvtepu8_epi16( _mm256_extracti128_si256( c, 1 ) ) );
+  }
+  encode_ssse3( codes + i, seq + i, len - i );
+}
+#endif
+
+/* upcase_seq
+   Args: (1) char* seq - sequence to upper case in place
+         (2) size_t len - number of characters of seq to do
+   Returns: void
+   Same as calling toupper (in the C locale) on each character
+*/
+void upcase_seq( char* seq, size_t len ) {
+  size_t i;
+#ifdef SEQOPS_X86
+  switch( get_simd_level() ) {
+  case SEQOPS_AVX2 :
+    upcase_avx2( seq, len );
+    return;
+  case SEQOPS_SSSE3 :
+  case SEQOPS_SSE2 :
+    upcase_sse2( seq, len );
+    return;
+  }
+#endif
+  for ( i = 0; i < len; i++ ) {
+    seq[i] = toupper( seq[i] );
+  }
+}
+
+/* revcom_seq
+   Args: (1) char* dst - where to put the reverse complement; room for
+             len characters. May be the same as src, but must not
+	     otherwise overlap it
+         (2) const char* src - sequence to reverse complement
+	 (3) size_t len - number of characters of src to do
+   Returns: void
+   Puts the reverse complement of the first len characters of src
+   into dst, keeping the case of each base, as revcom_char does. dst
+   is not '\0' terminated. Characters revcom_char does not know about
+   are reported and become 'N', as they do there.
+*/
+void revcom_seq( char* dst, const char* src, size_t len ) {
+#ifdef SEQOPS_X86
+  switch( get_simd_level() ) {
+  case SEQOPS_AVX2 :
+    revcom_avx2( dst, src, len );
+    return;
+  case SEQOPS_SSSE3 :
+    revcom_ssse3( dst, src, len );
+    return;
+  }
+#endif
+  revcom_scalar( dst, src, len );
+}
+
+/* encode_seq
+   Args: (1) short int* codes - room for len codes
+         (2) const char* seq - sequence to encode
+	 (3) size_t len - number of characters of seq to do
+   Returns: void
+   Puts the submat index of each base of seq into codes, as base2inx
+   does: A, C, G, T are 0, 1, 2, 3; everything else (lower case
+   included) is 4.
+*/
+void encode_seq( short int* codes, const char* seq, size_t len ) {
+  size_t i;
+#ifdef SEQOPS_X86
+  switch( get_simd_level() ) {
+  case SEQOPS_AVX2 :
+    encode_avx2( codes, seq, len );
+    return;
+  case SEQOPS_SSSE3 :
+    encode_ssse3( codes, seq, len );
+    return;
+  }
+#endif
+  for ( i = 0; i < len; i++ ) {
+    codes[i] = enc_base( seq[i] );
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef INCLUDED_seqops_H
+#define INCLUDED_seqops_H
+
+#include <stddef.h>
+
+/* Bulk operations on sequence strings: case folding, reverse
+   complementing, and encoding for submat lookup. On x86 built with
+   gcc or clang, these use SSE2/SSSE3 or AVX2, whichever the CPU that
+   runs them has; anywhere else they do it a base at a time. The
+   results are the same either way.
+*/
+
+/* upcase_seq
+   Args: (1) char* seq - sequence to upper case in place
+         (2) size_t len - number of characters of seq to do
+   Returns: void
+   Same as calling toupper (in the C locale) on each character
+*/
+void upcase_seq( char* seq, size_t len ) ;
+
+/* revcom_seq
+   Args: (1) char* dst - where to put the reverse complement; room for
+             len characters. May be the same as src, but must not
+	     otherwise overlap it
+         (2) const char* src - sequence to reverse complement
+	 (3) size_t len - number of characters of src to do
+   Returns: void
+   Puts the reverse complement of the first len characters of src
+   into dst, keeping the case of each base, as revcom_char does. dst
+   is not '\0' terminated. Characters revcom_char does not know about
+   are reported and become 'N', as they do there.
+*/
+void revcom_seq( char* dst, const char* src, size_t len ) ;
+
+/* encode_seq
+   Args: (1) short int* codes - room for len codes
+         (2) const char* seq - sequence to encode
+	 (3) size_t len - number of characters of seq to do
+   Returns: void
+   Puts the submat index of each base of seq into codes, as base2inx
+   does: A, C, G, T are 0, 1, 2, 3; everything else (lower case
+   included) is 4.
+*/
+void encode_seq( short int* codes, const char* seq, size_t len ) ;
+
+#endif
@@ -9,11 +9,17 @@
 #define	_TYPES_H
 
 #include "params.h"
+#include "alloc.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <ctype.h>
+#include <pthread.h>
 
 
-#define save_malloc malloc
+/* All long-lived buffers go through the allocation layer in alloc.c
+   for cache-line alignment and huge pages; they are still released
+   with free() */
+#define save_malloc aligned_malloc
 
 #ifdef	__cplusplus
 extern "C" {
@@ -48,8 +54,6 @@ typedef struct pw_aln_frag {
   int score;
   char segment; // f=front, a=all, b=back, n=not applicable
   int num_inputs; // for collapsed sequences, the number of input seqs
-  int offset; // for segment='b', number of bases not shown that
-              // were in the front fragment
 } PWAlnFrag;
 typedef struct pw_aln_frag* PWAlnFragP;
 
@@ -62,17 +66,24 @@ typedef struct alnseq {
   char id[MAX_ID_LEN + 1]; // the ID of the sequence
   char desc[MAX_DESC_LEN + 1]; // the description of the sequence
   char seq[ (2*INIT_ALN_SEQ_LEN) + 1];  // the sequence string
-  char smp[ (2*INIT_ALN_SEQ_LEN) + 1];  // code for substitution matrix depth
   char* ins[ (2*INIT_ALN_SEQ_LEN) + 1]; // array of pointers to char
   // that will be filled with sequence
   int start;  // where this sequence starts relative to the reference (0-indexed)
-  int end;    // where this sequence ends relative to the reference (0-indexed)
+  int end;    // where this sequence ends relative to the reference (0-indexed);
+              // past the end of a circular reference if it wraps around
+              // to the beginning (see aln_seq_col)
   int revcom; // boolean to denote that this sequence has been
               // reverse complemented
   int trimmed; // boolean to denote that this sequence has been trimmed
   int score;  // the alignment score for this guy
   int num_inputs; // the number of input seqs if this is a collapsed seq
   char segment; // f=front, a=all, b=back, n=not applicable
+  /* Everything needed to find the substitution matrix depth code
+     at any column; see set_depth_offsets and depth_code */
+  int smp_front_off; // distance from the front of the read at column 0
+  int smp_back_off;  // distance from the back of the read after the last column
+  int smp_front_cols; // columns before this one are near the front of the read
+  int smp_back_col;   // columns from this one on are near the back of the read
 } AlnSeq;
 // pointer to struct aln_seq
 typedef struct alnseq* AlnSeqP;
@@ -108,10 +119,12 @@ typedef struct qsumseq* QSSP;
 
 /* Define FragSeq and FragSeqP to hold a simple sequence */
 typedef struct fragseq {
-  char id[MAX_ID_LEN + 1];
-  char desc[MAX_DESC_LEN + 1];
-  char seq[INIT_ALN_SEQ_LEN+1];
-  char qual[INIT_ALN_SEQ_LEN+1];
+  char* id;   // id, desc, seq, and qual all point into one block
+  char* desc; // of FS_PAYLOAD_LEN chars, the payload. If the payload
+  char* seq;  // has been spilled to the run file of a memory limited
+  char* qual; // FSDB, they are all NULL until it is loaded again
+  long spill_pos; // offset of the spilled payload in the FSDB run file;
+                  // -1 if it has never been spilled
   QSSP qss; // pointer to a QSumSeq struct that may be needed for collapsing
   int qual_sum;
   int trim_point; // 0-indexed position of last base before adapter
@@ -121,17 +134,36 @@ typedef struct fragseq {
   // sequence has been learned by virtue of a positive scoring alignment
   int rc; // Boolean, TRUE means this is the reverse complement
   int as; // 0-indexed start point of alignment on current ref
-  int ae; // 0-indexed end point of alignment on current ref
+  int ae; // 0-indexed end point of alignment on current ref; past the
+  //         end of a circular ref if the alignment wraps around
   int score; // current score of alignment on reference
-  AlnSeqP front_asp; // pointer to where I can find the front AlnSeq
-  AlnSeqP back_asp;  // pointer to where I can find the back AlnSeqP
-  //                   (if applicable, otherwise NULL)
+  AlnSeqP asp; // pointer to where I can find my AlnSeq
   int unique_best;   // boolean; TRUE means unique & best score
   //                    for repeat filtering
+  int realign; // Boolean, TRUE means realign in the next iteration;
+  //              FALSE means carry as, ae, and score forward as they are
   int num_inputs; // number of sequences collapsed into this one
 } FragSeq;
 typedef struct fragseq* FragSeqP;
 
+/* Define ScoreFit as a struct score_fit to hold what is needed to
+   fit the length/score line through the FragSeqs of an FSDB that are
+   unique_best and score at least FIRST_ROUND_SCORE_CUTOFF. It is kept
+   up to date as their scores and unique_best flags change, with
+   Welford's running means and sums of squares */
+typedef struct score_fit {
+  size_t n;           // Number of FragSeqs in the fit
+  double mean_len;    // Mean seq_len
+  double mean_score;  // Mean score
+  double m2_len;      // Sum of squared deviations of seq_len from mean_len
+  double c_len_score; // Sum of products of deviations of seq_len and score
+  size_t len_count[INIT_ALN_SEQ_LEN+1]; // Number in the fit of each length
+  int max_score[INIT_ALN_SEQ_LEN+1];    // Best score in the fit of each length
+  size_t max_count[INIT_ALN_SEQ_LEN+1]; // Number with that best score
+  int max_stale; // Boolean, TRUE means the only FragSeq with some max_score
+                 // has left the fit, so max_score must be found again
+} ScoreFit;
+
 /* Define fragseqdb and FSDB to hold a database of FragSeqs */
 typedef struct fragseqdb {
   FragSeqP* fss; // Pointer to array of FragSeqs
@@ -139,9 +171,53 @@ typedef struct fragseqdb {
                        // determining whether a sequence is unique
   size_t    size; // Current size of array pointed to by fss
   size_t    num_fss; // Current number of FragSeqs in fss
+  size_t    mem_limit; // Bytes allowed for the FragSeqs and their payloads;
+                       // 0 means no limit. Payloads past this are spilled
+  size_t    num_resident; // Number of FragSeqs in fss with payload in memory
+  FILE*     run; // Run file with the spilled payloads; NULL if none yet
+  FILE*     next_run; // Run file being written during a pass over fss;
+                      // it replaces run when the pass is done
+  char      run_root[MAX_FN_LEN + 1]; // root name for making run files
+  ScoreFit  fit; // length/score line statistics, for find_fsdb_score_cut
 } FragSeqDB;
 typedef struct fragseqdb* FSDB;
 
+/* Define FastqJob as a struct fastq_job for a write_fastq that may
+   be going on in its own thread; see start_write_fastq */
+typedef struct fastq_job {
+  char fn[MAX_FN_LEN + 1]; // fastq output file
+  FSDB fsdb;       // sequences to write
+  FILE* f;         // fn, if it is written as it is
+  struct bgzf_writer* bw; // fn, if it is BGZF compressed
+  int threaded;    // Boolean, TRUE means thread is writing it
+  int ok;          // Boolean, TRUE means it was all written
+  pthread_t thread;
+} FastqJob;
+typedef struct fastq_job* FastqJobP;
+
+/* Define ReadSet as a struct read_set to keep sequences in memory, as
+   they were read and trimmed, for going through them again. The id,
+   desc, seq, and qual of each are '\0' terminated, one after the
+   other, in buf; the rest of what the reader and trimmer set is in
+   reads */
+typedef struct read_info {
+  size_t off; // where the id is in buf
+  int seq_len;
+  int qual_sum;
+  int trimmed;
+  int trim_point;
+} ReadInfo;
+
+typedef struct read_set {
+  char*     buf;       // packed id, desc, seq, and qual strings
+  size_t    buf_size;  // bytes malloced for buf
+  size_t    buf_len;   // bytes of buf used
+  ReadInfo* reads;     // one for each sequence, in the order added
+  size_t    size;      // room in reads
+  size_t    num_reads; // number of sequences in the set
+} ReadSet;
+typedef struct read_set* ReadSetP;
+
 /* Define PSSM as an array of position specific substitution
    matrices to be used at different points in an alignment.
    The first PSSM_DEPTH-1 matrices are for the beginning of the
@@ -184,8 +260,8 @@ typedef struct map_alignment {
   RefSeqP ref;       // The reference sequence to which everything is mapped
   PSSMP fpsm;        // The PSSMP set of + strand matrices for aligning and consensus
   PSSMP rpsm;        // The PSSMP set of - strand matrices for aligning and consensus
-  int num_aln_seqs;  // Number of sequences in this alignment
-  int size;          // Length of AlnSeqArray
+  size_t num_aln_seqs; // Number of sequences in this alignment
+  size_t size;         // Length of AlnSeqArray
   int cons_code;     // Code for scheme for determining the consensus base
                      //    1 => only majority rule consensus
                      //    2 => (unique) plurality rule consensus
@@ -211,6 +287,31 @@ typedef struct base_counts {
 } BaseCounts;
 typedef struct base_counts* BaseCountsP;
 
+/* The pileup of a whole MapAlignment: what the consensus formats of
+   ma are made from, whatever the consensus code. One column per
+   column of the padded alignment, inserts included, and one of each
+   of the fragment start and end counts per reference position. ma
+   keeps it in a sidecar file next to the maln (see write_pileup) */
+typedef struct pileup {
+  char ref_id[MAX_ID_LEN+1];
+  int ref_len;
+  int num_cols;          // number of columns in the padded alignment
+  int size;              // room for this many columns
+  size_t num_frags;      // not counting the back parts of the ones
+                         // that wrap around
+  size_t total_frag_len; // sum of the lengths of all fragments
+  char* aln_ref;         // reference base of each column; '-' for
+                         // inserts
+  int* ref_poss;         // reference position of each column
+  BaseCountsP bcs;       // base counts and aggregate scores of each
+                         // column; frac_agree is not kept
+  int* starts_f;         // for each reference position, number of
+  int* starts_r;         // fragments on the forward and reverse
+  int* ends_f;           // strands that start or end there (see
+  int* ends_r;           // add_frag_ends)
+} Pileup;
+typedef struct pileup* PileupP;
+
 typedef struct alignment {
   const char* seq1; // reference sequence
   const char* seq2; // fragment sequence
@@ -232,6 +333,9 @@ typedef struct alignment {
   int* hpcs;  // array of starts of hps for each seq1 position
   int* hprl;  // array of lenghs of hps for each seq2 position
   int* hprs;  // array of starts of hps for each seq2 position
+  int c_off;  // seq1 starts this far into the sequence s1c, hpcl, and
+              // hpcs were populated from; 0 unless they are shared by
+              // windows on one reference
   DPMP m;     // pointer to struct dpm, dynamic prog. matrix
   int* best_gap_row; // array of current best row to gap to,
   //                     useful during dynaminc programming
@@ -250,13 +354,15 @@ typedef struct alignment {
   int aec; // alignment ending column
   int aer; // alignment ending row
   int best_score; // score at m->[aer][aec], i.e., the best score
+  int ungapped; // Boolean, TRUE => abc, abr, aec, aer, and best_score were
+  //               found by ungapped_align and m has NOT been filled in
 } Alignment;
 typedef struct alignment* AlignmentP;
 
 typedef struct ids_list {
-  int num_ids;
+  size_t num_ids;
   int sorted;
-  int size;
+  size_t size;
   char** ids;
 } IDsList;
 typedef struct ids_list* IDsListP;
@@ -273,11 +379,148 @@ typedef struct kmers* KmersP;
 typedef struct kmer_pos_list {
   size_t num_pos; // current number of known positions for this kmer
   int    sorted;  // boolean; TRUE => positions are in order
+  int    low_complexity; // boolean; TRUE => some of its positions are in
+                         // low-complexity (DUST masked) sequence
   unsigned int positions[MAX_KMER_POS]; // list of known positions
                                         // for this kmer
 } KmerPosList;
 typedef struct kmer_pos_list* KPL;
 
+/* Define KmerSeed as a struct kmer_seed to say which bases of each
+   kmer the kmer filter looks at, and how closely */
+typedef struct kmer_seed {
+  int len; // number of bases a kmer spans; < 0 means no kmer filtering
+  int ry;  // Boolean, TRUE => bases are only told apart as purine (A, G)
+           // or pyrimidine (C, T), so C->T and G->A damage doesn't matter
+  int weight; // number of bases of each kmer that are looked at
+  char care[MAX_KMER_SPAN]; // TRUE where the base is looked at
+} KmerSeed;
+typedef struct kmer_seed* KmerSeedP;
+
+/* Define KmerFiltStats as a struct kmer_filt_stats to count what
+   the kmer filter did with the sequences of a sample */
+typedef struct kmer_filt_stats {
+  size_t passed; // sequences that share kmers with the reference
+  size_t failed; // sequences that do not
+  size_t lc_only; // passed, but only on low-complexity kmers
+  size_t lc_left_out; // passed with their low-complexity kmers left out
+  size_t unsaturated; // of those, how many would have been aligned to
+                      // the whole reference if they had been counted
+} KmerFiltStats;
+typedef struct kmer_filt_stats* KmerFiltStatsP;
+
+/* Define Sample as a struct sample to hold one line of a
+   batch manifest: the sample name, the file with its fragments
+   to align, and the root file name for its maln output. The
+   fastq output file name is optional; fastq_fn is the empty
+   string if the manifest did not give one */
+typedef struct sample {
+  char name[MAX_ID_LEN + 1];
+  char frag_fn[MAX_FN_LEN + 1];
+  char maln_root[MAX_FN_LEN + 1];
+  char fastq_fn[MAX_FN_LEN + 1];
+} Sample;
+typedef struct sample* SampleP;
+
+typedef struct sample_list {
+  int num_samples;
+  int size;
+  SampleP samples;
+} SampleList;
+typedef struct sample_list* SampleListP;
+
+/* Define ContamOpts as a struct contam_opts to hold the settings
+   of the contamination check, as done by ccheck or by mia -K */
+typedef struct contam_opts {
+  int adna; // Boolean, TRUE means treat the DNA as ancient (likely deaminated)
+  int transversions; // Boolean, TRUE means only transversions are diagnostic
+  int span_from; // Only assembly positions from span_from up to (not
+  int span_to;   // including) span_to are looked at
+  int maxd; // Most differences allowed between the assembly and contaminant
+  int verbose; // Verbosity level of the report
+} ContamOpts;
+typedef struct contam_opts* ContamOptsP;
+
+/* Define MiaOpts as a struct mia_opts to hold the run options
+   and the read-only state that is prepared once per run (the
+   substitution matrices, the reference kmer arrays, the adapter
+   and the list of IDs to use). Everything in here is shared by
+   all samples assembled against the same reference; nothing in
+   here is changed once sequences are being aligned */
+typedef struct mia_opts {
+  int Hard_cut; // If 0 => use dynamic score cutoff, if > 0 use this instead
+  int circular; // Boolean, TRUE if reference sequence is circular
+  int make_fastq; // Boolean, TRUE if we should also output fastq database of seqs in assembly
+  int do_adapter_trimming; // Boolean, TRUE if we should try to trim
+                           // adapter from input sequences
+  int iterate; //Boolean, TRUE means interate the assembly until convergence
+               // on an assembled sequence
+  int FINAL_ONLY; //Boolean, TRUE means only write out the final assembly maln file
+                  //         FALSE (default) means write out each one
+  int ids_rest; // Boolean, TRUE means restrict analysis to IDs in good_ids
+  int repeat_filt; //Boolean, TRUE means remove sequences that are repeats, 
+                   // keeping best-scoring representative
+  int repeat_qual_filt; //Boolean, TRUE means remove sequences that are repeats,
+                        // keeping best quality score sum representative
+  int just_outer_coords; // Boolean, TRUE means just use strand, start, and end to
+                         // determine if sequences are redundant
+  int SCORE_CUT_SET; //Boolean, TRUE means user has set a length/score cutoff line
+  int hp_special; // Boolean, TRUE means user wants hp gap special discount
+  int kmer_filt_len; // length of kmer filtering, if user wants it; otherwise
+                     // special value of -1 indicates this is unset
+  int collapse; // Boolean; TRUE => collapse input sequences in FSDB to improve
+                //                  sequence quality
+                //          FALSE => (default) keep all sequences
+  double slope; // slope and intercept of the length/score cutoff line
+  double intercept;
+  char* adapter; // adapter sequence to trim if do_adapter_trimming
+  IDsListP good_ids; // IDs to use if ids_rest
+  PSSMP ancsubmat; // forward substitution matrices
+  PSSMP rcancsubmat; // revcom substitution matrices
+  KPL* fkpa; // forward kmer array if user requested kmer filtering
+  KPL* rkpa; // reverse kmer array if user requested kmer filtering
+  KmerSeed kmer_seed; // which bases of each kmer are looked at, and how
+  unsigned int kmer_saturate; // kmer places at which a sequence is aligned
+                             // to the whole reference
+  int dust_level; // kmers from reference sequence with a DUST score above
+                  // this are only used if a sequence has no others;
+                  // 0 means no DUST masking
+  int soft_mask; // Boolean, TRUE means do not use kmers that are all lower-case
+  int reassemble; // Boolean, TRUE means assemble again from scratch to each
+                  // new consensus until it stops changing
+  int show_alloc_stats; // Boolean, TRUE means report allocation statistics
+                        // when the assembly is finished
+  size_t mem_limit; // Bytes of memory for sequences held in the FSDB;
+                    // 0 means no limit
+  int zip_threads; // Threads compressing -q output that ends in .gz
+  int target_depth; // If > 0, stop reading sequences once target_frac of the
+                    // reference is covered to this depth by good alignments
+  double target_frac;
+  int realign_margin; // If >= 0, only realign unique best sequences that
+                      // scored within this much of the score cutoff; the
+                      // rest are carried forward until a final full pass
+  int sam_input; // Boolean, TRUE means the fragment files are SAM alignments
+                 // to the reference; they are taken as the first round
+                 // instead of aligning
+  RefSeqP contam_ref; // If not NULL, the likely contaminant to check the
+                      // final assembly against, writing <maln root>.ccheck
+  ContamOpts contam; // settings of that check
+} MiaOpts;
+typedef struct mia_opts* MiaOptsP;
+
+/* Define DepthHist as a struct depth_hist for keeping track, as
+   sequences are aligned, of how deeply each position of the
+   reference is covered and how many positions have reached the
+   target depth */
+typedef struct depth_hist {
+  int* depth; // coverage at each reference position, capped at target
+  int ref_len;
+  int target; // depth we want
+  int num_at_target; // number of positions that have reached target
+  int num_needed; // number of positions that must reach target
+} DepthHist;
+typedef struct depth_hist* DepthHistP;
+
 
 
 